@@ -0,0 +1,1138 @@
+/* Allocator benchmarks.
+ *
+ * Every workload is run against every backend in a process of its own, so
+ * memory one run keeps doesn't show up in the next. Workloads drive
+ * bes_malloc, bes_realloc and bes_free with the backend set as the
+ * allocator of every thread:
+ *
+ *   larson    threads replace random blocks of a set of blocks, which is
+ *             handed to another thread every round so most blocks are
+ *             freed on a thread other than the one that allocated them
+ *   queue     producers allocate messages which consumers hold on to for
+ *             a while and then free
+ *   growth    buffers grown a few bytes at a time with bes_realloc
+ *   trace     a trace of allocations replayed on every thread
+ *
+ * Traces are text with one operation per line: "a ID SIZE" allocates the
+ * block ID, "r ID SIZE" resizes it and "f ID" frees it. IDs are reused
+ * once freed and should be small, they index a table. Without a trace one
+ * is generated from a distribution of mostly small sizes with a tail of
+ * large ones.
+ *
+ * Every run reports operations per second, percentiles of the latency of
+ * every sixteenth operation, the resident memory at the end of the run and
+ * at its peak, both above what the process used before the run, the bytes
+ * still allocated at the end of the run and the fragmentation, which is
+ * the resident memory over the bytes allocated.
+ *
+ * Backends which aren't thread safe are run behind a lock.
+ */
+#define _POSIX_C_SOURCE 200809L
+
+#include <bes/foundation/memory.h>
+#include <bes/foundation/heap.h>
+#include <bes/foundation/slab.h>
+#include <bes/foundation/tlsf.h>
+#include <bes/foundation/buddy.h>
+#include <bes/foundation/mmap.h>
+#include <bes/foundation/atomic.h>
+#include <bes/foundation/string.h>
+
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/* Every sampled operation is timed. */
+#define BENCH_SAMPLE_MASK 15
+
+#define BENCH_THREADS 4
+#define BENCH_OPERATIONS 200000
+#define BENCH_MAX_THREADS 64
+
+#define BENCH_LARSON_BLOCKS 1024
+#define BENCH_LARSON_ROUNDS 10
+#define BENCH_QUEUE_SIZE 1024
+#define BENCH_QUEUE_HELD 256
+#define BENCH_GROWTH_SIZE (64 * 1024)
+#define BENCH_GROWTH_HELD 16
+#define BENCH_TRACE_BLOCKS 4096
+
+#define BENCH_REGION_SIZE ((bes_size)512 * 1024 * 1024)
+
+/* Backends */
+static void* BES_API
+bench_libc_allocate(bes_allocator *allocator, bes_size size)
+{
+	(void)allocator;
+	return malloc(size);
+}
+
+static void* BES_API
+bench_libc_reallocate(bes_allocator *allocator, void *data, bes_size size)
+{
+	(void)allocator;
+	return realloc(data, size);
+}
+
+static void BES_API
+bench_libc_deallocate(bes_allocator *allocator, void *data)
+{
+	(void)allocator;
+	free(data);
+}
+
+static bes_size BES_API
+bench_libc_usable_size(bes_allocator *allocator, const void *data)
+{
+	(void)allocator;
+	return malloc_usable_size((void *)data);
+}
+
+static bes_allocator bench_libc;
+
+static bes_allocator*
+bench_libc_init(void)
+{
+	bench_libc.allocate = &bench_libc_allocate;
+	bench_libc.reallocate = &bench_libc_reallocate;
+	bench_libc.deallocate = &bench_libc_deallocate;
+	bench_libc.aux = 0;
+	bench_libc.flags = 0;
+	bench_libc.deallocate_sized = 0;
+	bench_libc.alignment = BES_ALIGNMENT;
+	bench_libc.usable_size = &bench_libc_usable_size;
+	bench_libc.allocate_aligned = 0;
+	bench_libc.reallocate_in_place = 0;
+	bench_libc.allocate_batch = 0;
+	bench_libc.deallocate_batch = 0;
+	bench_libc.allocate_zeroed = 0;
+	bench_libc.trim = 0;
+	return &bench_libc;
+}
+
+/* Allocators which aren't thread safe are wrapped by one which takes a
+ * lock around every call. */
+typedef struct bench_locked bench_locked;
+
+struct bench_locked
+{
+	bes_allocator allocator;
+	bes_allocator *backing;
+	pthread_mutex_t mutex;
+};
+
+static void* BES_API
+bench_locked_allocate(bes_allocator *allocator, bes_size size)
+{
+	bench_locked *locked = allocator->aux;
+	pthread_mutex_lock(&locked->mutex);
+	void *data = locked->backing->allocate(locked->backing, size);
+	pthread_mutex_unlock(&locked->mutex);
+	return data;
+}
+
+static void* BES_API
+bench_locked_reallocate(bes_allocator *allocator, void *data, bes_size size)
+{
+	bench_locked *locked = allocator->aux;
+	pthread_mutex_lock(&locked->mutex);
+	data = locked->backing->reallocate(locked->backing, data, size);
+	pthread_mutex_unlock(&locked->mutex);
+	return data;
+}
+
+static void BES_API
+bench_locked_deallocate(bes_allocator *allocator, void *data)
+{
+	bench_locked *locked = allocator->aux;
+	pthread_mutex_lock(&locked->mutex);
+	locked->backing->deallocate(locked->backing, data);
+	pthread_mutex_unlock(&locked->mutex);
+}
+
+static void BES_API
+bench_locked_deallocate_sized(bes_allocator *allocator, void *data, bes_size size)
+{
+	bench_locked *locked = allocator->aux;
+	pthread_mutex_lock(&locked->mutex);
+	locked->backing->deallocate_sized(locked->backing, data, size);
+	pthread_mutex_unlock(&locked->mutex);
+}
+
+static bes_size BES_API
+bench_locked_usable_size(bes_allocator *allocator, const void *data)
+{
+	bench_locked *locked = allocator->aux;
+	pthread_mutex_lock(&locked->mutex);
+	const bes_size size = locked->backing->usable_size(locked->backing, data);
+	pthread_mutex_unlock(&locked->mutex);
+	return size;
+}
+
+static void* BES_API
+bench_locked_allocate_aligned(bes_allocator *allocator, bes_size size, bes_size alignment)
+{
+	bench_locked *locked = allocator->aux;
+	pthread_mutex_lock(&locked->mutex);
+	void *data = locked->backing->allocate_aligned(locked->backing, size, alignment);
+	pthread_mutex_unlock(&locked->mutex);
+	return data;
+}
+
+static bes_bool BES_API
+bench_locked_reallocate_in_place(bes_allocator *allocator, void *data, bes_size size)
+{
+	bench_locked *locked = allocator->aux;
+	pthread_mutex_lock(&locked->mutex);
+	const bes_bool result = locked->backing->reallocate_in_place(locked->backing, data, size);
+	pthread_mutex_unlock(&locked->mutex);
+	return result;
+}
+
+static bes_allocator*
+bench_locked_init(bench_locked *locked, bes_allocator *backing)
+{
+	/* Optional hooks are only forwarded when the backing allocator has
+	 * them. */
+	locked->allocator.allocate = &bench_locked_allocate;
+	locked->allocator.reallocate = &bench_locked_reallocate;
+	locked->allocator.deallocate = &bench_locked_deallocate;
+	locked->allocator.aux = locked;
+	locked->allocator.flags = 0;
+	locked->allocator.deallocate_sized = backing->deallocate_sized ? &bench_locked_deallocate_sized : 0;
+	locked->allocator.alignment = backing->alignment;
+	locked->allocator.usable_size = backing->usable_size ? &bench_locked_usable_size : 0;
+	locked->allocator.allocate_aligned = backing->allocate_aligned ? &bench_locked_allocate_aligned : 0;
+	locked->allocator.reallocate_in_place = backing->reallocate_in_place ? &bench_locked_reallocate_in_place : 0;
+	locked->allocator.allocate_batch = 0;
+	locked->allocator.deallocate_batch = 0;
+	locked->allocator.allocate_zeroed = 0;
+	locked->allocator.trim = 0;
+	locked->backing = backing;
+	pthread_mutex_init(&locked->mutex, 0);
+	return &locked->allocator;
+}
+
+/* Only one backend is used by a process. */
+static struct
+{
+	bes_heap_allocator heap;
+	bes_slab_allocator slab;
+	bes_tlsf_allocator tlsf;
+	bes_buddy_allocator buddy;
+	bes_mmap_allocator mmap;
+	bench_locked locked;
+} g_bench_backends;
+
+static bes_allocator*
+bench_heap_init(void)
+{
+	bes_heap_allocator_init(&g_bench_backends.heap, bench_libc_init());
+	return &g_bench_backends.heap.allocator;
+}
+
+static void
+bench_heap_detach(void)
+{
+	bes_heap_allocator_detach(&g_bench_backends.heap);
+}
+
+static bes_allocator*
+bench_slab_init(void)
+{
+	bes_slab_allocator_init(&g_bench_backends.slab, bench_libc_init());
+	return bench_locked_init(&g_bench_backends.locked, &g_bench_backends.slab.allocator);
+}
+
+static bes_allocator*
+bench_tlsf_init(void)
+{
+	/* Pages of the region are only resident once touched. */
+	void *const region = malloc(BENCH_REGION_SIZE);
+	bes_tlsf_allocator_init(&g_bench_backends.tlsf);
+	if (!region || !bes_tlsf_allocator_add_pool(&g_bench_backends.tlsf, region, BENCH_REGION_SIZE))
+	{
+		return 0;
+	}
+	return bench_locked_init(&g_bench_backends.locked, &g_bench_backends.tlsf.allocator);
+}
+
+static bes_allocator*
+bench_buddy_init(void)
+{
+	void *const region = malloc(BENCH_REGION_SIZE);
+	if (!region || !bes_buddy_allocator_init(&g_bench_backends.buddy, region, BENCH_REGION_SIZE))
+	{
+		return 0;
+	}
+	return bench_locked_init(&g_bench_backends.locked, &g_bench_backends.buddy.allocator);
+}
+
+static bes_allocator*
+bench_mmap_init(void)
+{
+	bes_mmap_allocator_init(&g_bench_backends.mmap, bench_libc_init(), 0, 0);
+	return &g_bench_backends.mmap.allocator;
+}
+
+typedef struct bench_backend bench_backend;
+
+struct bench_backend
+{
+	const char *name;
+	bes_allocator *(*init)(void);
+	void (*detach)(void);
+};
+
+static const bench_backend bench_backends[] =
+{
+	{ "libc", &bench_libc_init, 0 },
+	{ "heap", &bench_heap_init, &bench_heap_detach },
+	{ "slab", &bench_slab_init, 0 },
+	{ "tlsf", &bench_tlsf_init, 0 },
+	{ "buddy", &bench_buddy_init, 0 },
+	{ "mmap", &bench_mmap_init, 0 }
+};
+
+/* Runs */
+typedef struct bench_op bench_op;
+typedef struct bench_queue bench_queue;
+typedef struct bench_thread bench_thread;
+typedef struct bench_run bench_run;
+typedef struct bench_result bench_result;
+typedef struct bench_workload bench_workload;
+
+struct bench_op
+{
+	char type;
+	bes_u32 id;
+	bes_size size;
+};
+
+/* Single producer single consumer ring, the counters sit on lines of their
+ * own so the two sides don't slow each other down. */
+struct bench_queue
+{
+	void *messages[BENCH_QUEUE_SIZE];
+	BES_ATTRIBUTE_ALIGN(BES_CACHE_LINE_SIZE) volatile bes_u64 head;
+	BES_ATTRIBUTE_ALIGN(BES_CACHE_LINE_SIZE) volatile bes_u64 tail;
+};
+
+struct bench_thread
+{
+	bench_run *run;
+	bes_size index;
+	pthread_t thread;
+	bes_u64 rng;
+	bes_u64 operations;
+	bes_u64 *samples;
+	bes_size sampled;
+	bes_size capacity;
+	bes_size live;
+	bes_bool failed;
+};
+
+struct bench_run
+{
+	const bench_workload *workload;
+	const bench_backend *backend;
+	bes_allocator *allocator;
+	bes_size threads;
+	bes_u64 operations;
+	const bench_op *trace;
+	bes_size trace_length;
+	bes_u32 trace_blocks;
+	pthread_barrier_t start;
+	pthread_barrier_t round;
+	pthread_barrier_t measure;
+	pthread_barrier_t resume;
+	void **larson_blocks[BENCH_MAX_THREADS];
+	bes_size *larson_sizes[BENCH_MAX_THREADS];
+	bench_queue *queues;
+	bench_thread workers[BENCH_MAX_THREADS];
+};
+
+struct bench_result
+{
+	bes_bool ok;
+	bes_bool failed;
+	bes_u64 operations;
+	bes_f64 seconds;
+	bes_u64 p50;
+	bes_u64 p99;
+	bes_u64 p999;
+	bes_u64 max;
+	bes_size rss;
+	bes_size peak;
+	bes_size live;
+};
+
+struct bench_workload
+{
+	const char *name;
+	void (*work)(bench_thread *thread);
+	bes_bool paired;
+};
+
+static bes_u64
+bench_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (bes_u64)now.tv_sec * 1000000000 + (bes_u64)now.tv_nsec;
+}
+
+static bes_u64
+bench_random(bes_u64 *const state)
+{
+	bes_u64 x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+/* Mostly small objects with a tail of large ones. */
+static bes_size
+bench_size(bes_u64 *const rng)
+{
+	const bes_u64 r = bench_random(rng);
+	const bes_u64 bucket = r % 100;
+	const bes_u64 offset = r >> 8;
+	if (bucket < 60)
+	{
+		return 16 + offset % 48;
+	}
+	else if (bucket < 85)
+	{
+		return 64 + offset % 192;
+	}
+	else if (bucket < 95)
+	{
+		return 256 + offset % 3840;
+	}
+	else if (bucket < 99)
+	{
+		return 4096 + offset % 28672;
+	}
+	return 32768 + offset % 229376;
+}
+
+/* Every sampled operation is timed, the rest only counted. */
+static inline bes_u64
+bench_begin(const bench_thread *const thread)
+{
+	return (thread->operations & BENCH_SAMPLE_MASK) == 0 ? bench_now() : 0;
+}
+
+static inline void
+bench_end(bench_thread *const thread, bes_u64 start)
+{
+	if (start && thread->sampled < thread->capacity)
+	{
+		thread->samples[thread->sampled++] = bench_now() - start;
+	}
+	thread->operations++;
+}
+
+/* Writes to every page of a block like a caller would, so resident memory
+ * reflects what's allocated. */
+static inline void
+bench_touch(bes_byte *const data, bes_size size)
+{
+	for (bes_size i = 0; i < size; i += 4096)
+	{
+		data[i] = 1;
+	}
+	data[size - 1] = 1;
+}
+
+static void*
+bench_malloc(bench_thread *const thread, bes_size size)
+{
+	const bes_u64 start = bench_begin(thread);
+	bes_byte *const data = bes_malloc(size);
+	bench_end(thread, start);
+	if (!data)
+	{
+		thread->failed = BES_TRUE;
+		return 0;
+	}
+	bench_touch(data, size);
+	return data;
+}
+
+static void*
+bench_realloc(bench_thread *const thread, void *const data, bes_size size)
+{
+	const bes_u64 start = bench_begin(thread);
+	bes_byte *const resized = bes_realloc(data, size);
+	bench_end(thread, start);
+	if (!resized)
+	{
+		thread->failed = BES_TRUE;
+		return data;
+	}
+	bench_touch(resized, size);
+	return resized;
+}
+
+static void
+bench_free(bench_thread *const thread, void *const data)
+{
+	const bes_u64 start = bench_begin(thread);
+	bes_free(data);
+	bench_end(thread, start);
+}
+
+/* Waits for the run to be measured before freeing what's left. */
+static void
+bench_measure(bench_thread *const thread)
+{
+	pthread_barrier_wait(&thread->run->measure);
+	pthread_barrier_wait(&thread->run->resume);
+}
+
+static void
+bench_larson(bench_thread *const thread)
+{
+	bench_run *const run = thread->run;
+	void **blocks = run->larson_blocks[thread->index];
+	bes_size *sizes = run->larson_sizes[thread->index];
+	for (bes_size i = 0; i < BENCH_LARSON_BLOCKS; i++)
+	{
+		sizes[i] = 16 + bench_random(&thread->rng) % 1009;
+		blocks[i] = bes_malloc(sizes[i]);
+	}
+
+	pthread_barrier_wait(&run->start);
+
+	const bes_u64 replacements = run->operations / BENCH_LARSON_ROUNDS / 2;
+	for (bes_size round = 0; round < BENCH_LARSON_ROUNDS; round++)
+	{
+		const bes_size set = (thread->index + round) % run->threads;
+		blocks = run->larson_blocks[set];
+		sizes = run->larson_sizes[set];
+		for (bes_u64 i = 0; i < replacements; i++)
+		{
+			const bes_size block = bench_random(&thread->rng) % BENCH_LARSON_BLOCKS;
+			bench_free(thread, blocks[block]);
+			sizes[block] = 16 + bench_random(&thread->rng) % 1009;
+			blocks[block] = bench_malloc(thread, sizes[block]);
+		}
+		pthread_barrier_wait(&run->round);
+	}
+
+	for (bes_size i = 0; i < BENCH_LARSON_BLOCKS; i++)
+	{
+		thread->live += blocks[i] ? sizes[i] : 0;
+	}
+
+	bench_measure(thread);
+
+	for (bes_size i = 0; i < BENCH_LARSON_BLOCKS; i++)
+	{
+		bes_free(blocks[i]);
+	}
+}
+
+static void
+bench_produce(bench_thread *const thread, bench_queue *const queue)
+{
+	const bes_u64 messages = thread->run->operations;
+	for (bes_u64 i = 0; i < messages; i++)
+	{
+		const bes_size size = bench_size(&thread->rng);
+		bes_size *const message = bench_malloc(thread, size);
+		if (message)
+		{
+			message[0] = size;
+		}
+
+		while (i - bes_atomic_load_u64(&queue->head, BES_ATOMIC_ACQUIRE) == BENCH_QUEUE_SIZE)
+		{
+			sched_yield();
+		}
+		queue->messages[i % BENCH_QUEUE_SIZE] = message;
+		bes_atomic_store_u64(&queue->tail, i + 1, BES_ATOMIC_RELEASE);
+	}
+
+	bench_measure(thread);
+}
+
+static void
+bench_consume(bench_thread *const thread, bench_queue *const queue)
+{
+	bes_size *held[BENCH_QUEUE_HELD] = { 0 };
+	const bes_u64 messages = thread->run->operations;
+	for (bes_u64 i = 0; i < messages; i++)
+	{
+		while (bes_atomic_load_u64(&queue->tail, BES_ATOMIC_ACQUIRE) == i)
+		{
+			sched_yield();
+		}
+		bes_size *const message = queue->messages[i % BENCH_QUEUE_SIZE];
+		bes_atomic_store_u64(&queue->head, i + 1, BES_ATOMIC_RELEASE);
+
+		bes_size **const slot = &held[i % BENCH_QUEUE_HELD];
+		if (*slot)
+		{
+			bench_free(thread, *slot);
+		}
+		*slot = message;
+	}
+
+	for (bes_size i = 0; i < BENCH_QUEUE_HELD; i++)
+	{
+		thread->live += held[i] ? *held[i] : 0;
+	}
+
+	bench_measure(thread);
+
+	for (bes_size i = 0; i < BENCH_QUEUE_HELD; i++)
+	{
+		bes_free(held[i]);
+	}
+}
+
+static void
+bench_queue_work(bench_thread *const thread)
+{
+	bench_run *const run = thread->run;
+	bench_queue *const queue = &run->queues[thread->index / 2];
+	pthread_barrier_wait(&run->start);
+	if (thread->index % 2 == 0)
+	{
+		bench_produce(thread, queue);
+	}
+	else
+	{
+		bench_consume(thread, queue);
+	}
+}
+
+static void
+bench_growth(bench_thread *const thread)
+{
+	bench_run *const run = thread->run;
+	void *held[BENCH_GROWTH_HELD] = { 0 };
+	bes_size sizes[BENCH_GROWTH_HELD] = { 0 };
+
+	pthread_barrier_wait(&run->start);
+
+	for (bes_size buffer = 0; thread->operations < run->operations; buffer++)
+	{
+		const bes_size target = BENCH_GROWTH_SIZE / 4 + bench_random(&thread->rng) % (BENCH_GROWTH_SIZE * 3 / 4);
+		void *data = 0;
+		bes_size size = 0;
+		while (size < target)
+		{
+			const bes_size grown = size + 1 + bench_random(&thread->rng) % 64;
+			void *const resized = bench_realloc(thread, data, grown);
+			if (resized == data && !data)
+			{
+				break;
+			}
+			data = resized;
+			size = grown;
+		}
+
+		const bes_size slot = buffer % BENCH_GROWTH_HELD;
+		if (held[slot])
+		{
+			bench_free(thread, held[slot]);
+		}
+		held[slot] = data;
+		sizes[slot] = size;
+	}
+
+	for (bes_size i = 0; i < BENCH_GROWTH_HELD; i++)
+	{
+		thread->live += held[i] ? sizes[i] : 0;
+	}
+
+	bench_measure(thread);
+
+	for (bes_size i = 0; i < BENCH_GROWTH_HELD; i++)
+	{
+		bes_free(held[i]);
+	}
+}
+
+static void
+bench_trace(bench_thread *const thread)
+{
+	bench_run *const run = thread->run;
+	void **const blocks = calloc(run->trace_blocks, sizeof *blocks);
+	bes_size *const sizes = calloc(run->trace_blocks, sizeof *sizes);
+	if (!blocks || !sizes)
+	{
+		thread->failed = BES_TRUE;
+	}
+
+	pthread_barrier_wait(&run->start);
+
+	while (!thread->failed && thread->operations < run->operations)
+	{
+		for (bes_size i = 0; i < run->trace_length; i++)
+		{
+			const bench_op *const op = &run->trace[i];
+			switch (op->type)
+			{
+			case 'a':
+				bes_free(blocks[op->id]);
+				blocks[op->id] = bench_malloc(thread, op->size);
+				sizes[op->id] = op->size;
+				break;
+			case 'r':
+				blocks[op->id] = bench_realloc(thread, blocks[op->id], op->size);
+				sizes[op->id] = op->size;
+				break;
+			case 'f':
+				bench_free(thread, blocks[op->id]);
+				blocks[op->id] = 0;
+				break;
+			}
+		}
+	}
+
+	for (bes_u32 i = 0; blocks && i < run->trace_blocks; i++)
+	{
+		thread->live += blocks[i] ? sizes[i] : 0;
+	}
+
+	bench_measure(thread);
+
+	for (bes_u32 i = 0; blocks && i < run->trace_blocks; i++)
+	{
+		bes_free(blocks[i]);
+	}
+	free(blocks);
+	free(sizes);
+}
+
+static const bench_workload bench_workloads[] =
+{
+	{ "larson", &bench_larson, BES_FALSE },
+	{ "queue", &bench_queue_work, BES_TRUE },
+	{ "growth", &bench_growth, BES_FALSE },
+	{ "trace", &bench_trace, BES_FALSE }
+};
+
+static void*
+bench_thread_main(void *data)
+{
+	bench_thread *const thread = data;
+	bench_run *const run = thread->run;
+	bes_allocator_set(run->allocator);
+	run->workload->work(thread);
+	if (run->backend->detach)
+	{
+		run->backend->detach();
+	}
+	return 0;
+}
+
+static bes_size
+bench_resident(void)
+{
+	FILE *const file = fopen("/proc/self/statm", "r");
+	unsigned long pages = 0;
+	if (file)
+	{
+		if (fscanf(file, "%*s %lu", &pages) != 1)
+		{
+			pages = 0;
+		}
+		fclose(file);
+	}
+	return (bes_size)pages * (bes_size)sysconf(_SC_PAGESIZE);
+}
+
+static bes_size
+bench_peak_resident(void)
+{
+	struct rusage usage;
+	return getrusage(RUSAGE_SELF, &usage) == 0 ? (bes_size)usage.ru_maxrss * 1024 : 0;
+}
+
+static int
+bench_compare(const void *lhs, const void *rhs)
+{
+	const bes_u64 a = *(const bes_u64 *)lhs;
+	const bes_u64 b = *(const bes_u64 *)rhs;
+	return a < b ? -1 : a > b;
+}
+
+static bes_u64
+bench_percentile(const bes_u64 *const samples, bes_size count, bes_size per_mille)
+{
+	return count ? samples[(count - 1) * per_mille / 1000] : 0;
+}
+
+/* Runs in a process of its own. */
+static void
+bench_execute(bench_run *const run, bench_result *const result)
+{
+	const bes_size threads = run->threads;
+	const bes_size capacity = (bes_size)(2 * run->operations >> 4) + 2;
+	for (bes_size i = 0; i < threads; i++)
+	{
+		bench_thread *const thread = &run->workers[i];
+		thread->run = run;
+		thread->index = i;
+		thread->rng = 0x9E3779B97F4A7C15ull * (i + 1);
+		thread->capacity = capacity;
+		thread->samples = malloc(capacity * sizeof *thread->samples);
+		if (!thread->samples)
+		{
+			return;
+		}
+		/* Samples are resident before the baseline is taken. */
+		bes_memset(thread->samples, 0, capacity * sizeof *thread->samples);
+
+		run->larson_blocks[i] = calloc(BENCH_LARSON_BLOCKS, sizeof(void *));
+		run->larson_sizes[i] = calloc(BENCH_LARSON_BLOCKS, sizeof(bes_size));
+		if (!run->larson_blocks[i] || !run->larson_sizes[i])
+		{
+			return;
+		}
+	}
+
+	run->queues = calloc(threads / 2 + 1, sizeof *run->queues);
+	if (!run->queues)
+	{
+		return;
+	}
+
+	const bes_size baseline = bench_resident();
+	run->allocator = run->backend->init();
+	if (!run->allocator)
+	{
+		return;
+	}
+
+	pthread_barrier_init(&run->start, 0, (unsigned)threads + 1);
+	pthread_barrier_init(&run->round, 0, (unsigned)threads);
+	pthread_barrier_init(&run->measure, 0, (unsigned)threads + 1);
+	pthread_barrier_init(&run->resume, 0, (unsigned)threads + 1);
+
+	for (bes_size i = 0; i < threads; i++)
+	{
+		if (pthread_create(&run->workers[i].thread, 0, &bench_thread_main, &run->workers[i]) != 0)
+		{
+			return;
+		}
+	}
+
+	pthread_barrier_wait(&run->start);
+	const bes_u64 start = bench_now();
+	pthread_barrier_wait(&run->measure);
+	const bes_u64 end = bench_now();
+
+	const bes_size resident = bench_resident();
+	/* The peak is only brought up to date now and then. */
+	const bes_size peak = bench_peak_resident() > resident ? bench_peak_resident() : resident;
+	pthread_barrier_wait(&run->resume);
+
+	bes_size sampled = 0;
+	for (bes_size i = 0; i < threads; i++)
+	{
+		pthread_join(run->workers[i].thread, 0);
+		sampled += run->workers[i].sampled;
+	}
+
+	bes_u64 *const samples = malloc((sampled + 1) * sizeof *samples);
+	if (!samples)
+	{
+		return;
+	}
+
+	sampled = 0;
+	for (bes_size i = 0; i < threads; i++)
+	{
+		const bench_thread *const thread = &run->workers[i];
+		bes_memcpy(samples + sampled, thread->samples, thread->sampled * sizeof *samples);
+		sampled += thread->sampled;
+		result->operations += thread->operations;
+		result->live += thread->live;
+		result->failed = result->failed || thread->failed;
+	}
+	qsort(samples, sampled, sizeof *samples, &bench_compare);
+
+	result->ok = BES_TRUE;
+	result->seconds = (bes_f64)(end - start) / 1e9;
+	result->p50 = bench_percentile(samples, sampled, 500);
+	result->p99 = bench_percentile(samples, sampled, 990);
+	result->p999 = bench_percentile(samples, sampled, 999);
+	result->max = bench_percentile(samples, sampled, 1000);
+	result->rss = resident > baseline ? resident - baseline : 0;
+	result->peak = peak > baseline ? peak - baseline : 0;
+}
+
+static void
+bench_report(const bench_run *const run, const bench_result *const result)
+{
+	printf("%-8s %-6s %7zu ", run->workload->name, run->backend->name, run->threads);
+	if (!result->ok)
+	{
+		printf("crashed or could not be set up\n");
+		return;
+	}
+
+	printf("%12.0f %8llu %8llu %9llu %10llu %10zu %10zu %10zu ",
+		(bes_f64)result->operations / result->seconds,
+		result->p50, result->p99, result->p999, result->max,
+		result->rss / 1024, result->peak / 1024, result->live / 1024);
+	if (result->live)
+	{
+		printf("%6.2f", (bes_f64)result->rss / (bes_f64)result->live);
+	}
+	else
+	{
+		printf("%6s", "-");
+	}
+	printf("%s\n", result->failed ? "  out of memory" : "");
+	fflush(stdout);
+}
+
+/* Reads a trace, an empty one on failure. */
+static bes_bool
+bench_load_trace(const char *const path, bench_run *const run)
+{
+	FILE *const file = fopen(path, "r");
+	if (!file)
+	{
+		return BES_FALSE;
+	}
+
+	bench_op *ops = 0;
+	bes_size length = 0;
+	bes_size capacity = 0;
+	bes_u32 blocks = 0;
+	char type;
+	unsigned long id;
+	unsigned long size;
+	while (fscanf(file, " %c %lu", &type, &id) == 2)
+	{
+		size = 0;
+		if (type != 'f' && fscanf(file, " %lu", &size) != 1)
+		{
+			break;
+		}
+
+		if (length == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 4096;
+			bench_op *const resized = realloc(ops, capacity * sizeof *ops);
+			if (!resized)
+			{
+				break;
+			}
+			ops = resized;
+		}
+
+		if ((type == 'a' || type == 'r' || type == 'f') && id < 0xFFFFFFFFul && (type == 'f' || size))
+		{
+			ops[length].type = type;
+			ops[length].id = (bes_u32)id;
+			ops[length].size = (bes_size)size;
+			length++;
+			blocks = (bes_u32)id + 1 > blocks ? (bes_u32)id + 1 : blocks;
+		}
+	}
+	fclose(file);
+
+	run->trace = ops;
+	run->trace_length = length;
+	run->trace_blocks = blocks;
+	return length ? BES_TRUE : BES_FALSE;
+}
+
+/* Generates a trace holding up to BENCH_TRACE_BLOCKS blocks, about half
+ * of the operations allocate, a tenth resize and the rest free. */
+static bes_bool
+bench_generate_trace(bench_run *const run)
+{
+	bench_op *const ops = malloc(run->operations * sizeof *ops);
+	bes_u32 *const live = malloc(BENCH_TRACE_BLOCKS * sizeof *live);
+	bes_u32 *const unused = malloc(BENCH_TRACE_BLOCKS * sizeof *unused);
+	if (!ops || !live || !unused)
+	{
+		free(ops);
+		free(live);
+		free(unused);
+		return BES_FALSE;
+	}
+
+	bes_u32 lives = 0;
+	bes_u32 unuseds = BENCH_TRACE_BLOCKS;
+	for (bes_u32 i = 0; i < BENCH_TRACE_BLOCKS; i++)
+	{
+		unused[i] = BENCH_TRACE_BLOCKS - 1 - i;
+	}
+
+	bes_u64 rng = 0x2545F4914F6CDD1Dull;
+	for (bes_u64 i = 0; i < run->operations; i++)
+	{
+		bench_op *const op = &ops[i];
+		const bes_u64 r = bench_random(&rng) % 100;
+		if (lives == 0 || (r < 50 && unuseds))
+		{
+			op->type = 'a';
+			op->id = unused[--unuseds];
+			op->size = bench_size(&rng);
+			live[lives++] = op->id;
+		}
+		else if (r < 60)
+		{
+			op->type = 'r';
+			op->id = live[bench_random(&rng) % lives];
+			op->size = bench_size(&rng);
+		}
+		else
+		{
+			const bes_u32 index = (bes_u32)(bench_random(&rng) % lives);
+			op->type = 'f';
+			op->id = live[index];
+			op->size = 0;
+			live[index] = live[--lives];
+			unused[unuseds++] = op->id;
+		}
+	}
+
+	free(live);
+	free(unused);
+	run->trace = ops;
+	run->trace_length = (bes_size)run->operations;
+	run->trace_blocks = BENCH_TRACE_BLOCKS;
+	return BES_TRUE;
+}
+
+static void
+bench_usage(const char *const name)
+{
+	fprintf(stderr,
+		"usage: %s [-t threads] [-n operations] [-r trace] [-b backend] [-w workload]\n"
+		"  -t  threads per run, default %d\n"
+		"  -n  operations per thread, default %d\n"
+		"  -r  trace to replay in the trace workload\n"
+		"  -b  only run this backend: libc, heap, slab, tlsf, buddy or mmap\n"
+		"  -w  only run this workload: larson, queue, growth or trace\n",
+		name, BENCH_THREADS, BENCH_OPERATIONS);
+}
+
+int main(int argc, char **argv)
+{
+	bes_allocator_set(bench_libc_init());
+
+	static bench_run run;
+	run.threads = BENCH_THREADS;
+	run.operations = BENCH_OPERATIONS;
+
+	const char *trace = 0;
+	const char *backend = 0;
+	const char *workload = 0;
+	int option;
+	while ((option = getopt(argc, argv, "t:n:r:b:w:h")) != -1)
+	{
+		switch (option)
+		{
+		case 't':
+			run.threads = (bes_size)strtoul(optarg, 0, 10);
+			break;
+		case 'n':
+			run.operations = strtoull(optarg, 0, 10);
+			break;
+		case 'r':
+			trace = optarg;
+			break;
+		case 'b':
+			backend = optarg;
+			break;
+		case 'w':
+			workload = optarg;
+			break;
+		default:
+			bench_usage(argv[0]);
+			return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+	}
+
+	if (run.threads == 0 || run.threads > BENCH_MAX_THREADS || run.operations == 0)
+	{
+		bench_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (trace ? !bench_load_trace(trace, &run) : !bench_generate_trace(&run))
+	{
+		fprintf(stderr, "could not %s trace\n", trace ? "read the" : "generate a");
+		return EXIT_FAILURE;
+	}
+
+	printf("%-8s %-6s %7s %12s %8s %8s %9s %10s %10s %10s %10s %6s\n",
+		"workload", "backend", "threads", "ops/s", "p50 ns", "p99 ns", "p99.9 ns",
+		"max ns", "rss KiB", "peak KiB", "live KiB", "frag");
+	fflush(stdout);
+
+	const bes_size threads = run.threads;
+	for (bes_size w = 0; w < BES_ARRAY_SIZE(bench_workloads); w++)
+	{
+		if (workload && bes_strcmp(workload, bench_workloads[w].name))
+		{
+			continue;
+		}
+
+		for (bes_size b = 0; b < BES_ARRAY_SIZE(bench_backends); b++)
+		{
+			if (backend && bes_strcmp(backend, bench_backends[b].name))
+			{
+				continue;
+			}
+
+			run.workload = &bench_workloads[w];
+			run.backend = &bench_backends[b];
+			/* Producers and consumers come in pairs. */
+			run.threads = run.workload->paired ? (threads < 2 ? 2 : threads & ~(bes_size)1) : threads;
+
+			int fds[2];
+			if (pipe(fds) != 0)
+			{
+				return EXIT_FAILURE;
+			}
+
+			bench_result result;
+			bes_memset(&result, 0, sizeof result);
+			const pid_t child = fork();
+			if (child == 0)
+			{
+				close(fds[0]);
+				bench_execute(&run, &result);
+				const bes_bool written = write(fds[1], &result, sizeof result) == (ssize_t)sizeof result;
+				_exit(written ? EXIT_SUCCESS : EXIT_FAILURE);
+			}
+
+			close(fds[1]);
+			if (child < 0 || read(fds[0], &result, sizeof result) != (ssize_t)sizeof result)
+			{
+				result.ok = BES_FALSE;
+			}
+			close(fds[0]);
+			if (child > 0)
+			{
+				waitpid(child, 0, 0);
+			}
+
+			bench_report(&run, &result);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,209 @@
+#ifndef BES_FOUNDATION_ATOMIC_H
+#define BES_FOUNDATION_ATOMIC_H
+
+#include <bes/foundation/types.h>
+
+#if defined(BES_COMPILER_MSVC)
+#include <intrin.h>
+#endif
+
+/* Memory orders for the operations below. Compilers without the GCC
+ * atomic builtins use interlocked operations, which are sequentially
+ * consistent regardless of the order asked for, and volatile loads and
+ * stores, which are acquire and release on the supported platforms. */
+#if defined(BES_COMPILER_GCC) || defined(BES_COMPILER_CLANG) || defined(BES_COMPILER_INTEL)
+#define BES_ATOMIC_BUILTINS
+#define BES_ATOMIC_RELAXED __ATOMIC_RELAXED
+#define BES_ATOMIC_ACQUIRE __ATOMIC_ACQUIRE
+#define BES_ATOMIC_RELEASE __ATOMIC_RELEASE
+#define BES_ATOMIC_ACQ_REL __ATOMIC_ACQ_REL
+#define BES_ATOMIC_SEQ_CST __ATOMIC_SEQ_CST
+#else
+#define BES_ATOMIC_RELAXED 0
+#define BES_ATOMIC_ACQUIRE 2
+#define BES_ATOMIC_RELEASE 3
+#define BES_ATOMIC_ACQ_REL 4
+#define BES_ATOMIC_SEQ_CST 5
+#endif
+
+static inline bes_u32
+bes_atomic_load_u32(const volatile bes_u32 *const object, int order)
+{
+#if defined(BES_ATOMIC_BUILTINS)
+	return __atomic_load_n(object, order);
+#else
+	(void)order;
+	return *object;
+#endif
+}
+
+static inline void
+bes_atomic_store_u32(volatile bes_u32 *const object, bes_u32 value, int order)
+{
+#if defined(BES_ATOMIC_BUILTINS)
+	__atomic_store_n(object, value, order);
+#else
+	if (order == BES_ATOMIC_SEQ_CST)
+	{
+		_InterlockedExchange((volatile long *)object, (long)value);
+	}
+	else
+	{
+		*object = value;
+	}
+#endif
+}
+
+/* Returns the value before the addition. */
+static inline bes_u32
+bes_atomic_add_u32(volatile bes_u32 *const object, bes_u32 value, int order)
+{
+#if defined(BES_ATOMIC_BUILTINS)
+	return __atomic_fetch_add(object, value, order);
+#else
+	(void)order;
+	return (bes_u32)_InterlockedExchangeAdd((volatile long *)object, (long)value);
+#endif
+}
+
+/* On failure @p expected is updated with the current value. */
+static inline bes_bool
+bes_atomic_cas_u32(volatile bes_u32 *const object, bes_u32 *const expected, bes_u32 desired, int order)
+{
+#if defined(BES_ATOMIC_BUILTINS)
+	return __atomic_compare_exchange_n(object, expected, desired, 0, order, BES_ATOMIC_RELAXED) ? BES_TRUE : BES_FALSE;
+#else
+	(void)order;
+	const bes_u32 previous = (bes_u32)_InterlockedCompareExchange((volatile long *)object, (long)desired, (long)*expected);
+	if (previous == *expected)
+	{
+		return BES_TRUE;
+	}
+	*expected = previous;
+	return BES_FALSE;
+#endif
+}
+
+static inline bes_u64
+bes_atomic_load_u64(const volatile bes_u64 *const object, int order)
+{
+#if defined(BES_ATOMIC_BUILTINS)
+	return __atomic_load_n(object, order);
+#elif defined(BES_ARCH_X86_64) || defined(BES_ARCH_ARM64)
+	(void)order;
+	return *object;
+#else
+	(void)order;
+	return (bes_u64)_InterlockedCompareExchange64((volatile __int64 *)object, 0, 0);
+#endif
+}
+
+static inline void
+bes_atomic_store_u64(volatile bes_u64 *const object, bes_u64 value, int order)
+{
+#if defined(BES_ATOMIC_BUILTINS)
+	__atomic_store_n(object, value, order);
+#elif defined(BES_ARCH_X86_64) || defined(BES_ARCH_ARM64)
+	if (order == BES_ATOMIC_SEQ_CST)
+	{
+		_InterlockedExchange64((volatile __int64 *)object, (__int64)value);
+	}
+	else
+	{
+		*object = value;
+	}
+#else
+	(void)order;
+	_InterlockedExchange64((volatile __int64 *)object, (__int64)value);
+#endif
+}
+
+/* Returns the value before the addition. */
+static inline bes_u64
+bes_atomic_add_u64(volatile bes_u64 *const object, bes_u64 value, int order)
+{
+#if defined(BES_ATOMIC_BUILTINS)
+	return __atomic_fetch_add(object, value, order);
+#else
+	(void)order;
+	return (bes_u64)_InterlockedExchangeAdd64((volatile __int64 *)object, (__int64)value);
+#endif
+}
+
+/* On failure @p expected is updated with the current value. */
+static inline bes_bool
+bes_atomic_cas_u64(volatile bes_u64 *const object, bes_u64 *const expected, bes_u64 desired, int order)
+{
+#if defined(BES_ATOMIC_BUILTINS)
+	return __atomic_compare_exchange_n(object, expected, desired, 0, order, BES_ATOMIC_RELAXED) ? BES_TRUE : BES_FALSE;
+#else
+	(void)order;
+	const bes_u64 previous = (bes_u64)_InterlockedCompareExchange64((volatile __int64 *)object, (__int64)desired, (__int64)*expected);
+	if (previous == *expected)
+	{
+		return BES_TRUE;
+	}
+	*expected = previous;
+	return BES_FALSE;
+#endif
+}
+
+static inline void*
+bes_atomic_load_ptr(void *const volatile *const object, int order)
+{
+#if defined(BES_ATOMIC_BUILTINS)
+	return __atomic_load_n(object, order);
+#else
+	(void)order;
+	return *object;
+#endif
+}
+
+static inline void
+bes_atomic_store_ptr(void *volatile *const object, void *value, int order)
+{
+#if defined(BES_ATOMIC_BUILTINS)
+	__atomic_store_n(object, value, order);
+#else
+	if (order == BES_ATOMIC_SEQ_CST)
+	{
+		_InterlockedExchangePointer(object, value);
+	}
+	else
+	{
+		*object = value;
+	}
+#endif
+}
+
+/* Returns the value before the exchange. */
+static inline void*
+bes_atomic_exchange_ptr(void *volatile *const object, void *value, int order)
+{
+#if defined(BES_ATOMIC_BUILTINS)
+	return __atomic_exchange_n(object, value, order);
+#else
+	(void)order;
+	return _InterlockedExchangePointer(object, value);
+#endif
+}
+
+/* On failure @p expected is updated with the current value. */
+static inline bes_bool
+bes_atomic_cas_ptr(void *volatile *const object, void **const expected, void *desired, int order)
+{
+#if defined(BES_ATOMIC_BUILTINS)
+	return __atomic_compare_exchange_n(object, expected, desired, 0, order, BES_ATOMIC_RELAXED) ? BES_TRUE : BES_FALSE;
+#else
+	(void)order;
+	void *const previous = _InterlockedCompareExchangePointer(object, desired, *expected);
+	if (previous == *expected)
+	{
+		return BES_TRUE;
+	}
+	*expected = previous;
+	return BES_FALSE;
+#endif
+}
+
+#endif
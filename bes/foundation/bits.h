@@ -0,0 +1,82 @@
+#ifndef BES_FOUNDATION_BITS_H
+#define BES_FOUNDATION_BITS_H
+
+#include <bes/foundation/types.h>
+
+#if defined(BES_COMPILER_MSVC)
+#include <intrin.h>
+#endif
+
+/* Index of the most significant set bit, the result is undefined when
+ * no bit is set. */
+static inline bes_size
+bes_bits_msb_u32(bes_u32 n)
+{
+#if defined(BES_COMPILER_GCC) || defined(BES_COMPILER_CLANG) || defined(BES_COMPILER_INTEL)
+	return 31 - (bes_size)__builtin_clz(n);
+#elif defined(BES_COMPILER_MSVC)
+	unsigned long index;
+	_BitScanReverse(&index, n);
+	return index;
+#else
+	bes_size index = 0;
+	while (n >>= 1)
+	{
+		index++;
+	}
+	return index;
+#endif
+}
+
+static inline bes_size
+bes_bits_msb_u64(bes_u64 n)
+{
+#if defined(BES_COMPILER_GCC) || defined(BES_COMPILER_CLANG) || defined(BES_COMPILER_INTEL)
+	return 63 - (bes_size)__builtin_clzll(n);
+#elif defined(BES_COMPILER_MSVC) && defined(BES_ARCH_X86_64)
+	unsigned long index;
+	_BitScanReverse64(&index, n);
+	return index;
+#else
+	return n >> 32 ? 32 + bes_bits_msb_u32((bes_u32)(n >> 32)) : bes_bits_msb_u32((bes_u32)n);
+#endif
+}
+
+/* Index of the least significant set bit, the result is undefined when
+ * no bit is set. */
+static inline bes_size
+bes_bits_lsb_u32(bes_u32 n)
+{
+#if defined(BES_COMPILER_GCC) || defined(BES_COMPILER_CLANG) || defined(BES_COMPILER_INTEL)
+	return (bes_size)__builtin_ctz(n);
+#elif defined(BES_COMPILER_MSVC)
+	unsigned long index;
+	_BitScanForward(&index, n);
+	return index;
+#else
+	return bes_bits_msb_u32(n & -n);
+#endif
+}
+
+static inline bes_size
+bes_bits_lsb_u64(bes_u64 n)
+{
+#if defined(BES_COMPILER_GCC) || defined(BES_COMPILER_CLANG) || defined(BES_COMPILER_INTEL)
+	return (bes_size)__builtin_ctzll(n);
+#elif defined(BES_COMPILER_MSVC) && defined(BES_ARCH_X86_64)
+	unsigned long index;
+	_BitScanForward64(&index, n);
+	return index;
+#else
+	return (bes_u32)n ? bes_bits_lsb_u32((bes_u32)n) : 32 + bes_bits_lsb_u32((bes_u32)(n >> 32));
+#endif
+}
+
+/* Floor of the base two logarithm, zero is treated as one. */
+static inline bes_size
+bes_bits_log2(bes_size n)
+{
+	return bes_bits_msb_u64((bes_u64)n | 1);
+}
+
+#endif
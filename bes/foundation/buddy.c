@@ -0,0 +1,456 @@
+#include <bes/foundation/buddy.h>
+#include <bes/foundation/bits.h>
+#include <bes/foundation/string.h>
+
+#define BES_BUDDY_MIN_SHIFT 5
+#define BES_BUDDY_WORD_BITS (sizeof(bes_size) * 8)
+
+BES_STATIC_ASSERT(BES_BUDDY_MIN_SIZE == 1 << BES_BUDDY_MIN_SHIFT);
+BES_STATIC_ASSERT(BES_BUDDY_ORDERS <= 64);
+
+/* Free blocks are linked through their own memory. */
+struct bes_buddy_block
+{
+	bes_buddy_block *next;
+	bes_buddy_block *prev;
+};
+
+BES_STATIC_ASSERT(sizeof(bes_buddy_block) <= BES_BUDDY_MIN_SIZE);
+
+/* Blocks are numbered like the nodes of a binary heap. The block spanning
+ * all of the memory is one, the halves of block n are 2n and 2n + 1 and
+ * the buddy of block n is n ^ 1. Only split blocks have bits in the split
+ * and parity bitmaps, block n of order zero is never split.
+ *
+ * A parity bit is the exclusive or of whether each half of a split block
+ * is free. A block being freed finds its buddy free when toggling the bit
+ * clears it, one bit per pair being enough to coalesce.
+ *
+ * Memory which isn't a power of two in size is treated as the start of a
+ * larger power of two. Blocks reaching past the end are split until the
+ * memory is covered by whole blocks, and blocks never merge with a buddy
+ * that reaches past the end. */
+static inline bes_bool
+bes_buddy_bit(const bes_size *const bits, bes_size n)
+{
+	return bits[n / BES_BUDDY_WORD_BITS] >> (n % BES_BUDDY_WORD_BITS) & 1 ? BES_TRUE : BES_FALSE;
+}
+
+static inline void
+bes_buddy_bit_set(bes_size *const bits, bes_size n)
+{
+	bits[n / BES_BUDDY_WORD_BITS] |= (bes_size)1 << (n % BES_BUDDY_WORD_BITS);
+}
+
+static inline void
+bes_buddy_bit_clear(bes_size *const bits, bes_size n)
+{
+	bits[n / BES_BUDDY_WORD_BITS] &= ~((bes_size)1 << (n % BES_BUDDY_WORD_BITS));
+}
+
+static inline void
+bes_buddy_bit_toggle(bes_size *const bits, bes_size n)
+{
+	bits[n / BES_BUDDY_WORD_BITS] ^= (bes_size)1 << (n % BES_BUDDY_WORD_BITS);
+}
+
+static inline bes_size
+bes_buddy_block_size(bes_size order)
+{
+	return (bes_size)BES_BUDDY_MIN_SIZE << order;
+}
+
+static inline bes_size
+bes_buddy_order_of_size(bes_size size)
+{
+	return size <= BES_BUDDY_MIN_SIZE ? 0 : bes_bits_log2(size - 1) + 1 - BES_BUDDY_MIN_SHIFT;
+}
+
+static inline bes_size
+bes_buddy_metadata_size(bes_size order)
+{
+	return BES_BUDDY_METADATA_SIZE(bes_buddy_block_size(order));
+}
+
+static inline bes_size
+bes_buddy_node_offset(const bes_buddy_allocator *const buddy, bes_size n, bes_size order)
+{
+	return (n - ((bes_size)1 << (buddy->order - order))) << (order + BES_BUDDY_MIN_SHIFT);
+}
+
+static inline bes_size
+bes_buddy_node_at(const bes_buddy_allocator *const buddy, bes_size offset, bes_size order)
+{
+	return ((bes_size)1 << (buddy->order - order)) + (offset >> (order + BES_BUDDY_MIN_SHIFT));
+}
+
+static inline bes_bool
+bes_buddy_node_exists(const bes_buddy_allocator *const buddy, bes_size n, bes_size order)
+{
+	return bes_buddy_node_offset(buddy, n, order) + bes_buddy_block_size(order) <= buddy->size ? BES_TRUE : BES_FALSE;
+}
+
+static inline bes_buddy_block*
+bes_buddy_node_block(const bes_buddy_allocator *const buddy, bes_size n, bes_size order)
+{
+	return (bes_buddy_block *)(buddy->base + bes_buddy_node_offset(buddy, n, order));
+}
+
+static void
+bes_buddy_push(bes_buddy_allocator *const buddy, bes_size n, bes_size order)
+{
+	bes_buddy_block *const block = bes_buddy_node_block(buddy, n, order);
+	block->prev = 0;
+	block->next = buddy->free[order];
+	if (block->next)
+	{
+		block->next->prev = block;
+	}
+	buddy->free[order] = block;
+	buddy->count[order]++;
+	buddy->available |= (bes_u64)1 << order;
+}
+
+static void
+bes_buddy_remove(bes_buddy_allocator *const buddy, bes_buddy_block *const block, bes_size order)
+{
+	if (block->prev)
+	{
+		block->prev->next = block->next;
+	}
+	else
+	{
+		buddy->free[order] = block->next;
+	}
+
+	if (block->next)
+	{
+		block->next->prev = block->prev;
+	}
+
+	if (--buddy->count[order] == 0)
+	{
+		buddy->available &= ~((bes_u64)1 << order);
+	}
+}
+
+/* Find the allocated block at an offset by descending through the split
+ * blocks containing it. */
+static bes_size
+bes_buddy_find(const bes_buddy_allocator *const buddy, bes_size offset, bes_size *const order_)
+{
+	bes_size n = 1;
+	bes_size order = buddy->order;
+	while (order && bes_buddy_bit(buddy->split, n))
+	{
+		order--;
+		n = 2 * n + ((offset >> (order + BES_BUDDY_MIN_SHIFT)) & 1);
+	}
+	*order_ = order;
+	return n;
+}
+
+static void*
+bes_buddy_take(bes_buddy_allocator *const buddy, bes_size order)
+{
+	if (order > buddy->order)
+	{
+		return 0;
+	}
+
+	/* The smallest free block large enough is found with a bit scan. */
+	const bes_u64 candidates = buddy->available & ~(((bes_u64)1 << order) - 1);
+	if (!candidates)
+	{
+		return 0;
+	}
+
+	bes_size current = bes_bits_lsb_u64(candidates);
+	bes_buddy_block *const block = buddy->free[current];
+	bes_buddy_remove(buddy, block, current);
+
+	bes_size n = bes_buddy_node_at(buddy, (bes_size)((bes_byte *)block - buddy->base), current);
+	if (n > 1)
+	{
+		bes_buddy_bit_toggle(buddy->parity, n >> 1);
+	}
+
+	/* Split off the upper halves until the block is as small as it can
+	 * be, the lower half keeps the address of the block. */
+	while (current > order)
+	{
+		bes_buddy_bit_set(buddy->split, n);
+		current--;
+		n *= 2;
+		bes_buddy_push(buddy, n + 1, current);
+		bes_buddy_bit_toggle(buddy->parity, n >> 1);
+	}
+
+	buddy->used += bes_buddy_block_size(order);
+	return block;
+}
+
+static void
+bes_buddy_release(bes_buddy_allocator *const buddy, bes_size n, bes_size order)
+{
+	buddy->used -= bes_buddy_block_size(order);
+
+	while (n > 1 && bes_buddy_node_exists(buddy, n ^ 1, order))
+	{
+		bes_buddy_bit_toggle(buddy->parity, n >> 1);
+		if (bes_buddy_bit(buddy->parity, n >> 1))
+		{
+			break;
+		}
+
+		bes_buddy_remove(buddy, bes_buddy_node_block(buddy, n ^ 1, order), order);
+		bes_buddy_bit_clear(buddy->split, n >> 1);
+		n >>= 1;
+		order++;
+	}
+
+	bes_buddy_push(buddy, n, order);
+}
+
+static bes_bool
+bes_buddy_resize(bes_buddy_allocator *const buddy, void *const data, bes_size size)
+{
+	bes_size order = 0;
+	bes_size n = bes_buddy_find(buddy, (bes_size)((bes_byte *)data - buddy->base), &order);
+	const bes_size needed = bes_buddy_order_of_size(size);
+	if (needed > buddy->order)
+	{
+		return BES_FALSE;
+	}
+
+	/* Shrinking splits off and frees the upper halves. */
+	if (needed <= order)
+	{
+		while (order > needed)
+		{
+			bes_buddy_bit_set(buddy->split, n);
+			order--;
+			n *= 2;
+			bes_buddy_push(buddy, n + 1, order);
+			bes_buddy_bit_toggle(buddy->parity, n >> 1);
+			buddy->used -= bes_buddy_block_size(order);
+		}
+		return BES_TRUE;
+	}
+
+	/* Growing requires the block to be the lower half of every block up
+	 * to the size needed, with the upper halves all free. */
+	for (bes_size m = n, current = order; current < needed; m >>= 1, current++)
+	{
+		if ((m & 1)
+			|| !bes_buddy_node_exists(buddy, m ^ 1, current)
+			|| !bes_buddy_bit(buddy->parity, m >> 1))
+		{
+			return BES_FALSE;
+		}
+	}
+
+	while (order < needed)
+	{
+		bes_buddy_remove(buddy, bes_buddy_node_block(buddy, n ^ 1, order), order);
+		bes_buddy_bit_toggle(buddy->parity, n >> 1);
+		bes_buddy_bit_clear(buddy->split, n >> 1);
+		buddy->used += bes_buddy_block_size(order);
+		n >>= 1;
+		order++;
+	}
+
+	return BES_TRUE;
+}
+
+static void* BES_API
+bes_buddy_allocate(bes_allocator *allocator, bes_size size)
+{
+	bes_buddy_allocator *const buddy = allocator->aux;
+	return bes_buddy_take(buddy, bes_buddy_order_of_size(size));
+}
+
+static void* BES_API
+bes_buddy_allocate_aligned(bes_allocator *allocator, bes_size size, bes_size alignment)
+{
+	/* Blocks are aligned by their size relative to the start of memory. */
+	bes_buddy_allocator *const buddy = allocator->aux;
+	const bes_uintptr base = (bes_uintptr)buddy->base;
+	if (alignment > (base & -base))
+	{
+		return 0;
+	}
+	return bes_buddy_take(buddy, bes_buddy_order_of_size(size > alignment ? size : alignment));
+}
+
+static void BES_API
+bes_buddy_deallocate(bes_allocator *allocator, void *data)
+{
+	bes_buddy_allocator *const buddy = allocator->aux;
+	if (data)
+	{
+		bes_size order = 0;
+		const bes_size n = bes_buddy_find(buddy, (bes_size)((bes_byte *)data - buddy->base), &order);
+		bes_buddy_release(buddy, n, order);
+	}
+}
+
+static bes_size BES_API
+bes_buddy_usable_size(bes_allocator *allocator, const void *data)
+{
+	const bes_buddy_allocator *const buddy = allocator->aux;
+	if ((const bes_byte *)data < buddy->base || (const bes_byte *)data >= buddy->base + buddy->size)
+	{
+		return 0;
+	}
+
+	bes_size order = 0;
+	bes_buddy_find(buddy, (bes_size)((const bes_byte *)data - buddy->base), &order);
+	return bes_buddy_block_size(order);
+}
+
+static bes_bool BES_API
+bes_buddy_reallocate_in_place(bes_allocator *allocator, void *data, bes_size size)
+{
+	return bes_buddy_resize(allocator->aux, data, size);
+}
+
+static void* BES_API
+bes_buddy_reallocate(bes_allocator *allocator, void *data, bes_size size)
+{
+	bes_buddy_allocator *const buddy = allocator->aux;
+
+	if (!data)
+	{
+		return bes_buddy_allocate(allocator, size);
+	}
+
+	if (bes_buddy_resize(buddy, data, size))
+	{
+		return data;
+	}
+
+	void *const resize = bes_buddy_allocate(allocator, size);
+	if (resize)
+	{
+		/* The block only failed to resize because it has to grow. */
+		bes_memcpy(resize, data, bes_buddy_usable_size(allocator, data));
+		bes_buddy_deallocate(allocator, data);
+	}
+
+	return resize;
+}
+
+bes_bool
+bes_buddy_allocator_init(bes_buddy_allocator *const buddy,
+                         void *const region,
+                         bes_size size)
+{
+	BES_ASSERT(buddy);
+
+	bes_byte *const base = (bes_byte *)(((bes_uintptr)region + BES_BUDDY_MIN_SIZE - 1) & -(bes_uintptr)BES_BUDDY_MIN_SIZE);
+	const bes_size slack = (bes_size)(base - (bes_byte *)region);
+	if (size < slack + BES_BUDDY_MIN_SIZE)
+	{
+		return BES_FALSE;
+	}
+
+	/* The bitmaps are sized for the block spanning all of the memory and
+	 * placed after the memory they leave for blocks. When that leaves no
+	 * more than a block of half the size, the smaller bitmaps of that block
+	 * let it fit whole. */
+	const bes_size available = size - slack;
+	bes_size order = bes_buddy_order_of_size(available);
+	if (order && bes_buddy_block_size(order - 1) + bes_buddy_metadata_size(order - 1) <= available
+		&& (available < bes_buddy_metadata_size(order)
+			|| available - bes_buddy_metadata_size(order) <= bes_buddy_block_size(order - 1)))
+	{
+		order--;
+	}
+
+	const bes_size bitmaps = bes_buddy_metadata_size(order);
+	if (available < bitmaps + BES_BUDDY_MIN_SIZE)
+	{
+		return BES_FALSE;
+	}
+
+	bes_size managed = (available - bitmaps) & -(bes_size)BES_BUDDY_MIN_SIZE;
+	if (managed > bes_buddy_block_size(order))
+	{
+		managed = bes_buddy_block_size(order);
+	}
+
+	buddy->allocator.allocate = &bes_buddy_allocate;
+	buddy->allocator.reallocate = &bes_buddy_reallocate;
+	buddy->allocator.deallocate = &bes_buddy_deallocate;
+	buddy->allocator.aux = buddy;
+	buddy->allocator.flags = 0;
+	buddy->allocator.deallocate_sized = 0;
+	buddy->allocator.alignment = BES_BUDDY_MIN_SIZE;
+	buddy->allocator.usable_size = &bes_buddy_usable_size;
+	buddy->allocator.allocate_aligned = &bes_buddy_allocate_aligned;
+	buddy->allocator.reallocate_in_place = &bes_buddy_reallocate_in_place;
+	buddy->allocator.allocate_batch = 0;
+	buddy->allocator.deallocate_batch = 0;
+	buddy->allocator.allocate_zeroed = 0;
+	buddy->allocator.trim = 0;
+	buddy->base = base;
+	buddy->size = managed;
+	buddy->order = order;
+	buddy->split = (bes_size *)(base + managed);
+	buddy->parity = buddy->split + bitmaps / (2 * sizeof(bes_size));
+	for (bes_size i = 0; i < BES_BUDDY_ORDERS; i++)
+	{
+		buddy->free[i] = 0;
+		buddy->count[i] = 0;
+	}
+	buddy->available = 0;
+	buddy->used = 0;
+
+	bes_memset(buddy->split, 0, bitmaps);
+
+	/* Cover the memory with the largest whole blocks, splitting the ones
+	 * reaching past its end. */
+	bes_size n = 1;
+	bes_size offset = 0;
+	while (offset < managed)
+	{
+		if (offset + bes_buddy_block_size(order) <= managed)
+		{
+			bes_buddy_push(buddy, n, order);
+			break;
+		}
+
+		bes_buddy_bit_set(buddy->split, n);
+		order--;
+		n *= 2;
+		if (offset + bes_buddy_block_size(order) <= managed)
+		{
+			bes_buddy_push(buddy, n, order);
+			offset += bes_buddy_block_size(order);
+			n++;
+		}
+	}
+
+	return BES_TRUE;
+}
+
+void
+bes_buddy_allocator_report(const bes_buddy_allocator *const buddy,
+                           bes_buddy_report *const report)
+{
+	BES_ASSERT(buddy);
+	BES_ASSERT(report);
+
+	report->size = buddy->size;
+	report->used = buddy->used;
+	report->free = buddy->size - buddy->used;
+	report->largest = buddy->available ? bes_buddy_block_size(bes_bits_msb_u64(buddy->available)) : 0;
+	for (bes_size i = 0; i < BES_BUDDY_ORDERS; i++)
+	{
+		report->count[i] = buddy->count[i];
+	}
+	report->fragmentation = report->free
+		? 1.0f - (bes_f32)report->largest / (bes_f32)report->free
+		: 0.0f;
+}
@@ -0,0 +1,116 @@
+#ifndef BES_FOUNDATION_BUDDY_H
+#define BES_FOUNDATION_BUDDY_H
+
+/**
+ * @defgroup Buddy Buddy allocator
+ *
+ * @brief Power of two allocator over a fixed region of memory
+ *
+ * The buddy allocator manages a single region of memory handed to it by
+ * the caller, for platforms where the library is given all the memory it
+ * may use up front. Blocks are powers of two in size and are split in
+ * halves to satisfy smaller allocations. Freeing a block merges it with
+ * its buddy, the other half it was split from, whenever that is free too.
+ *
+ * Bitmaps at the end of the region record which blocks are split and
+ * which pairs of buddies are partly free, so blocks carry no header and
+ * both allocation and deallocation take time logarithmic in the size of
+ * the region. The allocator is headerless, see @ref bes_allocator.
+ *
+ * @{
+ */
+
+#include <bes/foundation/memory.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** @brief The size of the smallest block */
+#define BES_BUDDY_MIN_SIZE 32
+
+/** @brief The most orders of block sizes, enough for any region */
+#define BES_BUDDY_ORDERS (sizeof(bes_size) * 8 - 5)
+
+/**
+ * @brief The size of the bitmaps for @p SIZE bytes of blocks
+ *
+ * A region of @p SIZE plus this many bytes, aligned by
+ * @ref BES_BUDDY_MIN_SIZE, makes blocks from exactly @p SIZE bytes when
+ * @p SIZE is a power of two.
+ */
+#define BES_BUDDY_METADATA_SIZE(SIZE) \
+	(2 * (((SIZE) / BES_BUDDY_MIN_SIZE + sizeof(bes_size) * 8 - 1) / (sizeof(bes_size) * 8)) * sizeof(bes_size))
+
+typedef struct bes_buddy_allocator bes_buddy_allocator;
+typedef struct bes_buddy_block bes_buddy_block;
+typedef struct bes_buddy_report bes_buddy_report;
+
+/**
+ * @brief Buddy allocator
+ * @warning The buddy allocator is not thread safe.
+ */
+struct bes_buddy_allocator
+{
+	bes_allocator allocator; /**< The allocator interface of the buddy allocator */
+	bes_byte *base; /**< The start of the memory blocks are made from */
+	bes_size size; /**< The amount of memory blocks are made from */
+	bes_size order; /**< The order of the block spanning all of the memory */
+	bes_size *split; /**< One bit per block set when it is split */
+	bes_size *parity; /**< One bit per split block set when one half is free */
+	bes_buddy_block *free[BES_BUDDY_ORDERS]; /**< Free blocks per order */
+	bes_size count[BES_BUDDY_ORDERS]; /**< The amount of free blocks per order */
+	bes_u64 available; /**< One bit per order set when it has free blocks */
+	bes_size used; /**< The amount of memory allocated */
+};
+
+/** @brief Report of how the memory of a buddy allocator is used */
+struct bes_buddy_report
+{
+	bes_size size; /**< The amount of memory blocks are made from */
+	bes_size used; /**< The amount of memory allocated, including rounding */
+	bes_size free; /**< The amount of memory free */
+	bes_size largest; /**< The largest free block */
+	bes_size count[BES_BUDDY_ORDERS]; /**< The amount of free blocks per order */
+
+	/**
+	 * The share of free memory which can't be allocated in one block, zero
+	 * when all free memory is in one block and nearing one as it is
+	 * scattered over many small blocks.
+	 */
+	bes_f32 fragmentation;
+};
+
+/**
+ * @brief Initialize a buddy allocator over a region of memory
+ * @param buddy The buddy allocator to initialize
+ * @param region The memory to allocate from, the bitmaps are placed at
+ * its end
+ * @param size The size of @p region
+ * @note Aligned allocations are supported up to the alignment of
+ * @p region rounded up to @ref BES_BUDDY_MIN_SIZE.
+ * @return BES_TRUE if successful, BES_FALSE if @p region is too small to
+ * hold a single block and the bitmaps.
+ */
+BES_EXPORT bes_bool BES_API
+bes_buddy_allocator_init(bes_buddy_allocator *const buddy,
+                         void *const region,
+                         bes_size size);
+
+/**
+ * @brief Report how the memory of a buddy allocator is used
+ * @param buddy The buddy allocator
+ * @param report The report to fill out
+ */
+BES_EXPORT void BES_API
+bes_buddy_allocator_report(const bes_buddy_allocator *const buddy,
+                           bes_buddy_report *const report);
+
+#if defined(__cplusplus)
+}
+#endif
+
+/**
+ * @}
+ */
+#endif
@@ -1,29 +1,287 @@
 #include <bes/foundation/buffer.h>
 #include <bes/foundation/memory.h>
 #include <bes/foundation/string.h>
+#include <bes/foundation/vm.h>
+
+/* Virtual buffers record their reservation in front of their meta data,
+ * at the very start of the reservation. */
+typedef struct bes_buffer_region bes_buffer_region;
+typedef union bes_buffer_region_data bes_buffer_region_data;
+
+struct bes_buffer_region
+{
+	bes_size reserved; /* Bytes reserved */
+	bes_size committed; /* Bytes committed from the start */
+};
+
+union bes_buffer_region_data
+{
+	bes_buffer_region data;
+	bes_byte aligned[(sizeof(bes_buffer_region) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT];
+};
+
+#define BES_BUFFER_REGION_HEADER (sizeof(bes_buffer_region_data) + sizeof(bes_buffer_data))
+
+static inline bes_buffer_region_data*
+bes_buffer_region_of(bes_buffer_data *const meta)
+{
+	return (bes_buffer_region_data *)meta - 1;
+}
+
+/* Commit enough of a reservation for the given amount of elements. Commits
+ * at least double what is already committed so growing one element at a
+ * time costs few system calls. */
+static bes_bool
+bes_buffer_region_commit(bes_buffer_region_data *const region,
+                         bes_size elements,
+                         bes_size type_size)
+{
+	bes_buffer_region *const data = &region->data;
+	if (elements > (data->reserved - BES_BUFFER_REGION_HEADER) / type_size)
+	{
+		return BES_FALSE;
+	}
+
+	const bes_size needed = BES_BUFFER_REGION_HEADER + elements * type_size;
+	if (needed <= data->committed)
+	{
+		return BES_TRUE;
+	}
+
+	const bes_size page_size = bes_vm_page_size();
+	bes_size commit = needed > 2 * data->committed ? needed : 2 * data->committed;
+	commit = (commit + page_size - 1) & -page_size;
+	if (commit > data->reserved)
+	{
+		commit = data->reserved;
+	}
+
+	if (!bes_vm_commit((bes_byte *)region + data->committed, commit - data->committed))
+	{
+		return BES_FALSE;
+	}
+
+	data->committed = commit;
+	return BES_TRUE;
+}
+
+static inline void
+bes_buffer_region_capacity(bes_buffer_region_data *const region, bes_size type_size)
+{
+	bes_buffer_data *const meta = (bes_buffer_data *)(region + 1);
+	meta->data.capacity = ((region->data.committed - BES_BUFFER_REGION_HEADER) / type_size) | BES_BUFFER_VIRTUAL;
+}
+
+bes_bool
+bes_buffer_virtual(void **const buffer,
+                   bes_size capacity,
+                   bes_size type_size)
+{
+	BES_ASSERT(buffer);
+
+	const bes_size size = bes_buffer_size(*buffer);
+	if (capacity < size + 1)
+	{
+		capacity = size + 1;
+	}
+
+	if (capacity > ((bes_size)-1 - BES_BUFFER_REGION_HEADER) / type_size)
+	{
+		return BES_FALSE;
+	}
+
+	const bes_size page_size = bes_vm_page_size();
+	const bes_size reserved = (BES_BUFFER_REGION_HEADER + capacity * type_size + page_size - 1) & -page_size;
+	bes_buffer_region_data *const region = bes_vm_reserve(reserved);
+	if (!region)
+	{
+		return BES_FALSE;
+	}
+
+	if (!bes_vm_commit(region, page_size))
+	{
+		bes_vm_release(region, reserved);
+		return BES_FALSE;
+	}
+
+	region->data.reserved = reserved;
+	region->data.committed = page_size;
+	if (!bes_buffer_region_commit(region, size + 1, type_size))
+	{
+		bes_vm_release(region, reserved);
+		return BES_FALSE;
+	}
+
+	bes_buffer_data *const meta = (bes_buffer_data *)(region + 1);
+	meta->data.size = size;
+	bes_buffer_region_capacity(region, type_size);
+
+	if (*buffer)
+	{
+		bes_memcpy(meta + 1, *buffer, size * type_size);
+		bes_buffer_delete(*buffer, type_size);
+	}
+
+	*buffer = meta + 1;
+	return BES_TRUE;
+}
+
+/* Virtual buffers commit more of their reservation rather than moving. */
+static bes_bool
+bes_buffer_grow_virtual(bes_buffer_data *const meta,
+                        bes_size elements,
+                        bes_size type_size)
+{
+	bes_buffer_region_data *const region = bes_buffer_region_of(meta);
+	if (elements > (bes_size)-1 - meta->data.size - 1
+		|| !bes_buffer_region_commit(region, meta->data.size + elements + 1, type_size))
+	{
+		return BES_FALSE;
+	}
+
+	bes_buffer_region_capacity(region, type_size);
+	return BES_TRUE;
+}
+
+/* The growth policy of the calling thread, doubling by default. */
+static BES_THREAD_LOCAL bes_buffer_growth g_bes_buffer_growth;
+static BES_THREAD_LOCAL bes_size g_bes_buffer_growth_step;
+
+void
+bes_buffer_set_growth(bes_buffer_growth growth, bes_size step)
+{
+	g_bes_buffer_growth = growth;
+	g_bes_buffer_growth_step = step;
+}
+
+/* The size of the allocation of a buffer grown by some elements under the
+ * growth policy. Requests are rounded up to the alignment every allocator
+ * rounds to at least, the rounding of the allocator itself is picked up
+ * from the usable size once allocated. */
+static bes_size
+bes_buffer_grown_size(bes_size capacity,
+                      bes_size elements,
+                      bes_size type_size)
+{
+	bes_size grown = 0;
+	switch (g_bes_buffer_growth)
+	{
+	case BES_BUFFER_GROWTH_HALF:
+		grown = capacity / 2;
+		break;
+	case BES_BUFFER_GROWTH_STEP:
+		grown = (g_bes_buffer_growth_step + type_size - 1) / type_size;
+		break;
+	case BES_BUFFER_GROWTH_DOUBLE:
+	case BES_BUFFER_GROWTH_PAGES:
+		grown = capacity;
+		break;
+	}
+
+	const bes_size limit = ((bes_size)-1 - sizeof(bes_buffer_data)) / type_size - BES_ALIGNMENT;
+	/* A buffer close to the limit can have a capacity and elements past it
+	 * together, which must be clamped before working out the room left. */
+	bes_size count = capacity < limit && elements < limit - capacity ? capacity + elements : limit;
+	count = grown < limit - count ? count + grown : limit;
+
+	bes_size size = (type_size * count + sizeof(bes_buffer_data) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT;
+	if (g_bes_buffer_growth == BES_BUFFER_GROWTH_PAGES)
+	{
+		const bes_size page_size = bes_vm_page_size();
+		size = size <= (bes_size)-1 - page_size ? (size + page_size - 1) & -page_size : size;
+	}
+	return size;
+}
+
+static inline bes_bool
+bes_buffer_fits(bes_size elements, bes_size type_size)
+{
+	return elements <= ((bes_size)-1 - sizeof(bes_buffer_data)) / type_size - 1 ? BES_TRUE : BES_FALSE;
+}
+
+void*
+bes_buffer_inline(void *const storage,
+                  bes_size capacity)
+{
+	BES_ASSERT(storage);
+	bes_buffer_data *const meta = storage;
+	meta->data.size = 0;
+	meta->data.capacity = capacity | BES_BUFFER_INLINE;
+	return meta + 1;
+}
+
+/* Inline buffers move their contents to the heap once they outgrow their
+ * storage, which belongs to the caller and is left as it is. */
+static bes_bool
+bes_buffer_spill(void **const buffer,
+                 bes_size size,
+                 bes_size type_size)
+{
+	const bes_buffer_data *const storage = bes_buffer_meta(*buffer);
+	bes_buffer_data *const meta = bes_malloc(size);
+	if (!meta)
+	{
+		return BES_FALSE;
+	}
+
+	meta->data.size = storage->data.size;
+	meta->data.capacity = (bes_malloc_usable_size(meta) - sizeof *meta) / type_size;
+	bes_memcpy(meta + 1, *buffer, storage->data.size * type_size);
+	*buffer = meta + 1;
+	return BES_TRUE;
+}
 
 bes_bool
 bes_buffer_grow(void **buffer,
                 bes_size elements,
                 bes_size type_size)
 {
-	bes_size count = 0;
 	void *data = 0;
 	if (*buffer)
 	{
 		bes_buffer_data *const meta = bes_buffer_meta(*buffer);
-		count = 2 * meta->data.capacity + elements;
-		data = bes_realloc(meta, type_size * count + sizeof *meta);
-		if (!data)
+		if (meta->data.capacity & BES_BUFFER_VIRTUAL)
+		{
+			return bes_buffer_grow_virtual(meta, elements, type_size);
+		}
+
+		if (elements > (bes_size)-1 - meta->data.size || !bes_buffer_fits(meta->data.size + elements, type_size))
 		{
-			bes_free(meta);
 			return BES_FALSE;
 		}
+
+		const bes_size size = bes_buffer_grown_size(meta->data.capacity & ~BES_BUFFER_FLAGS, elements, type_size);
+		if (meta->data.capacity & BES_BUFFER_INLINE)
+		{
+			return bes_buffer_spill(buffer, size, type_size);
+		}
+
+		/* Growing in place avoids copying the contents, which is worth
+		 * settling for only the elements needed right now. */
+		const bes_size needed = meta->data.size + elements + 1;
+		if (bes_realloc_in_place(meta, size)
+			|| bes_realloc_in_place(meta, type_size * needed + sizeof *meta))
+		{
+			data = meta;
+		}
+		else
+		{
+			/* A failed reallocation leaves the buffer be. */
+			data = bes_realloc(meta, size);
+			if (!data)
+			{
+				return BES_FALSE;
+			}
+		}
 	}
 	else
 	{
-		count = elements + 1;
-		data = bes_malloc(type_size * count + sizeof(bes_buffer_data));
+		if (!bes_buffer_fits(elements, type_size))
+		{
+			return BES_FALSE;
+		}
+
+		data = bes_malloc(type_size * (elements + 1) + sizeof(bes_buffer_data));
 		if (!data)
 		{
 			return BES_FALSE;
@@ -31,20 +289,203 @@ bes_buffer_grow(void **buffer,
 		((bes_buffer_data *)data)->data.size = 0;
 	}
 
+	/* Make use of any slack the allocation was rounded up with. */
 	bes_buffer_data *meta = (bes_buffer_data *)data;
-	meta->data.capacity = count;
+	meta->data.capacity = (bes_malloc_usable_size(meta) - sizeof *meta) / type_size;
 	*buffer = meta + 1;
 	return BES_TRUE;
 }
 
 void
-bes_buffer_delete(void *const buffer)
+bes_buffer_swap_remove_element(void *const buffer,
+                               bes_size index,
+                               bes_size type_size)
+{
+	BES_ASSERT(buffer);
+
+	bes_buffer_data *const meta = bes_buffer_meta(buffer);
+	BES_ASSERT(index < meta->data.size);
+
+	/* Removing the last element leaves nothing to move. */
+	const bes_size last = --meta->data.size;
+	if (index != last)
+	{
+		bes_memcpy((bes_byte *)buffer + index * type_size, (bes_byte *)buffer + last * type_size, type_size);
+	}
+}
+
+bes_bool
+bes_buffer_reserve_capacity(void **const buffer,
+                            bes_size capacity,
+                            bes_size type_size)
+{
+	BES_ASSERT(buffer);
+
+	/* There's always room for one more element than the capacity. */
+	if (bes_buffer_capacity(*buffer) > capacity)
+	{
+		return BES_TRUE;
+	}
+
+	if (!bes_buffer_fits(capacity, type_size))
+	{
+		return BES_FALSE;
+	}
+
+	const bes_size size = type_size * (capacity + 1) + sizeof(bes_buffer_data);
+	bes_buffer_data *meta = 0;
+	if (*buffer)
+	{
+		meta = bes_buffer_meta(*buffer);
+		if (meta->data.capacity & BES_BUFFER_VIRTUAL)
+		{
+			return bes_buffer_grow_virtual(meta, capacity - meta->data.size, type_size);
+		}
+
+		if (meta->data.capacity & BES_BUFFER_INLINE)
+		{
+			return bes_buffer_spill(buffer, size, type_size);
+		}
+
+		meta = bes_realloc(meta, size);
+		if (!meta)
+		{
+			return BES_FALSE;
+		}
+	}
+	else
+	{
+		meta = bes_malloc(size);
+		if (!meta)
+		{
+			return BES_FALSE;
+		}
+		meta->data.size = 0;
+	}
+
+	meta->data.capacity = (bes_malloc_usable_size(meta) - sizeof *meta) / type_size;
+	*buffer = meta + 1;
+	return BES_TRUE;
+}
+
+bes_bool
+bes_buffer_splice_elements(void **const buffer,
+                           bes_size index,
+                           bes_size erase,
+                           const void *const data,
+                           bes_size count,
+                           bes_size type_size)
+{
+	BES_ASSERT(buffer);
+
+	const bes_size size = bes_buffer_size(*buffer);
+	BES_ASSERT(index <= size && erase <= size - index);
+
+	/* Growing is the only thing which can fail, so it's done before any
+	 * element is moved. */
+	if (count > erase)
+	{
+		const bes_size elements = count - erase;
+		if ((!*buffer || elements >= bes_buffer_capacity(*buffer) - size)
+			&& !bes_buffer_grow(buffer, elements, type_size))
+		{
+			return BES_FALSE;
+		}
+	}
+
+	if (!*buffer)
+	{
+		return BES_TRUE;
+	}
+
+	bes_byte *const elements = *buffer;
+	const bes_size tail = size - index - erase;
+	if (count != erase && tail)
+	{
+		bes_memmove(elements + (index + count) * type_size,
+		            elements + (index + erase) * type_size,
+		            tail * type_size);
+	}
+
+	if (data && count)
+	{
+		bes_memcpy(elements + index * type_size, data, count * type_size);
+	}
+
+	bes_buffer_meta(*buffer)->data.size = size - erase + count;
+	return BES_TRUE;
+}
+
+void
+bes_buffer_shrink(void **const buffer,
+                  bes_size type_size)
+{
+	BES_ASSERT(buffer && *buffer);
+
+	bes_buffer_data *meta = bes_buffer_meta(*buffer);
+	if (meta->data.capacity & BES_BUFFER_VIRTUAL)
+	{
+		/* The first page holds the region and stays committed. */
+		bes_buffer_region_data *const region = bes_buffer_region_of(meta);
+		const bes_size page_size = bes_vm_page_size();
+		const bes_size needed = BES_BUFFER_REGION_HEADER + (meta->data.size + 1) * type_size;
+		const bes_size keep = (needed + page_size - 1) & -page_size;
+		if (keep < region->data.committed)
+		{
+			bes_vm_decommit((bes_byte *)region + keep, region->data.committed - keep);
+			region->data.committed = keep;
+			bes_buffer_region_capacity(region, type_size);
+		}
+		return;
+	}
+
+	/* The storage of inline buffers isn't theirs to give back. */
+	if (meta->data.capacity & BES_BUFFER_INLINE)
+	{
+		return;
+	}
+
+	if (meta->data.size == 0)
+	{
+		bes_buffer_delete(*buffer, type_size);
+		*buffer = 0;
+		return;
+	}
+
+	const bes_size size = type_size * (meta->data.size + 1) + sizeof *meta;
+	if (size >= bes_malloc_usable_size(meta))
+	{
+		return;
+	}
+
+	meta = bes_realloc(meta, size);
+	if (meta)
+	{
+		meta->data.capacity = (bes_malloc_usable_size(meta) - sizeof *meta) / type_size;
+		*buffer = meta + 1;
+	}
+}
+
+void
+bes_buffer_delete(void *const buffer,
+                  bes_size type_size)
 {
 	/* This function isn't ever called directly, but rather by bes_buffer_free
 	 * which does a null pointer check. The meta data calculation here is
 	 * otherwise safe provided that variant is held. */
 	BES_ASSERT(buffer);
-	bes_free(bes_buffer_meta(buffer));
+	bes_buffer_data *const meta = bes_buffer_meta(buffer);
+	if (meta->data.capacity & BES_BUFFER_VIRTUAL)
+	{
+		bes_buffer_region_data *const region = bes_buffer_region_of(meta);
+		bes_vm_release(region, region->data.reserved);
+	}
+	else if (!(meta->data.capacity & BES_BUFFER_INLINE))
+	{
+		/* The capacity is what the usable size of the allocation had room
+		 * for, which keeps the size inside the size class it came from. */
+		bes_free_sized(meta, meta->data.capacity * type_size + sizeof *meta);
+	}
 }
 
 bes_bool
@@ -69,7 +510,6 @@ bes_buffer_read(void *const data_,
 {
 	BES_ASSERT(data_);
 	BES_ASSERT(offset_);
-	BES_ASSERT(buffer);
 
 	/* Check to see if the read is within the bounds of the buffer */
 	const bes_size buffer_size = bes_buffer_size(buffer);
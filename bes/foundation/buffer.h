@@ -50,6 +50,21 @@ union bes_buffer_data
 BES_STATIC_ASSERT(sizeof(bes_buffer_data) == BES_ALIGNMENT);
 #endif
 
+/**
+ * @brief Set in the capacity of buffers kept in reserved virtual memory,
+ * see @ref bes_buffer_init_virtual
+ */
+#define BES_BUFFER_VIRTUAL ((bes_size)1 << (sizeof(bes_size) * 8 - 1))
+
+/**
+ * @brief Set in the capacity of buffers kept in storage of the caller,
+ * see @ref bes_buffer_init_inline
+ */
+#define BES_BUFFER_INLINE ((bes_size)1 << (sizeof(bes_size) * 8 - 2))
+
+/** @brief Every flag kept in the capacity of a buffer */
+#define BES_BUFFER_FLAGS (BES_BUFFER_VIRTUAL | BES_BUFFER_INLINE)
+
 /**
  * @brief Source code annotation for buffer objects.
  *
@@ -93,7 +108,7 @@ BES_STATIC_ASSERT(sizeof(bes_buffer_data) == BES_ALIGNMENT);
  * that is BES_TRUE on success.
  */
 #define bes_buffer_try_grow(BUFFER, SIZE) \
-	(((BUFFER) && bes_buffer_meta(BUFFER)->data.size + (SIZE) < bes_buffer_meta(BUFFER)->data.capacity) \
+	(((BUFFER) && bes_buffer_meta(BUFFER)->data.size + (SIZE) < (bes_buffer_meta(BUFFER)->data.capacity & ~BES_BUFFER_FLAGS)) \
 		? BES_TRUE \
 		: bes_buffer_grow((void **)&(BUFFER), (SIZE), sizeof *(BUFFER)))
 
@@ -105,6 +120,13 @@ BES_STATIC_ASSERT(sizeof(bes_buffer_data) == BES_ALIGNMENT);
 #define bes_buffer_size(BUFFER) \
 	((BUFFER) ? bes_buffer_meta(BUFFER)->data.size : 0)
 
+/**
+ * @brief Get the number of elements a buffer has room for
+ * @param BUFFER The buffer object
+ */
+#define bes_buffer_capacity(BUFFER) \
+	((BUFFER) ? bes_buffer_meta(BUFFER)->data.capacity & ~BES_BUFFER_FLAGS : 0)
+
 /**
  * @brief Expand a buffer with more elements
  *
@@ -154,7 +176,7 @@ BES_STATIC_ASSERT(sizeof(bes_buffer_data) == BES_ALIGNMENT);
  * reused safely.
  */
 #define bes_buffer_free(BUFFER) \
-	(void)((BUFFER) ? (bes_buffer_delete(BUFFER), (BUFFER) = 0) : 0)
+	(void)((BUFFER) ? (bes_buffer_delete((BUFFER), sizeof *(BUFFER)), (BUFFER) = 0) : 0)
 
 /**
  * @brief Resize a buffer to specified size
@@ -181,6 +203,141 @@ BES_STATIC_ASSERT(sizeof(bes_buffer_data) == BES_ALIGNMENT);
 			? (bes_buffer_meta(BUFFER)->data.size = (SIZE), BES_TRUE) \
 			: BES_FALSE))
 
+/**
+ * @brief Keep a buffer in reserved virtual memory so it never moves
+ *
+ * @param BUFFER The buffer object
+ * @param CAPACITY The most elements the buffer will ever hold
+ *
+ * Address space for @p CAPACITY elements is reserved once and pages are
+ * committed as the buffer grows. Growing never copies the contents and
+ * pointers to elements stay valid for as long as the buffer lives, which
+ * suits very large buffers where doubling and copying would cause latency
+ * spikes and need three times the memory at its peak.
+ *
+ * @note The contents of a buffer which isn't empty are moved into the
+ * reservation.
+ * @note Growing beyond the reservation, @p CAPACITY elements rounded up
+ * to whole pages, fails and leaves the buffer as it was.
+ * @note Only the pages holding elements use memory, so reserving far more
+ * than needed only costs address space.
+ *
+ * @return This macro expands to an expression yielding a boolean result
+ * that is BES_TRUE on success, BES_FALSE if the platform doesn't support
+ * reserving address space or the reservation failed.
+ */
+#define bes_buffer_init_virtual(BUFFER, CAPACITY) \
+	bes_buffer_virtual((void **)&(BUFFER), (CAPACITY), sizeof *(BUFFER))
+
+/**
+ * @brief Declare storage for a buffer of up to some amount of elements
+ *
+ * @param TYPE The type of the elements
+ * @param COUNT The amount of elements the storage holds
+ *
+ * Expands to a structure type, for a local variable or a member, which
+ * is handed to @ref bes_buffer_init_inline.
+ */
+#define BES_BUFFER_STORAGE(TYPE, COUNT) \
+	struct { bes_buffer_data meta; TYPE data[(COUNT) + 1]; }
+
+/**
+ * @brief Keep the first elements of a buffer in storage of the caller
+ *
+ * @param BUFFER The buffer object
+ * @param STORAGE The storage, declared with @ref BES_BUFFER_STORAGE
+ *
+ * The buffer uses the storage until it outgrows it and only then moves
+ * to the heap. Buffers which usually stay small, like most temporary
+ * collections, then never reach the allocator. The buffer is used with
+ * the same macros as any other buffer.
+ *
+ * @note Freeing a buffer which never outgrew its storage doesn't reach
+ * the allocator either. Storage isn't reused once outgrown or freed.
+ * @warning The storage must outlive the buffer, or its contents must have
+ * moved to the heap by then. The buffer must be empty before this, its
+ * contents aren't freed.
+ * @note Unlike other buffers the contents are only aligned like the
+ * element type unless the storage itself is aligned by
+ * @ref BES_ALIGNMENT.
+ *
+ * @return This macro expands to an expression yielding the buffer object.
+ */
+#define bes_buffer_init_inline(BUFFER, STORAGE) \
+	((BUFFER) = bes_buffer_inline(&(STORAGE), sizeof (STORAGE).data / sizeof *(BUFFER)))
+
+/**
+ * @brief Make room for at least some amount of elements
+ *
+ * @param BUFFER The buffer object
+ * @param CAPACITY The amount of elements to make room for
+ *
+ * Buffers whose final size is known up front can be sized once instead
+ * of growing, and without the slack growth leaves.
+ *
+ * @note Nothing is done when the buffer already has room.
+ *
+ * @return This macro expands to an expression yielding a boolean result
+ * that is BES_TRUE on success.
+ */
+#define bes_buffer_reserve(BUFFER, CAPACITY) \
+	(bes_buffer_capacity(BUFFER) > (CAPACITY) \
+		? BES_TRUE \
+		: bes_buffer_reserve_capacity((void **)&(BUFFER), (CAPACITY), sizeof *(BUFFER)))
+
+/**
+ * @brief Give back the room a buffer has beyond its elements
+ *
+ * @param BUFFER The buffer object
+ *
+ * @note An empty buffer is freed and set to NULL. Buffers kept in virtual
+ * memory decommit the pages past their elements and keep their
+ * reservation.
+ * @note The buffer is left as it was when it can't be shrunk.
+ */
+#define bes_buffer_shrink_to_fit(BUFFER) \
+	(void)((BUFFER) ? (bes_buffer_shrink((void **)&(BUFFER), sizeof *(BUFFER)), 0) : 0)
+
+/** @brief How buffers grow when they run out of room */
+enum bes_buffer_growth
+{
+	/** Double the capacity, the default */
+	BES_BUFFER_GROWTH_DOUBLE,
+
+	/** Grow the capacity by half, wasting less memory for more copies */
+	BES_BUFFER_GROWTH_HALF,
+
+	/** Grow by a fixed amount of bytes, for buffers growing at a known rate */
+	BES_BUFFER_GROWTH_STEP,
+
+	/**
+	 * Double the capacity and round the allocation up to whole pages, for
+	 * large buffers whose allocations are mapped a page at a time
+	 */
+	BES_BUFFER_GROWTH_PAGES
+};
+
+typedef enum bes_buffer_growth bes_buffer_growth;
+
+/**
+ * @brief Set how buffers grow on the calling thread
+ *
+ * @param growth The growth policy
+ * @param step The amount of bytes grown by with @ref BES_BUFFER_GROWTH_STEP,
+ * ignored otherwise
+ *
+ * Growth always makes room for at least what is asked for and requests
+ * are rounded up to @ref BES_ALIGNMENT so they line up with the size
+ * classes of allocators. Whatever an allocator rounds a request up to is
+ * made use of as capacity.
+ *
+ * @note Buffers kept in virtual memory commit pages as they grow and
+ * aren't affected.
+ * @warning The growth policy is thread local.
+ */
+BES_EXPORT void BES_API
+bes_buffer_set_growth(bes_buffer_growth growth, bes_size step);
+
 /**
  * @brief Clear the contents of the buffer
  * @param BUFFER The buffer object
@@ -189,6 +346,86 @@ BES_STATIC_ASSERT(sizeof(bes_buffer_data) == BES_ALIGNMENT);
 #define bes_buffer_clear(BUFFER) \
 	(void)((BUFFER) ? bes_buffer_meta(BUFFER)->data.size = 0 : 0)
 
+/**
+ * @brief Replace a range of elements of a buffer with others
+ *
+ * @param BUFFER The buffer object
+ * @param INDEX The index of the first element to replace
+ * @param ERASE The amount of elements to replace
+ * @param DATA The elements to replace them with, or NULL to leave the
+ * new elements uninitialized
+ * @param COUNT The amount of elements in @p DATA
+ *
+ * The buffer grows at most once, then the elements after the range are
+ * moved in one go and @p DATA is copied in, however many elements are
+ * involved.
+ *
+ * @note The order of the elements is kept.
+ * @warning @p DATA must not point into the buffer itself, growing may
+ * move it.
+ * @warning The range must be within the buffer.
+ *
+ * @return This macro expands to an expression yielding a boolean result
+ * that is BES_TRUE on success.
+ */
+#define bes_buffer_splice(BUFFER, INDEX, ERASE, DATA, COUNT) \
+	bes_buffer_splice_elements((void **)&(BUFFER), (INDEX), (ERASE), (DATA), (COUNT), sizeof *(BUFFER))
+
+/**
+ * @brief Insert elements into a buffer
+ *
+ * @param BUFFER The buffer object
+ * @param INDEX The index to insert at, which may be the size of the buffer
+ * @param DATA The elements to insert, or NULL to leave them uninitialized
+ * @param COUNT The amount of elements to insert
+ *
+ * @return This macro expands to an expression yielding a boolean result
+ * that is BES_TRUE on success.
+ */
+#define bes_buffer_insert_n(BUFFER, INDEX, DATA, COUNT) \
+	bes_buffer_splice((BUFFER), (INDEX), 0, (DATA), (COUNT))
+
+/**
+ * @brief Append elements to a buffer
+ *
+ * @param BUFFER The buffer object
+ * @param DATA The elements to append, or NULL to leave them uninitialized
+ * @param COUNT The amount of elements to append
+ *
+ * @return This macro expands to an expression yielding a boolean result
+ * that is BES_TRUE on success.
+ */
+#define bes_buffer_append_n(BUFFER, DATA, COUNT) \
+	bes_buffer_splice((BUFFER), bes_buffer_size(BUFFER), 0, (DATA), (COUNT))
+
+/**
+ * @brief Erase elements from a buffer, keeping the order of the rest
+ *
+ * @param BUFFER The buffer object
+ * @param INDEX The index of the first element to erase
+ * @param COUNT The amount of elements to erase
+ *
+ * @note Erasing never fails.
+ */
+#define bes_buffer_erase_n(BUFFER, INDEX, COUNT) \
+	(void)bes_buffer_splice((BUFFER), (INDEX), (COUNT), 0, 0)
+
+/**
+ * @brief Remove an element from a buffer by moving the last one into its
+ * place
+ *
+ * @param BUFFER The buffer object
+ * @param INDEX The index of the element to remove
+ *
+ * Cheaper than @ref bes_buffer_erase_n when the order of the elements
+ * doesn't matter, only a single element is moved.
+ *
+ * @note The buffer object must be a valid buffer object and @p INDEX must
+ * be within it.
+ */
+#define bes_buffer_swap_remove(BUFFER, INDEX) \
+	bes_buffer_swap_remove_element((BUFFER), (INDEX), sizeof *(BUFFER))
+
 /**
  * @brief Generic resizing function used by the macros above
  *
@@ -196,6 +433,7 @@ BES_STATIC_ASSERT(sizeof(bes_buffer_data) == BES_ALIGNMENT);
  * @param elements The amount of elements to append
  * @param type_size The size of the type the buffer object encapsulates
  *
+ * @note On failure the buffer is left as it was.
  * @return On success the function returns BES_TRUE.
  */
 BES_EXPORT bes_bool BES_API
@@ -203,16 +441,108 @@ bes_buffer_grow(void **const buffer,
                 bes_size elements,
                 bes_size type_size);
 
+/**
+ * @brief Move a buffer into reserved virtual memory, used by
+ * @ref bes_buffer_init_virtual
+ *
+ * @param buffer The buffer object
+ * @param capacity The most elements the buffer will ever hold
+ * @param type_size The size of the type the buffer object encapsulates
+ *
+ * @return On success the function returns BES_TRUE.
+ */
+BES_EXPORT bes_bool BES_API
+bes_buffer_virtual(void **const buffer,
+                   bes_size capacity,
+                   bes_size type_size);
+
+/**
+ * @brief Make a buffer of storage of the caller, used by
+ * @ref bes_buffer_init_inline
+ *
+ * @param storage The storage, a meta data header followed by the elements
+ * @param capacity The amount of elements after the header
+ *
+ * @return The buffer object.
+ */
+BES_EXPORT void* BES_API
+bes_buffer_inline(void *const storage,
+                  bes_size capacity);
+
+/**
+ * @brief Replace a range of elements, used by @ref bes_buffer_splice and
+ * the macros built on it
+ *
+ * @param buffer The buffer object
+ * @param index The index of the first element to replace
+ * @param erase The amount of elements to replace
+ * @param data The elements to replace them with, or NULL
+ * @param count The amount of elements in @p data
+ * @param type_size The size of the type the buffer object encapsulates
+ *
+ * @return On success the function returns BES_TRUE.
+ */
+BES_EXPORT bes_bool BES_API
+bes_buffer_splice_elements(void **const buffer,
+                           bes_size index,
+                           bes_size erase,
+                           const void *const data,
+                           bes_size count,
+                           bes_size type_size);
+
+/**
+ * @brief Remove an element by moving the last one into its place, used by
+ * @ref bes_buffer_swap_remove
+ *
+ * @param buffer The buffer object
+ * @param index The index of the element to remove
+ * @param type_size The size of the type the buffer object encapsulates
+ */
+BES_EXPORT void BES_API
+bes_buffer_swap_remove_element(void *const buffer,
+                               bes_size index,
+                               bes_size type_size);
+
+/**
+ * @brief Make room for an amount of elements, used by
+ * @ref bes_buffer_reserve
+ *
+ * @param buffer The buffer object
+ * @param capacity The amount of elements to make room for
+ * @param type_size The size of the type the buffer object encapsulates
+ *
+ * @return On success the function returns BES_TRUE.
+ */
+BES_EXPORT bes_bool BES_API
+bes_buffer_reserve_capacity(void **const buffer,
+                            bes_size capacity,
+                            bes_size type_size);
+
+/**
+ * @brief Give back the room beyond the elements of a buffer, used by
+ * @ref bes_buffer_shrink_to_fit
+ *
+ * @param buffer The buffer object
+ * @param type_size The size of the type the buffer object encapsulates
+ *
+ * @warning Do not pass an empty buffer object to this function.
+ */
+BES_EXPORT void BES_API
+bes_buffer_shrink(void **const buffer,
+                  bes_size type_size);
+
 /**
  * @brief Delete a buffer object
  * @param buffer The buffer object
+ * @param type_size The size of the type the buffer object encapsulates
  * @warning Do not pass an empty buffer object to this function.
  * @warning Do not use this function directly, use @ref bes_buffer_free
  * instead. The former ensures the buffer object isn't empty and resets
  * the pointer to make it safe to reuse.
  */
 BES_EXPORT void BES_API
-bes_buffer_delete(void *const buffer);
+bes_buffer_delete(void *const buffer,
+                  bes_size type_size);
 
 /**
  * @brief Write arbitrary data into a byte buffer
@@ -100,6 +100,8 @@
 	__attribute__((__always_inline__)) inline
 #define BES_RESTRICT \
 	restrict
+#define BES_THREAD_LOCAL \
+	__thread
 #elif defined(BES_COMPILER_MSVC) || defined(BES_COMPILER_INTEL)
 #define BES_ATTRIBUTE_ALIGN(a) \
 	__declspec(align(a))
@@ -107,11 +109,21 @@
 	__forceinline
 #define BES_RESTRICT \
 	__restrict
+#define BES_THREAD_LOCAL \
+	__declspec(thread)
 #endif
 
 #define BES_ALIGNMENT 16
+#define BES_CACHE_LINE_SIZE 64
 #define BES_EXPORT
 #define BES_API
+
+/* Assertions are only checked in debug builds. */
+#if defined(BES_DEBUG)
+#include <assert.h>
+#define BES_ASSERT(...) assert(__VA_ARGS__)
+#else
 #define BES_ASSERT(...)
+#endif
 
 #endif
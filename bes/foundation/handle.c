@@ -0,0 +1,487 @@
+/* clock_gettime is POSIX. */
+#define _POSIX_C_SOURCE 199309L
+
+#include <bes/foundation/handle.h>
+#include <bes/foundation/string.h>
+
+#if defined(BES_PLATFORM_LINUX)
+#include <time.h>
+#endif
+
+/* Blocks are laid out back to back from the base of the region, each
+ * starting with a header recording its size, including the header, and
+ * the handle that refers to it. Free blocks have no handle and sit between
+ * the base and the top, the end of the blocks made so far. Runs of free
+ * blocks are merged as they are found.
+ *
+ * The handle table maps handles to blocks. Handle n is entry n - 1, and
+ * unused entries are linked through their next field. */
+typedef struct bes_handle_block bes_handle_block;
+typedef union bes_handle_block_data bes_handle_block_data;
+
+struct bes_handle_block
+{
+	bes_size size;
+	bes_size handle;
+};
+
+union bes_handle_block_data
+{
+	bes_handle_block data;
+	bes_byte aligned[(sizeof(bes_handle_block) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT];
+};
+
+struct bes_handle_entry
+{
+	bes_byte *block;
+	bes_u32 locks;
+	bes_u32 next;
+};
+
+#define BES_HANDLE_HEADER sizeof(bes_handle_block_data)
+
+static inline bes_handle_block*
+bes_handle_block_at(bes_byte *const block)
+{
+	return &((bes_handle_block_data *)block)->data;
+}
+
+static inline bes_handle_entry*
+bes_handle_entry_of(const bes_handle_heap *const heap, bes_handle handle)
+{
+	BES_ASSERT(handle && handle <= heap->handles);
+	return &heap->entries[handle - 1];
+}
+
+/* Lower the top to the given block. Compaction resumes from the base when
+ * its cursor was past it, since blocks made from the top later may span
+ * the cursor. */
+static inline void
+bes_handle_lower(bes_handle_heap *const heap, bes_byte *const top)
+{
+	heap->top = top;
+	if (heap->cursor > top)
+	{
+		heap->cursor = heap->base;
+	}
+}
+
+static inline void
+bes_handle_block_free(bes_byte *const block, bes_size size)
+{
+	bes_handle_block *const header = bes_handle_block_at(block);
+	header->size = size;
+	header->handle = 0;
+}
+
+/* Merge the free blocks following the free block at the given address into
+ * it. A run reaching the top is given back to the top instead. Returns the
+ * size of the merged block, zero when it was given back. */
+static bes_size
+bes_handle_merge(bes_handle_heap *const heap, bes_byte *const block)
+{
+	bes_handle_block *const header = bes_handle_block_at(block);
+	bes_byte *next = block + header->size;
+	while (next < heap->top && !bes_handle_block_at(next)->handle)
+	{
+		/* Compaction resumes at a block boundary, the start of the run is
+		 * as good a place as the block it was at. */
+		if (next == heap->cursor)
+		{
+			heap->cursor = block;
+		}
+		header->size += bes_handle_block_at(next)->size;
+		next = block + header->size;
+	}
+
+	if (next == heap->top)
+	{
+		heap->gaps -= header->size;
+		bes_handle_lower(heap, block);
+		return 0;
+	}
+
+	return header->size;
+}
+
+/* Give a block back, to the top when it's the last one. */
+static void
+bes_handle_release(bes_handle_heap *const heap, bes_byte *const block, bes_size size)
+{
+	heap->used -= size;
+	if (block + size == heap->top)
+	{
+		bes_handle_lower(heap, block);
+	}
+	else
+	{
+		bes_handle_block_free(block, size);
+		heap->gaps += size;
+	}
+}
+
+/* Take the front of a free block, leaving the rest free. */
+static void
+bes_handle_split(bes_handle_heap *const heap, bes_byte *const block, bes_size size, bes_size take)
+{
+	if (size > take)
+	{
+		bes_handle_block_free(block + take, size - take);
+	}
+	heap->gaps -= take;
+}
+
+/* Find room for a block, first after the top and then in the gaps. */
+static bes_byte*
+bes_handle_find(bes_handle_heap *const heap, bes_size size)
+{
+	if ((bes_size)(heap->end - heap->top) >= size)
+	{
+		bes_byte *const block = heap->top;
+		heap->top += size;
+		return block;
+	}
+
+	if (heap->gaps < size)
+	{
+		return 0;
+	}
+
+	for (bes_byte *block = heap->base; block < heap->top; block += bes_handle_block_at(block)->size)
+	{
+		if (bes_handle_block_at(block)->handle)
+		{
+			continue;
+		}
+
+		const bes_size available = bes_handle_merge(heap, block);
+		if (!available)
+		{
+			/* The run reached the top, which may now have room. */
+			if ((bes_size)(heap->end - heap->top) >= size)
+			{
+				heap->top += size;
+				return block;
+			}
+			return 0;
+		}
+
+		if (available >= size)
+		{
+			bes_handle_split(heap, block, available, size);
+			return block;
+		}
+	}
+
+	return 0;
+}
+
+static bes_byte*
+bes_handle_place(bes_handle_heap *const heap, bes_size size)
+{
+	bes_byte *block = bes_handle_find(heap, size);
+	if (!block && heap->gaps)
+	{
+		/* Compaction resumes from where a budgeted pass stopped, which
+		 * would leave the gaps below it open. */
+		heap->cursor = heap->base;
+		bes_handle_heap_compact(heap, BES_HANDLE_HEAP_UNBOUNDED);
+		block = bes_handle_find(heap, size);
+	}
+	return block;
+}
+
+/* The size of a block holding the given amount of bytes, zero when that
+ * can't fit in the heap at all. */
+static inline bes_size
+bes_handle_block_size(const bes_handle_heap *const heap, bes_size size)
+{
+	if (size > (bes_size)(heap->end - heap->base))
+	{
+		return 0;
+	}
+	return ((size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT) + BES_HANDLE_HEADER;
+}
+
+bes_bool
+bes_handle_heap_init(bes_handle_heap *const heap,
+                     void *const region,
+                     bes_size size,
+                     bes_u32 handles)
+{
+	BES_ASSERT(heap);
+
+	bes_byte *const base = (bes_byte *)(((bes_uintptr)region + BES_ALIGNMENT - 1) & -(bes_uintptr)BES_ALIGNMENT);
+	const bes_size slack = (bes_size)(base - (bes_byte *)region);
+	const bes_size table = (bes_size)handles * sizeof(bes_handle_entry);
+	if (!handles || size < slack + table)
+	{
+		return BES_FALSE;
+	}
+
+	/* The table is placed at the end and the blocks end where it starts. */
+	bes_byte *const end = base + ((size - slack - table) & -(bes_size)BES_ALIGNMENT);
+
+	heap->base = base;
+	heap->top = base;
+	heap->end = end;
+	heap->cursor = base;
+	heap->entries = (bes_handle_entry *)end;
+	heap->handles = handles;
+	heap->free = 1;
+	heap->used = 0;
+	heap->gaps = 0;
+	heap->moved = 0;
+
+	for (bes_u32 i = 0; i < handles; i++)
+	{
+		heap->entries[i].block = 0;
+		heap->entries[i].locks = 0;
+		heap->entries[i].next = i + 2 <= handles ? i + 2 : 0;
+	}
+
+	return BES_TRUE;
+}
+
+bes_handle
+bes_handle_alloc(bes_handle_heap *const heap, bes_size size)
+{
+	BES_ASSERT(heap);
+
+	size = bes_handle_block_size(heap, size);
+	if (!heap->free || !size)
+	{
+		return BES_HANDLE_INVALID;
+	}
+
+	bes_byte *const block = bes_handle_place(heap, size);
+	if (!block)
+	{
+		return BES_HANDLE_INVALID;
+	}
+
+	const bes_handle handle = heap->free;
+	bes_handle_entry *const entry = bes_handle_entry_of(heap, handle);
+	heap->free = entry->next;
+	entry->block = block;
+	entry->locks = 0;
+
+	bes_handle_block *const header = bes_handle_block_at(block);
+	header->size = size;
+	header->handle = handle;
+	heap->used += size;
+
+	return handle;
+}
+
+bes_bool
+bes_handle_realloc(bes_handle_heap *const heap, bes_handle handle, bes_size size)
+{
+	BES_ASSERT(heap);
+
+	bes_handle_entry *const entry = bes_handle_entry_of(heap, handle);
+	bes_byte *const block = entry->block;
+	bes_handle_block *const header = bes_handle_block_at(block);
+	const bes_size current = header->size;
+
+	size = bes_handle_block_size(heap, size);
+	if (!size)
+	{
+		return BES_FALSE;
+	}
+
+	if (size <= current)
+	{
+		if (size < current)
+		{
+			header->size = size;
+			bes_handle_release(heap, block + size, current - size);
+		}
+		return BES_TRUE;
+	}
+
+	/* Grow into the top or the free blocks that follow. */
+	bes_byte *const next = block + current;
+	const bes_size following = next < heap->top && !bes_handle_block_at(next)->handle
+		? bes_handle_merge(heap, next)
+		: 0;
+
+	/* The free block the block grows into may be where compaction resumes,
+	 * which then has to be the block itself. */
+	if (heap->cursor == next)
+	{
+		heap->cursor = block;
+	}
+
+	if (next == heap->top)
+	{
+		if ((bes_size)(heap->end - block) >= size)
+		{
+			heap->top = block + size;
+			header->size = size;
+			heap->used += size - current;
+			return BES_TRUE;
+		}
+	}
+	else if (current + following >= size)
+	{
+		bes_handle_split(heap, next, following, size - current);
+		header->size = size;
+		heap->used += size - current;
+		return BES_TRUE;
+	}
+
+	if (entry->locks)
+	{
+		return BES_FALSE;
+	}
+
+	/* Keep the block from moving should finding room compact the heap. */
+	entry->locks++;
+	bes_byte *const resize = bes_handle_place(heap, size);
+	entry->locks--;
+	if (!resize)
+	{
+		return BES_FALSE;
+	}
+
+	bes_memcpy(resize + BES_HANDLE_HEADER, block + BES_HANDLE_HEADER, current - BES_HANDLE_HEADER);
+	bes_handle_block *const moved = bes_handle_block_at(resize);
+	moved->size = size;
+	moved->handle = handle;
+	entry->block = resize;
+	heap->used += size;
+	bes_handle_release(heap, block, current);
+
+	return BES_TRUE;
+}
+
+void
+bes_handle_free(bes_handle_heap *const heap, bes_handle handle)
+{
+	BES_ASSERT(heap);
+
+	if (handle == BES_HANDLE_INVALID)
+	{
+		return;
+	}
+
+	bes_handle_entry *const entry = bes_handle_entry_of(heap, handle);
+	BES_ASSERT(!entry->locks);
+
+	bes_handle_release(heap, entry->block, bes_handle_block_at(entry->block)->size);
+	entry->block = 0;
+	entry->next = heap->free;
+	heap->free = handle;
+}
+
+void*
+bes_handle_lock(bes_handle_heap *const heap, bes_handle handle)
+{
+	bes_handle_entry *const entry = bes_handle_entry_of(heap, handle);
+	entry->locks++;
+	return entry->block + BES_HANDLE_HEADER;
+}
+
+void
+bes_handle_unlock(bes_handle_heap *const heap, bes_handle handle)
+{
+	bes_handle_entry *const entry = bes_handle_entry_of(heap, handle);
+	BES_ASSERT(entry->locks);
+	entry->locks--;
+}
+
+bes_size
+bes_handle_size(const bes_handle_heap *const heap, bes_handle handle)
+{
+	return bes_handle_block_at(bes_handle_entry_of(heap, handle)->block)->size - BES_HANDLE_HEADER;
+}
+
+#if defined(BES_PLATFORM_LINUX)
+static inline bes_u64
+bes_handle_clock(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (bes_u64)now.tv_sec * 1000000000 + (bes_u64)now.tv_nsec;
+}
+#endif
+
+/* Compaction slides every block which isn't locked down to the end of the
+ * block before it. The gap in front of the next block to move is kept as
+ * a free block between calls so the heap stays walkable, and compaction
+ * resumes at its start. Locked blocks stay where they are and the gap in
+ * front of them is left free. Once the top is reached the gap in front of
+ * it is given back to the top. */
+bes_bool
+bes_handle_heap_compact(bes_handle_heap *const heap, bes_u64 budget)
+{
+	BES_ASSERT(heap);
+
+#if defined(BES_PLATFORM_LINUX)
+	const bes_u64 start = budget != BES_HANDLE_HEAP_UNBOUNDED ? bes_handle_clock() : 0;
+#endif
+
+	bes_byte *destination = heap->cursor;
+	bes_byte *block = heap->cursor;
+	while (block < heap->top)
+	{
+		bes_handle_block *const header = bes_handle_block_at(block);
+		const bes_size size = header->size;
+		if (!header->handle)
+		{
+			block += size;
+			continue;
+		}
+
+		bes_handle_entry *const entry = bes_handle_entry_of(heap, (bes_handle)header->handle);
+		if (entry->locks)
+		{
+			if (destination != block)
+			{
+				bes_handle_block_free(destination, (bes_size)(block - destination));
+			}
+			block += size;
+			destination = block;
+			continue;
+		}
+
+		if (destination == block)
+		{
+			block += size;
+			destination = block;
+			continue;
+		}
+
+		bes_memmove(destination, block, size);
+		entry->block = destination;
+		heap->moved += size;
+		destination += size;
+		block += size;
+
+		if (budget != BES_HANDLE_HEAP_UNBOUNDED)
+		{
+#if defined(BES_PLATFORM_LINUX)
+			if (bes_handle_clock() - start >= budget)
+#endif
+			{
+				break;
+			}
+		}
+	}
+
+	if (block < heap->top)
+	{
+		if (destination != block)
+		{
+			bes_handle_block_free(destination, (bes_size)(block - destination));
+		}
+		heap->cursor = destination;
+		return BES_FALSE;
+	}
+
+	heap->gaps -= (bes_size)(heap->top - destination);
+	heap->top = destination;
+	heap->cursor = heap->base;
+	return BES_TRUE;
+}
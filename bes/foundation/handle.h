@@ -0,0 +1,168 @@
+#ifndef BES_FOUNDATION_HANDLE_H
+#define BES_FOUNDATION_HANDLE_H
+
+/**
+ * @defgroup Handle Handle heap
+ *
+ * @brief Relocatable heap over a fixed region of memory
+ *
+ * Long running processes fragment their heap until large allocations fail
+ * while plenty of memory is free in small pieces. The handle heap avoids
+ * this by moving blocks. Callers hold a handle rather than a pointer and
+ * lock it to get at the memory for as long as they use it. Blocks which
+ * aren't locked may be moved to close the gaps left by freed blocks.
+ *
+ * Blocks are made by bumping the end of the used memory, and from gaps
+ * when it runs out. Compaction slides unlocked blocks down over the gaps
+ * in front of them and is done incrementally, resuming where it left off,
+ * within a time budget given to @ref bes_handle_heap_compact. Calling it
+ * once a frame keeps the heap compact without ever pausing for long. When
+ * an allocation finds no room the heap is compacted in full.
+ *
+ * Locked blocks are never moved. Compaction closes the gaps around them
+ * as best it can, so locks are best kept short.
+ *
+ * @{
+ */
+
+#include <bes/foundation/types.h>
+#include <bes/foundation/macros.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief Handle to a block of a @ref bes_handle_heap
+ *
+ * Handles are small integers, zero is never a valid handle. A handle is
+ * reused once the block it refers to is freed.
+ */
+typedef bes_u32 bes_handle;
+
+/** @brief The handle which refers to nothing */
+#define BES_HANDLE_INVALID 0
+
+/** @brief Budget for @ref bes_handle_heap_compact without a time limit */
+#define BES_HANDLE_HEAP_UNBOUNDED ((bes_u64)-1)
+
+typedef struct bes_handle_heap bes_handle_heap;
+typedef struct bes_handle_entry bes_handle_entry;
+
+/**
+ * @brief Handle heap
+ * @warning The handle heap is not thread safe.
+ */
+struct bes_handle_heap
+{
+	bes_byte *base; /**< The start of the memory blocks are made from */
+	bes_byte *top; /**< The end of the blocks made so far */
+	bes_byte *end; /**< The end of the memory blocks are made from */
+	bes_byte *cursor; /**< Where compaction resumes */
+	bes_handle_entry *entries; /**< The handle table, placed at the end of the region */
+	bes_u32 handles; /**< The amount of entries in the handle table */
+	bes_u32 free; /**< The first unused handle */
+	bes_size used; /**< The amount of memory in blocks, including their headers */
+	bes_size gaps; /**< The amount of free memory below @ref top */
+	bes_u64 moved; /**< The amount of bytes moved by compaction */
+};
+
+/**
+ * @brief Initialize a handle heap over a region of memory
+ * @param heap The handle heap to initialize
+ * @param region The memory to allocate from, the handle table is placed
+ * at its end
+ * @param size The size of @p region
+ * @param handles The most blocks allocated at once
+ * @return BES_TRUE if successful, BES_FALSE if @p region is too small to
+ * hold the handle table.
+ */
+BES_EXPORT bes_bool BES_API
+bes_handle_heap_init(bes_handle_heap *const heap,
+                     void *const region,
+                     bes_size size,
+                     bes_u32 handles);
+
+/**
+ * @brief Allocate a block
+ * @param heap The handle heap
+ * @param size The size of the block
+ * @note The heap is compacted in full when there is no room otherwise.
+ * @return On failure this function returns @ref BES_HANDLE_INVALID
+ */
+BES_EXPORT bes_handle BES_API
+bes_handle_alloc(bes_handle_heap *const heap, bes_size size);
+
+/**
+ * @brief Resize a block, keeping its handle and contents
+ * @param heap The handle heap
+ * @param handle The block to resize
+ * @param size The size to resize the block to
+ * @note Locked blocks are only resized when they can be without moving.
+ * @return BES_TRUE if the block now holds @p size bytes, BES_FALSE if it's
+ * unchanged.
+ */
+BES_EXPORT bes_bool BES_API
+bes_handle_realloc(bes_handle_heap *const heap, bes_handle handle, bes_size size);
+
+/**
+ * @brief Free a block
+ * @param heap The handle heap
+ * @param handle The block to free
+ * @note It's safe to pass @ref BES_HANDLE_INVALID.
+ * @warning The block must not be locked.
+ */
+BES_EXPORT void BES_API
+bes_handle_free(bes_handle_heap *const heap, bes_handle handle);
+
+/**
+ * @brief Lock a block in place to use its memory
+ * @param heap The handle heap
+ * @param handle The block to lock
+ * @note Locks nest, the block can move again once every lock is undone
+ * with @ref bes_handle_unlock.
+ * @return The memory of the block, valid until it's unlocked
+ */
+BES_EXPORT void* BES_API
+bes_handle_lock(bes_handle_heap *const heap, bes_handle handle);
+
+/**
+ * @brief Undo a @ref bes_handle_lock
+ * @param heap The handle heap
+ * @param handle The block to unlock
+ */
+BES_EXPORT void BES_API
+bes_handle_unlock(bes_handle_heap *const heap, bes_handle handle);
+
+/**
+ * @brief Get the size of a block
+ * @param heap The handle heap
+ * @param handle The block
+ * @return The amount of bytes that can be used in the block
+ */
+BES_EXPORT bes_size BES_API
+bes_handle_size(const bes_handle_heap *const heap, bes_handle handle);
+
+/**
+ * @brief Compact the heap for a limited time
+ * @param heap The handle heap
+ * @param budget The time to spend in nanoseconds, or
+ * @ref BES_HANDLE_HEAP_UNBOUNDED to compact in full
+ * @note At least one block is moved when any can be, even with a budget
+ * too small to move it in. Without a monotonic clock, on platforms other
+ * than Linux, at most one block is moved unless the budget is unbounded.
+ * @return BES_TRUE when compaction reached the top of the heap, leaving
+ * gaps only in front of locked blocks, BES_FALSE when it ran out of time.
+ * The call after one that reached the top starts over from the base.
+ */
+BES_EXPORT bes_bool BES_API
+bes_handle_heap_compact(bes_handle_heap *const heap, bes_u64 budget);
+
+#if defined(__cplusplus)
+}
+#endif
+
+/**
+ * @}
+ */
+#endif
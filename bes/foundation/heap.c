@@ -0,0 +1,936 @@
+#include <bes/foundation/heap.h>
+#include <bes/foundation/atomic.h>
+#include <bes/foundation/string.h>
+#include <bes/foundation/vm.h>
+
+/* Slabs are aligned by their size so the slab an object belongs to is
+ * found by masking the address of the object. The header sits at the
+ * start of the slab and objects follow it.
+ *
+ * Everything but the remote list and the two flags is only touched by the
+ * thread owning the heap the slab belongs to. A slab is full while it is
+ * taken off the partial list of its size class, which is when a thread
+ * freeing an object into it must tell the owner, by flagging the slab and
+ * pushing it onto the delayed list of the heap. */
+typedef union bes_heap_page_header bes_heap_page_header;
+
+struct bes_heap_page
+{
+	bes_heap *heap;
+	bes_heap_page *next;
+	bes_heap_page *prev;
+	void *free;
+	bes_byte *unused;
+	bes_u32 size;
+	bes_u32 used;
+	bes_u32 capacity;
+	bes_u32 index;
+	void *volatile remote;
+	bes_heap_page *delayed_next;
+	volatile bes_u32 full;
+	volatile bes_u32 flagged;
+	bes_u32 purged;
+};
+
+union bes_heap_page_header
+{
+	bes_heap_page data;
+	bes_byte aligned[(sizeof(bes_heap_page) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT];
+};
+
+/* Spans are linked through a header placed in the slack needed to align
+ * the first slab of the span. */
+struct bes_heap_span
+{
+	bes_heap_span *next;
+};
+
+struct bes_heap
+{
+	bes_heap_allocator *owner;
+	bes_heap *next;
+	bes_heap *next_abandoned;
+	bes_heap_page *partial[BES_HEAP_CLASSES];
+	bes_heap_page *empty;
+	bes_heap_span *spans;
+	bes_byte *cursor;
+	bes_byte *end;
+	void *volatile delayed;
+};
+
+/* Every slab is registered by address in an open addressed table when its
+ * span is obtained. A large allocation never shares a slab with objects,
+ * so an allocation is large when the slab it would be in is not in the
+ * table. Zero marks a free slot.
+ *
+ * Slabs are only added, under the lock, and never removed before release,
+ * so threads look up slabs without taking the lock. A table that fills up
+ * is replaced by a larger copy, and the one it replaces is kept until
+ * release as other threads may still be looking up slabs in it. Every
+ * slab an object handed to a thread can be in was added before the object
+ * was handed over, so whichever table the thread sees has it. */
+typedef struct bes_heap_table bes_heap_table;
+
+struct bes_heap_table
+{
+	bes_heap_table *replaced;
+	bes_size slots;
+	void *volatile pages[];
+};
+
+/* The amount of slots the table starts with. */
+#define BES_HEAP_TABLE_SIZE 64
+
+/* Large allocations start with a header recording where the block from the
+ * backing allocator starts and how large the allocation is. The header
+ * sits right before the allocation, which is aligned inside the block. */
+typedef struct bes_heap_large bes_heap_large;
+typedef union bes_heap_large_header bes_heap_large_header;
+
+struct bes_heap_large
+{
+	bes_byte *base;
+	bes_size size;
+};
+
+union bes_heap_large_header
+{
+	bes_heap_large data;
+	bes_byte aligned[(sizeof(bes_heap_large) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT];
+};
+
+/* What is requested from the backing allocator for a large allocation. */
+#define BES_HEAP_LARGE_REQUEST(SIZE) \
+	((SIZE) + sizeof(bes_heap_large_header) + BES_ALIGNMENT - 1)
+
+BES_STATIC_ASSERT(BES_HEAP_MAX_SIZE <= BES_HEAP_PAGE_SIZE / 8);
+BES_STATIC_ASSERT((BES_HEAP_TABLE_SIZE & (BES_HEAP_TABLE_SIZE - 1)) == 0);
+
+/* The heap of the calling thread, for whichever heap allocator it last
+ * allocated from. */
+static BES_THREAD_LOCAL bes_heap *g_bes_heap;
+
+static inline bes_heap_page*
+bes_heap_page_of(const void *const data)
+{
+	return (bes_heap_page *)((bes_uintptr)data & -(bes_uintptr)BES_HEAP_PAGE_SIZE);
+}
+
+/* The first slab of a span. */
+static inline bes_byte*
+bes_heap_span_first(bes_heap_span *const span)
+{
+	return (bes_byte *)((bes_uintptr)((bes_byte *)(span + 1) + BES_HEAP_PAGE_SIZE - 1) & -(bes_uintptr)BES_HEAP_PAGE_SIZE);
+}
+
+static inline bes_size
+bes_heap_table_slot(const void *const page, bes_size mask)
+{
+	return (bes_size)((bes_uintptr)page / BES_HEAP_PAGE_SIZE) * (bes_size)0x9E3779B1u & mask;
+}
+
+static inline void
+bes_heap_table_insert(bes_heap_table *const table, void *const page)
+{
+	const bes_size mask = table->slots - 1;
+	bes_size slot = bes_heap_table_slot(page, mask);
+	while (bes_atomic_load_ptr(&table->pages[slot], BES_ATOMIC_RELAXED))
+	{
+		slot = (slot + 1) & mask;
+	}
+	bes_atomic_store_ptr(&table->pages[slot], page, BES_ATOMIC_RELAXED);
+}
+
+static inline bes_bool
+bes_heap_is_large(bes_heap_allocator *const heap_allocator, const void *const data)
+{
+	const bes_heap_table *const table = bes_atomic_load_ptr(&heap_allocator->table, BES_ATOMIC_ACQUIRE);
+	if (BES_UNLIKELY(!table))
+	{
+		return BES_TRUE;
+	}
+
+	void *const page = bes_heap_page_of(data);
+	const bes_size mask = table->slots - 1;
+	for (bes_size slot = bes_heap_table_slot(page, mask); ; slot = (slot + 1) & mask)
+	{
+		void *const entry = bes_atomic_load_ptr(&table->pages[slot], BES_ATOMIC_RELAXED);
+		if (entry == page)
+		{
+			return BES_FALSE;
+		}
+		if (!entry)
+		{
+			return BES_TRUE;
+		}
+	}
+}
+
+static inline bes_heap_large*
+bes_heap_large_of(const void *const data)
+{
+	return (bes_heap_large *)((const bes_heap_large_header *)data - 1);
+}
+
+/* The header of a large allocation in a block from the backing allocator,
+ * at the first aligned address in it. */
+static inline bes_heap_large*
+bes_heap_large_place(bes_byte *const base)
+{
+	return (bes_heap_large *)((bes_uintptr)(base + BES_ALIGNMENT - 1) & -(bes_uintptr)BES_ALIGNMENT);
+}
+
+static inline void
+bes_heap_link(bes_heap_page **const list, bes_heap_page *const page)
+{
+	page->prev = 0;
+	page->next = *list;
+	if (*list)
+	{
+		(*list)->prev = page;
+	}
+	*list = page;
+}
+
+static inline void
+bes_heap_unlink(bes_heap_page **const list, bes_heap_page *const page)
+{
+	if (page->prev)
+	{
+		page->prev->next = page->next;
+	}
+	else
+	{
+		*list = page->next;
+	}
+
+	if (page->next)
+	{
+		page->next->prev = page->prev;
+	}
+}
+
+static inline void
+bes_heap_lock(bes_heap_allocator *const heap_allocator)
+{
+	bes_u32 expected = 0;
+	while (!bes_atomic_cas_u32(&heap_allocator->lock, &expected, 1, BES_ATOMIC_ACQUIRE))
+	{
+		expected = 0;
+	}
+}
+
+static inline void
+bes_heap_unlock(bes_heap_allocator *const heap_allocator)
+{
+	bes_atomic_store_u32(&heap_allocator->lock, 0, BES_ATOMIC_RELEASE);
+}
+
+/* Register the slabs of a span, replacing the table with one twice the
+ * size when it would be more than half full. */
+static bes_bool
+bes_heap_table_add(bes_heap_allocator *const heap_allocator, bes_heap_span *const span)
+{
+	bes_heap_lock(heap_allocator);
+
+	bes_heap_table *table = heap_allocator->table;
+	const bes_size needed = (heap_allocator->registered + BES_HEAP_SPAN_PAGES) * 2;
+	if (!table || needed > table->slots)
+	{
+		bes_size slots = table ? table->slots : BES_HEAP_TABLE_SIZE;
+		while (slots < needed)
+		{
+			slots *= 2;
+		}
+
+		bes_allocator *const backing = heap_allocator->backing;
+		bes_heap_table *const grown = backing->allocate(backing, sizeof *grown + slots * sizeof *grown->pages);
+		if (!grown)
+		{
+			bes_heap_unlock(heap_allocator);
+			return BES_FALSE;
+		}
+
+		grown->replaced = table;
+		grown->slots = slots;
+		bes_memset((void *)grown->pages, 0, slots * sizeof *grown->pages);
+		for (bes_size i = 0; table && i < table->slots; i++)
+		{
+			if (table->pages[i])
+			{
+				bes_heap_table_insert(grown, table->pages[i]);
+			}
+		}
+
+		bes_atomic_store_ptr(&heap_allocator->table, grown, BES_ATOMIC_RELEASE);
+		table = grown;
+	}
+
+	bes_byte *const first = bes_heap_span_first(span);
+	for (bes_size i = 0; i < BES_HEAP_SPAN_PAGES; i++)
+	{
+		bes_heap_table_insert(table, first + i * BES_HEAP_PAGE_SIZE);
+	}
+	heap_allocator->registered += BES_HEAP_SPAN_PAGES;
+
+	bes_heap_unlock(heap_allocator);
+	return BES_TRUE;
+}
+
+/* Take every object freed into a slab by other threads and put them on
+ * its own free list. */
+static void
+bes_heap_collect(bes_heap_page *const page)
+{
+	void *const remote = bes_atomic_exchange_ptr(&page->remote, 0, BES_ATOMIC_ACQUIRE);
+	if (!remote)
+	{
+		return;
+	}
+
+	bes_u32 count = 1;
+	void *last = remote;
+	while (*(void **)last)
+	{
+		last = *(void **)last;
+		count++;
+	}
+
+	*(void **)last = page->free;
+	page->free = remote;
+	page->used -= count;
+}
+
+/* Collect the slabs which were full when other threads freed into them and
+ * put the ones with free objects back on their partial lists. */
+static void
+bes_heap_collect_delayed(bes_heap *const heap)
+{
+	bes_heap_page *page = bes_atomic_exchange_ptr(&heap->delayed, 0, BES_ATOMIC_ACQUIRE);
+	while (page)
+	{
+		bes_heap_page *const next = page->delayed_next;
+
+		/* Clearing the flag before collecting means an object freed after
+		 * the collection flags the slab again. */
+		bes_atomic_store_u32(&page->flagged, 0, BES_ATOMIC_SEQ_CST);
+		bes_heap_collect(page);
+
+		/* A slab may be flagged just as it is put back on its partial
+		 * list, in which case it is already where it belongs. */
+		if (page->full && page->used < page->capacity)
+		{
+			bes_atomic_store_u32(&page->full, 0, BES_ATOMIC_RELAXED);
+			if (page->used == 0)
+			{
+				bes_heap_link(&heap->empty, page);
+			}
+			else
+			{
+				bes_heap_link(&heap->partial[page->index], page);
+			}
+		}
+
+		page = next;
+	}
+}
+
+static bes_heap_page*
+bes_heap_page_new(bes_heap *const heap, bes_size index)
+{
+	bes_heap_page *page = heap->empty;
+	if (page)
+	{
+		bes_heap_unlink(&heap->empty, page);
+	}
+	else
+	{
+		if (heap->cursor == heap->end)
+		{
+			bes_heap_allocator *const heap_allocator = heap->owner;
+			bes_allocator *const backing = heap_allocator->backing;
+			bes_heap_span *const span = backing->allocate(backing,
+				sizeof *span + (BES_HEAP_SPAN_PAGES + 1) * BES_HEAP_PAGE_SIZE);
+			if (!span)
+			{
+				return 0;
+			}
+
+			if (!bes_heap_table_add(heap_allocator, span))
+			{
+				backing->deallocate(backing, span);
+				return 0;
+			}
+
+			bes_atomic_add_u64(&heap_allocator->spans, 1, BES_ATOMIC_RELAXED);
+			span->next = heap->spans;
+			heap->spans = span;
+			heap->cursor = bes_heap_span_first(span);
+			heap->end = heap->cursor + BES_HEAP_SPAN_PAGES * BES_HEAP_PAGE_SIZE;
+		}
+
+		page = (bes_heap_page *)heap->cursor;
+		heap->cursor += BES_HEAP_PAGE_SIZE;
+		page->heap = heap;
+		page->remote = 0;
+		page->full = 0;
+		page->flagged = 0;
+	}
+
+	const bes_size size = (index + 1) * BES_ALIGNMENT;
+
+	page->free = 0;
+	page->unused = (bes_byte *)page + sizeof(bes_heap_page_header);
+	page->size = (bes_u32)size;
+	page->used = 0;
+	page->capacity = (bes_u32)((BES_HEAP_PAGE_SIZE - sizeof(bes_heap_page_header)) / size);
+	page->index = (bes_u32)index;
+	page->purged = 0;
+
+	bes_heap_link(&heap->partial[index], page);
+
+	return page;
+}
+
+static bes_heap*
+bes_heap_new(bes_heap_allocator *const heap_allocator)
+{
+	bes_allocator *const backing = heap_allocator->backing;
+	bes_heap *const heap = backing->allocate(backing, sizeof *heap);
+	if (!heap)
+	{
+		return 0;
+	}
+
+	heap->owner = heap_allocator;
+	heap->next_abandoned = 0;
+	for (bes_size i = 0; i < BES_HEAP_CLASSES; i++)
+	{
+		heap->partial[i] = 0;
+	}
+	heap->empty = 0;
+	heap->spans = 0;
+	heap->cursor = 0;
+	heap->end = 0;
+	heap->delayed = 0;
+
+	bes_heap_lock(heap_allocator);
+	heap->next = heap_allocator->heaps;
+	heap_allocator->heaps = heap;
+	heap_allocator->count++;
+	bes_heap_unlock(heap_allocator);
+
+	return heap;
+}
+
+static void
+bes_heap_abandon(bes_heap *const heap)
+{
+	bes_heap_allocator *const heap_allocator = heap->owner;
+	bes_heap_lock(heap_allocator);
+	heap->next_abandoned = heap_allocator->abandoned;
+	heap_allocator->abandoned = heap;
+	bes_heap_unlock(heap_allocator);
+}
+
+/* Adopt a heap left by a thread which detached, or make a new one. A
+ * thread moving on from another heap allocator leaves its heap there. */
+static bes_heap*
+bes_heap_acquire(bes_heap_allocator *const heap_allocator)
+{
+	bes_heap_lock(heap_allocator);
+	bes_heap *heap = heap_allocator->abandoned;
+	if (heap)
+	{
+		heap_allocator->abandoned = heap->next_abandoned;
+	}
+	bes_heap_unlock(heap_allocator);
+
+	if (!heap)
+	{
+		heap = bes_heap_new(heap_allocator);
+		if (!heap)
+		{
+			return 0;
+		}
+	}
+
+	if (g_bes_heap)
+	{
+		bes_heap_abandon(g_bes_heap);
+	}
+
+	g_bes_heap = heap;
+	return heap;
+}
+
+static inline bes_heap*
+bes_heap_current(bes_heap_allocator *const heap_allocator)
+{
+	bes_heap *const heap = g_bes_heap;
+	if (BES_LIKELY(heap && heap->owner == heap_allocator))
+	{
+		return heap;
+	}
+	return bes_heap_acquire(heap_allocator);
+}
+
+static void*
+bes_heap_large_allocate(bes_heap_allocator *const heap_allocator, bes_size size)
+{
+	bes_allocator *const backing = heap_allocator->backing;
+	bes_byte *const base = backing->allocate(backing, BES_HEAP_LARGE_REQUEST(size));
+	if (!base)
+	{
+		return 0;
+	}
+
+	bes_heap_large *const large = bes_heap_large_place(base);
+	large->base = base;
+	large->size = size;
+
+	return (bes_heap_large_header *)large + 1;
+}
+
+/* Find a slab of the size class with a free object. */
+static inline bes_heap_page*
+bes_heap_page_find(bes_heap *const heap, bes_size index)
+{
+	bes_heap_page *page = heap->partial[index];
+	if (BES_UNLIKELY(!page))
+	{
+		bes_heap_collect_delayed(heap);
+		page = heap->partial[index];
+		if (!page)
+		{
+			page = bes_heap_page_new(heap, index);
+		}
+	}
+	return page;
+}
+
+/* Take an object from a slab with a free object, taking the slab off its
+ * partial list once it's full. */
+static inline void*
+bes_heap_page_take(bes_heap *const heap, bes_heap_page *const page)
+{
+	/* Objects freed by other threads are reused before carving out new
+	 * ones, keeping the slab compact. */
+	if (!page->free && bes_atomic_load_ptr(&page->remote, BES_ATOMIC_RELAXED))
+	{
+		bes_heap_collect(page);
+	}
+
+	void *data = page->free;
+	if (data)
+	{
+		page->free = *(void **)data;
+	}
+	else
+	{
+		data = page->unused;
+		page->unused += page->size;
+	}
+
+	if (++page->used == page->capacity)
+	{
+		/* Marking the slab full before looking for remote objects one last
+		 * time means a thread freeing into it either has its object
+		 * collected here or sees the mark and flags the slab. */
+		bes_atomic_store_u32(&page->full, 1, BES_ATOMIC_SEQ_CST);
+		if (bes_atomic_load_ptr(&page->remote, BES_ATOMIC_SEQ_CST))
+		{
+			bes_atomic_store_u32(&page->full, 0, BES_ATOMIC_RELAXED);
+			bes_heap_collect(page);
+		}
+		else
+		{
+			bes_heap_unlink(&heap->partial[page->index], page);
+		}
+	}
+
+	return data;
+}
+
+static void* BES_API
+bes_heap_allocate(bes_allocator *allocator, bes_size size)
+{
+	bes_heap_allocator *const heap_allocator = allocator->aux;
+
+	if (size > BES_HEAP_MAX_SIZE)
+	{
+		return bes_heap_large_allocate(heap_allocator, size);
+	}
+
+	bes_heap *const heap = bes_heap_current(heap_allocator);
+	if (BES_UNLIKELY(!heap))
+	{
+		return 0;
+	}
+
+	bes_heap_page *const page = bes_heap_page_find(heap, size ? (size - 1) / BES_ALIGNMENT : 0);
+	if (BES_UNLIKELY(!page))
+	{
+		return 0;
+	}
+
+	return bes_heap_page_take(heap, page);
+}
+
+static bes_size BES_API
+bes_heap_allocate_batch(bes_allocator *allocator, bes_size size, bes_size count, void **data)
+{
+	bes_heap_allocator *const heap_allocator = allocator->aux;
+
+	if (size > BES_HEAP_MAX_SIZE)
+	{
+		return 0;
+	}
+
+	bes_heap *const heap = bes_heap_current(heap_allocator);
+	if (BES_UNLIKELY(!heap))
+	{
+		return 0;
+	}
+
+	/* Take as many objects from each slab as it has before moving on. */
+	const bes_size index = size ? (size - 1) / BES_ALIGNMENT : 0;
+	bes_size made = 0;
+	while (made < count)
+	{
+		bes_heap_page *const page = bes_heap_page_find(heap, index);
+		if (!page)
+		{
+			break;
+		}
+
+		do
+		{
+			data[made++] = bes_heap_page_take(heap, page);
+		} while (made < count && !page->full);
+	}
+
+	return made;
+}
+
+static inline void
+bes_heap_large_deallocate(bes_heap_allocator *const heap_allocator, void *const data)
+{
+	bes_allocator *const backing = heap_allocator->backing;
+	backing->deallocate(backing, bes_heap_large_of(data)->base);
+}
+
+/* Push a chain of objects linked through their first word onto the remote
+ * list of the slab they belong to, all in one go. */
+static void
+bes_heap_remote_deallocate(bes_heap_page *const page, void *const first, void *const last)
+{
+	void *head = bes_atomic_load_ptr(&page->remote, BES_ATOMIC_RELAXED);
+	do
+	{
+		*(void **)last = head;
+	} while (!bes_atomic_cas_ptr(&page->remote, &head, first, BES_ATOMIC_SEQ_CST));
+
+	/* Only the first thread to free into a full slab tells the owner. */
+	bes_u32 expected = 0;
+	if (bes_atomic_load_u32(&page->full, BES_ATOMIC_SEQ_CST)
+		&& bes_atomic_cas_u32(&page->flagged, &expected, 1, BES_ATOMIC_ACQ_REL))
+	{
+		bes_heap *const heap = page->heap;
+		void *delayed = bes_atomic_load_ptr(&heap->delayed, BES_ATOMIC_RELAXED);
+		do
+		{
+			page->delayed_next = delayed;
+		} while (!bes_atomic_cas_ptr(&heap->delayed, &delayed, page, BES_ATOMIC_RELEASE));
+	}
+}
+
+static inline void
+bes_heap_object_deallocate(void *const data)
+{
+	bes_heap_page *const page = bes_heap_page_of(data);
+	bes_heap *const heap = page->heap;
+	if (heap != g_bes_heap)
+	{
+		bes_heap_remote_deallocate(page, data, data);
+		return;
+	}
+
+	*(void **)data = page->free;
+	page->free = data;
+
+	if (page->full)
+	{
+		bes_atomic_store_u32(&page->full, 0, BES_ATOMIC_RELAXED);
+		bes_heap_link(&heap->partial[page->index], page);
+	}
+
+	/* Slabs without objects can be reused by any size class. */
+	if (--page->used == 0)
+	{
+		bes_heap_unlink(&heap->partial[page->index], page);
+		bes_heap_link(&heap->empty, page);
+	}
+}
+
+static void BES_API
+bes_heap_deallocate(bes_allocator *allocator, void *data)
+{
+	if (bes_heap_is_large(allocator->aux, data))
+	{
+		bes_heap_large_deallocate(allocator->aux, data);
+	}
+	else
+	{
+		bes_heap_object_deallocate(data);
+	}
+}
+
+static void BES_API
+bes_heap_deallocate_sized(bes_allocator *allocator, void *data, bes_size size)
+{
+	if (size > BES_HEAP_MAX_SIZE)
+	{
+		bes_heap_large_deallocate(allocator->aux, data);
+	}
+	else
+	{
+		bes_heap_object_deallocate(data);
+	}
+}
+
+static void BES_API
+bes_heap_deallocate_batch(bes_allocator *allocator, void *const *data, bes_size count)
+{
+	/* Runs of objects from the same slab of another thread are chained
+	 * together and pushed onto its remote list at once. */
+	bes_heap_page *page = 0;
+	void *first = 0;
+	void *last = 0;
+
+	for (bes_size i = 0; i < count; i++)
+	{
+		void *const object = data[i];
+		if (bes_heap_is_large(allocator->aux, object))
+		{
+			bes_heap_large_deallocate(allocator->aux, object);
+			continue;
+		}
+
+		bes_heap_page *const owner = bes_heap_page_of(object);
+		if (owner->heap == g_bes_heap)
+		{
+			bes_heap_object_deallocate(object);
+			continue;
+		}
+
+		if (owner != page)
+		{
+			if (page)
+			{
+				bes_heap_remote_deallocate(page, first, last);
+			}
+			page = owner;
+			first = object;
+		}
+		else
+		{
+			*(void **)last = object;
+		}
+		last = object;
+	}
+
+	if (page)
+	{
+		bes_heap_remote_deallocate(page, first, last);
+	}
+}
+
+static void* BES_API
+bes_heap_reallocate(bes_allocator *allocator, void *data, bes_size size)
+{
+	bes_heap_allocator *const heap_allocator = allocator->aux;
+
+	bes_size capacity = 0;
+	if (bes_heap_is_large(allocator->aux, data))
+	{
+		bes_heap_large *const large = bes_heap_large_of(data);
+		if (size > BES_HEAP_MAX_SIZE)
+		{
+			/* Large allocations stay large, let the backing allocator
+			 * resize them and move the header and the data to the first
+			 * aligned address of the block when it moved elsewhere. */
+			bes_allocator *const backing = heap_allocator->backing;
+			const bes_size offset = (bes_size)((bes_byte *)large - large->base);
+			const bes_size preserve = size < large->size ? size : large->size;
+			bes_byte *const base = backing->reallocate(backing, large->base, BES_HEAP_LARGE_REQUEST(size));
+			if (!base)
+			{
+				return 0;
+			}
+
+			bes_heap_large *const resize = bes_heap_large_place(base);
+			if ((bes_byte *)resize != base + offset)
+			{
+				bes_memmove(resize, base + offset, sizeof(bes_heap_large_header) + preserve);
+			}
+
+			resize->base = base;
+			resize->size = size;
+			return (bes_heap_large_header *)resize + 1;
+		}
+		capacity = large->size;
+	}
+	else
+	{
+		capacity = bes_heap_page_of(data)->size;
+		if (size <= capacity && size > capacity - BES_ALIGNMENT)
+		{
+			return data;
+		}
+	}
+
+	void *const resize = bes_heap_allocate(allocator, size);
+	if (resize)
+	{
+		bes_memcpy(resize, data, size < capacity ? size : capacity);
+		bes_heap_deallocate(allocator, data);
+	}
+
+	return resize;
+}
+
+static bes_bool BES_API
+bes_heap_reallocate_in_place(bes_allocator *allocator, void *data, bes_size size)
+{
+	/* The size of a slab object is fixed when its slab is set up so any
+	 * thread can read it. */
+	if (bes_heap_is_large(allocator->aux, data))
+	{
+		return size > BES_HEAP_MAX_SIZE && size <= bes_heap_large_of(data)->size ? BES_TRUE : BES_FALSE;
+	}
+
+	return size <= bes_heap_page_of(data)->size ? BES_TRUE : BES_FALSE;
+}
+
+static bes_size BES_API
+bes_heap_usable_size(bes_allocator *allocator, const void *data)
+{
+	if (bes_heap_is_large(allocator->aux, data))
+	{
+		return bes_heap_large_of(data)->size;
+	}
+
+	/* Like the capacity, the size of a slab is fixed when it is set up. */
+	return bes_heap_page_of(data)->size;
+}
+
+/* Empty slabs of the heap of the calling thread give the memory behind
+ * their header back to the operating system. Spans can't be given back
+ * to the backing allocator since a thread freeing an object into a slab
+ * still reads its header after handing the object over, so the header
+ * stays. Objects freed by other threads are collected first, as they may
+ * leave slabs empty. */
+static bes_size BES_API
+bes_heap_trim(bes_allocator *allocator)
+{
+	bes_heap_allocator *const heap_allocator = allocator->aux;
+	bes_heap *const heap = g_bes_heap;
+	if (!heap || heap->owner != heap_allocator)
+	{
+		return 0;
+	}
+
+	bes_heap_collect_delayed(heap);
+
+	bes_size released = 0;
+	for (bes_heap_page *page = heap->empty; page; page = page->next)
+	{
+		if (!page->purged)
+		{
+			page->purged = 1;
+			released += bes_vm_purge((bes_byte *)page + sizeof(bes_heap_page_header),
+				BES_HEAP_PAGE_SIZE - sizeof(bes_heap_page_header));
+		}
+	}
+
+	return released;
+}
+
+void
+bes_heap_allocator_init(bes_heap_allocator *const heap_allocator,
+                        bes_allocator *const backing)
+{
+	BES_ASSERT(heap_allocator);
+
+	heap_allocator->allocator.allocate = &bes_heap_allocate;
+	heap_allocator->allocator.reallocate = &bes_heap_reallocate;
+	heap_allocator->allocator.deallocate = &bes_heap_deallocate;
+	heap_allocator->allocator.aux = heap_allocator;
+	heap_allocator->allocator.flags = 0;
+	heap_allocator->allocator.deallocate_sized = &bes_heap_deallocate_sized;
+	heap_allocator->allocator.alignment = BES_ALIGNMENT;
+	heap_allocator->allocator.usable_size = &bes_heap_usable_size;
+	heap_allocator->allocator.allocate_aligned = 0;
+	heap_allocator->allocator.reallocate_in_place = &bes_heap_reallocate_in_place;
+	heap_allocator->allocator.allocate_batch = &bes_heap_allocate_batch;
+	heap_allocator->allocator.deallocate_batch = &bes_heap_deallocate_batch;
+	heap_allocator->allocator.allocate_zeroed = 0;
+	heap_allocator->allocator.trim = &bes_heap_trim;
+	heap_allocator->backing = backing ? backing : bes_allocator_get();
+	heap_allocator->heaps = 0;
+	heap_allocator->abandoned = 0;
+	heap_allocator->count = 0;
+	heap_allocator->lock = 0;
+	heap_allocator->spans = 0;
+	heap_allocator->table = 0;
+	heap_allocator->registered = 0;
+
+	BES_ASSERT(heap_allocator->backing);
+}
+
+void
+bes_heap_allocator_detach(bes_heap_allocator *const heap_allocator)
+{
+	bes_heap *const heap = g_bes_heap;
+	if (heap && heap->owner == heap_allocator)
+	{
+		bes_heap_abandon(heap);
+		g_bes_heap = 0;
+	}
+}
+
+void
+bes_heap_allocator_release(bes_heap_allocator *const heap_allocator)
+{
+	if (g_bes_heap && g_bes_heap->owner == heap_allocator)
+	{
+		g_bes_heap = 0;
+	}
+
+	bes_allocator *const backing = heap_allocator->backing;
+	bes_heap *heap = heap_allocator->heaps;
+	while (heap)
+	{
+		bes_heap *const next = heap->next;
+		bes_heap_span *span = heap->spans;
+		while (span)
+		{
+			bes_heap_span *const next_span = span->next;
+			backing->deallocate(backing, span);
+			span = next_span;
+		}
+		backing->deallocate(backing, heap);
+		heap = next;
+	}
+
+	bes_heap_table *table = heap_allocator->table;
+	while (table)
+	{
+		bes_heap_table *const replaced = table->replaced;
+		backing->deallocate(backing, table);
+		table = replaced;
+	}
+
+	bes_heap_allocator_init(heap_allocator, backing);
+}
@@ -0,0 +1,112 @@
+#ifndef BES_FOUNDATION_HEAP_H
+#define BES_FOUNDATION_HEAP_H
+
+/**
+ * @defgroup Heap Concurrent heap allocator
+ *
+ * @brief Size-class allocator for small objects shared between threads
+ *
+ * The heap allocator is a slab allocator any amount of threads can use at
+ * once. Every thread allocating from it is given a heap of its own, the
+ * slabs of which only that thread allocates from, so allocation and
+ * deallocation on the owning thread take no locks or atomic operations.
+ *
+ * Objects freed by another thread are pushed onto a lock-free list in the
+ * slab they came from, which the owning thread collects in one go once it
+ * runs out of objects in that slab. A full slab receiving such a free is
+ * pushed onto another lock-free list in the heap so its owner knows to
+ * collect it. Neither list is ever walked by the threads pushing to it, so
+ * the cost of freeing an object on another thread is a single atomic
+ * operation in the common case.
+ *
+ * A thread done with the allocator detaches from it, leaving its heap to
+ * be adopted whole by the next thread that needs one. Allocations larger
+ * than @ref BES_HEAP_MAX_SIZE are passed through to the backing allocator.
+ *
+ * @{
+ */
+
+#include <bes/foundation/memory.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** @brief The size and alignment of a slab */
+#define BES_HEAP_PAGE_SIZE 16384
+
+/** @brief The amount of slabs obtained from the backing allocator at once */
+#define BES_HEAP_SPAN_PAGES 8
+
+/** @brief The amount of size classes, spaced by @ref BES_ALIGNMENT */
+#define BES_HEAP_CLASSES 64
+
+/** @brief The largest allocation served from a slab */
+#define BES_HEAP_MAX_SIZE (BES_HEAP_CLASSES * BES_ALIGNMENT)
+
+typedef struct bes_heap_allocator bes_heap_allocator;
+typedef struct bes_heap bes_heap;
+typedef struct bes_heap_page bes_heap_page;
+typedef struct bes_heap_span bes_heap_span;
+
+/**
+ * @brief Concurrent heap allocator
+ *
+ * @warning The backing allocator must be thread safe, it is called from
+ * every thread using the heap allocator.
+ */
+struct bes_heap_allocator
+{
+	bes_allocator allocator; /**< The allocator interface of the heap allocator */
+	bes_allocator *backing; /**< The allocator heaps, spans and large allocations come from */
+	bes_heap *heaps; /**< Every heap made, guarded by the lock */
+	bes_heap *abandoned; /**< Heaps of threads which detached, guarded by the lock */
+	bes_size count; /**< The amount of heaps made, guarded by the lock */
+	volatile bes_u32 lock; /**< Guards making, adopting and abandoning heaps and adding to the table */
+	volatile bes_u64 spans; /**< The amount of spans obtained from the backing allocator */
+	void *volatile table; /**< The address of every slab, telling slab objects and large allocations apart */
+	bes_size registered; /**< The amount of slabs in the table, guarded by the lock */
+};
+
+/**
+ * @brief Initialize a heap allocator
+ * @param heap_allocator The heap allocator to initialize
+ * @param backing The allocator to obtain heaps, spans and large
+ * allocations from
+ * @note If @p backing is NULL the allocator set for the calling thread is
+ * used.
+ */
+BES_EXPORT void BES_API
+bes_heap_allocator_init(bes_heap_allocator *const heap_allocator,
+                        bes_allocator *const backing);
+
+/**
+ * @brief Detach the calling thread from a heap allocator
+ * @param heap_allocator The heap allocator
+ *
+ * The heap of the calling thread is left for the next thread to adopt,
+ * along with the objects in it that are still allocated. Threads should
+ * detach before they exit so their heaps aren't lost.
+ *
+ * @note Does nothing if the calling thread doesn't have a heap.
+ */
+BES_EXPORT void BES_API
+bes_heap_allocator_detach(bes_heap_allocator *const heap_allocator);
+
+/**
+ * @brief Return every heap and span to the backing allocator
+ * @param heap_allocator The heap allocator
+ * @warning Every thread other than the calling one must have detached and
+ * large allocations still outstanding are not released.
+ */
+BES_EXPORT void BES_API
+bes_heap_allocator_release(bes_heap_allocator *const heap_allocator);
+
+#if defined(__cplusplus)
+}
+#endif
+
+/**
+ * @}
+ */
+#endif
@@ -55,4 +55,18 @@
 #define BES_PURE
 #endif
 
+/* The address a function returns to, which identifies where it was
+ * called from. Evaluates to NULL where that can't be determined. */
+#if defined(BES_COMPILER_GCC) || defined(BES_COMPILER_CLANG)
+#define BES_RETURN_ADDRESS() \
+	__builtin_return_address(0)
+#elif defined(BES_COMPILER_MSVC)
+#include <intrin.h>
+#define BES_RETURN_ADDRESS() \
+	_ReturnAddress()
+#else
+#define BES_RETURN_ADDRESS() \
+	((void *)0)
+#endif
+
 #endif
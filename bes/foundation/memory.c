@@ -1,42 +1,243 @@
 #include <bes/foundation/memory.h>
+#include <bes/foundation/string.h>
+#include <bes/foundation/atomic.h>
+#include <bes/foundation/bits.h>
+#include <bes/foundation/stream.h>
 
-static bes_allocator *g_bes_allocator;
+#if defined(BES_PLATFORM_LINUX)
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#elif defined(BES_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
 
-bes_bool
-bes_allocator_set(bes_allocator *const allocator)
+static BES_THREAD_LOCAL bes_allocator *g_bes_allocator;
+static BES_THREAD_LOCAL bes_bool g_bes_headerless;
+
+/* The allocators below the one in use, pushed with bes_allocator_push.
+ * Allocations are never headerless while any are pushed. */
+static BES_THREAD_LOCAL bes_allocator *g_bes_allocator_stack[BES_ALLOCATOR_STACK_DEPTH];
+static BES_THREAD_LOCAL bes_u32 g_bes_allocator_depth;
+
+/* Blocks freed on a thread are kept on a free list per rounded size and
+ * handed back out by the same thread without calling into the allocator.
+ * Only blocks owned by the allocator set for the thread are kept, which
+ * is why the cache is flushed whenever that allocator changes. */
+#define BES_CACHE_CLASSES 32
+#define BES_CACHE_DEPTH 32
+
+typedef struct bes_cache bes_cache;
+
+struct bes_cache
 {
-	BES_ASSERT(allocator);
+	void *blocks[BES_CACHE_CLASSES];
+	bes_u32 count[BES_CACHE_CLASSES];
+	bes_bool registered;
+};
 
-	if (allocator->allocate && allocator->reallocate && allocator->deallocate)
+static BES_THREAD_LOCAL bes_cache g_bes_cache;
+
+/* A thread flushes its cache when it exits, through a destructor it
+ * registers the first time it caches a block. Destructors which free
+ * memory after it ran register it again. */
+#if defined(BES_PLATFORM_LINUX)
+static pthread_once_t g_bes_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_bes_cache_key;
+
+static void
+bes_cache_exit(void *data)
+{
+	(void)data;
+	g_bes_cache.registered = BES_FALSE;
+	bes_allocator_flush();
+}
+
+static void
+bes_cache_key_create(void)
+{
+	pthread_key_create(&g_bes_cache_key, &bes_cache_exit);
+}
+#elif defined(BES_PLATFORM_WINDOWS)
+static INIT_ONCE g_bes_cache_once = INIT_ONCE_STATIC_INIT;
+static DWORD g_bes_cache_key = FLS_OUT_OF_INDEXES;
+
+static VOID NTAPI
+bes_cache_exit(PVOID data)
+{
+	(void)data;
+	g_bes_cache.registered = BES_FALSE;
+	bes_allocator_flush();
+}
+
+static BOOL CALLBACK
+bes_cache_key_create(PINIT_ONCE once, PVOID parameter, PVOID *context)
+{
+	(void)once;
+	(void)parameter;
+	(void)context;
+	g_bes_cache_key = FlsAlloc(&bes_cache_exit);
+	return TRUE;
+}
+#endif
+
+static void
+bes_cache_register(void)
+{
+	g_bes_cache.registered = BES_TRUE;
+#if defined(BES_PLATFORM_LINUX)
+	pthread_once(&g_bes_cache_once, &bes_cache_key_create);
+	pthread_setspecific(g_bes_cache_key, &g_bes_cache);
+#elif defined(BES_PLATFORM_WINDOWS)
+	InitOnceExecuteOnce(&g_bes_cache_once, &bes_cache_key_create, 0, 0);
+	if (g_bes_cache_key != FLS_OUT_OF_INDEXES)
 	{
-		g_bes_allocator = allocator;
-		return BES_TRUE;
+		FlsSetValue(g_bes_cache_key, &g_bes_cache);
 	}
+#endif
+}
 
-	return BES_FALSE;
+/* Statistics and profiling are enabled through a single word so the
+ * allocation functions only test one thing while neither is used. */
+enum
+{
+	BES_MEMORY_HOOK_STATS = 1 << 0,
+	BES_MEMORY_HOOK_PROFILE = 1 << 1
+};
+
+static volatile bes_u32 g_bes_memory_hooks;
+
+static inline bes_u32
+bes_memory_hooks(void)
+{
+	return bes_atomic_load_u32(&g_bes_memory_hooks, BES_ATOMIC_RELAXED);
 }
 
-static inline void*
-bes_allocator_allocate(bes_size size)
+static void
+bes_memory_hooks_set(bes_u32 hook, bes_bool enable)
 {
-	BES_ASSERT(g_bes_allocator);
-	return g_bes_allocator->allocate(g_bes_allocator, size);
+	bes_u32 hooks = bes_atomic_load_u32(&g_bes_memory_hooks, BES_ATOMIC_RELAXED);
+	while (!bes_atomic_cas_u32(&g_bes_memory_hooks, &hooks, enable ? hooks | hook : hooks & ~hook, BES_ATOMIC_RELAXED))
+	{
+		/* Another hook changed at the same time, try again. */
+	}
 }
 
-static inline void*
-bes_allocator_reallocate(void *const data, bes_size size)
+/* Statistics are kept per thread so recording them doesn't contend, and
+ * only summed up when a snapshot is taken. Records are never given back
+ * because the allocations made by a thread outlive it. Threads beyond
+ * the amount of records share the first one and update it atomically.
+ *
+ * Live bytes can't be summed from per thread counts when a peak is to be
+ * kept, so each thread publishes the change in live bytes to a global
+ * count once it exceeds BES_STATS_BATCH. That is also when the peak is
+ * updated, making it exact to within that amount for each thread. */
+#define BES_STATS_BATCH (64 * 1024)
+
+typedef struct bes_stats bes_stats;
+typedef union bes_stats_slot bes_stats_slot;
+
+enum
 {
-	BES_ASSERT(g_bes_allocator);
-	return g_bes_allocator->reallocate(g_bes_allocator, data, size);
+	BES_STATS_MALLOC,
+	BES_STATS_REALLOC,
+	BES_STATS_FREE
+};
+
+struct bes_stats
+{
+	bes_u64 calls[3];
+
+	/* Change in live bytes not yet published, in two's complement. */
+	bes_u64 pending;
+
+	bes_u64 histogram[BES_MEMORY_STATS_CLASSES];
+};
+
+union bes_stats_slot
+{
+	bes_stats data;
+	bes_byte aligned[(sizeof(bes_stats) + BES_CACHE_LINE_SIZE - 1) & -BES_CACHE_LINE_SIZE];
+};
+
+static bes_stats_slot g_bes_stats_records[BES_MEMORY_STATS_THREADS];
+static volatile bes_u32 g_bes_stats_records_used = 1;
+static volatile bes_u64 g_bes_stats_live;
+static volatile bes_u64 g_bes_stats_peak;
+static BES_THREAD_LOCAL bes_stats *g_bes_stats;
+
+static inline bes_bool
+bes_stats_shared(const bes_stats *const stats)
+{
+	return stats == &g_bes_stats_records[0].data ? BES_TRUE : BES_FALSE;
+}
+
+static bes_stats*
+bes_stats_get(void)
+{
+	if (BES_UNLIKELY(!g_bes_stats))
+	{
+		const bes_u32 index = bes_atomic_add_u32(&g_bes_stats_records_used, 1, BES_ATOMIC_RELAXED);
+		g_bes_stats = &g_bes_stats_records[index < BES_MEMORY_STATS_THREADS ? index : 0].data;
+	}
+	return g_bes_stats;
 }
 
 static inline void
-bes_allocator_deallocate(void *const data)
+bes_stats_add(bes_stats *const stats, volatile bes_u64 *const counter, bes_u64 value)
+{
+	/* Only the owning thread writes to a record that isn't shared, the
+	 * atomic load and store are so snapshots can read it. */
+	if (bes_stats_shared(stats))
+	{
+		bes_atomic_add_u64(counter, value, BES_ATOMIC_RELAXED);
+	}
+	else
+	{
+		bes_atomic_store_u64(counter, bes_atomic_load_u64(counter, BES_ATOMIC_RELAXED) + value, BES_ATOMIC_RELAXED);
+	}
+}
+
+static void
+bes_stats_publish(bes_u64 delta)
+{
+	const bes_s64 live = (bes_s64)(bes_atomic_add_u64(&g_bes_stats_live, delta, BES_ATOMIC_RELAXED) + delta);
+	bes_u64 peak = bes_atomic_load_u64(&g_bes_stats_peak, BES_ATOMIC_RELAXED);
+	while ((bes_s64)peak < live && !bes_atomic_cas_u64(&g_bes_stats_peak, &peak, (bes_u64)live, BES_ATOMIC_RELAXED))
+	{
+		/* The peak was updated by another thread, try again. */
+	}
+}
+
+static void
+bes_stats_record(int event, bes_size size, bes_s64 delta)
 {
-	/* There's no need to do the assertion check here since it's not
-	 * legal to call free with pointers that were not obtained with
-	 * the other functions. The other ones would fail sooner. */
-	g_bes_allocator->deallocate(g_bes_allocator, data);
+	bes_stats *const stats = bes_stats_get();
+
+	bes_stats_add(stats, &stats->calls[event], 1);
+	if (event != BES_STATS_FREE)
+	{
+		bes_stats_add(stats, &stats->histogram[bes_bits_log2(size)], 1);
+	}
+
+	if (bes_stats_shared(stats))
+	{
+		bes_stats_publish((bes_u64)delta);
+		return;
+	}
+
+	const bes_u64 pending = bes_atomic_load_u64(&stats->pending, BES_ATOMIC_RELAXED) + (bes_u64)delta;
+	if ((bes_s64)pending > BES_STATS_BATCH || (bes_s64)pending < -BES_STATS_BATCH)
+	{
+		bes_atomic_store_u64(&stats->pending, 0, BES_ATOMIC_RELAXED);
+		bes_stats_publish(pending);
+	}
+	else
+	{
+		bes_atomic_store_u64(&stats->pending, pending, BES_ATOMIC_RELAXED);
+	}
 }
 
 /* Ensure all allocations are BES_ALIGNED aligned. */
@@ -47,6 +248,15 @@ struct bes_alloc_header_data
 {
 	bes_size size;
 	bes_byte *base;
+
+	/* The allocator that owns the allocation. Allocators are per thread
+	 * so this is what permits freeing memory from any thread. */
+	bes_allocator *allocator;
+
+	/* The alignment the allocation was made with, which is at least
+	 * BES_ALIGNMENT. The lowest bit is set for allocations sampled by the
+	 * profiler, which are preceded by a bes_profile_sample. */
+	bes_size alignment;
 };
 
 union bes_alloc_header
@@ -57,72 +267,1620 @@ union bes_alloc_header
 	bes_byte aligned[(sizeof(bes_alloc_header_data) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT];
 };
 
-void*
-bes_malloc(bes_size size)
+#define BES_ALLOC_SAMPLED 1
+
+static inline bes_size
+bes_alloc_alignment(const bes_alloc_header *const node)
 {
-	BES_ASSERT(g_bes_allocator);
+	return node->data.alignment & ~(bes_size)BES_ALLOC_SAMPLED;
+}
 
-	/* The size doesn't need to be a multiple of the alignment, however it's
-	 * good to reduce fragmentation. */
-	size = (size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT;
+static inline bes_bool
+bes_alloc_sampled(const bes_alloc_header *const node)
+{
+	return node->data.alignment & BES_ALLOC_SAMPLED ? BES_TRUE : BES_FALSE;
+}
 
-	/* Additional memory may be needed to align base of the allocation */
-	bes_byte *base = bes_allocator_allocate(size + sizeof(bes_alloc_header) + BES_ALIGNMENT);
-	if (base)
+/* Sampled allocations record the site they count towards at the base of
+ * the allocation, before the header. */
+typedef struct bes_profile_site bes_profile_site;
+typedef struct bes_profile_sample bes_profile_sample;
+typedef union bes_profile_sample_prefix bes_profile_sample_prefix;
+
+struct bes_profile_sample
+{
+	bes_profile_site *site;
+	bes_size size;
+};
+
+union bes_profile_sample_prefix
+{
+	bes_profile_sample data;
+	bes_byte aligned[(sizeof(bes_profile_sample) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT];
+};
+
+static inline bes_bool
+bes_allocator_headerless(const bes_allocator *const allocator)
+{
+	return allocator->alignment >= BES_ALIGNMENT && allocator->usable_size ? BES_TRUE : BES_FALSE;
+}
+
+static inline bes_bool
+bes_cache_enabled(const bes_allocator *const allocator)
+{
+	return allocator->flags & BES_ALLOCATOR_CACHE ? BES_TRUE : BES_FALSE;
+}
+
+static inline bes_size
+bes_cache_index(bes_size size)
+{
+	/* Zero sized blocks have no room for the link and map to an index
+	 * that is out of range by wrapping around. */
+	return (size - 1) / BES_ALIGNMENT;
+}
+
+/* The amount of memory requested from an allocator for an allocation of
+ * the given rounded size and alignment. */
+static inline bes_size
+bes_alloc_request_size(bes_size size, bes_size alignment)
+{
+	return size + sizeof(bes_alloc_header) + alignment;
+}
+
+/* Round up to the alignment after the header, making a small gap if
+ * necessary. */
+static inline bes_byte*
+bes_alloc_align(bes_byte *const base, bes_size alignment)
+{
+	return (bes_byte *)((bes_uintptr)(base + sizeof(bes_alloc_header) + alignment - 1) & -alignment);
+}
+
+static inline void
+bes_alloc_release(const bes_alloc_header *const node)
+{
+	bes_allocator *const allocator = node->data.allocator;
+	if (allocator->deallocate_sized)
 	{
-		/* Round up to the alignment, making a small gap if necessary. */
-		bes_byte *aligned = (bes_byte *)((bes_uintptr)(base + sizeof(bes_alloc_header) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT);
+		bes_size size = bes_alloc_request_size(node->data.size, bes_alloc_alignment(node));
+		if (bes_alloc_sampled(node))
+		{
+			size += sizeof(bes_profile_sample_prefix);
+		}
+		allocator->deallocate_sized(allocator, node->data.base, size);
+	}
+	else
+	{
+		allocator->deallocate(allocator, node->data.base);
+	}
+}
 
-		bes_alloc_header *node = (bes_alloc_header*)aligned - 1;
-		node->data.base = base;
-		node->data.size = size;
+bes_bool
+bes_allocator_set(bes_allocator *const allocator)
+{
+	BES_ASSERT(allocator);
 
-		return aligned;
+	if (allocator->allocate && allocator->reallocate && allocator->deallocate)
+	{
+		if (g_bes_allocator != allocator)
+		{
+			bes_allocator_flush();
+		}
+		g_bes_allocator = allocator;
+		g_bes_headerless = !g_bes_allocator_depth && bes_allocator_headerless(allocator);
+		return BES_TRUE;
 	}
 
-	return 0;
+	return BES_FALSE;
 }
 
-void*
-bes_realloc(void *const ptr, bes_size size)
+bes_bool
+bes_allocator_push(bes_allocator *const allocator)
 {
-	BES_ASSERT(g_bes_allocator);
+	BES_ASSERT(allocator);
 
-	if (ptr)
+	if (!allocator->allocate || !allocator->reallocate || !allocator->deallocate
+		|| g_bes_allocator_depth == BES_ALLOCATOR_STACK_DEPTH
+		|| g_bes_headerless)
 	{
-		/* The size doesn't need to be a multiple of the alignment, however
-		 * it's good to reduce fragmentation. */
-		size = (size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT;
+		return BES_FALSE;
+	}
 
-		bes_alloc_header *node = (bes_alloc_header *)ptr - 1;
-		bes_byte *original = node->data.base;
-		bes_byte *resize = bes_allocator_reallocate(original, size + sizeof(bes_alloc_header) + BES_ALIGNMENT);
-		if (resize)
+	/* The cache only holds blocks of the allocator at the bottom and is
+	 * left alone until it is back on top, sparing a flush per push. */
+	g_bes_allocator_stack[g_bes_allocator_depth++] = g_bes_allocator;
+	g_bes_allocator = allocator;
+	return BES_TRUE;
+}
+
+void
+bes_allocator_pop(void)
+{
+	BES_ASSERT(g_bes_allocator_depth);
+
+	g_bes_allocator = g_bes_allocator_stack[--g_bes_allocator_depth];
+	g_bes_headerless = !g_bes_allocator_depth && bes_allocator_headerless(g_bes_allocator);
+}
+
+bes_size
+bes_allocator_trim(void)
+{
+	bes_allocator_flush();
+
+	bes_size released = 0;
+	for (bes_u32 i = 0; i <= g_bes_allocator_depth; i++)
+	{
+		bes_allocator *const allocator = i < g_bes_allocator_depth ? g_bes_allocator_stack[i] : g_bes_allocator;
+
+		/* The same allocator may be pushed more than once. */
+		bes_bool trimmed = BES_FALSE;
+		for (bes_u32 j = 0; j < i && !trimmed; j++)
+		{
+			trimmed = g_bes_allocator_stack[j] == allocator ? BES_TRUE : BES_FALSE;
+		}
+
+		if (!trimmed && allocator && allocator->trim)
+		{
+			released += allocator->trim(allocator);
+		}
+	}
+
+	return released;
+}
+
+bes_allocator*
+bes_allocator_get(void)
+{
+	return g_bes_allocator;
+}
+
+void
+bes_allocator_flush(void)
+{
+	for (bes_size i = 0; i < BES_CACHE_CLASSES; i++)
+	{
+		void *block = g_bes_cache.blocks[i];
+		while (block)
 		{
-			/* Round to the alignment, making a small gap if necessary. */
-			bes_byte *aligned = (bes_byte *)((bes_uintptr)(resize + sizeof(bes_alloc_header) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT);
+			void *const next = *(void **)block;
+			bes_alloc_release((bes_alloc_header *)block - 1);
+			block = next;
+		}
+		g_bes_cache.blocks[i] = 0;
+		g_bes_cache.count[i] = 0;
+	}
+}
+
+static inline void*
+bes_alloc_place(bes_allocator *const allocator, bes_byte *const base, bes_size size, bes_size alignment, bes_size prefix)
+{
+	bes_byte *aligned = bes_alloc_align(base + prefix, alignment);
+
+	bes_alloc_header *node = (bes_alloc_header*)aligned - 1;
+	node->data.base = base;
+	node->data.size = size;
+	node->data.allocator = allocator;
+	node->data.alignment = prefix ? alignment | BES_ALLOC_SAMPLED : alignment;
+
+	return aligned;
+}
+
+static void*
+bes_alloc_allocate(bes_size size, bes_size alignment, bes_size prefix)
+{
+	/* Additional memory may be needed to align base of the allocation */
+	bes_allocator *const allocator = g_bes_allocator;
+	bes_byte *base = allocator->allocate(allocator, bes_alloc_request_size(size, alignment) + prefix);
+	if (base)
+	{
+		return bes_alloc_place(allocator, base, size, alignment, prefix);
+	}
+
+	return 0;
+}
+
+static inline void*
+bes_alloc_malloc(bes_size size)
+{
+	if (g_bes_headerless)
+	{
+		return g_bes_allocator->allocate(g_bes_allocator, size);
+	}
 
-			bes_alloc_header *meta = (bes_alloc_header*)aligned - 1;
-			meta->data.size = size;
-			meta->data.base = resize;
+	/* The size doesn't need to be a multiple of the alignment, however it's
+	 * good to reduce fragmentation. */
+	size = (size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT;
 
-			return aligned;
+	const bes_size index = bes_cache_index(size);
+	if (index < BES_CACHE_CLASSES && !g_bes_allocator_depth)
+	{
+		void *const block = g_bes_cache.blocks[index];
+		if (block)
+		{
+			g_bes_cache.blocks[index] = *(void **)block;
+			g_bes_cache.count[index]--;
+			return block;
 		}
+	}
+
+	return bes_alloc_allocate(size, BES_ALIGNMENT, 0);
+}
 
+static inline void*
+bes_alloc_malloc_aligned(bes_size size, bes_size alignment)
+{
+	if (alignment & (alignment - 1))
+	{
 		return 0;
 	}
 
-	return bes_malloc(size);
+	if (g_bes_headerless)
+	{
+		bes_allocator *const allocator = g_bes_allocator;
+		if (alignment <= allocator->alignment)
+		{
+			return allocator->allocate(allocator, size);
+		}
+		return allocator->allocate_aligned ? allocator->allocate_aligned(allocator, size, alignment) : 0;
+	}
+
+	if (alignment <= BES_ALIGNMENT)
+	{
+		return bes_alloc_malloc(size);
+	}
+
+	size = (size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT;
+
+	return bes_alloc_allocate(size, alignment, 0);
 }
 
-void
-bes_free(void *const ptr)
+/* Zeroed allocation clears the memory unless the allocator reports it's
+ * already zero. Small blocks are cheap to clear and are taken from the
+ * cache like any other. */
+static void*
+bes_alloc_calloc(bes_size size)
 {
-	BES_ASSERT(g_bes_allocator);
+	bes_allocator *const allocator = g_bes_allocator;
+	bes_bool zeroed = BES_FALSE;
+	void *data;
 
-	if (ptr)
+	if (g_bes_headerless)
 	{
-		bes_alloc_header *node = (bes_alloc_header *)ptr - 1;
-		bes_allocator_deallocate(node);
+		data = allocator->allocate_zeroed
+			? allocator->allocate_zeroed(allocator, size, &zeroed)
+			: allocator->allocate(allocator, size);
+	}
+	else if (!allocator->allocate_zeroed || bes_cache_index((size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT) < BES_CACHE_CLASSES)
+	{
+		data = bes_alloc_malloc(size);
+	}
+	else
+	{
+		/* The header is written in front of the data, which is left as the
+		 * allocator gave it. */
+		size = (size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT;
+		bes_byte *const base = allocator->allocate_zeroed(allocator, bes_alloc_request_size(size, BES_ALIGNMENT), &zeroed);
+		data = base ? bes_alloc_place(allocator, base, size, BES_ALIGNMENT, 0) : 0;
+	}
+
+	if (data && !zeroed)
+	{
+		bes_memset(data, 0, size);
+	}
+
+	return data;
+}
+
+/* The profiler samples an allocation once the bytes allocated by a thread
+ * since its last sample exceed an interval drawn from an exponential
+ * distribution with the sampling rate as its mean. Sampling is then a
+ * Poisson process over allocated bytes, every byte is equally likely to
+ * be sampled regardless of the size of the allocation it belongs to.
+ *
+ * Samples are counted towards the site they were made at, the tag if
+ * given or else the return address of the allocation function, in a table
+ * guarded by a lock. Sampling is rare so the lock is hardly contended.
+ * Sites beyond the capacity of the table share the entry past its end. */
+struct bes_profile_site
+{
+	void *address;
+	const char *tag;
+	bes_u64 live_count;
+	bes_u64 live_bytes;
+	bes_u64 total_count;
+	bes_u64 total_bytes;
+};
+
+static bes_profile_site g_bes_profile_sites[BES_MEMORY_PROFILE_SITES + 1];
+static volatile bes_u32 g_bes_profile_lock;
+static volatile bes_u64 g_bes_profile_rate;
+static BES_THREAD_LOCAL bes_u64 g_bes_profile_thread_rate;
+static BES_THREAD_LOCAL bes_s64 g_bes_profile_countdown;
+static BES_THREAD_LOCAL bes_u64 g_bes_profile_random;
+
+static inline void
+bes_profile_lock(void)
+{
+	bes_u32 expected = 0;
+	while (!bes_atomic_cas_u32(&g_bes_profile_lock, &expected, 1, BES_ATOMIC_ACQUIRE))
+	{
+		expected = 0;
 	}
 }
+
+static inline void
+bes_profile_unlock(void)
+{
+	bes_atomic_store_u32(&g_bes_profile_lock, 0, BES_ATOMIC_RELEASE);
+}
+
+/* Tagged sites are told apart by tag alone and keep the address of the
+ * first allocation made with the tag. Must be called with the lock held. */
+static bes_profile_site*
+bes_profile_site_find(void *const address, const char *const tag)
+{
+	const bes_u64 key = tag ? (bes_u64)(bes_uintptr)tag : (bes_u64)(bes_uintptr)address;
+	bes_size index = (bes_size)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+	for (bes_size probe = 0; probe < BES_MEMORY_PROFILE_SITES; probe++, index++)
+	{
+		bes_profile_site *const site = &g_bes_profile_sites[index & (BES_MEMORY_PROFILE_SITES - 1)];
+		if (site->total_count == 0)
+		{
+			site->address = address;
+			site->tag = tag;
+			return site;
+		}
+		if (site->tag == tag && (tag || site->address == address))
+		{
+			return site;
+		}
+	}
+	return &g_bes_profile_sites[BES_MEMORY_PROFILE_SITES];
+}
+
+/* xorshift64* seeded by the address of its state, which differs for every
+ * thread. */
+static inline bes_u64
+bes_profile_random(void)
+{
+	bes_u64 x = g_bes_profile_random;
+	if (BES_UNLIKELY(!x))
+	{
+		x = ((bes_u64)(bes_uintptr)&g_bes_profile_random * 0x9E3779B97F4A7C15ULL) | 1;
+	}
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	g_bes_profile_random = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* Draw -ln(u) * rate for u uniform in (0, 1]. The logarithm is the
+ * exponent of u plus a cubic fit of log2 over its mantissa, which is
+ * accurate to about 0.0013 and plenty for picking intervals. */
+static bes_s64
+bes_profile_interval(bes_u64 rate)
+{
+	const bes_u64 u = (bes_profile_random() >> 11) + 1;
+	const bes_size exponent = bes_bits_msb_u64(u);
+	const bes_f64 x = (bes_f64)(u - ((bes_u64)1 << exponent)) / (bes_f64)((bes_u64)1 << exponent);
+	const bes_f64 log2 = (bes_f64)exponent - 53.0 + x * (1.4234755 + x * (-0.5876945 + x * 0.1655245));
+	return (bes_s64)(-log2 * 0.69314718055994530942 * (bes_f64)rate) + 1;
+}
+
+static bes_bool
+bes_profile_should_sample(bes_size size)
+{
+	/* Headerless allocations have nowhere to record the sample. */
+	const bes_u64 rate = bes_atomic_load_u64(&g_bes_profile_rate, BES_ATOMIC_RELAXED);
+	if (g_bes_headerless || !rate)
+	{
+		return BES_FALSE;
+	}
+
+	if (BES_UNLIKELY(g_bes_profile_thread_rate != rate))
+	{
+		g_bes_profile_thread_rate = rate;
+		g_bes_profile_countdown = bes_profile_interval(rate);
+	}
+
+	g_bes_profile_countdown -= (bes_s64)size;
+	if (g_bes_profile_countdown > 0)
+	{
+		return BES_FALSE;
+	}
+
+	g_bes_profile_countdown = bes_profile_interval(rate);
+	return BES_TRUE;
+}
+
+static void*
+bes_profile_allocate(bes_size size, bes_size alignment, const char *const tag, void *const address)
+{
+	size = (size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT;
+	if (alignment < BES_ALIGNMENT)
+	{
+		alignment = BES_ALIGNMENT;
+	}
+
+	void *const data = bes_alloc_allocate(size, alignment, sizeof(bes_profile_sample_prefix));
+	if (data)
+	{
+		bes_profile_sample *const sample = (bes_profile_sample *)((bes_alloc_header *)data - 1)->data.base;
+		bes_profile_lock();
+		bes_profile_site *const site = bes_profile_site_find(address, tag);
+		site->live_count++;
+		site->live_bytes += size;
+		site->total_count++;
+		site->total_bytes += size;
+		bes_profile_unlock();
+		sample->site = site;
+		sample->size = size;
+	}
+
+	return data;
+}
+
+static void
+bes_profile_release(const bes_alloc_header *const node)
+{
+	const bes_profile_sample *const sample = (const bes_profile_sample *)node->data.base;
+	bes_profile_lock();
+	sample->site->live_count--;
+	sample->site->live_bytes -= sample->size;
+	bes_profile_unlock();
+}
+
+static inline void
+bes_alloc_free(void *const ptr)
+{
+	if (g_bes_headerless)
+	{
+		/* Without a header memory of another allocator can't be told
+		 * apart, except by allocators which report no usable size for it. */
+		BES_ASSERT(g_bes_allocator->usable_size(g_bes_allocator, ptr));
+		g_bes_allocator->deallocate(g_bes_allocator, ptr);
+	}
+	else
+	{
+		bes_alloc_header *node = (bes_alloc_header *)ptr - 1;
+		bes_allocator *const allocator = node->data.allocator;
+		BES_ASSERT(allocator && node->data.base < (bes_byte *)ptr);
+
+		/* Sampled blocks are never cached so they are only counted once. */
+		if (BES_UNLIKELY(bes_alloc_sampled(node)))
+		{
+			bes_profile_release(node);
+			bes_alloc_release(node);
+			return;
+		}
+
+		/* Blocks owned by another allocator, which includes blocks made
+		 * on other threads that don't share the allocator, go straight
+		 * back to their owner. */
+		if (allocator == g_bes_allocator && bes_cache_enabled(allocator) && !g_bes_allocator_depth)
+		{
+			const bes_size index = bes_cache_index(node->data.size);
+			if (index < BES_CACHE_CLASSES && g_bes_cache.count[index] < BES_CACHE_DEPTH)
+			{
+				if (BES_UNLIKELY(!g_bes_cache.registered))
+				{
+					bes_cache_register();
+				}
+				*(void **)ptr = g_bes_cache.blocks[index];
+				g_bes_cache.blocks[index] = ptr;
+				g_bes_cache.count[index]++;
+				return;
+			}
+		}
+
+		bes_alloc_release(node);
+	}
+}
+
+static inline void
+bes_alloc_free_sized(void *const ptr, bes_size size)
+{
+	if (g_bes_headerless && g_bes_allocator->deallocate_sized)
+	{
+		BES_ASSERT(g_bes_allocator->usable_size(g_bes_allocator, ptr));
+		g_bes_allocator->deallocate_sized(g_bes_allocator, ptr, size);
+	}
+	else
+	{
+		/* Headers record the size themselves. */
+		bes_alloc_free(ptr);
+	}
+}
+
+/* Ask the allocator to resize the block without moving it. */
+static bes_bool
+bes_alloc_resize_in_place(bes_alloc_header *const node, bes_size size)
+{
+	bes_allocator *const allocator = node->data.allocator;
+	if (!bes_alloc_sampled(node)
+		&& allocator->reallocate_in_place
+		&& allocator->reallocate_in_place(allocator, node->data.base, bes_alloc_request_size(size, node->data.alignment)))
+	{
+		node->data.size = size;
+		return BES_TRUE;
+	}
+	return BES_FALSE;
+}
+
+static inline void*
+bes_alloc_realloc(void *const ptr, bes_size size)
+{
+	if (g_bes_headerless)
+	{
+		BES_ASSERT(g_bes_allocator->usable_size(g_bes_allocator, ptr));
+		return g_bes_allocator->reallocate(g_bes_allocator, ptr, size);
+	}
+
+	/* The size doesn't need to be a multiple of the alignment, however
+	 * it's good to reduce fragmentation. */
+	size = (size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT;
+
+	bes_alloc_header *node = (bes_alloc_header *)ptr - 1;
+	if (bes_alloc_resize_in_place(node, size))
+	{
+		return ptr;
+	}
+
+	/* Sampled blocks are preceded by their sample, moving them to a block
+	 * of their own is simpler than carrying it over. */
+	if (BES_UNLIKELY(bes_alloc_sampled(node)))
+	{
+		void *const resize = bes_alloc_malloc_aligned(size, bes_alloc_alignment(node));
+		if (resize)
+		{
+			bes_memcpy(resize, ptr, size < node->data.size ? size : node->data.size);
+			bes_alloc_free(ptr);
+		}
+		return resize;
+	}
+
+	bes_allocator *const allocator = node->data.allocator;
+	const bes_size alignment = node->data.alignment;
+	bes_byte *original = node->data.base;
+	const bes_size offset = (bes_size)((bes_byte *)ptr - original);
+	const bes_size preserve = size < node->data.size ? size : node->data.size;
+
+	bes_byte *resize = allocator->reallocate(allocator, original, bes_alloc_request_size(size, alignment));
+	if (resize)
+	{
+		bes_byte *aligned = bes_alloc_align(resize, alignment);
+
+		/* The allocator knows nothing of the alignment. When the block moved
+		 * to an address with a different misalignment the data is still at
+		 * the old offset and has to be moved to where it's aligned. */
+		if (aligned != resize + offset)
+		{
+			bes_memmove(aligned, resize + offset, preserve);
+		}
+
+		bes_alloc_header *meta = (bes_alloc_header*)aligned - 1;
+		meta->data.size = size;
+		meta->data.base = resize;
+		meta->data.allocator = allocator;
+		meta->data.alignment = alignment;
+
+		return aligned;
+	}
+
+	return 0;
+}
+
+static inline void*
+bes_alloc_realloc_aligned(void *const ptr, bes_size size, bes_size alignment)
+{
+	if (g_bes_headerless)
+	{
+		if (alignment <= g_bes_allocator->alignment)
+		{
+			return g_bes_allocator->reallocate(g_bes_allocator, ptr, size);
+		}
+	}
+	else if (bes_alloc_alignment((bes_alloc_header *)ptr - 1) == (alignment > BES_ALIGNMENT ? alignment : BES_ALIGNMENT))
+	{
+		return bes_alloc_realloc(ptr, size);
+	}
+
+	void *const resize = bes_alloc_malloc_aligned(size, alignment);
+	if (resize)
+	{
+		const bes_size preserve = bes_malloc_usable_size(ptr);
+		bes_memcpy(resize, ptr, size < preserve ? size : preserve);
+		bes_alloc_free(ptr);
+	}
+
+	return resize;
+}
+
+static inline bes_bool
+bes_alloc_realloc_in_place(void *const ptr, bes_size size)
+{
+	if (g_bes_headerless)
+	{
+		bes_allocator *const allocator = g_bes_allocator;
+		if (allocator->reallocate_in_place && allocator->reallocate_in_place(allocator, ptr, size))
+		{
+			return BES_TRUE;
+		}
+		return size <= allocator->usable_size(allocator, ptr) ? BES_TRUE : BES_FALSE;
+	}
+
+	size = (size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT;
+
+	bes_alloc_header *node = (bes_alloc_header *)ptr - 1;
+	if (bes_alloc_resize_in_place(node, size))
+	{
+		return BES_TRUE;
+	}
+
+	/* Shrinking always succeeds, the block simply keeps its slack. */
+	return size <= node->data.size ? BES_TRUE : BES_FALSE;
+}
+
+/* Batches are handed to the allocator whole when it supports that, with
+ * whatever it doesn't serve allocated one block at a time. */
+static bes_bool
+bes_alloc_malloc_batch(bes_size count, bes_size size, void **const data)
+{
+	bes_allocator *const allocator = g_bes_allocator;
+	bes_size made = 0;
+
+	if (g_bes_headerless)
+	{
+		if (allocator->allocate_batch)
+		{
+			made = allocator->allocate_batch(allocator, size, count, data);
+		}
+		for (; made < count; made++)
+		{
+			if (!(data[made] = allocator->allocate(allocator, size)))
+			{
+				break;
+			}
+		}
+	}
+	else
+	{
+		size = (size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT;
+		if (allocator->allocate_batch)
+		{
+			made = allocator->allocate_batch(allocator, bes_alloc_request_size(size, BES_ALIGNMENT), count, data);
+			for (bes_size i = 0; i < made; i++)
+			{
+				data[i] = bes_alloc_place(allocator, data[i], size, BES_ALIGNMENT, 0);
+			}
+		}
+		for (; made < count; made++)
+		{
+			if (!(data[made] = bes_alloc_malloc(size)))
+			{
+				break;
+			}
+		}
+	}
+
+	if (made < count)
+	{
+		bes_free_batch(data, made);
+		return BES_FALSE;
+	}
+
+	return BES_TRUE;
+}
+
+#define BES_BATCH_RUN 64
+
+static void
+bes_alloc_free_batch(void *const *const data, bes_size count)
+{
+	/* Runs of blocks from the same allocator are collected and given back
+	 * together. Sampled blocks and blocks of allocators without batch
+	 * support, which may be cached, go back one at a time. */
+	void *run[BES_BATCH_RUN];
+	bes_size length = 0;
+	bes_allocator *owner = 0;
+
+	for (bes_size i = 0; i < count; i++)
+	{
+		void *const ptr = data[i];
+		if (!ptr)
+		{
+			continue;
+		}
+
+		bes_allocator *allocator = g_bes_allocator;
+		void *base = ptr;
+		if (!g_bes_headerless)
+		{
+			const bes_alloc_header *const node = (const bes_alloc_header *)ptr - 1;
+			allocator = node->data.allocator;
+			base = node->data.base;
+			if (bes_alloc_sampled(node))
+			{
+				bes_alloc_free(ptr);
+				continue;
+			}
+		}
+
+		if (!allocator->deallocate_batch)
+		{
+			bes_alloc_free(ptr);
+			continue;
+		}
+
+		if (allocator != owner || length == BES_BATCH_RUN)
+		{
+			if (length)
+			{
+				owner->deallocate_batch(owner, run, length);
+			}
+			owner = allocator;
+			length = 0;
+		}
+		run[length++] = base;
+	}
+
+	if (length)
+	{
+		owner->deallocate_batch(owner, run, length);
+	}
+}
+
+/* Allocation while statistics or profiling are enabled. */
+static void*
+bes_malloc_hooked(bes_u32 hooks, bes_size size, bes_size alignment, const char *const tag, void *const address)
+{
+	void *data;
+	if ((hooks & BES_MEMORY_HOOK_PROFILE)
+		&& !(alignment & (alignment - 1))
+		&& bes_profile_should_sample(size))
+	{
+		data = bes_profile_allocate(size, alignment, tag, address);
+	}
+	else
+	{
+		data = bes_alloc_malloc_aligned(size, alignment);
+	}
+
+	if ((hooks & BES_MEMORY_HOOK_STATS) && data)
+	{
+		bes_stats_record(BES_STATS_MALLOC, size, (bes_s64)bes_malloc_usable_size(data));
+	}
+
+	return data;
+}
+
+/* Zeroed allocation while statistics or profiling are enabled. */
+static void*
+bes_calloc_hooked(bes_u32 hooks, bes_size size, void *const address)
+{
+	void *data;
+	if ((hooks & BES_MEMORY_HOOK_PROFILE) && bes_profile_should_sample(size))
+	{
+		data = bes_profile_allocate(size, BES_ALIGNMENT, 0, address);
+		if (data)
+		{
+			bes_memset(data, 0, size);
+		}
+	}
+	else
+	{
+		data = bes_alloc_calloc(size);
+	}
+
+	if ((hooks & BES_MEMORY_HOOK_STATS) && data)
+	{
+		bes_stats_record(BES_STATS_MALLOC, size, (bes_s64)bes_malloc_usable_size(data));
+	}
+
+	return data;
+}
+
+/* Reallocation while statistics or profiling are enabled. An alignment of
+ * zero keeps the alignment the allocation was made with. */
+static void*
+bes_realloc_hooked(bes_u32 hooks, void *const ptr, bes_size size, bes_size alignment, void *const address)
+{
+	const bes_size before = bes_malloc_usable_size(ptr);
+
+	void *data;
+	if ((hooks & BES_MEMORY_HOOK_PROFILE)
+		&& !(alignment & (alignment - 1))
+		&& bes_profile_should_sample(size))
+	{
+		/* The profiler sees reallocation as a new allocation, so one that
+		 * is sampled moves to a sampled block. */
+		data = bes_profile_allocate(size, alignment ? alignment : bes_alloc_alignment((bes_alloc_header *)ptr - 1), 0, address);
+		if (data)
+		{
+			bes_memcpy(data, ptr, size < before ? size : before);
+			bes_alloc_free(ptr);
+		}
+	}
+	else if (alignment)
+	{
+		data = bes_alloc_realloc_aligned(ptr, size, alignment);
+	}
+	else
+	{
+		data = bes_alloc_realloc(ptr, size);
+	}
+
+	if ((hooks & BES_MEMORY_HOOK_STATS) && data)
+	{
+		bes_stats_record(BES_STATS_REALLOC, size, (bes_s64)(bes_malloc_usable_size(data) - before));
+	}
+
+	return data;
+}
+
+void*
+bes_malloc(bes_size size)
+{
+	BES_ASSERT(g_bes_allocator);
+
+	const bes_u32 hooks = bes_memory_hooks();
+	if (BES_UNLIKELY(hooks))
+	{
+		return bes_malloc_hooked(hooks, size, BES_ALIGNMENT, 0, BES_RETURN_ADDRESS());
+	}
+
+	return bes_alloc_malloc(size);
+}
+
+void*
+bes_malloc_tagged(bes_size size, const char *const tag)
+{
+	BES_ASSERT(g_bes_allocator);
+
+	const bes_u32 hooks = bes_memory_hooks();
+	if (BES_UNLIKELY(hooks))
+	{
+		return bes_malloc_hooked(hooks, size, BES_ALIGNMENT, tag, BES_RETURN_ADDRESS());
+	}
+
+	return bes_alloc_malloc(size);
+}
+
+void*
+bes_malloc_aligned(bes_size size, bes_size alignment)
+{
+	BES_ASSERT(g_bes_allocator);
+
+	const bes_u32 hooks = bes_memory_hooks();
+	if (BES_UNLIKELY(hooks))
+	{
+		return bes_malloc_hooked(hooks, size, alignment, 0, BES_RETURN_ADDRESS());
+	}
+
+	return bes_alloc_malloc_aligned(size, alignment);
+}
+
+void*
+bes_realloc(void *const ptr, bes_size size)
+{
+	BES_ASSERT(g_bes_allocator);
+
+	const bes_u32 hooks = bes_memory_hooks();
+	if (BES_UNLIKELY(hooks))
+	{
+		return ptr
+			? bes_realloc_hooked(hooks, ptr, size, 0, BES_RETURN_ADDRESS())
+			: bes_malloc_hooked(hooks, size, BES_ALIGNMENT, 0, BES_RETURN_ADDRESS());
+	}
+
+	return ptr ? bes_alloc_realloc(ptr, size) : bes_alloc_malloc(size);
+}
+
+void*
+bes_realloc_aligned(void *const ptr, bes_size size, bes_size alignment)
+{
+	BES_ASSERT(g_bes_allocator);
+
+	const bes_u32 hooks = bes_memory_hooks();
+	if (BES_UNLIKELY(hooks))
+	{
+		/* No alignment is the same as the least, which isn't the same as
+		 * keeping the alignment of the allocation. */
+		return ptr
+			? bes_realloc_hooked(hooks, ptr, size, alignment ? alignment : 1, BES_RETURN_ADDRESS())
+			: bes_malloc_hooked(hooks, size, alignment, 0, BES_RETURN_ADDRESS());
+	}
+
+	return ptr ? bes_alloc_realloc_aligned(ptr, size, alignment) : bes_alloc_malloc_aligned(size, alignment);
+}
+
+void*
+bes_calloc(bes_size count, bes_size size)
+{
+	BES_ASSERT(g_bes_allocator);
+
+	if (size && count > (bes_size)-1 / size)
+	{
+		return 0;
+	}
+
+	const bes_u32 hooks = bes_memory_hooks();
+	if (BES_UNLIKELY(hooks))
+	{
+		return bes_calloc_hooked(hooks, count * size, BES_RETURN_ADDRESS());
+	}
+
+	return bes_alloc_calloc(count * size);
+}
+
+void*
+bes_realloc_zeroed(void *const ptr, bes_size old_size, bes_size size)
+{
+	BES_ASSERT(g_bes_allocator);
+
+	const bes_u32 hooks = bes_memory_hooks();
+	if (!ptr)
+	{
+		return BES_UNLIKELY(hooks)
+			? bes_calloc_hooked(hooks, size, BES_RETURN_ADDRESS())
+			: bes_alloc_calloc(size);
+	}
+
+	BES_ASSERT(old_size <= bes_malloc_usable_size(ptr));
+
+	/* Clearing large growth would touch pages an allocator knows to be
+	 * zero, copying the contents into a zeroed allocation doesn't. */
+	bes_allocator *const allocator = g_bes_allocator;
+	if (size > old_size && allocator->allocate_zeroed
+		&& bes_cache_index((size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT) >= BES_CACHE_CLASSES)
+	{
+		void *const data = BES_UNLIKELY(hooks)
+			? bes_calloc_hooked(hooks, size, BES_RETURN_ADDRESS())
+			: bes_alloc_calloc(size);
+		if (data)
+		{
+			bes_memcpy(data, ptr, old_size);
+			bes_free(ptr);
+		}
+		return data;
+	}
+
+	bes_byte *const data = BES_UNLIKELY(hooks)
+		? bes_realloc_hooked(hooks, ptr, size, 0, BES_RETURN_ADDRESS())
+		: bes_alloc_realloc(ptr, size);
+	if (data && size > old_size)
+	{
+		bes_memset(data + old_size, 0, size - old_size);
+	}
+
+	return data;
+}
+
+bes_bool
+bes_realloc_in_place(void *const ptr, bes_size size)
+{
+	BES_ASSERT(g_bes_allocator);
+
+	if (!ptr)
+	{
+		return BES_FALSE;
+	}
+
+	if (BES_LIKELY(!(bes_memory_hooks() & BES_MEMORY_HOOK_STATS)))
+	{
+		return bes_alloc_realloc_in_place(ptr, size);
+	}
+
+	const bes_size before = bes_malloc_usable_size(ptr);
+	const bes_bool resized = bes_alloc_realloc_in_place(ptr, size);
+	if (resized)
+	{
+		bes_stats_record(BES_STATS_REALLOC, size, (bes_s64)(bes_malloc_usable_size(ptr) - before));
+	}
+
+	return resized;
+}
+
+void
+bes_free(void *const ptr)
+{
+	if (ptr)
+	{
+		if (BES_UNLIKELY(bes_memory_hooks() & BES_MEMORY_HOOK_STATS))
+		{
+			bes_stats_record(BES_STATS_FREE, 0, -(bes_s64)bes_malloc_usable_size(ptr));
+		}
+		bes_alloc_free(ptr);
+	}
+}
+
+void
+bes_free_sized(void *const ptr, bes_size size)
+{
+	if (ptr)
+	{
+		if (BES_UNLIKELY(bes_memory_hooks() & BES_MEMORY_HOOK_STATS))
+		{
+			bes_stats_record(BES_STATS_FREE, 0, -(bes_s64)bes_malloc_usable_size(ptr));
+		}
+		bes_alloc_free_sized(ptr, size);
+	}
+}
+
+bes_bool
+bes_malloc_batch(bes_size count, bes_size size, void **const data)
+{
+	BES_ASSERT(g_bes_allocator);
+
+	const bes_u32 hooks = bes_memory_hooks();
+	if (BES_UNLIKELY(hooks))
+	{
+		/* Every block is sampled and counted on its own. */
+		for (bes_size i = 0; i < count; i++)
+		{
+			if (!(data[i] = bes_malloc_hooked(hooks, size, BES_ALIGNMENT, 0, BES_RETURN_ADDRESS())))
+			{
+				bes_free_batch(data, i);
+				return BES_FALSE;
+			}
+		}
+		return BES_TRUE;
+	}
+
+	return bes_alloc_malloc_batch(count, size, data);
+}
+
+void
+bes_free_batch(void *const *const data, bes_size count)
+{
+	if (BES_UNLIKELY(bes_memory_hooks() & BES_MEMORY_HOOK_STATS))
+	{
+		for (bes_size i = 0; i < count; i++)
+		{
+			if (data[i])
+			{
+				bes_stats_record(BES_STATS_FREE, 0, -(bes_s64)bes_malloc_usable_size(data[i]));
+			}
+		}
+	}
+
+	bes_alloc_free_batch(data, count);
+}
+
+bes_size
+bes_malloc_usable_size(const void *const ptr)
+{
+	if (!ptr)
+	{
+		return 0;
+	}
+
+	if (g_bes_headerless)
+	{
+		return g_bes_allocator->usable_size(g_bes_allocator, ptr);
+	}
+
+	return ((const bes_alloc_header *)ptr - 1)->data.size;
+}
+
+void
+bes_memory_stats_enable(bes_bool enable)
+{
+	bes_memory_hooks_set(BES_MEMORY_HOOK_STATS, enable);
+}
+
+void
+bes_memory_stats(bes_memory_snapshot *const snapshot)
+{
+	BES_ASSERT(snapshot);
+
+	bes_u64 live = bes_atomic_load_u64(&g_bes_stats_live, BES_ATOMIC_RELAXED);
+	bes_u64 calls[3] = { 0, 0, 0 };
+	for (bes_size i = 0; i < BES_MEMORY_STATS_CLASSES; i++)
+	{
+		snapshot->histogram[i] = 0;
+	}
+
+	bes_u32 used = bes_atomic_load_u32(&g_bes_stats_records_used, BES_ATOMIC_RELAXED);
+	if (used > BES_MEMORY_STATS_THREADS)
+	{
+		used = BES_MEMORY_STATS_THREADS;
+	}
+
+	for (bes_size i = 0; i < used; i++)
+	{
+		bes_stats *const stats = &g_bes_stats_records[i].data;
+		for (bes_size j = 0; j < 3; j++)
+		{
+			calls[j] += bes_atomic_load_u64(&stats->calls[j], BES_ATOMIC_RELAXED);
+		}
+		for (bes_size j = 0; j < BES_MEMORY_STATS_CLASSES; j++)
+		{
+			snapshot->histogram[j] += bes_atomic_load_u64(&stats->histogram[j], BES_ATOMIC_RELAXED);
+		}
+		live += bes_atomic_load_u64(&stats->pending, BES_ATOMIC_RELAXED);
+	}
+
+	/* Blocks allocated before statistics were enabled and freed after
+	 * would make the count negative. */
+	const bes_u64 peak = bes_atomic_load_u64(&g_bes_stats_peak, BES_ATOMIC_RELAXED);
+	snapshot->live = (bes_s64)live > 0 ? (bes_size)live : 0;
+	snapshot->peak = (bes_s64)peak > (bes_s64)snapshot->live ? (bes_size)peak : snapshot->live;
+	snapshot->mallocs = calls[BES_STATS_MALLOC];
+	snapshot->reallocs = calls[BES_STATS_REALLOC];
+	snapshot->frees = calls[BES_STATS_FREE];
+}
+
+void
+bes_memory_profile_start(bes_size rate)
+{
+	if (rate)
+	{
+		bes_atomic_store_u64(&g_bes_profile_rate, rate, BES_ATOMIC_RELAXED);
+		bes_memory_hooks_set(BES_MEMORY_HOOK_PROFILE, BES_TRUE);
+	}
+	else
+	{
+		bes_memory_profile_stop();
+	}
+}
+
+void
+bes_memory_profile_stop(void)
+{
+	bes_memory_hooks_set(BES_MEMORY_HOOK_PROFILE, BES_FALSE);
+}
+
+static char*
+bes_profile_format_u64(char *out, bes_u64 value, bes_u64 base)
+{
+	char digits[20];
+	bes_size count = 0;
+	do
+	{
+		digits[count++] = "0123456789abcdef"[value % base];
+		value /= base;
+	} while (value);
+
+	while (count)
+	{
+		*out++ = digits[--count];
+	}
+
+	return out;
+}
+
+static char*
+bes_profile_format_string(char *out, const char *string, bes_size limit)
+{
+	while (*string && limit--)
+	{
+		*out++ = *string++;
+	}
+	return out;
+}
+
+static bes_bool
+bes_profile_write(bes_stream *const stream, const char *const begin, const char *const end)
+{
+	bes_size written = 0;
+	return bes_stream_write(stream, begin, (bes_size)(end - begin), &written);
+}
+
+/* Copy the mappings of the process so pprof can symbolize addresses. Not
+ * being able to read them leaves the profile unsymbolized, not invalid. */
+static bes_bool
+bes_profile_write_maps(bes_stream *const stream)
+{
+#if defined(BES_PLATFORM_LINUX)
+	const int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return BES_TRUE;
+	}
+
+	char chunk[4096];
+	bes_bool result = BES_TRUE;
+	for (;;)
+	{
+		const ssize_t length = read(fd, chunk, sizeof chunk);
+		if (length < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (length <= 0)
+		{
+			break;
+		}
+		if (!bes_profile_write(stream, chunk, chunk + length))
+		{
+			result = BES_FALSE;
+			break;
+		}
+	}
+
+	close(fd);
+	return result;
+#else
+	(void)stream;
+	return BES_TRUE;
+#endif
+}
+
+/* Counts in the pprof format are "live: bytes [total: bytes]". */
+static char*
+bes_profile_format_pprof_counts(char *out, const bes_profile_site *const site)
+{
+	out = bes_profile_format_u64(out, site->live_count, 10);
+	out = bes_profile_format_string(out, ": ", 2);
+	out = bes_profile_format_u64(out, site->live_bytes, 10);
+	out = bes_profile_format_string(out, " [", 2);
+	out = bes_profile_format_u64(out, site->total_count, 10);
+	out = bes_profile_format_string(out, ": ", 2);
+	out = bes_profile_format_u64(out, site->total_bytes, 10);
+	return bes_profile_format_string(out, "] @", 3);
+}
+
+bes_bool
+bes_memory_profile_dump(bes_stream *const stream, bes_memory_profile_format format)
+{
+	if (!stream)
+	{
+		return BES_FALSE;
+	}
+
+	/* Sites are copied out one at a time so the stream is written without
+	 * holding the lock, writing may well allocate. */
+	bes_profile_site total = { 0, 0, 0, 0, 0, 0 };
+	for (bes_size i = 0; i <= BES_MEMORY_PROFILE_SITES; i++)
+	{
+		bes_profile_lock();
+		const bes_profile_site site = g_bes_profile_sites[i];
+		bes_profile_unlock();
+		total.live_count += site.live_count;
+		total.live_bytes += site.live_bytes;
+		total.total_count += site.total_count;
+		total.total_bytes += site.total_bytes;
+	}
+
+	const bes_u64 rate = bes_atomic_load_u64(&g_bes_profile_rate, BES_ATOMIC_RELAXED);
+
+	char line[256];
+	char *out = line;
+	if (format == BES_MEMORY_PROFILE_PPROF)
+	{
+		/* The legacy heap profile format of gperftools. Counts are of the
+		 * samples taken, heap_v2 tells pprof to scale them by the rate. */
+		out = bes_profile_format_string(out, "heap profile: ", 14);
+		out = bes_profile_format_pprof_counts(out, &total);
+		out = bes_profile_format_string(out, " heap_v2/", 9);
+		out = bes_profile_format_u64(out, rate, 10);
+	}
+	else
+	{
+		out = bes_profile_format_string(out, "# heap profile sampled every ", 29);
+		out = bes_profile_format_u64(out, rate, 10);
+		out = bes_profile_format_string(out, " bytes\n# live_count live_bytes total_count total_bytes site", 60);
+	}
+	*out++ = '\n';
+	if (!bes_profile_write(stream, line, out))
+	{
+		return BES_FALSE;
+	}
+
+	for (bes_size i = 0; i <= BES_MEMORY_PROFILE_SITES; i++)
+	{
+		bes_profile_lock();
+		const bes_profile_site site = g_bes_profile_sites[i];
+		bes_profile_unlock();
+
+		if (site.total_count == 0)
+		{
+			continue;
+		}
+
+		out = line;
+		if (format == BES_MEMORY_PROFILE_PPROF)
+		{
+			out = bes_profile_format_pprof_counts(out, &site);
+			out = bes_profile_format_string(out, " 0x", 3);
+			out = bes_profile_format_u64(out, (bes_u64)(bes_uintptr)site.address, 16);
+		}
+		else
+		{
+			out = bes_profile_format_u64(out, site.live_count, 10);
+			*out++ = ' ';
+			out = bes_profile_format_u64(out, site.live_bytes, 10);
+			*out++ = ' ';
+			out = bes_profile_format_u64(out, site.total_count, 10);
+			*out++ = ' ';
+			out = bes_profile_format_u64(out, site.total_bytes, 10);
+			*out++ = ' ';
+			if (i == BES_MEMORY_PROFILE_SITES)
+			{
+				out = bes_profile_format_string(out, "(other)", 7);
+			}
+			else if (site.tag)
+			{
+				out = bes_profile_format_string(out, site.tag, 128);
+			}
+			else
+			{
+				out = bes_profile_format_string(out, "0x", 2);
+				out = bes_profile_format_u64(out, (bes_u64)(bes_uintptr)site.address, 16);
+			}
+		}
+		*out++ = '\n';
+
+		if (!bes_profile_write(stream, line, out))
+		{
+			return BES_FALSE;
+		}
+	}
+
+	if (format == BES_MEMORY_PROFILE_PPROF)
+	{
+		static const char maps[] = "\nMAPPED_LIBRARIES:\n";
+		return bes_profile_write(stream, maps, maps + sizeof maps - 1)
+			&& bes_profile_write_maps(stream);
+	}
+
+	return BES_TRUE;
+}
+
+/* Chunks are linked from the most recent to the oldest so rewinding only
+ * has to walk the chunks that were obtained after the marker. */
+typedef union bes_arena_chunk_header bes_arena_chunk_header;
+
+struct bes_arena_chunk
+{
+	bes_arena_chunk *prev;
+	bes_byte *end;
+};
+
+union bes_arena_chunk_header
+{
+	bes_arena_chunk data;
+	bes_byte aligned[(sizeof(bes_arena_chunk) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT];
+};
+
+/* Allocations made through the allocator interface are prefixed with
+ * their size so they can be reallocated and so the most recent one can
+ * be given back on free. Direct arena allocations don't pay for this. */
+typedef union bes_arena_prefix bes_arena_prefix;
+
+union bes_arena_prefix
+{
+	bes_size size;
+	bes_byte aligned[(sizeof(bes_size) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT];
+};
+
+static inline bes_byte*
+bes_arena_chunk_begin(bes_arena_chunk *const chunk)
+{
+	return (bes_byte *)((bes_uintptr)((bes_byte *)chunk + sizeof(bes_arena_chunk_header) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT);
+}
+
+static void* BES_API
+bes_arena_interface_allocate(bes_allocator *allocator, bes_size size)
+{
+	bes_arena *const arena = allocator->aux;
+	if (size > (bes_size)-1 - sizeof(bes_arena_prefix))
+	{
+		return 0;
+	}
+
+	bes_arena_prefix *const prefix = bes_arena_allocate(arena, size + sizeof *prefix);
+	if (prefix)
+	{
+		prefix->size = (size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT;
+		return prefix + 1;
+	}
+	return 0;
+}
+
+static bes_bool BES_API
+bes_arena_interface_reallocate_in_place(bes_allocator *allocator, void *data, bes_size size)
+{
+	bes_arena *const arena = allocator->aux;
+	bes_arena_prefix *const prefix = (bes_arena_prefix *)data - 1;
+	if (size > (bes_size)-1 - BES_ALIGNMENT)
+	{
+		return BES_FALSE;
+	}
+
+	const bes_size rounded = (size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT;
+
+	/* The most recent allocation can be resized in place as long as the
+	 * chunk has room for it. */
+	if ((bes_byte *)data + prefix->size == arena->cursor
+		&& rounded <= (bes_size)(arena->end - (bes_byte *)data))
+	{
+		arena->cursor = (bes_byte *)data + rounded;
+		prefix->size = rounded;
+		return BES_TRUE;
+	}
+
+	return rounded <= prefix->size ? BES_TRUE : BES_FALSE;
+}
+
+static void* BES_API
+bes_arena_interface_reallocate(bes_allocator *allocator, void *data, bes_size size)
+{
+	if (bes_arena_interface_reallocate_in_place(allocator, data, size))
+	{
+		return data;
+	}
+
+	const bes_size preserve = ((bes_arena_prefix *)data - 1)->size;
+	void *const resize = bes_arena_interface_allocate(allocator, size);
+	if (resize)
+	{
+		bes_memcpy(resize, data, preserve);
+	}
+
+	return resize;
+}
+
+static void BES_API
+bes_arena_interface_deallocate(bes_allocator *allocator, void *data)
+{
+	bes_arena *const arena = allocator->aux;
+	bes_arena_prefix *const prefix = (bes_arena_prefix *)data - 1;
+
+	/* Only the most recent allocation can be given back. */
+	if ((bes_byte *)data + prefix->size == arena->cursor)
+	{
+		arena->cursor = (bes_byte *)prefix;
+	}
+}
+
+static bes_size BES_API
+bes_arena_interface_allocate_batch(bes_allocator *allocator, bes_size size, bes_size count, void **data)
+{
+	/* The batch is carved out of one contiguous allocation. */
+	bes_arena *const arena = allocator->aux;
+	const bes_size rounded = (size + BES_ALIGNMENT - 1) & -BES_ALIGNMENT;
+	const bes_size stride = rounded + sizeof(bes_arena_prefix);
+	if (count > ~(bes_size)0 / stride)
+	{
+		return 0;
+	}
+
+	bes_byte *const block = bes_arena_allocate(arena, stride * count);
+	if (!block)
+	{
+		return 0;
+	}
+
+	for (bes_size i = 0; i < count; i++)
+	{
+		bes_arena_prefix *const prefix = (bes_arena_prefix *)(block + i * stride);
+		prefix->size = rounded;
+		data[i] = prefix + 1;
+	}
+
+	return count;
+}
+
+static void BES_API
+bes_arena_interface_deallocate_batch(bes_allocator *allocator, void *const *data, bes_size count)
+{
+	/* Going backwards gives back a whole batch freed in the order it was
+	 * allocated. */
+	while (count--)
+	{
+		bes_arena_interface_deallocate(allocator, data[count]);
+	}
+}
+
+void
+bes_arena_init(bes_arena *const arena,
+               bes_allocator *const backing,
+               bes_size chunk_size)
+{
+	BES_ASSERT(arena);
+
+	arena->allocator.allocate = &bes_arena_interface_allocate;
+	arena->allocator.reallocate = &bes_arena_interface_reallocate;
+	arena->allocator.deallocate = &bes_arena_interface_deallocate;
+	arena->allocator.aux = arena;
+	arena->allocator.flags = 0;
+	arena->allocator.deallocate_sized = 0;
+	arena->allocator.alignment = 0;
+	arena->allocator.usable_size = 0;
+	arena->allocator.allocate_aligned = 0;
+	arena->allocator.reallocate_in_place = &bes_arena_interface_reallocate_in_place;
+	arena->allocator.allocate_batch = &bes_arena_interface_allocate_batch;
+	arena->allocator.deallocate_batch = &bes_arena_interface_deallocate_batch;
+	arena->allocator.allocate_zeroed = 0;
+	arena->allocator.trim = 0;
+	arena->backing = backing ? backing : bes_allocator_get();
+	arena->chunk = 0;
+	arena->cursor = 0;
+	arena->end = 0;
+	arena->chunk_size = chunk_size ? chunk_size : BES_ARENA_CHUNK_SIZE;
+
+	BES_ASSERT(arena->backing);
+}
+
+void*
+bes_arena_grow(bes_arena *const arena, bes_size size)
+{
+	/* Oversized requests get a chunk of their own. */
+	const bes_size capacity = size > arena->chunk_size ? size : arena->chunk_size;
+	if (capacity > (bes_size)-1 - sizeof(bes_arena_chunk_header) - BES_ALIGNMENT)
+	{
+		return 0;
+	}
+
+	bes_allocator *const backing = arena->backing;
+	bes_arena_chunk *const chunk = backing->allocate(backing, sizeof(bes_arena_chunk_header) + capacity + BES_ALIGNMENT);
+	if (!chunk)
+	{
+		return 0;
+	}
+
+	bes_byte *const data = bes_arena_chunk_begin(chunk);
+	chunk->prev = arena->chunk;
+	chunk->end = data + capacity;
+
+	arena->chunk = chunk;
+	arena->cursor = data + size;
+	arena->end = chunk->end;
+
+	return data;
+}
+
+bes_arena_marker
+bes_arena_mark(const bes_arena *const arena)
+{
+	bes_arena_marker marker;
+	marker.chunk = arena->chunk;
+	marker.cursor = arena->cursor;
+	return marker;
+}
+
+void
+bes_arena_rewind(bes_arena *const arena, bes_arena_marker marker)
+{
+	bes_allocator *const backing = arena->backing;
+	while (arena->chunk != marker.chunk)
+	{
+		bes_arena_chunk *const prev = arena->chunk->prev;
+		backing->deallocate(backing, arena->chunk);
+		arena->chunk = prev;
+	}
+
+	arena->cursor = marker.cursor;
+	arena->end = arena->chunk ? arena->chunk->end : 0;
+}
+
+void
+bes_arena_reset(bes_arena *const arena)
+{
+	if (!arena->chunk)
+	{
+		return;
+	}
+
+	bes_allocator *const backing = arena->backing;
+	while (arena->chunk->prev)
+	{
+		bes_arena_chunk *const prev = arena->chunk->prev;
+		backing->deallocate(backing, arena->chunk);
+		arena->chunk = prev;
+	}
+
+	arena->cursor = bes_arena_chunk_begin(arena->chunk);
+	arena->end = arena->chunk->end;
+}
+
+void
+bes_arena_release(bes_arena *const arena)
+{
+	bes_arena_marker empty;
+	empty.chunk = 0;
+	empty.cursor = 0;
+	bes_arena_rewind(arena, empty);
+}
@@ -9,16 +9,46 @@
  * @{
  */
 #include <bes/foundation/types.h>
+#include <bes/foundation/macros.h>
+#include <bes/foundation/stream.h>
 
 #if defined(__cplusplus)
 extern "C" {
 #endif
 
+/**
+ * @brief Flags describing an allocator
+ */
+enum bes_allocator_flags
+{
+	/**
+	 * Blocks freed on a thread are kept in a cache local to that thread
+	 * and handed back out by @ref bes_malloc without calling into the
+	 * allocator. Only suitable for allocators where memory is given back
+	 * by freeing it, not for ones which release memory in bulk.
+	 */
+	BES_ALLOCATOR_CACHE = 1 << 0
+};
+
 /**
  * @brief Interface used to describe an allocator
  *
  * The functions supplied by this structure must be implemented following
- * the same requirements as malloc, realloc and free.
+ * the same requirements as malloc, realloc and free. Memory is always
+ * given back to the allocator that made the allocation, which may happen
+ * on a thread other than the one that made it when memory is exchanged
+ * between threads.
+ *
+ * An allocator which guarantees an @ref alignment of at least
+ * @ref BES_ALIGNMENT and knows the size of its blocks through
+ * @ref usable_size is headerless. @ref bes_malloc hands out its memory
+ * directly instead of placing a header in front of it, which saves up to
+ * two alignments worth of memory per allocation. Since no header records
+ * the owner, memory obtained while a headerless allocator is set must only
+ * be reallocated and freed while that same allocator is set, and memory
+ * obtained otherwise must not be freed while it is set. Debug builds
+ * assert memory freed through a headerless allocator has a usable size
+ * and memory freed otherwise has a header.
  */
 typedef struct bes_allocator bes_allocator;
 struct bes_allocator
@@ -31,12 +61,71 @@ struct bes_allocator
 	void (BES_API *deallocate)(bes_allocator *allocator, void *data);
 	/** @brief Optional user specified data */
 	void *aux;
+	/** @brief Optional flags, see @ref bes_allocator_flags */
+	bes_u32 flags;
+	/**
+	 * @brief Optional deallocation function which is also given the size
+	 * the memory was last allocated or reallocated with. When supplied it
+	 * is used instead of @ref deallocate.
+	 */
+	void (BES_API *deallocate_sized)(bes_allocator *allocator, void *data, bes_size size);
+	/** @brief Optional alignment guaranteed for all memory returned */
+	bes_size alignment;
+	/**
+	 * @brief Optional function returning the usable size of a block
+	 * @note Allocators which can tell a block isn't theirs return zero for
+	 * it.
+	 */
+	bes_size (BES_API *usable_size)(bes_allocator *allocator, const void *data);
+	/**
+	 * @brief Optional aligned allocation function, used by headerless
+	 * allocators for alignments larger than @ref alignment. Without it such
+	 * requests fail.
+	 */
+	void* (BES_API *allocate_aligned)(bes_allocator *allocator, bes_size size, bes_size alignment);
+	/**
+	 * @brief Optional function to resize a block without moving it
+	 * @return BES_FALSE if the block can't be resized where it is, in which
+	 * case the block must be left as it was.
+	 */
+	bes_bool (BES_API *reallocate_in_place)(bes_allocator *allocator, void *data, bes_size size);
+	/**
+	 * @brief Optional function to allocate many blocks of the same size at
+	 * once, storing them in @p data
+	 * @return The amount of blocks allocated, which may be fewer than
+	 * @p count. The rest are allocated one at a time.
+	 */
+	bes_size (BES_API *allocate_batch)(bes_allocator *allocator, bes_size size, bes_size count, void **data);
+	/**
+	 * @brief Optional function to deallocate many blocks at once. When
+	 * supplied it is used instead of @ref deallocate and
+	 * @ref deallocate_sized for blocks freed together.
+	 */
+	void (BES_API *deallocate_batch)(bes_allocator *allocator, void *const *data, bes_size count);
+	/**
+	 * @brief Optional allocation function which also reports whether the
+	 * memory is known to be zero, such as pages fresh from the operating
+	 * system. When supplied it is used by @ref bes_calloc, which skips
+	 * clearing memory reported as zeroed.
+	 * @note @p zeroed is always set, to BES_FALSE if the memory may hold
+	 * anything.
+	 */
+	void* (BES_API *allocate_zeroed)(bes_allocator *allocator, bes_size size, bes_bool *zeroed);
+	/**
+	 * @brief Optional function to give memory the allocator holds on to
+	 * but doesn't use back to where it came from, see
+	 * @ref bes_allocator_trim
+	 * @return The amount of bytes given back
+	 */
+	bes_size (BES_API *trim)(bes_allocator *allocator);
 };
 
 /**
  * @brief Set the allocator to carry out allocations
  * @param allocator The allocator to use for the calling thread
  * @note An allocator must be supplied.
+ * @note Changing the allocator of a thread flushes the cache of that
+ * thread, see @ref bes_allocator_flush.
  * @warning The allocator is thread local and must be set by every calling thread
  * @warning If no allocator is specified foundation will terminate.
  * @return If the allocator specified doesn't implement the full interface
@@ -45,6 +134,72 @@ struct bes_allocator
 BES_EXPORT bes_bool BES_API
 bes_allocator_set(bes_allocator *const allocator);
 
+/** @brief The most allocators which can be pushed on a thread at once */
+#define BES_ALLOCATOR_STACK_DEPTH 16
+
+/**
+ * @brief Temporarily carry out allocations with another allocator
+ * @param allocator The allocator to use for the calling thread until the
+ * matching @ref bes_allocator_pop
+ *
+ * This routes every allocation made on the calling thread, including the
+ * ones made inside foundation, to @p allocator. A hot path can push an
+ * arena, call into code which allocates scratch memory and then pop and
+ * rewind the arena. Memory is still reallocated and freed by the allocator
+ * which made it, whether or not it is the one on top.
+ *
+ * @note Allocations made while an allocator is pushed always carry a
+ * header, even when the allocator is headerless, so they can be freed once
+ * it is popped. The thread cache is bypassed while an allocator is pushed.
+ * @note @ref bes_allocator_set replaces the allocator on top.
+ * @return BES_FALSE if the allocator doesn't implement the full interface,
+ * if @ref BES_ALLOCATOR_STACK_DEPTH allocators are already pushed, or if
+ * the allocator set for the thread is headerless, which assumes it owns
+ * every block freed on the thread.
+ */
+BES_EXPORT bes_bool BES_API
+bes_allocator_push(bes_allocator *const allocator);
+
+/**
+ * @brief Go back to the allocator in use before the most recent
+ * @ref bes_allocator_push
+ * @warning Must be paired with a successful @ref bes_allocator_push.
+ */
+BES_EXPORT void BES_API
+bes_allocator_pop(void);
+
+/**
+ * @brief Give every block cached by the calling thread back to the
+ * allocator that owns it.
+ * @note Threads flush their cache when they exit on Linux and Windows,
+ * elsewhere threads using an allocator with @ref BES_ALLOCATOR_CACHE must
+ * call this before exiting, otherwise the blocks they cached are leaked.
+ */
+BES_EXPORT void BES_API
+bes_allocator_flush(void);
+
+/**
+ * @brief Give memory that isn't in use back
+ *
+ * Flushes the cache of the calling thread and asks the allocator set for
+ * it, and every allocator pushed on it, to give back the memory they hold
+ * on to without using. Caches and pools built on foundation do the same
+ * when told of memory pressure, see @ref bes_memory_pressure_subscribe.
+ *
+ * @note Allocators keeping memory per thread only give back the memory of
+ * the calling thread.
+ * @return The amount of bytes the allocators gave back
+ */
+BES_EXPORT bes_size BES_API
+bes_allocator_trim(void);
+
+/**
+ * @brief Get the allocator carrying out allocations
+ * @return The allocator set for the calling thread
+ */
+BES_EXPORT bes_allocator* BES_API
+bes_allocator_get(void);
+
 /**
  * @brief Allocate memory
  * @param size The size of the allocation request
@@ -53,15 +208,95 @@ bes_allocator_set(bes_allocator *const allocator);
 BES_EXPORT void* BES_API
 bes_malloc(bes_size size);
 
+/**
+ * @brief Allocate memory attributed to a tag by the heap profiler
+ * @param size The size of the allocation
+ * @param tag The site sampled allocations are counted towards
+ * @note Tags are told apart by address rather than contents and must
+ * outlive the profile, string literals are ideal.
+ * @return Same as @ref bes_malloc
+ */
+BES_EXPORT void* BES_API
+bes_malloc_tagged(bes_size size, const char *const tag);
+
 /**
  * @brief Reallocate memory
  * @param ptr The original pointer to resize the allocation of
  * @param size The size to resize the allocation to
+ * @note The allocation is resized in place when the allocator can, and
+ * keeps the alignment it was made with otherwise.
  * @return On failure this function returns NULL
  */
 BES_EXPORT void* BES_API
 bes_realloc(void *const ptr, bes_size size);
 
+/**
+ * @brief Allocate aligned memory
+ * @param size The size of the allocation request
+ * @param alignment The alignment of the allocation, a power of two
+ * @note Alignments smaller than @ref BES_ALIGNMENT are raised to it.
+ * @note The memory is given back with @ref bes_free like any other and
+ * keeps its alignment when resized with @ref bes_realloc.
+ * @return On failure, or when @p alignment isn't a power of two, this
+ * function returns NULL
+ */
+BES_EXPORT void* BES_API
+bes_malloc_aligned(bes_size size, bes_size alignment);
+
+/**
+ * @brief Reallocate memory with a specific alignment
+ * @param ptr The original pointer to resize the allocation of
+ * @param size The size to resize the allocation to
+ * @param alignment The alignment of the allocation, a power of two
+ * @warning Memory from a headerless allocator that is aligned beyond the
+ * alignment the allocator guarantees must be resized with this rather than
+ * @ref bes_realloc, since nothing records its alignment.
+ * @return On failure, or when @p alignment isn't a power of two, this
+ * function returns NULL
+ */
+BES_EXPORT void* BES_API
+bes_realloc_aligned(void *const ptr, bes_size size, bes_size alignment);
+
+/**
+ * @brief Allocate zeroed memory
+ * @param count The amount of elements
+ * @param size The size of each element
+ * @note Allocators which know their memory to be zero, like the memory
+ * mapped allocator for large requests, are not made to clear it again. The
+ * pages of such allocations are only touched once they are used.
+ * @return On failure, or when @p count times @p size overflows, this
+ * function returns NULL
+ */
+BES_EXPORT void* BES_API
+bes_calloc(bes_size count, bes_size size);
+
+/**
+ * @brief Reallocate memory, zeroing what it grows by
+ * @param ptr The original pointer to resize the allocation of, NULL to
+ * allocate zeroed memory like @ref bes_calloc
+ * @param old_size The size the original allocation was requested with
+ * @param size The size to resize the allocation to
+ * @note The bytes from @p old_size on are zero, the contents before it are
+ * preserved as with @ref bes_realloc. Large growth on allocators which
+ * know their memory to be zero is made like @ref bes_calloc followed by a
+ * copy, so the pages it grows by are not touched.
+ * @return On failure this function returns NULL
+ */
+BES_EXPORT void* BES_API
+bes_realloc_zeroed(void *const ptr, bes_size old_size, bes_size size);
+
+/**
+ * @brief Resize memory without moving it
+ * @param ptr The pointer to resize the allocation of
+ * @param size The size to resize the allocation to
+ * @note Shrinking always succeeds. Growing requires the allocator to
+ * support resizing in place and to have room after the allocation.
+ * @return BES_TRUE if the allocation now holds at least @p size bytes at
+ * @p ptr, BES_FALSE if it's unchanged.
+ */
+BES_EXPORT bes_bool BES_API
+bes_realloc_in_place(void *const ptr, bes_size size);
+
 /**
  * @brief Free memory
  * @param ptr The pointer to free
@@ -70,6 +305,271 @@ bes_realloc(void *const ptr, bes_size size);
 BES_EXPORT void BES_API
 bes_free(void *const ptr);
 
+/**
+ * @brief Free memory of a known size
+ * @param ptr The pointer to free
+ * @param size The size the memory was allocated or last reallocated with
+ * @note Allocators without a header pass @p size on to
+ * @ref bes_allocator::deallocate_sized, which saves size-class allocators
+ * looking it up. A size smaller than the one requested by less than
+ * @ref BES_ALIGNMENT, or larger up to the usable size, works as well.
+ * @note It's safe to pass NULL.
+ */
+BES_EXPORT void BES_API
+bes_free_sized(void *const ptr, bes_size size);
+
+/**
+ * @brief Allocate many blocks of the same size at once
+ * @param count The amount of blocks to allocate
+ * @param size The size of each block
+ * @param data The blocks are stored here
+ * @note Allocators supporting it serve the whole batch in one call, often
+ * from contiguous memory. Each block is given back with @ref bes_free or
+ * @ref bes_free_batch like any other.
+ * @return On failure no blocks are allocated and BES_FALSE is returned.
+ */
+BES_EXPORT bes_bool BES_API
+bes_malloc_batch(bes_size count, bes_size size, void **const data);
+
+/**
+ * @brief Free many blocks at once
+ * @param data The blocks to free, which may come from different
+ * allocators
+ * @param count The amount of blocks
+ * @note NULL blocks are skipped. Consecutive blocks of the same allocator
+ * are given back to it together when it supports that.
+ */
+BES_EXPORT void BES_API
+bes_free_batch(void *const *const data, bes_size count);
+
+/**
+ * @brief Get the usable size of an allocation
+ * @param ptr The pointer to get the usable size of
+ * @return The amount of bytes that can be used through @p ptr, which is at
+ * least the size it was allocated with. Zero is returned for NULL.
+ */
+BES_EXPORT bes_size BES_API
+bes_malloc_usable_size(const void *const ptr);
+
+/** @brief The amount of size classes in @ref bes_memory_snapshot::histogram */
+#define BES_MEMORY_STATS_CLASSES (sizeof(bes_size) * 8)
+
+/**
+ * @brief The amount of threads keeping statistics of their own, threads
+ * beyond this share statistics which is slower
+ */
+#define BES_MEMORY_STATS_THREADS 64
+
+typedef struct bes_memory_snapshot bes_memory_snapshot;
+
+/** @brief Allocation statistics summed over all threads */
+struct bes_memory_snapshot
+{
+	bes_size live; /**< Bytes currently allocated */
+	bes_size peak; /**< The most bytes allocated at once */
+	bes_u64 mallocs; /**< Calls allocating memory */
+	bes_u64 reallocs; /**< Calls resizing memory */
+	bes_u64 frees; /**< Calls freeing memory */
+	bes_u64 histogram[BES_MEMORY_STATS_CLASSES]; /**< Allocations and reallocations by the base two logarithm of their size */
+};
+
+/**
+ * @brief Enable or disable allocation statistics
+ * @param enable Whether to keep statistics
+ * @note Statistics are disabled by default and cost a single branch per
+ * call to the allocation functions while disabled.
+ * @note Byte counts are of usable size, which includes rounding.
+ * @warning Blocks allocated while statistics are disabled and freed while
+ * enabled, or the other way around, make the live count inaccurate. Enable
+ * statistics before allocating to keep it exact.
+ */
+BES_EXPORT void BES_API
+bes_memory_stats_enable(bes_bool enable);
+
+/**
+ * @brief Take a snapshot of the allocation statistics of all threads
+ * @param snapshot The snapshot to fill out
+ * @note Statistics of other threads are read while they may be changing,
+ * so the snapshot is only consistent when those threads are idle.
+ * @note The peak is tracked in batches of changes and may be off by up to
+ * 64 KiB for each thread.
+ */
+BES_EXPORT void BES_API
+bes_memory_stats(bes_memory_snapshot *const snapshot);
+
+/** @brief The amount of sites the heap profiler tells apart */
+#define BES_MEMORY_PROFILE_SITES 1024
+
+/** @brief Formats of the heap profile */
+enum bes_memory_profile_format
+{
+	/** One line per site of live and total sampled counts and bytes */
+	BES_MEMORY_PROFILE_TEXT,
+	/**
+	 * The legacy heap profile format of gperftools read by pprof. The
+	 * mappings of the process, /proc/self/maps, are appended on Linux for
+	 * pprof to symbolize it.
+	 */
+	BES_MEMORY_PROFILE_PPROF
+};
+
+typedef enum bes_memory_profile_format bes_memory_profile_format;
+
+/**
+ * @brief Start sampling allocations for the heap profile
+ * @param rate The mean amount of bytes allocated between samples
+ * @note Allocations are sampled at the return address of the allocation
+ * function they were made with, or by tag with @ref bes_malloc_tagged.
+ * Allocations made while a headerless allocator is set are not sampled.
+ * @note Sampling while stopped costs a single branch per call to the
+ * allocation functions, the same one checking for statistics.
+ */
+BES_EXPORT void BES_API
+bes_memory_profile_start(bes_size rate);
+
+/**
+ * @brief Stop sampling allocations
+ * @note Sampled allocations still count towards the live columns of the
+ * profile until they are freed.
+ */
+BES_EXPORT void BES_API
+bes_memory_profile_stop(void);
+
+/**
+ * @brief Write the heap profile
+ * @param stream The stream to write the profile to
+ * @param format The format of the profile
+ * @return BES_TRUE if the profile was written, BES_FALSE if @p stream is
+ * NULL or writing to it failed.
+ */
+BES_EXPORT bes_bool BES_API
+bes_memory_profile_dump(bes_stream *const stream, bes_memory_profile_format format);
+
+/** @brief Default size of an arena chunk */
+#define BES_ARENA_CHUNK_SIZE (64 * 1024)
+
+typedef struct bes_arena bes_arena;
+typedef struct bes_arena_chunk bes_arena_chunk;
+typedef struct bes_arena_marker bes_arena_marker;
+
+/**
+ * @brief Linear allocator
+ *
+ * An arena hands out memory by bumping a cursor through large chunks
+ * obtained from a backing allocator. Individual allocations are never
+ * released, instead the arena is rewound to a marker or reset as a whole,
+ * which costs O(chunks) rather than O(allocations).
+ *
+ * The embedded @ref bes_allocator permits an arena to be installed with
+ * @ref bes_allocator_set. When used that way @ref bes_free only reclaims
+ * memory for the most recent allocation, everything else is reclaimed by
+ * @ref bes_arena_rewind, @ref bes_arena_reset or @ref bes_arena_release.
+ */
+struct bes_arena
+{
+	bes_allocator allocator; /**< The allocator interface of the arena */
+	bes_allocator *backing; /**< The allocator chunks are obtained from */
+	bes_arena_chunk *chunk; /**< The most recent chunk */
+	bes_byte *cursor; /**< The next free byte in the most recent chunk */
+	bes_byte *end; /**< The end of the most recent chunk */
+	bes_size chunk_size; /**< The minimum size of a chunk */
+};
+
+/** @brief A saved position in an arena */
+struct bes_arena_marker
+{
+	bes_arena_chunk *chunk; /**< The chunk that was most recent */
+	bes_byte *cursor; /**< The cursor in that chunk */
+};
+
+/**
+ * @brief Initialize an arena
+ * @param arena The arena to initialize
+ * @param backing The allocator to obtain chunks from
+ * @param chunk_size The minimum size of a chunk
+ * @note If @p backing is NULL the allocator set for the calling thread is
+ * used. If @p chunk_size is zero @ref BES_ARENA_CHUNK_SIZE is used.
+ * @warning An arena installed with @ref bes_allocator_set must be given
+ * an explicit @p backing allocator.
+ */
+BES_EXPORT void BES_API
+bes_arena_init(bes_arena *const arena,
+               bes_allocator *const backing,
+               bes_size chunk_size);
+
+/**
+ * @brief Allocate from a new chunk
+ * @param arena The arena
+ * @param size The size of the allocation, a multiple of @ref BES_ALIGNMENT
+ * @warning Do not use this function directly, use @ref bes_arena_allocate
+ * instead, which only calls this when the current chunk is exhausted.
+ * @return On failure this function returns NULL
+ */
+BES_EXPORT void* BES_API
+bes_arena_grow(bes_arena *const arena, bes_size size);
+
+/**
+ * @brief Allocate memory from an arena
+ * @param arena The arena
+ * @param size The size of the allocation request
+ * @note The memory is aligned by @ref BES_ALIGNMENT. Requests of zero
+ * bytes take one alignment unit so they are distinct and never NULL.
+ * @return On failure this function returns NULL
+ */
+static BES_ATTRIBUTE_ALWAYS_INLINE void*
+bes_arena_allocate(bes_arena *const arena, bes_size size)
+{
+	if (BES_UNLIKELY(size > (bes_size)-1 - BES_ALIGNMENT))
+	{
+		return 0;
+	}
+	/* Rounds zero up to a whole alignment unit as well. */
+	size = (size + BES_ALIGNMENT - (size != 0)) & -BES_ALIGNMENT;
+	if (BES_LIKELY((bes_size)(arena->end - arena->cursor) >= size))
+	{
+		void *const data = arena->cursor;
+		arena->cursor += size;
+		return data;
+	}
+	return bes_arena_grow(arena, size);
+}
+
+/**
+ * @brief Save the current position of an arena
+ * @param arena The arena
+ * @return A marker that can be given to @ref bes_arena_rewind
+ */
+BES_EXPORT bes_arena_marker BES_API
+bes_arena_mark(const bes_arena *const arena);
+
+/**
+ * @brief Rewind an arena to a saved position
+ * @param arena The arena
+ * @param marker The marker obtained by @ref bes_arena_mark
+ * @note Chunks obtained after the marker are returned to the backing
+ * allocator.
+ * @warning Markers obtained after @p marker are invalidated.
+ */
+BES_EXPORT void BES_API
+bes_arena_rewind(bes_arena *const arena, bes_arena_marker marker);
+
+/**
+ * @brief Free all allocations of an arena at once
+ * @param arena The arena
+ * @note The oldest chunk is kept so that an arena reset every frame does
+ * not go back to the backing allocator.
+ */
+BES_EXPORT void BES_API
+bes_arena_reset(bes_arena *const arena);
+
+/**
+ * @brief Free all allocations of an arena and return every chunk to the
+ * backing allocator.
+ * @param arena The arena
+ */
+BES_EXPORT void BES_API
+bes_arena_release(bes_arena *const arena);
+
 #if defined(__cplusplus)
 }
 #endif
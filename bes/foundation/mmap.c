@@ -0,0 +1,392 @@
+/* mremap and MAP_ANONYMOUS are extensions. */
+#define _GNU_SOURCE
+
+#include <bes/foundation/mmap.h>
+#include <bes/foundation/atomic.h>
+#include <bes/foundation/string.h>
+
+#if defined(BES_PLATFORM_LINUX)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/* Every block is preceded by a prefix telling mapped blocks apart from
+ * ones passed through. Mapped blocks record the length of their mapping,
+ * blocks passed through their size so they can be copied when they grow
+ * large enough to be mapped. */
+typedef struct bes_mmap_block bes_mmap_block;
+typedef union bes_mmap_prefix bes_mmap_prefix;
+
+enum
+{
+	BES_MMAP_KIND_BACKING,
+	BES_MMAP_KIND_MAPPED,
+	BES_MMAP_KIND_HUGETLB
+};
+
+struct bes_mmap_block
+{
+	bes_size length;
+	bes_size kind;
+};
+
+union bes_mmap_prefix
+{
+	bes_mmap_block data;
+	bes_byte aligned[(sizeof(bes_mmap_block) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT];
+};
+
+static inline bes_mmap_block*
+bes_mmap_block_of(void *const data)
+{
+	return &((bes_mmap_prefix *)data - 1)->data;
+}
+
+static inline bes_size
+bes_mmap_round(bes_size size, bes_size granularity)
+{
+	return (size + granularity - 1) & -granularity;
+}
+
+/* The length of the mapping needed for a block of the given size. */
+static inline bes_size
+bes_mmap_length(const bes_mmap_allocator *const mmap_allocator, bes_size size, bes_size kind)
+{
+	const bes_size granularity = kind == BES_MMAP_KIND_HUGETLB ? BES_MMAP_HUGE_PAGE_SIZE : mmap_allocator->page_size;
+	return bes_mmap_round(size + sizeof(bes_mmap_prefix), granularity);
+}
+
+static inline void
+bes_mmap_account(bes_mmap_allocator *const mmap_allocator, bes_size add, bes_size remove)
+{
+	bes_atomic_add_u64(&mmap_allocator->mapped, (bes_u64)add - (bes_u64)remove, BES_ATOMIC_RELAXED);
+}
+
+static inline void*
+bes_mmap_finish(bes_mmap_allocator *const mmap_allocator, void *const base, bes_size length, bes_size kind)
+{
+	bes_mmap_account(mmap_allocator, length, 0);
+	bes_mmap_block *const block = &((bes_mmap_prefix *)base)->data;
+	block->length = length;
+	block->kind = kind;
+	return (bes_mmap_prefix *)base + 1;
+}
+
+static void*
+bes_mmap_map(bes_mmap_allocator *const mmap_allocator, bes_size size)
+{
+#if defined(BES_PLATFORM_LINUX)
+	const int protection = PROT_READ | PROT_WRITE;
+	const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#if defined(MAP_HUGETLB)
+	if ((mmap_allocator->flags & BES_MMAP_HUGETLB) && size >= BES_MMAP_HUGE_PAGE_SIZE)
+	{
+		const bes_size length = bes_mmap_length(mmap_allocator, size, BES_MMAP_KIND_HUGETLB);
+		void *const base = mmap(0, length, protection, flags | MAP_HUGETLB, -1, 0);
+		if (base != MAP_FAILED)
+		{
+			return bes_mmap_finish(mmap_allocator, base, length, BES_MMAP_KIND_HUGETLB);
+		}
+	}
+#endif
+
+	const bes_size length = bes_mmap_length(mmap_allocator, size, BES_MMAP_KIND_MAPPED);
+
+#if defined(MADV_HUGEPAGE)
+	/* Transparent huge pages can only back huge page aligned ranges, which
+	 * mmap doesn't give out. Map a huge page more than needed and trim the
+	 * mapping down to the aligned range inside of it. */
+	if ((mmap_allocator->flags & BES_MMAP_TRANSPARENT_HUGE_PAGES) && length >= BES_MMAP_HUGE_PAGE_SIZE)
+	{
+		bes_byte *const base = mmap(0, length + BES_MMAP_HUGE_PAGE_SIZE, protection, flags, -1, 0);
+		if (base == MAP_FAILED)
+		{
+			return 0;
+		}
+
+		bes_byte *const aligned = (bes_byte *)bes_mmap_round((bes_uintptr)base, BES_MMAP_HUGE_PAGE_SIZE);
+		const bes_size head = (bes_size)(aligned - base);
+		if (head)
+		{
+			munmap(base, head);
+		}
+		if (head != BES_MMAP_HUGE_PAGE_SIZE)
+		{
+			munmap(aligned + length, BES_MMAP_HUGE_PAGE_SIZE - head);
+		}
+
+		madvise(aligned, length, MADV_HUGEPAGE);
+		return bes_mmap_finish(mmap_allocator, aligned, length, BES_MMAP_KIND_MAPPED);
+	}
+#endif
+
+	void *const base = mmap(0, length, protection, flags, -1, 0);
+	return base != MAP_FAILED ? bes_mmap_finish(mmap_allocator, base, length, BES_MMAP_KIND_MAPPED) : 0;
+#else
+	(void)mmap_allocator;
+	(void)size;
+	return 0;
+#endif
+}
+
+static void
+bes_mmap_unmap(bes_mmap_allocator *const mmap_allocator, void *const data)
+{
+#if defined(BES_PLATFORM_LINUX)
+	bes_mmap_block *const block = bes_mmap_block_of(data);
+	const bes_size length = block->length;
+	munmap(block, length);
+	bes_mmap_account(mmap_allocator, 0, length);
+#else
+	(void)mmap_allocator;
+	(void)data;
+#endif
+}
+
+/* Resize a mapping, moving it only if allowed. */
+static void*
+bes_mmap_remap(bes_mmap_allocator *const mmap_allocator, void *const data, bes_size size, bes_bool move)
+{
+#if defined(BES_PLATFORM_LINUX)
+	bes_mmap_block *const block = bes_mmap_block_of(data);
+	const bes_size length = block->length;
+	const bes_size resize = bes_mmap_length(mmap_allocator, size, block->kind);
+	if (resize == length)
+	{
+		return data;
+	}
+
+	bes_mmap_block *const remapped = mremap(block, length, resize, move ? MREMAP_MAYMOVE : 0);
+	if (remapped == MAP_FAILED)
+	{
+		return 0;
+	}
+
+	remapped->length = resize;
+	bes_mmap_account(mmap_allocator, resize, length);
+	return (bes_mmap_prefix *)remapped + 1;
+#else
+	(void)mmap_allocator;
+	(void)data;
+	(void)size;
+	(void)move;
+	return 0;
+#endif
+}
+
+/* Pass an allocation through to the backing allocator. When zeroed is
+ * given it is set to whether the backing allocator knows the memory to be
+ * zero, which holds for everything after the prefix too. */
+static void*
+bes_mmap_backing_allocate(bes_mmap_allocator *const mmap_allocator, bes_size size, bes_bool *const zeroed)
+{
+	bes_allocator *const backing = mmap_allocator->backing;
+	bes_mmap_prefix *prefix;
+	if (zeroed && backing->allocate_zeroed)
+	{
+		prefix = backing->allocate_zeroed(backing, size + sizeof *prefix, zeroed);
+	}
+	else
+	{
+		prefix = backing->allocate(backing, size + sizeof *prefix);
+		if (zeroed)
+		{
+			*zeroed = BES_FALSE;
+		}
+	}
+	if (!prefix)
+	{
+		return 0;
+	}
+
+	prefix->data.length = size;
+	prefix->data.kind = BES_MMAP_KIND_BACKING;
+	return prefix + 1;
+}
+
+static void
+bes_mmap_backing_deallocate(bes_mmap_allocator *const mmap_allocator, void *const data)
+{
+	bes_allocator *const backing = mmap_allocator->backing;
+	bes_mmap_prefix *const prefix = (bes_mmap_prefix *)data - 1;
+	if (backing->deallocate_sized)
+	{
+		backing->deallocate_sized(backing, prefix, prefix->data.length + sizeof *prefix);
+	}
+	else
+	{
+		backing->deallocate(backing, prefix);
+	}
+}
+
+static void* BES_API
+bes_mmap_allocate(bes_allocator *allocator, bes_size size)
+{
+	bes_mmap_allocator *const mmap_allocator = allocator->aux;
+
+	if (size >= mmap_allocator->threshold)
+	{
+		void *const data = bes_mmap_map(mmap_allocator, size);
+		if (data)
+		{
+			return data;
+		}
+	}
+
+	return bes_mmap_backing_allocate(mmap_allocator, size, 0);
+}
+
+/* Mappings are always fresh and anonymous pages are zero filled by the
+ * kernel when first touched, so they never need clearing. */
+static void* BES_API
+bes_mmap_allocate_zeroed(bes_allocator *allocator, bes_size size, bes_bool *zeroed)
+{
+	bes_mmap_allocator *const mmap_allocator = allocator->aux;
+
+	if (size >= mmap_allocator->threshold)
+	{
+		void *const data = bes_mmap_map(mmap_allocator, size);
+		if (data)
+		{
+			*zeroed = BES_TRUE;
+			return data;
+		}
+	}
+
+	return bes_mmap_backing_allocate(mmap_allocator, size, zeroed);
+}
+
+static void BES_API
+bes_mmap_deallocate(bes_allocator *allocator, void *data)
+{
+	bes_mmap_allocator *const mmap_allocator = allocator->aux;
+
+	if (bes_mmap_block_of(data)->kind == BES_MMAP_KIND_BACKING)
+	{
+		bes_mmap_backing_deallocate(mmap_allocator, data);
+	}
+	else
+	{
+		bes_mmap_unmap(mmap_allocator, data);
+	}
+}
+
+/* Move a block between the backing allocator and a mapping. */
+static void*
+bes_mmap_move(bes_allocator *const allocator, void *const data, bes_size size, bes_size preserve)
+{
+	void *const resize = bes_mmap_allocate(allocator, size);
+	if (resize)
+	{
+		bes_memcpy(resize, data, size < preserve ? size : preserve);
+		bes_mmap_deallocate(allocator, data);
+	}
+	return resize;
+}
+
+static void* BES_API
+bes_mmap_reallocate(bes_allocator *allocator, void *data, bes_size size)
+{
+	bes_mmap_allocator *const mmap_allocator = allocator->aux;
+	bes_mmap_block *const block = bes_mmap_block_of(data);
+
+	if (block->kind == BES_MMAP_KIND_BACKING)
+	{
+		if (size >= mmap_allocator->threshold)
+		{
+			return bes_mmap_move(allocator, data, size, block->length);
+		}
+
+		bes_allocator *const backing = mmap_allocator->backing;
+		bes_mmap_prefix *const prefix = backing->reallocate(backing, (bes_mmap_prefix *)data - 1, size + sizeof *prefix);
+		if (!prefix)
+		{
+			return 0;
+		}
+
+		prefix->data.length = size;
+		return prefix + 1;
+	}
+
+	const bes_size capacity = block->length - sizeof(bes_mmap_prefix);
+	if (size < mmap_allocator->threshold)
+	{
+		return bes_mmap_move(allocator, data, size, capacity);
+	}
+
+	/* Growing a mapping is a matter of updating page tables, the contents
+	 * are never copied. Remapping huge pages isn't supported by every
+	 * kernel, those are copied instead. */
+	void *const resize = bes_mmap_remap(mmap_allocator, data, size, BES_TRUE);
+	return resize ? resize : bes_mmap_move(allocator, data, size, capacity);
+}
+
+static bes_bool BES_API
+bes_mmap_reallocate_in_place(bes_allocator *allocator, void *data, bes_size size)
+{
+	bes_mmap_allocator *const mmap_allocator = allocator->aux;
+	bes_mmap_block *const block = bes_mmap_block_of(data);
+
+	if (block->kind == BES_MMAP_KIND_BACKING)
+	{
+		bes_allocator *const backing = mmap_allocator->backing;
+		if (size < mmap_allocator->threshold
+			&& backing->reallocate_in_place
+			&& backing->reallocate_in_place(backing, (bes_mmap_prefix *)data - 1, size + sizeof(bes_mmap_prefix)))
+		{
+			block->length = size;
+			return BES_TRUE;
+		}
+		return BES_FALSE;
+	}
+
+	/* Mappings shrink in place, returning the pages at their end, and grow
+	 * in place when the address space after them is free. */
+	return size >= mmap_allocator->threshold && bes_mmap_remap(mmap_allocator, data, size, BES_FALSE) ? BES_TRUE : BES_FALSE;
+}
+
+/* Mappings are unmapped as soon as they are freed, only the backing
+ * allocator may hold on to memory. */
+static bes_size BES_API
+bes_mmap_trim(bes_allocator *allocator)
+{
+	bes_mmap_allocator *const mmap_allocator = allocator->aux;
+	bes_allocator *const backing = mmap_allocator->backing;
+	return backing->trim ? backing->trim(backing) : 0;
+}
+
+void
+bes_mmap_allocator_init(bes_mmap_allocator *const mmap_allocator,
+                        bes_allocator *const backing,
+                        bes_size threshold,
+                        bes_u32 flags)
+{
+	BES_ASSERT(mmap_allocator);
+
+	mmap_allocator->backing = backing ? backing : bes_allocator_get();
+	mmap_allocator->allocator.allocate = &bes_mmap_allocate;
+	mmap_allocator->allocator.reallocate = &bes_mmap_reallocate;
+	mmap_allocator->allocator.deallocate = &bes_mmap_deallocate;
+	mmap_allocator->allocator.aux = mmap_allocator;
+	mmap_allocator->allocator.flags = mmap_allocator->backing->flags & BES_ALLOCATOR_CACHE;
+	mmap_allocator->allocator.deallocate_sized = 0;
+	mmap_allocator->allocator.alignment = 0;
+	mmap_allocator->allocator.usable_size = 0;
+	mmap_allocator->allocator.allocate_aligned = 0;
+	mmap_allocator->allocator.reallocate_in_place = &bes_mmap_reallocate_in_place;
+	mmap_allocator->allocator.allocate_batch = 0;
+	mmap_allocator->allocator.deallocate_batch = 0;
+	mmap_allocator->allocator.allocate_zeroed = &bes_mmap_allocate_zeroed;
+	mmap_allocator->allocator.trim = &bes_mmap_trim;
+	mmap_allocator->threshold = threshold ? threshold : BES_MMAP_THRESHOLD;
+#if defined(BES_PLATFORM_LINUX)
+	mmap_allocator->page_size = (bes_size)sysconf(_SC_PAGESIZE);
+#else
+	mmap_allocator->page_size = 4096;
+#endif
+	mmap_allocator->flags = flags;
+	mmap_allocator->mapped = 0;
+
+	BES_ASSERT(mmap_allocator->backing);
+}
@@ -0,0 +1,89 @@
+#ifndef BES_FOUNDATION_MMAP_H
+#define BES_FOUNDATION_MMAP_H
+
+/**
+ * @defgroup Mmap Memory mapped allocator
+ *
+ * @brief Allocator mapping large blocks directly from the operating system
+ *
+ * Allocations at or above a threshold are given pages of their own with
+ * mmap, which are returned to the operating system as soon as they are
+ * freed. Growing them remaps the pages rather than copying their contents
+ * and, where possible, they are backed by huge pages to reduce TLB misses.
+ * Smaller allocations are passed through to a backing allocator.
+ *
+ * Only Linux is supported, elsewhere every allocation is passed through.
+ *
+ * @{
+ */
+
+#include <bes/foundation/memory.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** @brief Default size at which allocations are mapped */
+#define BES_MMAP_THRESHOLD (256 * 1024)
+
+/** @brief The size of a huge page */
+#define BES_MMAP_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/** @brief Flags controlling the use of huge pages */
+enum bes_mmap_flags
+{
+	/**
+	 * Map allocations of at least @ref BES_MMAP_HUGE_PAGE_SIZE with huge
+	 * pages reserved up front by the system administrator, falling back
+	 * to regular pages when none are left.
+	 */
+	BES_MMAP_HUGETLB = 1 << 0,
+
+	/**
+	 * Align mappings of at least @ref BES_MMAP_HUGE_PAGE_SIZE to a huge
+	 * page and advise the kernel to back them with transparent huge pages.
+	 */
+	BES_MMAP_TRANSPARENT_HUGE_PAGES = 1 << 1
+};
+
+typedef struct bes_mmap_allocator bes_mmap_allocator;
+
+/**
+ * @brief Memory mapped allocator
+ * @note The allocator is thread safe if the backing allocator is.
+ */
+struct bes_mmap_allocator
+{
+	bes_allocator allocator; /**< The allocator interface of the mapped allocator */
+	bes_allocator *backing; /**< The allocator smaller allocations come from */
+	bes_size threshold; /**< The size at which allocations are mapped */
+	bes_size page_size; /**< The size of a page */
+	bes_u32 flags; /**< Flags controlling the use of huge pages, see @ref bes_mmap_flags */
+	volatile bes_u64 mapped; /**< The amount of bytes currently mapped */
+};
+
+/**
+ * @brief Initialize a memory mapped allocator
+ * @param mmap_allocator The allocator to initialize
+ * @param backing The allocator to pass smaller allocations through to
+ * @param threshold The size at which allocations are mapped, zero selects
+ * @ref BES_MMAP_THRESHOLD
+ * @param flags Flags controlling the use of huge pages, see
+ * @ref bes_mmap_flags
+ * @note If @p backing is NULL the allocator set for the calling thread is
+ * used.
+ */
+BES_EXPORT void BES_API
+bes_mmap_allocator_init(bes_mmap_allocator *const mmap_allocator,
+                        bes_allocator *const backing,
+                        bes_size threshold,
+                        bes_u32 flags);
+
+#if defined(__cplusplus)
+}
+#endif
+
+/**
+ * @}
+ */
+#endif
@@ -0,0 +1,311 @@
+/* pipe2 and O_CLOEXEC are extensions. */
+#define _GNU_SOURCE
+
+#include <bes/foundation/pressure.h>
+#include <bes/foundation/atomic.h>
+
+#if defined(BES_PLATFORM_LINUX)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+typedef struct bes_pressure_subscriber bes_pressure_subscriber;
+
+struct bes_pressure_subscriber
+{
+	bes_memory_pressure_callback callback;
+	void *user;
+};
+
+/* Subscribers are guarded by a lock, which is only contended while
+ * subscribing during a notification. Notifications call a copy of the
+ * subscribers so callbacks may subscribe and unsubscribe. */
+static bes_pressure_subscriber g_bes_pressure_subscribers[BES_MEMORY_PRESSURE_CALLBACKS];
+static bes_size g_bes_pressure_count;
+static volatile bes_u32 g_bes_pressure_lock;
+
+static inline void
+bes_pressure_lock(void)
+{
+	bes_u32 expected = 0;
+	while (!bes_atomic_cas_u32(&g_bes_pressure_lock, &expected, 1, BES_ATOMIC_ACQUIRE))
+	{
+		expected = 0;
+	}
+}
+
+static inline void
+bes_pressure_unlock(void)
+{
+	bes_atomic_store_u32(&g_bes_pressure_lock, 0, BES_ATOMIC_RELEASE);
+}
+
+bes_bool
+bes_memory_pressure_subscribe(bes_memory_pressure_callback callback, void *const user)
+{
+	BES_ASSERT(callback);
+
+	bes_pressure_lock();
+	const bes_bool subscribed = g_bes_pressure_count < BES_MEMORY_PRESSURE_CALLBACKS ? BES_TRUE : BES_FALSE;
+	if (subscribed)
+	{
+		bes_pressure_subscriber *const subscriber = &g_bes_pressure_subscribers[g_bes_pressure_count++];
+		subscriber->callback = callback;
+		subscriber->user = user;
+	}
+	bes_pressure_unlock();
+
+	return subscribed;
+}
+
+void
+bes_memory_pressure_unsubscribe(bes_memory_pressure_callback callback, void *const user)
+{
+	bes_pressure_lock();
+	for (bes_size i = 0; i < g_bes_pressure_count; i++)
+	{
+		bes_pressure_subscriber *const subscriber = &g_bes_pressure_subscribers[i];
+		if (subscriber->callback == callback && subscriber->user == user)
+		{
+			*subscriber = g_bes_pressure_subscribers[--g_bes_pressure_count];
+			break;
+		}
+	}
+	bes_pressure_unlock();
+}
+
+void
+bes_memory_pressure_notify(bes_memory_pressure level)
+{
+	bes_pressure_subscriber subscribers[BES_MEMORY_PRESSURE_CALLBACKS];
+
+	bes_pressure_lock();
+	const bes_size count = g_bes_pressure_count;
+	for (bes_size i = 0; i < count; i++)
+	{
+		subscribers[i] = g_bes_pressure_subscribers[i];
+	}
+	bes_pressure_unlock();
+
+	for (bes_size i = 0; i < count; i++)
+	{
+		subscribers[i].callback(level, subscribers[i].user);
+	}
+}
+
+#if defined(BES_PLATFORM_LINUX)
+/* Pressure is watched with triggers, one for when some tasks are stalled
+ * and one for when all of them are. Writing a trigger to a pressure file
+ * arms it and the kernel then wakes up pollers of the file with POLLPRI
+ * whenever tasks were stalled for the stall time within a window. A pipe
+ * wakes up the watching thread when it's time to stop. */
+enum
+{
+	BES_PRESSURE_SOME,
+	BES_PRESSURE_FULL,
+	BES_PRESSURE_WAKE,
+	BES_PRESSURE_FDS
+};
+
+static int g_bes_pressure_fds[BES_PRESSURE_FDS] = { -1, -1, -1 };
+static int g_bes_pressure_wake = -1;
+static pthread_t g_bes_pressure_thread;
+static bes_bool g_bes_pressure_watching;
+
+static char*
+bes_pressure_format_u32(char *out, bes_u32 value)
+{
+	char digits[10];
+	bes_size count = 0;
+	do
+	{
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value);
+
+	while (count)
+	{
+		*out++ = digits[--count];
+	}
+	return out;
+}
+
+static int
+bes_pressure_trigger(const char *const path, const char *kind, bes_u32 stall, bes_u32 window)
+{
+	const int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	char trigger[32];
+	char *out = trigger;
+	while (*kind)
+	{
+		*out++ = *kind++;
+	}
+	*out++ = ' ';
+	out = bes_pressure_format_u32(out, stall);
+	*out++ = ' ';
+	out = bes_pressure_format_u32(out, window);
+	*out++ = '\0';
+
+	if (write(fd, trigger, (bes_size)(out - trigger)) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void*
+bes_pressure_watch(void *const data)
+{
+	(void)data;
+
+	struct pollfd fds[BES_PRESSURE_FDS];
+	fds[BES_PRESSURE_SOME].fd = g_bes_pressure_fds[BES_PRESSURE_SOME];
+	fds[BES_PRESSURE_SOME].events = POLLPRI;
+	fds[BES_PRESSURE_FULL].fd = g_bes_pressure_fds[BES_PRESSURE_FULL];
+	fds[BES_PRESSURE_FULL].events = POLLPRI;
+	fds[BES_PRESSURE_WAKE].fd = g_bes_pressure_fds[BES_PRESSURE_WAKE];
+	fds[BES_PRESSURE_WAKE].events = POLLIN;
+
+	for (;;)
+	{
+		if (poll(fds, BES_PRESSURE_FDS, -1) < 0)
+		{
+			continue;
+		}
+
+		if (fds[BES_PRESSURE_WAKE].revents)
+		{
+			break;
+		}
+
+		/* A trigger errors once the file goes away, like when its cgroup
+		 * is removed, which is not pressure. Negative descriptors are
+		 * ignored by poll. */
+		bes_bool triggered[BES_PRESSURE_FDS] = { BES_FALSE };
+		for (bes_size i = BES_PRESSURE_SOME; i <= BES_PRESSURE_FULL; i++)
+		{
+			if (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+			{
+				fds[i].fd = -1;
+			}
+			else if (fds[i].revents & POLLPRI)
+			{
+				triggered[i] = BES_TRUE;
+			}
+		}
+
+		/* Full stalls are also counted as some stalls, only the most
+		 * severe pressure is reported. */
+		if (triggered[BES_PRESSURE_FULL])
+		{
+			bes_memory_pressure_notify(BES_MEMORY_PRESSURE_CRITICAL);
+		}
+		else if (triggered[BES_PRESSURE_SOME])
+		{
+			bes_memory_pressure_notify(BES_MEMORY_PRESSURE_MODERATE);
+		}
+	}
+
+	return 0;
+}
+
+static void
+bes_pressure_close(void)
+{
+	for (bes_size i = 0; i < BES_PRESSURE_FDS; i++)
+	{
+		if (g_bes_pressure_fds[i] >= 0)
+		{
+			close(g_bes_pressure_fds[i]);
+			g_bes_pressure_fds[i] = -1;
+		}
+	}
+
+	if (g_bes_pressure_wake >= 0)
+	{
+		close(g_bes_pressure_wake);
+		g_bes_pressure_wake = -1;
+	}
+}
+#endif
+
+bes_bool
+bes_memory_pressure_watch(const char *const path, bes_u32 stall, bes_u32 window)
+{
+#if defined(BES_PLATFORM_LINUX)
+	if (g_bes_pressure_watching)
+	{
+		return BES_FALSE;
+	}
+
+	const char *const file = path ? path : "/proc/pressure/memory";
+	g_bes_pressure_fds[BES_PRESSURE_SOME] = bes_pressure_trigger(file, "some", stall, window);
+	g_bes_pressure_fds[BES_PRESSURE_FULL] = bes_pressure_trigger(file, "full", stall, window);
+
+	int wake[2];
+	if (g_bes_pressure_fds[BES_PRESSURE_SOME] < 0
+		|| g_bes_pressure_fds[BES_PRESSURE_FULL] < 0
+		|| pipe2(wake, O_CLOEXEC) < 0)
+	{
+		bes_pressure_close();
+		return BES_FALSE;
+	}
+
+	g_bes_pressure_fds[BES_PRESSURE_WAKE] = wake[0];
+	g_bes_pressure_wake = wake[1];
+
+	if (pthread_create(&g_bes_pressure_thread, 0, &bes_pressure_watch, 0) != 0)
+	{
+		bes_pressure_close();
+		return BES_FALSE;
+	}
+
+	g_bes_pressure_watching = BES_TRUE;
+	return BES_TRUE;
+#else
+	(void)path;
+	(void)stall;
+	(void)window;
+	return BES_FALSE;
+#endif
+}
+
+void
+bes_memory_pressure_unwatch(void)
+{
+#if defined(BES_PLATFORM_LINUX)
+	if (!g_bes_pressure_watching)
+	{
+		return;
+	}
+
+	/* Retry when interrupted, the pipe is never full. Should waking fail
+	 * otherwise the thread is cancelled instead, poll is a cancellation
+	 * point. */
+	const char wake = 0;
+	ssize_t written;
+	do
+	{
+		written = write(g_bes_pressure_wake, &wake, 1);
+	} while (written < 0 && errno == EINTR);
+
+	if (written < 0)
+	{
+		pthread_cancel(g_bes_pressure_thread);
+	}
+
+	pthread_join(g_bes_pressure_thread, 0);
+	bes_pressure_close();
+	g_bes_pressure_watching = BES_FALSE;
+#endif
+}
@@ -0,0 +1,115 @@
+#ifndef BES_FOUNDATION_PRESSURE_H
+#define BES_FOUNDATION_PRESSURE_H
+
+/**
+ * @defgroup Pressure Memory pressure
+ *
+ * @brief Tell caches and pools to shed memory before the system runs out
+ *
+ * Caches and pools subscribe a callback which is called when the system
+ * is under memory pressure, in which they give back what they can, for
+ * instance with @ref bes_allocator_trim. Pressure is reported by calling
+ * @ref bes_memory_pressure_notify, or on Linux by a thread watching the
+ * pressure stall information of the kernel, which tells how long tasks
+ * have been stalled waiting on memory.
+ *
+ * @{
+ */
+
+#include <bes/foundation/types.h>
+#include <bes/foundation/macros.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** @brief The most callbacks subscribed at once */
+#define BES_MEMORY_PRESSURE_CALLBACKS 32
+
+/** @brief How severe memory pressure is */
+enum bes_memory_pressure
+{
+	/** Some tasks are stalled waiting on memory, caches should be trimmed */
+	BES_MEMORY_PRESSURE_MODERATE,
+
+	/**
+	 * All tasks are stalled waiting on memory, everything which can be
+	 * given back should be before the out of memory killer steps in
+	 */
+	BES_MEMORY_PRESSURE_CRITICAL
+};
+
+typedef enum bes_memory_pressure bes_memory_pressure;
+
+/**
+ * @brief Callback told of memory pressure
+ * @param level How severe the pressure is
+ * @param user The data given to @ref bes_memory_pressure_subscribe
+ */
+typedef void (BES_API *bes_memory_pressure_callback)(bes_memory_pressure level, void *user);
+
+/**
+ * @brief Subscribe a callback to memory pressure
+ * @param callback The callback to call
+ * @param user Data passed to @p callback
+ * @note Callbacks are called on the thread reporting the pressure, which
+ * is the watching thread when pressure is watched.
+ * @return BES_FALSE if @ref BES_MEMORY_PRESSURE_CALLBACKS callbacks are
+ * already subscribed.
+ */
+BES_EXPORT bes_bool BES_API
+bes_memory_pressure_subscribe(bes_memory_pressure_callback callback, void *const user);
+
+/**
+ * @brief Unsubscribe a callback subscribed with the same data
+ * @param callback The callback
+ * @param user The data it was subscribed with
+ * @warning A callback may still be running on another thread while it is
+ * unsubscribed.
+ */
+BES_EXPORT void BES_API
+bes_memory_pressure_unsubscribe(bes_memory_pressure_callback callback, void *const user);
+
+/**
+ * @brief Report memory pressure to every subscribed callback
+ * @param level How severe the pressure is
+ */
+BES_EXPORT void BES_API
+bes_memory_pressure_notify(bes_memory_pressure level);
+
+/**
+ * @brief Start watching for memory pressure
+ * @param path The pressure file to watch, NULL for the pressure of the
+ * whole system in /proc/pressure/memory. The memory.pressure file of a
+ * cgroup watches the pressure of just that cgroup.
+ * @param stall How long tasks must be stalled, in microseconds, within
+ * @p window for pressure to be reported
+ * @param window The window stalls are measured over in microseconds,
+ * which the kernel requires to be between 500ms and 10s
+ *
+ * A thread is started which reports @ref BES_MEMORY_PRESSURE_MODERATE when
+ * some tasks were stalled for @p stall and @ref BES_MEMORY_PRESSURE_CRITICAL
+ * when all of them were, at most once per window each.
+ *
+ * @note Only Linux 4.20 and newer with pressure stall information enabled
+ * is supported.
+ * @return BES_FALSE if pressure is already watched or can't be watched.
+ */
+BES_EXPORT bes_bool BES_API
+bes_memory_pressure_watch(const char *const path, bes_u32 stall, bes_u32 window);
+
+/**
+ * @brief Stop watching for memory pressure
+ * @note It's safe to call while pressure isn't watched.
+ */
+BES_EXPORT void BES_API
+bes_memory_pressure_unwatch(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+/**
+ * @}
+ */
+#endif
@@ -0,0 +1,58 @@
+#include <bes/foundation/scratch.h>
+
+static BES_THREAD_LOCAL bes_arena g_bes_scratch_arenas[BES_SCRATCH_ARENAS];
+static BES_THREAD_LOCAL bes_bool g_bes_scratch_ready;
+
+bes_scratch
+bes_scratch_begin(const bes_scratch *const conflict)
+{
+	if (BES_UNLIKELY(!g_bes_scratch_ready))
+	{
+		for (bes_size i = 0; i < BES_SCRATCH_ARENAS; i++)
+		{
+			bes_arena_init(&g_bes_scratch_arenas[i], 0, 0);
+		}
+		g_bes_scratch_ready = BES_TRUE;
+	}
+
+	bes_arena *arena = &g_bes_scratch_arenas[0];
+	if (conflict && conflict->arena == arena)
+	{
+		arena = &g_bes_scratch_arenas[1];
+	}
+
+	bes_scratch scratch;
+	scratch.arena = arena;
+	scratch.marker = bes_arena_mark(arena);
+	return scratch;
+}
+
+void
+bes_scratch_end(const bes_scratch *const scratch)
+{
+	/* A scope begun before the arena had a chunk would give every chunk
+	 * back when rewound, resetting keeps the first one for the next. */
+	if (scratch->marker.chunk)
+	{
+		bes_arena_rewind(scratch->arena, scratch->marker);
+	}
+	else
+	{
+		bes_arena_reset(scratch->arena);
+	}
+}
+
+void
+bes_scratch_release(void)
+{
+	if (!g_bes_scratch_ready)
+	{
+		return;
+	}
+
+	for (bes_size i = 0; i < BES_SCRATCH_ARENAS; i++)
+	{
+		bes_arena_release(&g_bes_scratch_arenas[i]);
+	}
+	g_bes_scratch_ready = BES_FALSE;
+}
@@ -0,0 +1,92 @@
+#ifndef BES_FOUNDATION_SCRATCH_H
+#define BES_FOUNDATION_SCRATCH_H
+
+/**
+ * @defgroup Scratch Scratch memory
+ *
+ * @brief Per-thread memory for short-lived temporaries
+ *
+ * Every thread has a pair of arenas for temporaries which are used once
+ * and thrown away, like a string converted just to be handed to the
+ * operating system. A scope is begun with @ref bes_scratch_begin, memory
+ * is allocated in it with @ref bes_scratch_alloc and all of it is freed
+ * at once by @ref bes_scratch_end. The arenas keep their memory between
+ * scopes, so once warmed up scratch allocations don't reach the allocator.
+ *
+ * Scopes nest and must be ended in the reverse order they were begun. A
+ * function which takes a scope to return its result in and begins one of
+ * its own for its temporaries passes the scope it was given as a conflict
+ * to @ref bes_scratch_begin. Its scope is then begun in the other arena,
+ * so ending it doesn't free the result, and its temporaries don't get in
+ * the way of the result.
+ *
+ * @{
+ */
+
+#include <bes/foundation/memory.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** @brief The amount of scratch arenas of a thread */
+#define BES_SCRATCH_ARENAS 2
+
+typedef struct bes_scratch bes_scratch;
+
+/** @brief A scope of scratch memory */
+struct bes_scratch
+{
+	bes_arena *arena; /**< The arena the scope allocates from */
+	bes_arena_marker marker; /**< Where the arena is rewound to */
+};
+
+/**
+ * @brief Begin a scope of scratch memory
+ * @param conflict A scope whose memory must survive this one, or NULL
+ * @note The memory of the arenas comes from the allocator set for the
+ * thread when scratch memory is first used, which must stay alive until
+ * @ref bes_scratch_release.
+ * @return The scope, to be ended with @ref bes_scratch_end
+ */
+BES_EXPORT bes_scratch BES_API
+bes_scratch_begin(const bes_scratch *const conflict);
+
+/**
+ * @brief Allocate scratch memory
+ * @param scratch The scope to allocate in
+ * @param size The size of the allocation
+ * @note The memory is aligned by @ref BES_ALIGNMENT.
+ * @return On failure this function returns NULL
+ */
+static BES_ATTRIBUTE_ALWAYS_INLINE void*
+bes_scratch_alloc(const bes_scratch *const scratch, bes_size size)
+{
+	return bes_arena_allocate(scratch->arena, size);
+}
+
+/**
+ * @brief End a scope, freeing everything allocated in it
+ * @param scratch The scope returned by @ref bes_scratch_begin
+ * @warning Scopes begun after @p scratch and not ended yet are ended too
+ * when they share its arena, and must not be used anymore.
+ */
+BES_EXPORT void BES_API
+bes_scratch_end(const bes_scratch *const scratch);
+
+/**
+ * @brief Give the memory of the scratch arenas of the calling thread back
+ * @note Threads which used scratch memory should call this before they
+ * exit, no scope may be open.
+ */
+BES_EXPORT void BES_API
+bes_scratch_release(void);
+
+#if defined(__cplusplus)
+}
+#endif
+
+/**
+ * @}
+ */
+#endif
@@ -0,0 +1,635 @@
+#include <bes/foundation/slab.h>
+#include <bes/foundation/string.h>
+
+/* Slabs are aligned by their size so the slab an object belongs to is
+ * found by masking the address of the object. The header sits at the
+ * start of the slab and objects follow it. */
+typedef union bes_slab_page_header bes_slab_page_header;
+
+struct bes_slab_page
+{
+	bes_slab_page *next;
+	bes_slab_page *prev;
+	void *free;
+	bes_byte *unused;
+	bes_u32 size;
+	bes_u32 used;
+	bes_u32 capacity;
+	bes_u32 index;
+};
+
+union bes_slab_page_header
+{
+	bes_slab_page data;
+	bes_byte aligned[(sizeof(bes_slab_page) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT];
+};
+
+/* Spans are linked through a header placed in the slack needed to align
+ * the first slab of the span. */
+struct bes_slab_span
+{
+	bes_slab_span *next;
+};
+
+/* Large allocations start with a header recording where the block from the
+ * backing allocator starts and how large the allocation is. The header
+ * sits right before the allocation, which is aligned inside the block. */
+typedef struct bes_slab_large bes_slab_large;
+typedef union bes_slab_large_header bes_slab_large_header;
+
+struct bes_slab_large
+{
+	bes_byte *base;
+	bes_size size;
+};
+
+union bes_slab_large_header
+{
+	bes_slab_large data;
+	bes_byte aligned[(sizeof(bes_slab_large) + BES_ALIGNMENT - 1) & -BES_ALIGNMENT];
+};
+
+/* What is requested from the backing allocator for a large allocation. */
+#define BES_SLAB_LARGE_REQUEST(SIZE) \
+	((SIZE) + sizeof(bes_slab_large_header) + BES_ALIGNMENT - 1)
+
+/* The amount of slots the page table starts with. */
+#define BES_SLAB_TABLE_SIZE 64
+
+BES_STATIC_ASSERT(BES_SLAB_MAX_SIZE <= BES_SLAB_PAGE_SIZE / 4);
+BES_STATIC_ASSERT((BES_SLAB_TABLE_SIZE & (BES_SLAB_TABLE_SIZE - 1)) == 0);
+
+static inline bes_slab_page*
+bes_slab_page_of(void *const data)
+{
+	return (bes_slab_page *)((bes_uintptr)data & -(bes_uintptr)BES_SLAB_PAGE_SIZE);
+}
+
+/* The first slab of a span. */
+static inline bes_byte*
+bes_slab_span_first(bes_slab_span *const span)
+{
+	return (bes_byte *)((bes_uintptr)((bes_byte *)(span + 1) + BES_SLAB_PAGE_SIZE - 1) & -(bes_uintptr)BES_SLAB_PAGE_SIZE);
+}
+
+/* Every slab is registered by address in an open addressed table. A large
+ * allocation never shares a page with a slab, so an allocation is large
+ * when the page it is in is not in the table. Zero marks a free slot. */
+static inline bes_size
+bes_slab_table_slot(bes_uintptr page, bes_size mask)
+{
+	return (bes_size)(page / BES_SLAB_PAGE_SIZE) * (bes_size)0x9E3779B1u & mask;
+}
+
+static inline void
+bes_slab_table_insert(bes_uintptr *const table, bes_size slots, bes_uintptr page)
+{
+	const bes_size mask = slots - 1;
+	bes_size slot = bes_slab_table_slot(page, mask);
+	while (table[slot])
+	{
+		slot = (slot + 1) & mask;
+	}
+	table[slot] = page;
+}
+
+static inline bes_bool
+bes_slab_is_large(const bes_slab_allocator *const slab, void *const data)
+{
+	if (BES_UNLIKELY(!slab->table))
+	{
+		return BES_TRUE;
+	}
+
+	const bes_uintptr page = (bes_uintptr)bes_slab_page_of(data);
+	const bes_size mask = slab->slots - 1;
+	for (bes_size slot = bes_slab_table_slot(page, mask); slab->table[slot]; slot = (slot + 1) & mask)
+	{
+		if (slab->table[slot] == page)
+		{
+			return BES_FALSE;
+		}
+	}
+
+	return BES_TRUE;
+}
+
+/* Register the slabs of a span, growing the table to stay at most half
+ * full. */
+static bes_bool
+bes_slab_table_add(bes_slab_allocator *const slab, bes_slab_span *const span)
+{
+	const bes_size needed = (slab->registered + BES_SLAB_SPAN_PAGES) * 2;
+	if (needed > slab->slots)
+	{
+		bes_size slots = slab->slots ? slab->slots : BES_SLAB_TABLE_SIZE;
+		while (slots < needed)
+		{
+			slots *= 2;
+		}
+
+		bes_allocator *const backing = slab->backing;
+		bes_uintptr *const table = backing->allocate(backing, slots * sizeof *table);
+		if (!table)
+		{
+			return BES_FALSE;
+		}
+
+		bes_memset(table, 0, slots * sizeof *table);
+		for (bes_size i = 0; i < slab->slots; i++)
+		{
+			if (slab->table[i])
+			{
+				bes_slab_table_insert(table, slots, slab->table[i]);
+			}
+		}
+
+		if (slab->table)
+		{
+			backing->deallocate(backing, slab->table);
+		}
+
+		slab->table = table;
+		slab->slots = slots;
+	}
+
+	bes_byte *const first = bes_slab_span_first(span);
+	for (bes_size i = 0; i < BES_SLAB_SPAN_PAGES; i++)
+	{
+		bes_slab_table_insert(slab->table, slab->slots, (bes_uintptr)(first + i * BES_SLAB_PAGE_SIZE));
+	}
+	slab->registered += BES_SLAB_SPAN_PAGES;
+
+	return BES_TRUE;
+}
+
+static inline bes_slab_large*
+bes_slab_large_of(void *const data)
+{
+	return (bes_slab_large *)((bes_slab_large_header *)data - 1);
+}
+
+/* The header of a large allocation in a block from the backing allocator,
+ * at the first aligned address in it. */
+static inline bes_slab_large*
+bes_slab_large_place(bes_byte *const base)
+{
+	return (bes_slab_large *)((bes_uintptr)(base + BES_ALIGNMENT - 1) & -(bes_uintptr)BES_ALIGNMENT);
+}
+
+static inline void
+bes_slab_link(bes_slab_page **const list, bes_slab_page *const page)
+{
+	page->prev = 0;
+	page->next = *list;
+	if (*list)
+	{
+		(*list)->prev = page;
+	}
+	*list = page;
+}
+
+static inline void
+bes_slab_unlink(bes_slab_page **const list, bes_slab_page *const page)
+{
+	if (page->prev)
+	{
+		page->prev->next = page->next;
+	}
+	else
+	{
+		*list = page->next;
+	}
+
+	if (page->next)
+	{
+		page->next->prev = page->prev;
+	}
+}
+
+static bes_slab_page*
+bes_slab_page_new(bes_slab_allocator *const slab, bes_size index)
+{
+	bes_slab_page *page = slab->empty;
+	if (page)
+	{
+		bes_slab_unlink(&slab->empty, page);
+	}
+	else
+	{
+		if (slab->cursor == slab->end)
+		{
+			bes_allocator *const backing = slab->backing;
+			bes_slab_span *const span = backing->allocate(backing,
+				sizeof *span + (BES_SLAB_SPAN_PAGES + 1) * BES_SLAB_PAGE_SIZE);
+			if (!span)
+			{
+				return 0;
+			}
+
+			if (!bes_slab_table_add(slab, span))
+			{
+				backing->deallocate(backing, span);
+				return 0;
+			}
+
+			span->next = slab->spans;
+			slab->spans = span;
+			slab->cursor = bes_slab_span_first(span);
+			slab->end = slab->cursor + BES_SLAB_SPAN_PAGES * BES_SLAB_PAGE_SIZE;
+		}
+
+		page = (bes_slab_page *)slab->cursor;
+		slab->cursor += BES_SLAB_PAGE_SIZE;
+	}
+
+	const bes_size size = (index + 1) * BES_ALIGNMENT;
+
+	/* Objects are carved out lazily so a new slab costs the same to set
+	 * up regardless of how many objects it holds. */
+	page->free = 0;
+	page->unused = (bes_byte *)page + sizeof(bes_slab_page_header);
+	page->size = (bes_u32)size;
+	page->used = 0;
+	page->capacity = (bes_u32)((BES_SLAB_PAGE_SIZE - sizeof(bes_slab_page_header)) / size);
+	page->index = (bes_u32)index;
+
+	bes_slab_link(&slab->partial[index], page);
+
+	return page;
+}
+
+static void*
+bes_slab_large_allocate(bes_slab_allocator *const slab, bes_size size)
+{
+	bes_allocator *const backing = slab->backing;
+	bes_byte *const base = backing->allocate(backing, BES_SLAB_LARGE_REQUEST(size));
+	if (!base)
+	{
+		return 0;
+	}
+
+	bes_slab_large *const large = bes_slab_large_place(base);
+	large->base = base;
+	large->size = size;
+
+	return (bes_slab_large_header *)large + 1;
+}
+
+static void* BES_API
+bes_slab_allocate(bes_allocator *allocator, bes_size size)
+{
+	bes_slab_allocator *const slab = allocator->aux;
+
+	if (size > BES_SLAB_MAX_SIZE)
+	{
+		return bes_slab_large_allocate(slab, size);
+	}
+
+	const bes_size index = size ? (size - 1) / BES_ALIGNMENT : 0;
+	bes_slab_page *page = slab->partial[index];
+	if (BES_UNLIKELY(!page))
+	{
+		page = bes_slab_page_new(slab, index);
+		if (!page)
+		{
+			return 0;
+		}
+	}
+
+	void *data = page->free;
+	if (data)
+	{
+		page->free = *(void **)data;
+	}
+	else
+	{
+		data = page->unused;
+		page->unused += page->size;
+	}
+
+	/* Full slabs are taken off the partial list until an object is freed. */
+	if (++page->used == page->capacity)
+	{
+		bes_slab_unlink(&slab->partial[index], page);
+	}
+
+	return data;
+}
+
+static bes_size BES_API
+bes_slab_allocate_batch(bes_allocator *allocator, bes_size size, bes_size count, void **data)
+{
+	bes_slab_allocator *const slab = allocator->aux;
+
+	if (size > BES_SLAB_MAX_SIZE)
+	{
+		return 0;
+	}
+
+	/* Take as many objects from each slab as it has before moving on, so
+	 * objects carved out of fresh slabs are contiguous. */
+	const bes_size index = size ? (size - 1) / BES_ALIGNMENT : 0;
+	bes_size made = 0;
+	while (made < count)
+	{
+		bes_slab_page *page = slab->partial[index];
+		if (!page)
+		{
+			page = bes_slab_page_new(slab, index);
+			if (!page)
+			{
+				break;
+			}
+		}
+
+		while (made < count && page->used < page->capacity)
+		{
+			void *object = page->free;
+			if (object)
+			{
+				page->free = *(void **)object;
+			}
+			else
+			{
+				object = page->unused;
+				page->unused += page->size;
+			}
+			page->used++;
+			data[made++] = object;
+		}
+
+		if (page->used == page->capacity)
+		{
+			bes_slab_unlink(&slab->partial[index], page);
+		}
+	}
+
+	return made;
+}
+
+static inline void
+bes_slab_large_deallocate(bes_slab_allocator *const slab, void *const data)
+{
+	bes_allocator *const backing = slab->backing;
+	backing->deallocate(backing, bes_slab_large_of(data)->base);
+}
+
+static inline void
+bes_slab_object_deallocate(bes_slab_allocator *const slab, void *const data)
+{
+	bes_slab_page *const page = bes_slab_page_of(data);
+	*(void **)data = page->free;
+	page->free = data;
+
+	if (page->used-- == page->capacity)
+	{
+		bes_slab_link(&slab->partial[page->index], page);
+	}
+
+	/* Slabs without objects can be reused by any size class. */
+	if (page->used == 0)
+	{
+		bes_slab_unlink(&slab->partial[page->index], page);
+		bes_slab_link(&slab->empty, page);
+	}
+}
+
+static void BES_API
+bes_slab_deallocate(bes_allocator *allocator, void *data)
+{
+	bes_slab_allocator *const slab = allocator->aux;
+	if (bes_slab_is_large(slab, data))
+	{
+		bes_slab_large_deallocate(slab, data);
+	}
+	else
+	{
+		bes_slab_object_deallocate(slab, data);
+	}
+}
+
+static void BES_API
+bes_slab_deallocate_sized(bes_allocator *allocator, void *data, bes_size size)
+{
+	/* The size tells large allocations apart without looking at the
+	 * address. */
+	bes_slab_allocator *const slab = allocator->aux;
+	if (size > BES_SLAB_MAX_SIZE)
+	{
+		bes_slab_large_deallocate(slab, data);
+	}
+	else
+	{
+		bes_slab_object_deallocate(slab, data);
+	}
+}
+
+static void* BES_API
+bes_slab_reallocate(bes_allocator *allocator, void *data, bes_size size)
+{
+	bes_slab_allocator *const slab = allocator->aux;
+
+	bes_size capacity = 0;
+	if (bes_slab_is_large(slab, data))
+	{
+		bes_slab_large *const large = bes_slab_large_of(data);
+		if (size > BES_SLAB_MAX_SIZE)
+		{
+			/* Large allocations stay large, let the backing allocator
+			 * resize them and move the header and the data to the first
+			 * page boundary of the block when it moved elsewhere. */
+			bes_allocator *const backing = slab->backing;
+			const bes_size offset = (bes_size)((bes_byte *)large - large->base);
+			const bes_size preserve = size < large->size ? size : large->size;
+			bes_byte *const base = backing->reallocate(backing, large->base, BES_SLAB_LARGE_REQUEST(size));
+			if (!base)
+			{
+				return 0;
+			}
+
+			bes_slab_large *const resize = bes_slab_large_place(base);
+			if ((bes_byte *)resize != base + offset)
+			{
+				bes_memmove(resize, base + offset, sizeof(bes_slab_large_header) + preserve);
+			}
+
+			resize->base = base;
+			resize->size = size;
+			return (bes_slab_large_header *)resize + 1;
+		}
+		capacity = large->size;
+	}
+	else
+	{
+		capacity = bes_slab_page_of(data)->size;
+		if (size <= capacity && size > capacity - BES_ALIGNMENT)
+		{
+			return data;
+		}
+	}
+
+	void *const resize = bes_slab_allocate(allocator, size);
+	if (resize)
+	{
+		bes_memcpy(resize, data, size < capacity ? size : capacity);
+		bes_slab_deallocate(allocator, data);
+	}
+
+	return resize;
+}
+
+static bes_bool BES_API
+bes_slab_reallocate_in_place(bes_allocator *allocator, void *data, bes_size size)
+{
+	bes_slab_allocator *const slab = allocator->aux;
+
+	/* Allocations can grow into the slack of their size class but must
+	 * not cross between slab objects and large allocations, which sized
+	 * deallocation tells apart by size. */
+	if (bes_slab_is_large(slab, data))
+	{
+		return size > BES_SLAB_MAX_SIZE && size <= bes_slab_large_of(data)->size ? BES_TRUE : BES_FALSE;
+	}
+
+	return size <= bes_slab_page_of(data)->size ? BES_TRUE : BES_FALSE;
+}
+
+static bes_size BES_API
+bes_slab_usable_size(bes_allocator *allocator, const void *data)
+{
+	bes_slab_allocator *const slab = allocator->aux;
+	if (bes_slab_is_large(slab, (void *)data))
+	{
+		return bes_slab_large_of((void *)data)->size;
+	}
+
+	return bes_slab_page_of((void *)data)->size;
+}
+
+/* A span whose slabs are all empty is given back to the backing allocator.
+ * The span slabs are being carved from only counts the slabs carved so
+ * far. Trimming is rare, so the empty slabs of each span are counted by
+ * walking the empty list. */
+static bes_size BES_API
+bes_slab_trim(bes_allocator *allocator)
+{
+	bes_slab_allocator *const slab = allocator->aux;
+	bes_allocator *const backing = slab->backing;
+	bes_size released = 0;
+
+	bes_slab_span **link = &slab->spans;
+	while (*link)
+	{
+		bes_slab_span *const span = *link;
+		bes_byte *const first = bes_slab_span_first(span);
+		bes_byte *const last = first + BES_SLAB_SPAN_PAGES * BES_SLAB_PAGE_SIZE;
+		const bes_bool carving = slab->cursor >= first && slab->cursor <= last ? BES_TRUE : BES_FALSE;
+		const bes_size carved = carving ? (bes_size)(slab->cursor - first) / BES_SLAB_PAGE_SIZE : BES_SLAB_SPAN_PAGES;
+
+		bes_size empty = 0;
+		for (bes_slab_page *page = slab->empty; page; page = page->next)
+		{
+			if ((bes_byte *)page >= first && (bes_byte *)page < last)
+			{
+				empty++;
+			}
+		}
+
+		if (empty != carved)
+		{
+			link = &span->next;
+			continue;
+		}
+
+		for (bes_slab_page *page = slab->empty; page; )
+		{
+			bes_slab_page *const next = page->next;
+			if ((bes_byte *)page >= first && (bes_byte *)page < last)
+			{
+				bes_slab_unlink(&slab->empty, page);
+			}
+			page = next;
+		}
+
+		if (carving)
+		{
+			slab->cursor = 0;
+			slab->end = 0;
+		}
+
+		*link = span->next;
+		backing->deallocate(backing, span);
+		released += sizeof *span + (BES_SLAB_SPAN_PAGES + 1) * BES_SLAB_PAGE_SIZE;
+	}
+
+	/* The slabs of the spans given back are dropped from the table by
+	 * registering the slabs of the spans kept all over again. */
+	if (released)
+	{
+		bes_memset(slab->table, 0, slab->slots * sizeof *slab->table);
+		slab->registered = 0;
+		for (bes_slab_span *span = slab->spans; span; span = span->next)
+		{
+			bes_slab_table_add(slab, span);
+		}
+	}
+
+	return released;
+}
+
+void
+bes_slab_allocator_init(bes_slab_allocator *const slab,
+                        bes_allocator *const backing)
+{
+	BES_ASSERT(slab);
+
+	slab->allocator.allocate = &bes_slab_allocate;
+	slab->allocator.reallocate = &bes_slab_reallocate;
+	slab->allocator.deallocate = &bes_slab_deallocate;
+	slab->allocator.aux = slab;
+	slab->allocator.flags = 0;
+	slab->allocator.deallocate_sized = &bes_slab_deallocate_sized;
+	slab->allocator.alignment = BES_ALIGNMENT;
+	slab->allocator.usable_size = &bes_slab_usable_size;
+	slab->allocator.allocate_aligned = 0;
+	slab->allocator.reallocate_in_place = &bes_slab_reallocate_in_place;
+	slab->allocator.allocate_batch = &bes_slab_allocate_batch;
+	slab->allocator.deallocate_batch = 0;
+	slab->allocator.allocate_zeroed = 0;
+	slab->allocator.trim = &bes_slab_trim;
+	slab->backing = backing ? backing : bes_allocator_get();
+	for (bes_size i = 0; i < BES_SLAB_CLASSES; i++)
+	{
+		slab->partial[i] = 0;
+	}
+	slab->empty = 0;
+	slab->spans = 0;
+	slab->cursor = 0;
+	slab->end = 0;
+	slab->table = 0;
+	slab->slots = 0;
+	slab->registered = 0;
+
+	BES_ASSERT(slab->backing);
+}
+
+void
+bes_slab_allocator_release(bes_slab_allocator *const slab)
+{
+	bes_allocator *const backing = slab->backing;
+	bes_slab_span *span = slab->spans;
+	while (span)
+	{
+		bes_slab_span *const next = span->next;
+		backing->deallocate(backing, span);
+		span = next;
+	}
+
+	if (slab->table)
+	{
+		backing->deallocate(backing, slab->table);
+	}
+
+	bes_slab_allocator_init(slab, backing);
+}
@@ -0,0 +1,90 @@
+#ifndef BES_FOUNDATION_SLAB_H
+#define BES_FOUNDATION_SLAB_H
+
+/**
+ * @defgroup Slab Slab allocator
+ *
+ * @brief Size-class allocator for small objects
+ *
+ * The slab allocator serves small allocations out of page sized slabs,
+ * each of which only holds objects of a single size class. Free objects
+ * are kept on a list per slab so both allocation and deallocation are
+ * O(1) and objects carry no header of their own. Allocations larger than
+ * @ref BES_SLAB_MAX_SIZE are passed through to the backing allocator.
+ *
+ * Every allocation is aligned by @ref BES_ALIGNMENT and knows its size,
+ * so @ref bes_malloc hands out slab objects without a header of its own.
+ *
+ * @{
+ */
+
+#include <bes/foundation/memory.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** @brief The size and alignment of a slab */
+#define BES_SLAB_PAGE_SIZE 4096
+
+/** @brief The amount of slabs obtained from the backing allocator at once */
+#define BES_SLAB_SPAN_PAGES 16
+
+/** @brief The amount of size classes, spaced by @ref BES_ALIGNMENT */
+#define BES_SLAB_CLASSES 32
+
+/** @brief The largest allocation served from a slab */
+#define BES_SLAB_MAX_SIZE (BES_SLAB_CLASSES * BES_ALIGNMENT)
+
+typedef struct bes_slab_allocator bes_slab_allocator;
+typedef struct bes_slab_page bes_slab_page;
+typedef struct bes_slab_span bes_slab_span;
+
+/**
+ * @brief Slab allocator
+ *
+ * @warning The slab allocator is not thread safe.
+ */
+struct bes_slab_allocator
+{
+	bes_allocator allocator; /**< The allocator interface of the slab allocator */
+	bes_allocator *backing; /**< The allocator spans and large allocations come from */
+	bes_slab_page *partial[BES_SLAB_CLASSES]; /**< Slabs with free objects per size class */
+	bes_slab_page *empty; /**< Slabs without objects, reusable by any size class */
+	bes_slab_span *spans; /**< Spans obtained from the backing allocator */
+	bes_byte *cursor; /**< The next slab never handed out in the most recent span */
+	bes_byte *end; /**< The end of the most recent span */
+	bes_uintptr *table; /**< The address of every slab, telling slab objects and large allocations apart */
+	bes_size slots; /**< The amount of slots in the table */
+	bes_size registered; /**< The amount of slabs in the table */
+};
+
+/**
+ * @brief Initialize a slab allocator
+ * @param slab The slab allocator to initialize
+ * @param backing The allocator to obtain spans and large allocations from
+ * @note If @p backing is NULL the allocator set for the calling thread is
+ * used.
+ * @warning A slab allocator installed with @ref bes_allocator_set must be
+ * given an explicit @p backing allocator.
+ */
+BES_EXPORT void BES_API
+bes_slab_allocator_init(bes_slab_allocator *const slab,
+                        bes_allocator *const backing);
+
+/**
+ * @brief Return every span to the backing allocator
+ * @param slab The slab allocator
+ * @warning Large allocations still outstanding are not released.
+ */
+BES_EXPORT void BES_API
+bes_slab_allocator_release(bes_slab_allocator *const slab);
+
+#if defined(__cplusplus)
+}
+#endif
+
+/**
+ * @}
+ */
+#endif
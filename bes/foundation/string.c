@@ -85,14 +85,14 @@ bes_memcpy(void *BES_RESTRICT dst, const void *BES_RESTRICT src, bes_size n)
 				x = *(bes_u32 *)(s + 9);
 				*(bes_u32 *)(d + 8) = BES_LS(w, 24) | BES_RS(x, 8);
 				w = *(bes_u32 *)(s + 13);
-				*(bes_u32 *)(d + 13) = BES_LS(x, 24) | BES_RS(w, 8);
+				*(bes_u32 *)(d + 12) = BES_LS(x, 24) | BES_RS(w, 8);
 			}
 			break;
 		case 2:
 			w = *(bes_u32 *)s;
 			*d++ = *s++;
 			*d++ = *s++;
-			d -= 2;
+			n -= 2;
 			for (; n >= 18; s += 16, d += 16, n -= 16)
 			{
 				x = *(bes_u32 *)(s + 2);
@@ -108,17 +108,17 @@ bes_memcpy(void *BES_RESTRICT dst, const void *BES_RESTRICT src, bes_size n)
 		case 3:
 			w = *(bes_u32 *)s;
 			*d++ = *s++;
-			d -= 1;
+			n -= 1;
 			for (; n >= 19; s += 16, d += 16, n -= 16)
 			{
 				x = *(bes_u32 *)(s + 3);
-				*(bes_u32 *)(d + 0) = BES_LS(w, 8) | BES_RS(x, 8);
+				*(bes_u32 *)(d + 0) = BES_LS(w, 8) | BES_RS(x, 24);
 				w = *(bes_u32 *)(s + 7);
-				*(bes_u32 *)(d + 4) = BES_LS(x, 8) | BES_RS(w, 8);
+				*(bes_u32 *)(d + 4) = BES_LS(x, 8) | BES_RS(w, 24);
 				x = *(bes_u32 *)(s + 11);
-				*(bes_u32 *)(d + 8) = BES_LS(w, 8) | BES_RS(x, 8);
+				*(bes_u32 *)(d + 8) = BES_LS(w, 8) | BES_RS(x, 24);
 				w = *(bes_u32 *)(s + 15);
-				*(bes_u32 *)(d + 12) = BES_LS(x, 8) | BES_RS(w, 8);
+				*(bes_u32 *)(d + 12) = BES_LS(x, 8) | BES_RS(w, 24);
 			}
 			break;
 		}
@@ -138,6 +138,10 @@ bes_memcpy(void *BES_RESTRICT dst, const void *BES_RESTRICT src, bes_size n)
 		*d++ = *s++;
 		*d++ = *s++;
 		*d++ = *s++;
+		*d++ = *s++;
+		*d++ = *s++;
+		*d++ = *s++;
+		*d++ = *s++;
 	}
 
 	if (n & 8)
@@ -174,6 +178,73 @@ bes_memcpy(void *BES_RESTRICT dst, const void *BES_RESTRICT src, bes_size n)
 	return dst;
 }
 
+void*
+bes_memmove(void *dst, const void *src, bes_size n)
+{
+	bes_byte *d = dst;
+	const bes_byte *s = src;
+
+	if (d == s)
+	{
+		return dst;
+	}
+
+	/* Non-overlapping regions can take the faster copy. */
+	if ((bes_uintptr)s - (bes_uintptr)d - n <= -2 * n)
+	{
+		return bes_memcpy(d, s, n);
+	}
+
+	if (d < s)
+	{
+		if ((bes_uintptr)s % BES_ALIGN == (bes_uintptr)d % BES_ALIGN)
+		{
+			for (; (bes_uintptr)d % BES_ALIGN; n--)
+			{
+				if (!n)
+				{
+					return dst;
+				}
+				*d++ = *s++;
+			}
+			for (; n >= BES_ALIGN; n -= BES_ALIGN, d += BES_ALIGN, s += BES_ALIGN)
+			{
+				*(bes_size *)d = *(const bes_size *)s;
+			}
+		}
+		for (; n; n--)
+		{
+			*d++ = *s++;
+		}
+	}
+	else
+	{
+		if ((bes_uintptr)s % BES_ALIGN == (bes_uintptr)d % BES_ALIGN)
+		{
+			while ((bes_uintptr)(d + n) % BES_ALIGN)
+			{
+				if (!n--)
+				{
+					return dst;
+				}
+				d[n] = s[n];
+			}
+			while (n >= BES_ALIGN)
+			{
+				n -= BES_ALIGN;
+				*(bes_size *)(d + n) = *(const bes_size *)(s + n);
+			}
+		}
+		while (n)
+		{
+			n--;
+			d[n] = s[n];
+		}
+	}
+
+	return dst;
+}
+
 int
 bes_memcmp(const void *vl, const void *vr, bes_size n)
 {
@@ -317,14 +388,14 @@ bes_utf8_to_utf16_core(const char *const source,
 			code_point = ch & 0x07;
 		}
 
-		if (((*element & 0xC0) != 0x80) && code_point <= 0x10FFFF)
+		if (((*(element + 1) & 0xC0) != 0x80) && code_point <= 0x10FFFF)
 		{
 			if (code_point > 0xFFFF)
 			{
 				n_elements += 2;
 				if (destination)
 				{
-					*destination++ = (bes_wchar)(0xD800 + (code_point >> 10));
+					*destination++ = (bes_wchar)(0xD800 + ((code_point - 0x10000) >> 10));
 					*destination++ = (bes_wchar)(0xDC00 + (code_point & 0x03FF));
 				}
 			}
@@ -398,7 +469,7 @@ bes_utf16_to_utf8_core(const bes_wchar *const source,
 				{
 					*destination++ = (char)(0xE0 | ((code_point >> 12) & 0x0F));
 					*destination++ = (char)(0x80 | ((code_point >> 6) & 0x3F));
-					*destination++ = (char)(0x80 | (code_point & 0xeF));
+					*destination++ = (char)(0x80 | (code_point & 0x3F));
 				}
 			}
 			else
@@ -470,6 +541,48 @@ bes_utf16_to_utf8(const bes_wchar *source,
 	return BES_TRUE;
 }
 
+bes_bool
+bes_utf8_to_utf16_scratch(const bes_scratch *const scratch,
+                          const char *source,
+                          bes_wchar **const destination_)
+{
+	bes_size destination_length = 0;
+	bes_utf8_to_utf16_core(source, 0, &destination_length);
+
+	bes_wchar *destination = bes_scratch_alloc(scratch, (destination_length + 1) * sizeof *destination);
+	if (!destination)
+	{
+		return BES_FALSE;
+	}
+
+	bes_utf8_to_utf16_core(source, destination, 0);
+
+	destination[destination_length] = 0;
+	*destination_ = destination;
+	return BES_TRUE;
+}
+
+bes_bool
+bes_utf16_to_utf8_scratch(const bes_scratch *const scratch,
+                          const bes_wchar *source,
+                          char **const destination_)
+{
+	bes_size destination_length = 0;
+	bes_utf16_to_utf8_core(source, 0, &destination_length);
+
+	char *destination = bes_scratch_alloc(scratch, destination_length + 1);
+	if (!destination)
+	{
+		return BES_FALSE;
+	}
+
+	bes_utf16_to_utf8_core(source, destination, 0);
+
+	destination[destination_length] = 0;
+	*destination_ = destination;
+	return BES_TRUE;
+}
+
 bes_size
 bes_strlen(const char *s)
 {
@@ -10,6 +10,7 @@
  */
 
 #include <bes/foundation/types.h>
+#include <bes/foundation/scratch.h>
 
 #if defined(__cplusplus)
 extern "C" {
@@ -30,6 +31,22 @@ extern "C" {
 BES_EXPORT void* BES_API
 bes_memcpy(void *BES_RESTRICT dst, const void *BES_RESTRICT src, bes_size n);
 
+/**
+ * @brief Move block of memory
+ *
+ * Copies the values of @p n bytes from the location pointed by @p src
+ * to the memory block pointed to by @p dst. Unlike @ref bes_memcpy the
+ * blocks are permitted to overlap.
+ *
+ * @param dst The destination
+ * @param src The source
+ * @param n The amount of bytes to move
+ *
+ * @return The destination is returned
+ */
+BES_EXPORT void* BES_API
+bes_memmove(void *dst, const void *src, bes_size n);
+
 /**
  * @brief Compare the first @p n bytes of memory
  *
@@ -99,6 +116,40 @@ BES_EXPORT bes_bool BES_API
 bes_utf16_to_utf8(const bes_wchar *contents,
                     char **const destination_);
 
+/**
+ * @brief Convert UTF-8 string to UTF-16 in scratch memory
+ *
+ * @param scratch The scope to allocate the converted string in
+ * @param source The source string to convert
+ * @param destination_ The converted string is stored here
+ *
+ * @note The converted string is freed along with @p scratch, see
+ * @ref bes_scratch_end.
+ *
+ * @return On success this function returns @ref BES_TRUE.
+ */
+BES_EXPORT bes_bool BES_API
+bes_utf8_to_utf16_scratch(const bes_scratch *const scratch,
+                          const char *source,
+                          bes_wchar **const destination_);
+
+/**
+ * @brief Convert UTF-16 string to UTF-8 in scratch memory
+ *
+ * @param scratch The scope to allocate the converted string in
+ * @param source The source string to convert
+ * @param destination_ The converted string is stored here
+ *
+ * @note The converted string is freed along with @p scratch, see
+ * @ref bes_scratch_end.
+ *
+ * @return On success this function returns @ref BES_TRUE.
+ */
+BES_EXPORT bes_bool BES_API
+bes_utf16_to_utf8_scratch(const bes_scratch *const scratch,
+                          const bes_wchar *source,
+                          char **const destination_);
+
 /**
  * @brief Calculate the length of a string
  *
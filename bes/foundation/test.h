@@ -2,16 +2,89 @@
 #define BES_FOUNDATION_TEST_H
 
 #include <bes/foundation/string.h>
+#include <bes/foundation/memory.h>
 #include <bes/foundation/macros.h>
 
+/** @brief Budget of a test which may allocate without limit */
+#define BES_TEST_UNLIMITED ((bes_size)-1)
+
 typedef struct bes_test_entry bes_test_entry;
+typedef struct bes_test_counter bes_test_counter;
 
 struct bes_test_entry
 {
 	const char *name;
 	bes_bool (*function)(void);
+	bes_size allocations;
+	bes_size reallocations;
+};
+
+/* Tests with a budget run with this allocator pushed, which counts what
+ * reaches it before passing it on to the allocator it was pushed over. */
+struct bes_test_counter
+{
+	bes_allocator allocator;
+	bes_allocator *backing;
+	bes_size allocations;
+	bes_size reallocations;
 };
 
+static bes_test_counter g_bes_test_counter;
+
+static inline void* BES_API
+bes_test_counter_allocate(bes_allocator *allocator, bes_size size)
+{
+	bes_test_counter *const counter = allocator->aux;
+	counter->allocations++;
+	return counter->backing->allocate(counter->backing, size);
+}
+
+static inline void* BES_API
+bes_test_counter_reallocate(bes_allocator *allocator, void *data, bes_size size)
+{
+	bes_test_counter *const counter = allocator->aux;
+	counter->reallocations++;
+	return counter->backing->reallocate(counter->backing, data, size);
+}
+
+static inline void BES_API
+bes_test_counter_deallocate(bes_allocator *allocator, void *data)
+{
+	bes_test_counter *const counter = allocator->aux;
+	counter->backing->deallocate(counter->backing, data);
+}
+
+static inline bes_bool
+bes_test_counter_push(bes_test_counter *const counter)
+{
+	bes_memset(counter, 0, sizeof *counter);
+	counter->allocator.allocate = &bes_test_counter_allocate;
+	counter->allocator.reallocate = &bes_test_counter_reallocate;
+	counter->allocator.deallocate = &bes_test_counter_deallocate;
+	counter->allocator.aux = counter;
+	counter->backing = bes_allocator_get();
+	return bes_allocator_push(&counter->allocator);
+}
+
+static inline char*
+bes_test_format_size(char *out, bes_size value)
+{
+	char digits[24];
+	bes_size count = 0;
+	do
+	{
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value);
+
+	while (count)
+	{
+		*out++ = digits[--count];
+	}
+	*out = '\0';
+	return out;
+}
+
 #define BES_DEFINE_TEST(NAME) \
 	static bes_bool NAME(void)
 
@@ -19,7 +92,30 @@ struct bes_test_entry
 	static const bes_test_entry NAME[] =
 
 #define BES_ADD_TEST(NAME) \
-	{ #NAME, &(NAME) }
+	{ #NAME, &(NAME), BES_TEST_UNLIMITED, BES_TEST_UNLIMITED }
+
+/**
+ * @brief Add a test which fails when it allocates more than its budget
+ *
+ * Calls to the allocator made on the thread of the test, including the
+ * ones made inside foundation, count against the budget. Allocations
+ * served from the thread cache don't reach the allocator and aren't
+ * counted, so the cache is bypassed while the test runs.
+ *
+ * @param NAME The test
+ * @param ALLOCATIONS The most allocations the test may make
+ * @param REALLOCATIONS The most reallocations the test may make
+ */
+#define BES_ADD_TEST_BUDGET(NAME, ALLOCATIONS, REALLOCATIONS) \
+	{ #NAME, &(NAME), (ALLOCATIONS), (REALLOCATIONS) }
+
+/**
+ * @brief Leave everything a test allocated so far out of its budget
+ *
+ * Lets a test set up what it needs before the code its budget is for.
+ */
+#define BES_TEST_BUDGET_RESET() \
+	(g_bes_test_counter.allocations = 0, g_bes_test_counter.reallocations = 0)
 
 #define BES_DEFINE_TEST_COMMAND(NAME, DESCRIPTION, TESTS, PRINTER) \
 	bes_bool NAME(bes_size *tests, bes_size *failed) \
@@ -54,14 +150,39 @@ struct bes_test_entry
 				} \
 			} \
 			(PRINTER)("\e[0m "); \
+			const bes_bool budgeted = entry->allocations != BES_TEST_UNLIMITED \
+				|| entry->reallocations != BES_TEST_UNLIMITED; \
+			const bes_bool counted = budgeted && bes_test_counter_push(&g_bes_test_counter); \
 			const bes_bool result = entry->function(); \
-			if (result) \
+			if (counted) \
+			{ \
+				bes_allocator_pop(); \
+			} \
+			const bes_bool within = !budgeted || (counted \
+				&& g_bes_test_counter.allocations <= entry->allocations \
+				&& g_bes_test_counter.reallocations <= entry->reallocations); \
+			if (result && within) \
 			{ \
 				(PRINTER)("\e[32mpassed\e[0m\n"); \
 			} \
 			else \
 			{ \
-				(PRINTER)("\e[31mfailed\e[0m\n"); \
+				(PRINTER)("\e[31mfailed\e[0m"); \
+				if (!counted && budgeted) \
+				{ \
+					(PRINTER)(" (allocations can't be counted)"); \
+				} \
+				else if (!within) \
+				{ \
+					/* Tell how far over budget the test went. */ \
+					char *out = bes_stpcpy(buffer, " ("); \
+					out = bes_test_format_size(out, g_bes_test_counter.allocations); \
+					out = bes_stpcpy(out, " allocations, "); \
+					out = bes_test_format_size(out, g_bes_test_counter.reallocations); \
+					bes_stpcpy(out, " reallocations)"); \
+					(PRINTER)(buffer); \
+				} \
+				(PRINTER)("\n"); \
 				(*failed)++; \
 				status = BES_FALSE; \
 			} \
@@ -0,0 +1,453 @@
+#include <bes/foundation/tlsf.h>
+#include <bes/foundation/bits.h>
+#include <bes/foundation/string.h>
+
+/* Every block starts with a header recording the block physically before
+ * it and the size of its data, the low bit of which is set when the block
+ * is free. Free blocks link their list through the start of their data.
+ * A pool ends in a sentinel block without data that is never free. */
+struct bes_tlsf_block
+{
+	bes_tlsf_block *prev_physical;
+	bes_size size;
+	bes_tlsf_block *next_free;
+	bes_tlsf_block *prev_free;
+};
+
+#define BES_TLSF_HEADER_SIZE BES_ALIGNMENT
+#define BES_TLSF_MIN_SIZE BES_ALIGNMENT
+#define BES_TLSF_SMALL_SIZE ((bes_size)1 << BES_TLSF_FL_SHIFT)
+#define BES_TLSF_BLOCK_MAX ((bes_size)(((bes_u64)1 << BES_TLSF_FL_MAX) - BES_ALIGNMENT))
+#define BES_TLSF_FREE ((bes_size)1)
+
+BES_STATIC_ASSERT(2 * sizeof(void *) <= BES_TLSF_HEADER_SIZE);
+BES_STATIC_ASSERT(sizeof(bes_tlsf_block) <= BES_TLSF_HEADER_SIZE + BES_TLSF_MIN_SIZE);
+BES_STATIC_ASSERT(BES_TLSF_SMALL_SIZE / BES_TLSF_SL_COUNT == BES_ALIGNMENT);
+BES_STATIC_ASSERT(BES_TLSF_FL_COUNT <= 32);
+BES_STATIC_ASSERT(BES_TLSF_POOL_OVERHEAD == 2 * BES_TLSF_HEADER_SIZE);
+
+static inline bes_size
+bes_tlsf_block_size(const bes_tlsf_block *const block)
+{
+	return block->size & ~BES_TLSF_FREE;
+}
+
+static inline bes_bool
+bes_tlsf_block_is_free(const bes_tlsf_block *const block)
+{
+	return block->size & BES_TLSF_FREE ? BES_TRUE : BES_FALSE;
+}
+
+static inline void*
+bes_tlsf_block_data(bes_tlsf_block *const block)
+{
+	return (bes_byte *)block + BES_TLSF_HEADER_SIZE;
+}
+
+static inline bes_tlsf_block*
+bes_tlsf_block_of(const void *const data)
+{
+	return (bes_tlsf_block *)((bes_byte *)data - BES_TLSF_HEADER_SIZE);
+}
+
+static inline bes_tlsf_block*
+bes_tlsf_block_next(bes_tlsf_block *const block)
+{
+	return (bes_tlsf_block *)((bes_byte *)bes_tlsf_block_data(block) + bes_tlsf_block_size(block));
+}
+
+static inline bes_size
+bes_tlsf_adjust_size(bes_size size)
+{
+	return size <= BES_TLSF_MIN_SIZE ? BES_TLSF_MIN_SIZE : (size + BES_ALIGNMENT - 1) & -(bes_size)BES_ALIGNMENT;
+}
+
+/* The first level is the power of two of the size and the second level
+ * the next BES_TLSF_SL_LOG2 bits below it. Sizes small enough to not have
+ * that many bits share the first level in steps of the alignment. */
+static inline void
+bes_tlsf_mapping(bes_size size, bes_size *const fl, bes_size *const sl)
+{
+	if (size < BES_TLSF_SMALL_SIZE)
+	{
+		*fl = 0;
+		*sl = size / BES_ALIGNMENT;
+	}
+	else
+	{
+		const bes_size msb = bes_bits_log2(size);
+		*fl = msb - BES_TLSF_FL_SHIFT + 1;
+		*sl = (size >> (msb - BES_TLSF_SL_LOG2)) ^ BES_TLSF_SL_COUNT;
+	}
+}
+
+static void
+bes_tlsf_insert(bes_tlsf_allocator *const tlsf, bes_tlsf_block *const block)
+{
+	bes_size fl = 0;
+	bes_size sl = 0;
+	bes_tlsf_mapping(bes_tlsf_block_size(block), &fl, &sl);
+
+	block->size |= BES_TLSF_FREE;
+	block->prev_free = 0;
+	block->next_free = tlsf->blocks[fl][sl];
+	if (block->next_free)
+	{
+		block->next_free->prev_free = block;
+	}
+	tlsf->blocks[fl][sl] = block;
+	tlsf->fl_bitmap |= (bes_u32)1 << fl;
+	tlsf->sl_bitmap[fl] |= (bes_u32)1 << sl;
+	tlsf->steps++;
+}
+
+static void
+bes_tlsf_remove(bes_tlsf_allocator *const tlsf, bes_tlsf_block *const block)
+{
+	bes_size fl = 0;
+	bes_size sl = 0;
+	bes_tlsf_mapping(bes_tlsf_block_size(block), &fl, &sl);
+
+	block->size &= ~BES_TLSF_FREE;
+	if (block->prev_free)
+	{
+		block->prev_free->next_free = block->next_free;
+	}
+	else
+	{
+		tlsf->blocks[fl][sl] = block->next_free;
+		if (!block->next_free)
+		{
+			tlsf->sl_bitmap[fl] &= ~((bes_u32)1 << sl);
+			if (!tlsf->sl_bitmap[fl])
+			{
+				tlsf->fl_bitmap &= ~((bes_u32)1 << fl);
+			}
+		}
+	}
+
+	if (block->next_free)
+	{
+		block->next_free->prev_free = block->prev_free;
+	}
+	tlsf->steps++;
+}
+
+/* Find a free block of at least size bytes. The size is rounded up to the
+ * next list boundary first so any block on the list found fits, which is
+ * what keeps the search free of list walks. */
+static bes_tlsf_block*
+bes_tlsf_find(bes_tlsf_allocator *const tlsf, bes_size size)
+{
+	tlsf->steps++;
+
+	if (size >= BES_TLSF_SMALL_SIZE)
+	{
+		const bes_size round = ((bes_size)1 << (bes_bits_log2(size) - BES_TLSF_SL_LOG2)) - 1;
+		if (size > (bes_size)-1 - round)
+		{
+			return 0;
+		}
+		size += round;
+	}
+
+	bes_size fl = 0;
+	bes_size sl = 0;
+	bes_tlsf_mapping(size, &fl, &sl);
+	if (fl >= BES_TLSF_FL_COUNT)
+	{
+		return 0;
+	}
+
+	bes_u32 sl_map = tlsf->sl_bitmap[fl] & (~(bes_u32)0 << sl);
+	if (!sl_map)
+	{
+		const bes_u32 fl_map = fl + 1 < 32 ? tlsf->fl_bitmap & (~(bes_u32)0 << (fl + 1)) : 0;
+		if (!fl_map)
+		{
+			return 0;
+		}
+		fl = bes_bits_lsb_u32(fl_map);
+		sl_map = tlsf->sl_bitmap[fl];
+	}
+
+	return tlsf->blocks[fl][bes_bits_lsb_u32(sl_map)];
+}
+
+/* Give back the end of a block past size bytes when it can hold a block of
+ * its own. The block after must not be free. */
+static void
+bes_tlsf_trim(bes_tlsf_allocator *const tlsf, bes_tlsf_block *const block, bes_size size)
+{
+	const bes_size available = bes_tlsf_block_size(block);
+	if (available < size + BES_TLSF_HEADER_SIZE + BES_TLSF_MIN_SIZE)
+	{
+		return;
+	}
+
+	bes_tlsf_block *const remainder = (bes_tlsf_block *)((bes_byte *)bes_tlsf_block_data(block) + size);
+	remainder->prev_physical = block;
+	remainder->size = available - size - BES_TLSF_HEADER_SIZE;
+	bes_tlsf_block_next(remainder)->prev_physical = remainder;
+	block->size = size;
+	bes_tlsf_insert(tlsf, remainder);
+}
+
+/* Merge the block after into a block, which must be free. */
+static void
+bes_tlsf_absorb(bes_tlsf_allocator *const tlsf, bes_tlsf_block *const block, bes_tlsf_block *const next)
+{
+	bes_tlsf_remove(tlsf, next);
+	block->size += bes_tlsf_block_size(next) + BES_TLSF_HEADER_SIZE;
+	bes_tlsf_block_next(block)->prev_physical = block;
+}
+
+static void*
+bes_tlsf_take(bes_tlsf_allocator *const tlsf, bes_size size)
+{
+	if (size > BES_TLSF_BLOCK_MAX)
+	{
+		return 0;
+	}
+
+	size = bes_tlsf_adjust_size(size);
+	bes_tlsf_block *const block = bes_tlsf_find(tlsf, size);
+	if (!block)
+	{
+		return 0;
+	}
+
+	bes_tlsf_remove(tlsf, block);
+	bes_tlsf_trim(tlsf, block, size);
+	tlsf->used += bes_tlsf_block_size(block);
+	return bes_tlsf_block_data(block);
+}
+
+static void
+bes_tlsf_release(bes_tlsf_allocator *const tlsf, void *const data)
+{
+	bes_tlsf_block *block = bes_tlsf_block_of(data);
+	tlsf->used -= bes_tlsf_block_size(block);
+
+	bes_tlsf_block *const prev = block->prev_physical;
+	if (prev && bes_tlsf_block_is_free(prev))
+	{
+		bes_tlsf_remove(tlsf, prev);
+		prev->size += bes_tlsf_block_size(block) + BES_TLSF_HEADER_SIZE;
+		bes_tlsf_block_next(prev)->prev_physical = prev;
+		block = prev;
+	}
+
+	bes_tlsf_block *const next = bes_tlsf_block_next(block);
+	if (bes_tlsf_block_is_free(next))
+	{
+		bes_tlsf_absorb(tlsf, block, next);
+	}
+
+	bes_tlsf_insert(tlsf, block);
+}
+
+static bes_bool
+bes_tlsf_resize(bes_tlsf_allocator *const tlsf, void *const data, bes_size size)
+{
+	if (size > BES_TLSF_BLOCK_MAX)
+	{
+		return BES_FALSE;
+	}
+
+	bes_tlsf_block *const block = bes_tlsf_block_of(data);
+	bes_tlsf_block *const next = bes_tlsf_block_next(block);
+	const bes_size current = bes_tlsf_block_size(block);
+	size = bes_tlsf_adjust_size(size);
+
+	if (size > current
+		&& (!bes_tlsf_block_is_free(next)
+			|| current + BES_TLSF_HEADER_SIZE + bes_tlsf_block_size(next) < size))
+	{
+		return BES_FALSE;
+	}
+
+	/* Both growing and shrinking merge with a free block after, growing to
+	 * make room and shrinking so the memory given back isn't left next to
+	 * a free block without coalescing. */
+	if (bes_tlsf_block_is_free(next))
+	{
+		bes_tlsf_absorb(tlsf, block, next);
+	}
+
+	bes_tlsf_trim(tlsf, block, size);
+	tlsf->used += bes_tlsf_block_size(block);
+	tlsf->used -= current;
+	return BES_TRUE;
+}
+
+static void* BES_API
+bes_tlsf_allocate(bes_allocator *allocator, bes_size size)
+{
+	bes_tlsf_allocator *const tlsf = allocator->aux;
+	tlsf->steps = 0;
+	return bes_tlsf_take(tlsf, size);
+}
+
+static void* BES_API
+bes_tlsf_allocate_aligned(bes_allocator *allocator, bes_size size, bes_size alignment)
+{
+	bes_tlsf_allocator *const tlsf = allocator->aux;
+	tlsf->steps = 0;
+
+	if (alignment <= BES_ALIGNMENT)
+	{
+		return bes_tlsf_take(tlsf, size);
+	}
+
+	/* Find a block with room for the alignment and for a free block in
+	 * front of the aligned data, then give back both ends. */
+	const bes_size gap = BES_TLSF_HEADER_SIZE + BES_TLSF_MIN_SIZE;
+	if (alignment > BES_TLSF_BLOCK_MAX - gap || size > BES_TLSF_BLOCK_MAX - gap - alignment)
+	{
+		return 0;
+	}
+
+	size = bes_tlsf_adjust_size(size);
+	bes_tlsf_block *block = bes_tlsf_find(tlsf, size + alignment + gap);
+	if (!block)
+	{
+		return 0;
+	}
+
+	bes_tlsf_remove(tlsf, block);
+
+	const bes_uintptr data = (bes_uintptr)bes_tlsf_block_data(block);
+	if (data % alignment)
+	{
+		const bes_uintptr aligned = (data + gap + alignment - 1) & -(bes_uintptr)alignment;
+		bes_tlsf_block *const front = block;
+		block = bes_tlsf_block_of((void *)aligned);
+		block->prev_physical = front;
+		block->size = bes_tlsf_block_size(front) - (bes_size)(aligned - data);
+		bes_tlsf_block_next(block)->prev_physical = block;
+		front->size = (bes_size)(aligned - data) - BES_TLSF_HEADER_SIZE;
+		bes_tlsf_insert(tlsf, front);
+	}
+
+	bes_tlsf_trim(tlsf, block, size);
+	tlsf->used += bes_tlsf_block_size(block);
+	return bes_tlsf_block_data(block);
+}
+
+static void BES_API
+bes_tlsf_deallocate(bes_allocator *allocator, void *data)
+{
+	bes_tlsf_allocator *const tlsf = allocator->aux;
+	tlsf->steps = 0;
+	if (data)
+	{
+		bes_tlsf_release(tlsf, data);
+	}
+}
+
+static bes_size BES_API
+bes_tlsf_usable_size(bes_allocator *allocator, const void *data)
+{
+	(void)allocator;
+	return bes_tlsf_block_size(bes_tlsf_block_of(data));
+}
+
+static bes_bool BES_API
+bes_tlsf_reallocate_in_place(bes_allocator *allocator, void *data, bes_size size)
+{
+	bes_tlsf_allocator *const tlsf = allocator->aux;
+	tlsf->steps = 0;
+	return bes_tlsf_resize(tlsf, data, size);
+}
+
+static void* BES_API
+bes_tlsf_reallocate(bes_allocator *allocator, void *data, bes_size size)
+{
+	bes_tlsf_allocator *const tlsf = allocator->aux;
+	tlsf->steps = 0;
+
+	if (!data)
+	{
+		return bes_tlsf_take(tlsf, size);
+	}
+
+	if (bes_tlsf_resize(tlsf, data, size))
+	{
+		return data;
+	}
+
+	void *const resize = bes_tlsf_take(tlsf, size);
+	if (resize)
+	{
+		/* The block only failed to resize because it has to grow. */
+		bes_memcpy(resize, data, bes_tlsf_block_size(bes_tlsf_block_of(data)));
+		bes_tlsf_release(tlsf, data);
+	}
+
+	return resize;
+}
+
+void
+bes_tlsf_allocator_init(bes_tlsf_allocator *const tlsf)
+{
+	BES_ASSERT(tlsf);
+
+	tlsf->allocator.allocate = &bes_tlsf_allocate;
+	tlsf->allocator.reallocate = &bes_tlsf_reallocate;
+	tlsf->allocator.deallocate = &bes_tlsf_deallocate;
+	tlsf->allocator.aux = tlsf;
+	tlsf->allocator.flags = 0;
+	tlsf->allocator.deallocate_sized = 0;
+	tlsf->allocator.alignment = BES_ALIGNMENT;
+	tlsf->allocator.usable_size = &bes_tlsf_usable_size;
+	tlsf->allocator.allocate_aligned = &bes_tlsf_allocate_aligned;
+	tlsf->allocator.reallocate_in_place = &bes_tlsf_reallocate_in_place;
+	tlsf->allocator.allocate_batch = 0;
+	tlsf->allocator.deallocate_batch = 0;
+	tlsf->allocator.allocate_zeroed = 0;
+	tlsf->allocator.trim = 0;
+	tlsf->fl_bitmap = 0;
+	for (bes_size fl = 0; fl < BES_TLSF_FL_COUNT; fl++)
+	{
+		tlsf->sl_bitmap[fl] = 0;
+		for (bes_size sl = 0; sl < BES_TLSF_SL_COUNT; sl++)
+		{
+			tlsf->blocks[fl][sl] = 0;
+		}
+	}
+	tlsf->used = 0;
+	tlsf->steps = 0;
+}
+
+bes_bool
+bes_tlsf_allocator_add_pool(bes_tlsf_allocator *const tlsf,
+                            void *const pool,
+                            bes_size size)
+{
+	BES_ASSERT(tlsf);
+
+	bes_byte *const start = (bes_byte *)(((bes_uintptr)pool + BES_ALIGNMENT - 1) & -(bes_uintptr)BES_ALIGNMENT);
+	const bes_size slack = (bes_size)(start - (bes_byte *)pool);
+	if (size < slack + BES_TLSF_POOL_OVERHEAD + BES_TLSF_MIN_SIZE)
+	{
+		return BES_FALSE;
+	}
+
+	bes_size available = (size - slack - BES_TLSF_POOL_OVERHEAD) & -(bes_size)BES_ALIGNMENT;
+	if (available > BES_TLSF_BLOCK_MAX)
+	{
+		available = BES_TLSF_BLOCK_MAX;
+	}
+
+	bes_tlsf_block *const block = (bes_tlsf_block *)start;
+	block->prev_physical = 0;
+	block->size = available;
+
+	bes_tlsf_block *const sentinel = bes_tlsf_block_next(block);
+	sentinel->prev_physical = block;
+	sentinel->size = 0;
+
+	bes_tlsf_insert(tlsf, block);
+	return BES_TRUE;
+}
@@ -0,0 +1,116 @@
+#ifndef BES_FOUNDATION_TLSF_H
+#define BES_FOUNDATION_TLSF_H
+
+/**
+ * @defgroup TLSF TLSF allocator
+ *
+ * @brief Two-level segregated fit allocator with bounded latency
+ *
+ * The TLSF allocator serves allocations out of one or more pools of memory
+ * handed to it by the caller. Free blocks are kept on lists segregated by
+ * size in two levels, the first by power of two and the second dividing
+ * each power of two in @ref BES_TLSF_SL_COUNT linear steps. A pair of
+ * bitmaps records which lists have blocks, so a fitting block is found
+ * with two bit scans and no search.
+ *
+ * Every block records the block physically before it, letting a freed
+ * block coalesce with both of its neighbours immediately. Allocation,
+ * deallocation and resizing in place thus take a bounded amount of work
+ * regardless of the state of the pools, which suits threads that can't
+ * tolerate unpredictable latency. Allocations are rounded up to a list
+ * boundary, wasting at most one part in @ref BES_TLSF_SL_COUNT.
+ *
+ * The allocator is headerless, see @ref bes_allocator.
+ *
+ * @{
+ */
+
+#include <bes/foundation/memory.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** @brief The log2 of the amount of second level lists per first level */
+#define BES_TLSF_SL_LOG2 5
+
+/** @brief The amount of second level lists per first level */
+#define BES_TLSF_SL_COUNT (1 << BES_TLSF_SL_LOG2)
+
+/** @brief The log2 of the size blocks must stay below */
+#define BES_TLSF_FL_MAX 32
+
+/** @brief The log2 of the smallest size with a first level of its own */
+#define BES_TLSF_FL_SHIFT (BES_TLSF_SL_LOG2 + 4)
+
+/** @brief The amount of first level lists */
+#define BES_TLSF_FL_COUNT (BES_TLSF_FL_MAX - BES_TLSF_FL_SHIFT + 1)
+
+/** @brief The memory taken by the allocator from every pool it is given */
+#define BES_TLSF_POOL_OVERHEAD (2 * BES_ALIGNMENT)
+
+typedef struct bes_tlsf_allocator bes_tlsf_allocator;
+typedef struct bes_tlsf_block bes_tlsf_block;
+
+/**
+ * @brief TLSF allocator
+ * @warning The TLSF allocator is not thread safe.
+ */
+struct bes_tlsf_allocator
+{
+	bes_allocator allocator; /**< The allocator interface of the TLSF allocator */
+	bes_u32 fl_bitmap; /**< One bit per first level set when it has free blocks */
+	bes_u32 sl_bitmap[BES_TLSF_FL_COUNT]; /**< One bit per list set when it has free blocks */
+	bes_tlsf_block *blocks[BES_TLSF_FL_COUNT][BES_TLSF_SL_COUNT]; /**< Free blocks per list */
+	bes_size used; /**< The amount of memory in allocated blocks */
+
+	/**
+	 * The amount of list searches, insertions and removals made by the
+	 * most recent call through the allocator interface, bounded by
+	 * @ref BES_TLSF_MAX_STEPS.
+	 */
+	bes_size steps;
+};
+
+/**
+ * @brief The most steps allocating, deallocating or resizing in place makes
+ * @note Reallocating a block which can't be resized in place makes at most
+ * twice as many steps, for an allocation and a deallocation.
+ */
+#define BES_TLSF_MAX_STEPS 4
+
+/**
+ * @brief Initialize a TLSF allocator without any memory
+ * @param tlsf The TLSF allocator to initialize
+ * @note Allocations fail until a pool is added with
+ * @ref bes_tlsf_allocator_add_pool.
+ */
+BES_EXPORT void BES_API
+bes_tlsf_allocator_init(bes_tlsf_allocator *const tlsf);
+
+/**
+ * @brief Add a pool of memory to allocate from
+ * @param tlsf The TLSF allocator
+ * @param pool The memory to allocate from
+ * @param size The size of @p pool
+ * @note A pool is limited to blocks below 2^@ref BES_TLSF_FL_MAX bytes,
+ * memory past that is left unused. Larger regions can be added as several
+ * pools.
+ * @note @ref BES_TLSF_POOL_OVERHEAD bytes of each pool, plus any needed to
+ * align it by @ref BES_ALIGNMENT, can't be allocated.
+ * @return BES_TRUE if successful, BES_FALSE if @p pool is too small to
+ * hold a block.
+ */
+BES_EXPORT bes_bool BES_API
+bes_tlsf_allocator_add_pool(bes_tlsf_allocator *const tlsf,
+                            void *const pool,
+                            bes_size size);
+
+#if defined(__cplusplus)
+}
+#endif
+
+/**
+ * @}
+ */
+#endif
@@ -0,0 +1,117 @@
+/* MAP_ANONYMOUS and MAP_NORESERVE are extensions. */
+#define _GNU_SOURCE
+
+#include <bes/foundation/vm.h>
+
+#if defined(BES_PLATFORM_LINUX)
+#include <sys/mman.h>
+#include <unistd.h>
+#elif defined(BES_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+bes_size
+bes_vm_page_size(void)
+{
+#if defined(BES_PLATFORM_LINUX)
+	return (bes_size)sysconf(_SC_PAGESIZE);
+#elif defined(BES_PLATFORM_WINDOWS)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (bes_size)info.dwPageSize;
+#else
+	return 4096;
+#endif
+}
+
+static inline bes_size
+bes_vm_round(bes_size size)
+{
+	const bes_size page_size = bes_vm_page_size();
+	return (size + page_size - 1) & -page_size;
+}
+
+void*
+bes_vm_reserve(bes_size size)
+{
+#if defined(BES_PLATFORM_LINUX)
+	/* Inaccessible pages aren't counted against the commit limit, so even
+	 * very large reservations succeed without overcommitting. */
+	void *const address = mmap(0, bes_vm_round(size), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	return address != MAP_FAILED ? address : 0;
+#elif defined(BES_PLATFORM_WINDOWS)
+	return VirtualAlloc(0, bes_vm_round(size), MEM_RESERVE, PAGE_NOACCESS);
+#else
+	(void)size;
+	return 0;
+#endif
+}
+
+bes_bool
+bes_vm_commit(void *const address, bes_size size)
+{
+#if defined(BES_PLATFORM_LINUX)
+	return mprotect(address, size, PROT_READ | PROT_WRITE) == 0 ? BES_TRUE : BES_FALSE;
+#elif defined(BES_PLATFORM_WINDOWS)
+	return VirtualAlloc(address, size, MEM_COMMIT, PAGE_READWRITE) ? BES_TRUE : BES_FALSE;
+#else
+	(void)address;
+	(void)size;
+	return BES_FALSE;
+#endif
+}
+
+void
+bes_vm_decommit(void *const address, bes_size size)
+{
+#if defined(BES_PLATFORM_LINUX)
+	/* Dropping the pages first releases their memory right away, taking
+	 * away access then has nothing left to write back. */
+	madvise(address, size, MADV_DONTNEED);
+	mprotect(address, size, PROT_NONE);
+#elif defined(BES_PLATFORM_WINDOWS)
+	VirtualFree(address, size, MEM_DECOMMIT);
+#else
+	(void)address;
+	(void)size;
+#endif
+}
+
+bes_size
+bes_vm_purge(void *const address, bes_size size)
+{
+	const bes_size page_size = bes_vm_page_size();
+	bes_byte *const first = (bes_byte *)(((bes_uintptr)address + page_size - 1) & -(bes_uintptr)page_size);
+	bes_byte *const last = (bes_byte *)(((bes_uintptr)address + size) & -(bes_uintptr)page_size);
+	if (first >= last)
+	{
+		return 0;
+	}
+
+#if defined(BES_PLATFORM_LINUX)
+	/* Fails for locked and huge pages, which simply keep their memory. */
+	return madvise(first, (bes_size)(last - first), MADV_DONTNEED) == 0 ? (bes_size)(last - first) : 0;
+#elif defined(BES_PLATFORM_WINDOWS)
+	/* Reset pages keep their commit but their memory is free to be taken
+	 * away, unlike decommitting this works on memory from any allocator. */
+	return VirtualAlloc(first, (bes_size)(last - first), MEM_RESET, PAGE_READWRITE) ? (bes_size)(last - first) : 0;
+#else
+	return 0;
+#endif
+}
+
+void
+bes_vm_release(void *const address, bes_size size)
+{
+#if defined(BES_PLATFORM_LINUX)
+	munmap(address, bes_vm_round(size));
+#elif defined(BES_PLATFORM_WINDOWS)
+	/* The whole reservation is released at once, by its base address. */
+	(void)size;
+	VirtualFree(address, 0, MEM_RELEASE);
+#else
+	(void)address;
+	(void)size;
+#endif
+}
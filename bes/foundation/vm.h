@@ -0,0 +1,99 @@
+#ifndef BES_FOUNDATION_VM_H
+#define BES_FOUNDATION_VM_H
+
+/**
+ * @defgroup VM Virtual memory
+ *
+ * @brief Reserve address space and commit pages to it
+ *
+ * Reserving address space costs no memory, it only keeps a range of
+ * addresses from being handed out to anything else. Pages of a reserved
+ * range must be committed before they are accessed and can be decommitted
+ * again to give their memory back to the operating system while keeping
+ * the range reserved. Structures that must not move can reserve the most
+ * they will ever need up front and commit as they grow.
+ *
+ * Committed pages are zero when first accessed, whether they were never
+ * committed before or were decommitted since.
+ *
+ * Linux and Windows are supported, elsewhere every reservation fails.
+ *
+ * @{
+ */
+
+#include <bes/foundation/types.h>
+#include <bes/foundation/macros.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief Get the granularity of commits
+ * @return The size of a page, addresses and sizes given to
+ * @ref bes_vm_commit and @ref bes_vm_decommit must be multiples of it.
+ */
+BES_EXPORT bes_size BES_API
+bes_vm_page_size(void);
+
+/**
+ * @brief Reserve address space
+ * @param size The amount of bytes to reserve, rounded up to a page
+ * @note Nothing is committed, accessing the range faults until it is.
+ * @return On failure this function returns NULL
+ */
+BES_EXPORT void* BES_API
+bes_vm_reserve(bes_size size);
+
+/**
+ * @brief Commit pages of a reserved range
+ * @param address The first page to commit
+ * @param size The amount of bytes to commit
+ * @note The memory of committed pages is only used once they are touched.
+ * @note Committing pages that are already committed leaves their contents
+ * as they are.
+ * @return BES_TRUE if the pages can now be accessed.
+ */
+BES_EXPORT bes_bool BES_API
+bes_vm_commit(void *const address, bes_size size);
+
+/**
+ * @brief Give the memory of committed pages back to the operating system
+ * @param address The first page to decommit
+ * @param size The amount of bytes to decommit
+ * @note The pages stay reserved and fault when accessed until committed
+ * again.
+ */
+BES_EXPORT void BES_API
+bes_vm_decommit(void *const address, bes_size size);
+
+/**
+ * @brief Give the memory of pages back to the operating system while
+ * keeping them accessible
+ * @param address The start of the memory
+ * @param size The amount of bytes
+ * @note Only the pages wholly inside the range are purged, the memory
+ * need not be reserved with @ref bes_vm_reserve. Their contents are lost,
+ * they may read as zero or as anything that was written to them before.
+ * @return The amount of bytes purged
+ */
+BES_EXPORT bes_size BES_API
+bes_vm_purge(void *const address, bes_size size);
+
+/**
+ * @brief Release a reserved range
+ * @param address The address returned by @ref bes_vm_reserve
+ * @param size The size given to @ref bes_vm_reserve
+ * @note Committed pages are released along with the range.
+ */
+BES_EXPORT void BES_API
+bes_vm_release(void *const address, bes_size size);
+
+#if defined(__cplusplus)
+}
+#endif
+
+/**
+ * @}
+ */
+#endif
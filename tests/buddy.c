@@ -0,0 +1,241 @@
+#include <bes/foundation/test.h>
+#include <bes/foundation/buddy.h>
+#include <bes/foundation/string.h>
+
+#include <stdlib.h>
+
+#define REGION (64 * 1024)
+
+/* Regions leave exactly REGION bytes for blocks after the bitmaps. */
+#define REGION_SIZE (REGION + BES_BUDDY_METADATA_SIZE(REGION))
+
+static bes_byte*
+region_new(bes_size size)
+{
+	return aligned_alloc(4096, (size + 4095) & ~(bes_size)4095);
+}
+
+BES_DEFINE_TEST(buddy_allocations_are_aligned_and_distinct)
+{
+	bes_byte *region = region_new(REGION);
+	bes_buddy_allocator buddy;
+	bes_bool result = bes_buddy_allocator_init(&buddy, region, REGION);
+	bes_allocator *allocator = &buddy.allocator;
+	void *x = allocator->allocate(allocator, 1);
+	void *y = allocator->allocate(allocator, 100);
+	void *z = allocator->allocate(allocator, 1000);
+	result = result && x && y && z && x != y && y != z && x != z;
+	result = result && (bes_uintptr)x % BES_BUDDY_MIN_SIZE == 0;
+	result = result && (bes_uintptr)y % 128 == 0;
+	result = result && (bes_uintptr)z % 1024 == 0;
+	allocator->deallocate(allocator, x);
+	allocator->deallocate(allocator, y);
+	allocator->deallocate(allocator, z);
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(buddy_usable_size_is_a_power_of_two)
+{
+	bes_byte *region = region_new(REGION);
+	bes_buddy_allocator buddy;
+	bes_buddy_allocator_init(&buddy, region, REGION);
+	bes_allocator *allocator = &buddy.allocator;
+	void *x = allocator->allocate(allocator, 1);
+	void *y = allocator->allocate(allocator, 33);
+	void *z = allocator->allocate(allocator, 1025);
+	const bes_bool result = allocator->usable_size(allocator, x) == 32
+		&& allocator->usable_size(allocator, y) == 64
+		&& allocator->usable_size(allocator, z) == 2048;
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(buddy_usable_size_of_foreign_memory_is_zero)
+{
+	bes_byte *region = region_new(REGION);
+	bes_buddy_allocator buddy;
+	bes_buddy_allocator_init(&buddy, region, REGION);
+	bes_allocator *allocator = &buddy.allocator;
+	bes_byte other[64];
+	const bes_bool result = allocator->usable_size(allocator, other) == 0
+		&& allocator->usable_size(allocator, region + REGION) == 0;
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(buddy_exhaustion_returns_null)
+{
+	bes_byte *region = region_new(REGION);
+	bes_buddy_allocator buddy;
+	bes_buddy_allocator_init(&buddy, region, REGION);
+	bes_allocator *allocator = &buddy.allocator;
+	bes_size count = 0;
+	while (allocator->allocate(allocator, 1024))
+	{
+		count++;
+	}
+	bes_buddy_report report;
+	bes_buddy_allocator_report(&buddy, &report);
+	const bes_bool result = count == buddy.size / 1024 && report.free < 1024
+		&& !allocator->allocate(allocator, REGION);
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(buddy_free_coalesces_back_to_one_block)
+{
+	bes_byte *region = region_new(REGION_SIZE);
+	bes_buddy_allocator buddy;
+	bes_buddy_allocator_init(&buddy, region, REGION_SIZE);
+	bes_allocator *allocator = &buddy.allocator;
+	bes_buddy_report report;
+	bes_buddy_allocator_report(&buddy, &report);
+	const bes_size largest = report.largest;
+	void *blocks[64];
+	for (bes_size i = 0; i < 64; i++)
+	{
+		blocks[i] = allocator->allocate(allocator, 16 + i * 13);
+	}
+	for (bes_size i = 0; i < 64; i += 2)
+	{
+		allocator->deallocate(allocator, blocks[i]);
+	}
+	for (bes_size i = 1; i < 64; i += 2)
+	{
+		allocator->deallocate(allocator, blocks[i]);
+	}
+	bes_buddy_allocator_report(&buddy, &report);
+	const bes_bool result = largest == REGION && report.used == 0 && report.largest == largest;
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(buddy_region_need_not_be_a_power_of_two)
+{
+	const bes_size size = REGION + 3 * 1024 + 100;
+	bes_byte *region = region_new(REGION + 4096);
+	bes_buddy_allocator buddy;
+	bes_bool result = bes_buddy_allocator_init(&buddy, region + 7, size);
+	bes_allocator *allocator = &buddy.allocator;
+	bes_size total = 0;
+	void *x;
+	while ((x = allocator->allocate(allocator, 32)))
+	{
+		result = result && (bes_byte *)x >= region + 7 && (bes_byte *)x + 32 <= (bes_byte *)buddy.split;
+		bes_memset(x, 0xff, 32);
+		total += 32;
+	}
+	result = result && total == buddy.size && buddy.size > REGION;
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(buddy_report_measures_fragmentation)
+{
+	bes_byte *region = region_new(REGION_SIZE);
+	bes_buddy_allocator buddy;
+	bes_buddy_allocator_init(&buddy, region, REGION_SIZE);
+	bes_allocator *allocator = &buddy.allocator;
+	bes_buddy_report report;
+	bes_buddy_allocator_report(&buddy, &report);
+	bes_bool result = report.size == REGION && report.fragmentation == 0.0f;
+	void *blocks[REGION / 1024];
+	for (bes_size i = 0; i < REGION / 1024; i++)
+	{
+		blocks[i] = allocator->allocate(allocator, 1024);
+	}
+	for (bes_size i = 0; i < REGION / 1024; i += 2)
+	{
+		allocator->deallocate(allocator, blocks[i]);
+	}
+	bes_buddy_allocator_report(&buddy, &report);
+	result = result && report.used == REGION / 2 && report.free == REGION / 2
+		&& report.largest == 1024 && report.count[5] == REGION / 2048
+		&& report.fragmentation > 0.9f;
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(buddy_reallocate_in_place_grows_and_shrinks)
+{
+	bes_byte *region = region_new(REGION_SIZE);
+	bes_buddy_allocator buddy;
+	bes_buddy_allocator_init(&buddy, region, REGION_SIZE);
+	bes_allocator *allocator = &buddy.allocator;
+	void *x = allocator->allocate(allocator, 64);
+	bes_bool result = allocator->reallocate_in_place(allocator, x, 4096)
+		&& allocator->usable_size(allocator, x) == 4096
+		&& buddy.used == 4096;
+	void *y = allocator->allocate(allocator, 64);
+	result = result && (bes_byte *)y == (bes_byte *)x + 4096;
+	result = result && !allocator->reallocate_in_place(allocator, x, 8192);
+	result = result && allocator->reallocate_in_place(allocator, x, 100)
+		&& allocator->usable_size(allocator, x) == 128
+		&& buddy.used == 128 + 64;
+	allocator->deallocate(allocator, x);
+	allocator->deallocate(allocator, y);
+	result = result && buddy.used == 0 && buddy.count[buddy.order] == 1;
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(buddy_reallocate_moves_and_preserves_contents)
+{
+	bes_byte *region = region_new(REGION_SIZE);
+	bes_buddy_allocator buddy;
+	bes_buddy_allocator_init(&buddy, region, REGION_SIZE);
+	bes_allocator *allocator = &buddy.allocator;
+	bes_byte *x = allocator->allocate(allocator, 64);
+	void *y = allocator->allocate(allocator, 64);
+	for (bes_size i = 0; i < 64; i++)
+	{
+		x[i] = (bes_byte)i;
+	}
+	bes_byte *z = allocator->reallocate(allocator, x, 1024);
+	bes_bool result = z && z != x;
+	for (bes_size i = 0; result && i < 64; i++)
+	{
+		result = z[i] == (bes_byte)i;
+	}
+	allocator->deallocate(allocator, z);
+	allocator->deallocate(allocator, y);
+	free(region);
+	return result && buddy.used == 0;
+}
+
+BES_DEFINE_TEST(buddy_allocator_behind_malloc)
+{
+	bes_byte *region = region_new(REGION_SIZE);
+	bes_buddy_allocator buddy;
+	bes_buddy_allocator_init(&buddy, region, REGION_SIZE);
+	bes_allocator *previous = bes_allocator_get();
+	bes_allocator_set(&buddy.allocator);
+	void *x = bes_malloc(100);
+	void *y = bes_malloc_aligned(100, 4096);
+	x = bes_realloc(x, 3000);
+	bes_bool result = x && y && (bes_uintptr)y % 4096 == 0 && buddy.used == 4096 + 4096;
+	bes_free(x);
+	bes_free(y);
+	bes_allocator_set(previous);
+	result = result && buddy.used == 0;
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST_LIST(buddy_tests)
+{
+	BES_ADD_TEST(buddy_allocations_are_aligned_and_distinct),
+	BES_ADD_TEST(buddy_usable_size_is_a_power_of_two),
+	BES_ADD_TEST(buddy_usable_size_of_foreign_memory_is_zero),
+	BES_ADD_TEST(buddy_exhaustion_returns_null),
+	BES_ADD_TEST(buddy_free_coalesces_back_to_one_block),
+	BES_ADD_TEST(buddy_region_need_not_be_a_power_of_two),
+	BES_ADD_TEST(buddy_report_measures_fragmentation),
+	BES_ADD_TEST(buddy_reallocate_in_place_grows_and_shrinks),
+	BES_ADD_TEST(buddy_reallocate_moves_and_preserves_contents),
+	BES_ADD_TEST(buddy_allocator_behind_malloc)
+};
+
+#include <stdio.h>
+BES_DEFINE_TEST_COMMAND(test_buddy_command, "buddy", buddy_tests, printf)
@@ -1,5 +1,7 @@
 #include <bes/foundation/test.h>
 #include <bes/foundation/buffer.h>
+#include <bes/foundation/memory.h>
+#include <bes/foundation/vm.h>
 
 BES_DEFINE_TEST(empty_buffer_has_size_zero)
 {
@@ -36,6 +38,36 @@ BES_DEFINE_TEST(buffer_access_after_push_contains_same_value)
 	return result;
 }
 
+BES_DEFINE_TEST(buffer_capacity_includes_allocation_slack)
+{
+	BES_BUFFER(bes_byte) a = BES_BUFFER_INITIALIZER;
+	bes_buffer_push(a, 1);
+	const bes_size capacity = bes_buffer_meta(a)->data.capacity;
+	const bes_bool result = capacity + sizeof(bes_buffer_data) == bes_malloc_usable_size(bes_buffer_meta(a));
+	bes_buffer_free(a);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_grow_on_arena_extends_in_place)
+{
+	bes_allocator *const previous = bes_allocator_get();
+	bes_arena arena;
+	bes_arena_init(&arena, previous, 0);
+	bes_allocator_set(&arena.allocator);
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_buffer_push(a, 1);
+	int *const data = a;
+	for (int i = 0; i < 256; i++)
+	{
+		bes_buffer_push(a, i);
+	}
+	const bes_bool result = a == data && bes_buffer_size(a) == 257 && a[0] == 1 && a[256] == 255;
+	bes_buffer_free(a);
+	bes_allocator_set(previous);
+	bes_arena_release(&arena);
+	return result;
+}
+
 BES_DEFINE_TEST(buffer_free_resets_buffer)
 {
 	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
@@ -135,12 +167,349 @@ BES_DEFINE_TEST(buffer_read_after_write_contains_same_data)
 	return write == read;
 }
 
+BES_DEFINE_TEST(buffer_read_does_not_allocate)
+{
+	BES_BUFFER(bes_byte) a = BES_BUFFER_INITIALIZER;
+	const bes_byte write[4] = { 1, 2, 3, 4 };
+	bes_byte read[4];
+	bes_size offset = 0;
+	bes_bool result = bes_buffer_write(&a, write, sizeof write);
+	BES_TEST_BUDGET_RESET();
+	result = result && bes_buffer_read(read, 2, &offset, a) && bes_buffer_read(read + 2, 2, &offset, a);
+	bes_buffer_free(a);
+	return result && read[3] == 4;
+}
+
+BES_DEFINE_TEST(buffer_push_grows_geometrically)
+{
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_bool result = BES_TRUE;
+	for (int i = 0; i < 1000; i++)
+	{
+		result = result && bes_buffer_push(a, i);
+	}
+	result = result && bes_buffer_size(a) == 1000 && a[999] == 999;
+	bes_buffer_free(a);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_virtual_growth_keeps_addresses)
+{
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_bool result = bes_buffer_init_virtual(a, 1 << 24) && bes_buffer_push(a, 0);
+	int *const first = a;
+	for (int i = 1; result && i < 1 << 20; i++)
+	{
+		result = bes_buffer_push(a, i) && a == first;
+	}
+	for (int i = 0; result && i < 1 << 20; i += 4096)
+	{
+		result = a[i] == i;
+	}
+	result = result && bes_buffer_size(a) == 1 << 20 && bes_buffer_capacity(a) >= 1 << 20;
+	bes_buffer_free(a);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_virtual_growth_beyond_reservation_fails)
+{
+	BES_BUFFER(bes_byte) a = BES_BUFFER_INITIALIZER;
+	bes_bool result = bes_buffer_init_virtual(a, 1 << 16) && bes_buffer_resize(a, 1 << 16);
+	bes_byte *const first = a;
+	result = result && !bes_buffer_resize(a, 1 << 17) && a == first && bes_buffer_size(a) == 1 << 16;
+	bes_buffer_free(a);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_virtual_keeps_existing_contents)
+{
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_buffer_push(a, 1);
+	bes_buffer_push(a, 2);
+	bes_buffer_push(a, 3);
+	const bes_bool result = bes_buffer_init_virtual(a, 1024)
+		&& bes_buffer_size(a) == 3 && a[0] == 1 && a[1] == 2 && a[2] == 3
+		&& (bes_buffer_meta(a)->data.capacity & BES_BUFFER_VIRTUAL);
+	bes_buffer_free(a);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_reserve_then_push_does_not_reallocate)
+{
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_bool result = bes_buffer_reserve(a, 1000) && bes_buffer_capacity(a) >= 1000;
+	for (int i = 0; i < 1000; i++)
+	{
+		result = result && bes_buffer_push(a, i);
+	}
+	result = result && bes_buffer_reserve(a, 10) && bes_buffer_size(a) == 1000 && a[999] == 999;
+	bes_buffer_free(a);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_shrink_to_fit_keeps_contents)
+{
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_bool result = bes_buffer_reserve(a, 4096);
+	for (int i = 0; i < 10; i++)
+	{
+		result = result && bes_buffer_push(a, i);
+	}
+	bes_buffer_shrink_to_fit(a);
+	result = result && bes_buffer_capacity(a) < 4096 && bes_buffer_capacity(a) >= 10
+		&& bes_buffer_size(a) == 10 && a[0] == 0 && a[9] == 9;
+	bes_buffer_free(a);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_shrink_to_fit_frees_empty)
+{
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_buffer_shrink_to_fit(a);
+	const bes_bool result = bes_buffer_reserve(a, 100);
+	bes_buffer_shrink_to_fit(a);
+	return result && !a;
+}
+
+BES_DEFINE_TEST(buffer_shrink_to_fit_decommits_virtual)
+{
+	BES_BUFFER(bes_byte) a = BES_BUFFER_INITIALIZER;
+	bes_bool result = bes_buffer_init_virtual(a, 1 << 20) && bes_buffer_resize(a, 1 << 18);
+	bes_byte *const first = a;
+	bes_buffer_resize(a, 16);
+	bes_buffer_shrink_to_fit(a);
+	result = result && a == first && bes_buffer_capacity(a) < 1 << 18 && bes_buffer_capacity(a) >= 16;
+	result = result && bes_buffer_resize(a, 1 << 18) && a == first;
+	bes_buffer_free(a);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_growth_policies)
+{
+	const bes_buffer_growth policies[] = {
+		BES_BUFFER_GROWTH_HALF,
+		BES_BUFFER_GROWTH_STEP,
+		BES_BUFFER_GROWTH_PAGES,
+		BES_BUFFER_GROWTH_DOUBLE
+	};
+	bes_bool result = BES_TRUE;
+	for (bes_size i = 0; i < sizeof policies / sizeof *policies; i++)
+	{
+		bes_buffer_set_growth(policies[i], 256);
+		BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+		bes_size grown = 0;
+		bes_size capacity = 0;
+		for (int j = 0; j < 1000; j++)
+		{
+			result = result && bes_buffer_push(a, j);
+			if (bes_buffer_capacity(a) != capacity)
+			{
+				capacity = bes_buffer_capacity(a);
+				grown++;
+			}
+			/* Growing past the first allocation rounds up to a whole page. */
+			if (grown > 1 && policies[i] == BES_BUFFER_GROWTH_PAGES)
+			{
+				result = result && capacity * sizeof *a + sizeof(bes_buffer_data) >= bes_vm_page_size();
+			}
+		}
+		result = result && bes_buffer_size(a) == 1000 && a[999] == 999;
+		if (policies[i] == BES_BUFFER_GROWTH_STEP)
+		{
+			/* A step of 256 bytes is 64 elements at a time. */
+			result = result && grown >= 1000 / 64 / 2;
+		}
+		bes_buffer_free(a);
+	}
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_inline_does_not_allocate)
+{
+	BES_BUFFER_STORAGE(int, 8) storage;
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_buffer_init_inline(a, storage);
+	bes_bool result = bes_buffer_size(a) == 0 && bes_buffer_capacity(a) >= 8;
+	for (int i = 0; i < 8; i++)
+	{
+		result = result && bes_buffer_push(a, i);
+	}
+	result = result && bes_buffer_resize(a, 4) && bes_buffer_expand(a, 2) && bes_buffer_reserve(a, 8);
+	result = result && a == storage.data && bes_buffer_size(a) == 6 && a[3] == 3;
+	bes_buffer_shrink_to_fit(a);
+	bes_buffer_free(a);
+	return result && !a;
+}
+
+BES_DEFINE_TEST(buffer_inline_spills_to_heap)
+{
+	BES_BUFFER_STORAGE(int, 4) storage;
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_buffer_init_inline(a, storage);
+	bes_bool result = BES_TRUE;
+	for (int i = 0; i < 100; i++)
+	{
+		result = result && bes_buffer_push(a, i);
+	}
+	result = result && a != storage.data && bes_buffer_size(a) == 100
+		&& a[0] == 0 && a[3] == 3 && a[99] == 99
+		&& !(bes_buffer_meta(a)->data.capacity & BES_BUFFER_FLAGS);
+	bes_buffer_free(a);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_insert_n_shifts_tail)
+{
+	static const int values[] = { 10, 11, 12 };
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_bool result = bes_buffer_append_n(a, values, 3)
+		&& bes_buffer_insert_n(a, 1, values, 3)
+		&& bes_buffer_insert_n(a, 6, values, 1)
+		&& bes_buffer_insert_n(a, 0, 0, 2);
+	result = result && bes_buffer_size(a) == 9
+		&& a[2] == 10 && a[3] == 10 && a[4] == 11 && a[5] == 12
+		&& a[6] == 11 && a[7] == 12 && a[8] == 10;
+	bes_buffer_free(a);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_erase_n_keeps_order)
+{
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_bool result = BES_TRUE;
+	for (int i = 0; i < 10; i++)
+	{
+		result = result && bes_buffer_push(a, i);
+	}
+	bes_buffer_erase_n(a, 2, 3);
+	bes_buffer_erase_n(a, 5, 2);
+	bes_buffer_erase_n(a, 0, 0);
+	result = result && bes_buffer_size(a) == 5
+		&& a[0] == 0 && a[1] == 1 && a[2] == 5 && a[3] == 6 && a[4] == 7;
+	bes_buffer_free(a);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_swap_remove_moves_last)
+{
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_bool result = bes_buffer_push(a, 1) && bes_buffer_push(a, 2) && bes_buffer_push(a, 3);
+	bes_buffer_swap_remove(a, 0);
+	result = result && bes_buffer_size(a) == 2 && a[0] == 3 && a[1] == 2;
+	bes_buffer_swap_remove(a, 1);
+	result = result && bes_buffer_size(a) == 1 && a[0] == 3;
+	bes_buffer_free(a);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_swap_remove_last_element)
+{
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_bool result = bes_buffer_push(a, 1) && bes_buffer_push(a, 2);
+	bes_buffer_swap_remove(a, bes_buffer_size(a) - 1);
+	result = result && bes_buffer_size(a) == 1 && a[0] == 1;
+	bes_buffer_swap_remove(a, bes_buffer_size(a) - 1);
+	result = result && bes_buffer_size(a) == 0;
+	bes_buffer_free(a);
+	return result;
+}
+
+static bes_allocator *refusing_backing;
+
+static void *refusing_allocate(bes_allocator *allocator, bes_size size)
+{
+	(void)allocator;
+	return refusing_backing->allocate(refusing_backing, size);
+}
+
+static void *refusing_reallocate(bes_allocator *allocator, void *data, bes_size size)
+{
+	(void)allocator;
+	(void)data;
+	(void)size;
+	return 0;
+}
+
+static void refusing_deallocate(bes_allocator *allocator, void *data)
+{
+	(void)allocator;
+	refusing_backing->deallocate(refusing_backing, data);
+}
+
+static bes_allocator refusing =
+{
+	&refusing_allocate,
+	&refusing_reallocate,
+	&refusing_deallocate,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0
+};
+
+BES_DEFINE_TEST(buffer_failed_growth_leaves_buffer_intact)
+{
+	static const int values[64];
+	refusing_backing = bes_allocator_get();
+	bes_allocator_set(&refusing);
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_bool result = bes_buffer_push(a, 1) && bes_buffer_push(a, 2);
+	void *const before = a;
+	result = result && !bes_buffer_append_n(a, values, 64);
+	result = result && a == before && bes_buffer_size(a) == 2 && a[0] == 1 && a[1] == 2;
+	bes_buffer_free(a);
+	bes_allocator_set(refusing_backing);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_splice_replaces_range)
+{
+	static const int values[] = { 10, 11, 12, 13 };
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	bes_bool result = BES_TRUE;
+	for (int i = 0; i < 6; i++)
+	{
+		result = result && bes_buffer_push(a, i);
+	}
+	result = result && bes_buffer_splice(a, 1, 2, values, 4);
+	result = result && bes_buffer_size(a) == 8
+		&& a[0] == 0 && a[1] == 10 && a[4] == 13 && a[5] == 3 && a[7] == 5;
+	result = result && bes_buffer_splice(a, 2, 5, values, 1);
+	result = result && bes_buffer_size(a) == 4
+		&& a[0] == 0 && a[1] == 10 && a[2] == 10 && a[3] == 5;
+	bes_buffer_free(a);
+	return result;
+}
+
+BES_DEFINE_TEST(buffer_append_n_grows_once)
+{
+	int values[1000];
+	for (int i = 0; i < 1000; i++)
+	{
+		values[i] = i;
+	}
+	BES_BUFFER(int) a = BES_BUFFER_INITIALIZER;
+	const bes_bool result = bes_buffer_append_n(a, values, 1000)
+		&& bes_buffer_size(a) == 1000 && a[0] == 0 && a[999] == 999;
+	bes_buffer_free(a);
+	return result;
+}
+
 BES_DEFINE_TEST_LIST(buffer_tests)
 {
 	BES_ADD_TEST(empty_buffer_has_size_zero),
 	BES_ADD_TEST(buffer_push_on_empty_resizes),
 	BES_ADD_TEST(buffer_push_on_non_empty_resizes),
 	BES_ADD_TEST(buffer_access_after_push_contains_same_value),
+	BES_ADD_TEST(buffer_capacity_includes_allocation_slack),
+	BES_ADD_TEST(buffer_grow_on_arena_extends_in_place),
 	BES_ADD_TEST(buffer_free_resets_buffer),
 	BES_ADD_TEST(buffer_resize_from_smaller_makes_larger),
 	BES_ADD_TEST(buffer_resize_from_larger_makes_smaller),
@@ -150,7 +519,26 @@ BES_DEFINE_TEST_LIST(buffer_tests)
 	BES_ADD_TEST(buffer_read_on_empty_fails),
 	BES_ADD_TEST(buffer_read_after_write_with_same_size_succeeds),
 	BES_ADD_TEST(buffer_read_offset_after_write_advances_by_write_size),
-	BES_ADD_TEST(buffer_read_after_write_contains_same_data)
+	BES_ADD_TEST(buffer_read_after_write_contains_same_data),
+	BES_ADD_TEST_BUDGET(buffer_read_does_not_allocate, 0, 0),
+	BES_ADD_TEST_BUDGET(buffer_push_grows_geometrically, 1, 12),
+	BES_ADD_TEST(buffer_virtual_growth_keeps_addresses),
+	BES_ADD_TEST(buffer_virtual_growth_beyond_reservation_fails),
+	BES_ADD_TEST(buffer_virtual_keeps_existing_contents),
+	BES_ADD_TEST_BUDGET(buffer_reserve_then_push_does_not_reallocate, 1, 0),
+	BES_ADD_TEST(buffer_shrink_to_fit_keeps_contents),
+	BES_ADD_TEST(buffer_shrink_to_fit_frees_empty),
+	BES_ADD_TEST(buffer_shrink_to_fit_decommits_virtual),
+	BES_ADD_TEST(buffer_growth_policies),
+	BES_ADD_TEST_BUDGET(buffer_inline_does_not_allocate, 0, 0),
+	BES_ADD_TEST_BUDGET(buffer_inline_spills_to_heap, 1, 7),
+	BES_ADD_TEST(buffer_insert_n_shifts_tail),
+	BES_ADD_TEST(buffer_erase_n_keeps_order),
+	BES_ADD_TEST(buffer_swap_remove_moves_last),
+	BES_ADD_TEST(buffer_swap_remove_last_element),
+	BES_ADD_TEST(buffer_failed_growth_leaves_buffer_intact),
+	BES_ADD_TEST(buffer_splice_replaces_range),
+	BES_ADD_TEST_BUDGET(buffer_append_n_grows_once, 1, 0)
 };
 
 #include <stdio.h>
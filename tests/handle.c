@@ -0,0 +1,216 @@
+#include <bes/foundation/test.h>
+#include <bes/foundation/handle.h>
+#include <bes/foundation/string.h>
+
+#include <stdlib.h>
+
+#define REGION (64 * 1024)
+#define HANDLES 256
+
+static bes_bool handle_heap_init(bes_handle_heap *heap, void **region)
+{
+	*region = malloc(REGION);
+	return *region && bes_handle_heap_init(heap, *region, REGION, HANDLES);
+}
+
+static void handle_fill(bes_handle_heap *heap, bes_handle handle, bes_byte value)
+{
+	bes_memset(bes_handle_lock(heap, handle), value, bes_handle_size(heap, handle));
+	bes_handle_unlock(heap, handle);
+}
+
+static bes_bool handle_check(bes_handle_heap *heap, bes_handle handle, bes_byte value)
+{
+	const bes_byte *const data = bes_handle_lock(heap, handle);
+	bes_bool result = BES_TRUE;
+	for (bes_size i = 0; result && i < bes_handle_size(heap, handle); i++)
+	{
+		result = data[i] == value;
+	}
+	bes_handle_unlock(heap, handle);
+	return result;
+}
+
+BES_DEFINE_TEST(handle_lock_gives_aligned_memory)
+{
+	bes_handle_heap heap;
+	void *region;
+	bes_bool result = handle_heap_init(&heap, &region);
+	const bes_handle handle = bes_handle_alloc(&heap, 100);
+	void *const data = bes_handle_lock(&heap, handle);
+	result = result && handle != BES_HANDLE_INVALID && (bes_uintptr)data % BES_ALIGNMENT == 0
+		&& bes_handle_size(&heap, handle) >= 100;
+	bes_handle_unlock(&heap, handle);
+	bes_handle_free(&heap, handle);
+	free(region);
+	return result && heap.used == 0 && heap.top == heap.base;
+}
+
+BES_DEFINE_TEST(handle_compact_closes_gaps_and_keeps_contents)
+{
+	bes_handle_heap heap;
+	void *region;
+	bes_bool result = handle_heap_init(&heap, &region);
+	const bes_handle a = bes_handle_alloc(&heap, 100);
+	const bes_handle b = bes_handle_alloc(&heap, 200);
+	const bes_handle c = bes_handle_alloc(&heap, 300);
+	handle_fill(&heap, a, 1);
+	handle_fill(&heap, c, 3);
+	bes_handle_free(&heap, b);
+	const bes_byte *const top = heap.top;
+	result = result && heap.gaps && bes_handle_heap_compact(&heap, BES_HANDLE_HEAP_UNBOUNDED)
+		&& heap.gaps == 0 && heap.top < top && heap.top == heap.base + heap.used
+		&& handle_check(&heap, a, 1) && handle_check(&heap, c, 3);
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(handle_compact_leaves_locked_blocks_in_place)
+{
+	bes_handle_heap heap;
+	void *region;
+	bes_bool result = handle_heap_init(&heap, &region);
+	const bes_handle a = bes_handle_alloc(&heap, 100);
+	const bes_handle b = bes_handle_alloc(&heap, 200);
+	const bes_handle c = bes_handle_alloc(&heap, 300);
+	handle_fill(&heap, b, 2);
+	handle_fill(&heap, c, 3);
+	bes_handle_free(&heap, a);
+	void *const locked = bes_handle_lock(&heap, b);
+	result = result && bes_handle_heap_compact(&heap, BES_HANDLE_HEAP_UNBOUNDED)
+		&& bes_handle_lock(&heap, b) == locked;
+	bes_handle_unlock(&heap, b);
+	bes_handle_unlock(&heap, b);
+	result = result && handle_check(&heap, b, 2) && handle_check(&heap, c, 3);
+	result = result && bes_handle_heap_compact(&heap, BES_HANDLE_HEAP_UNBOUNDED) && heap.gaps == 0;
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(handle_fragmented_heap_satisfies_large_allocation)
+{
+	bes_handle_heap heap;
+	void *region;
+	bes_bool result = handle_heap_init(&heap, &region);
+	bes_handle handles[HANDLES];
+	bes_size count = 0;
+	while (count < HANDLES && (handles[count] = bes_handle_alloc(&heap, 240)))
+	{
+		handle_fill(&heap, handles[count], (bes_byte)count);
+		count++;
+	}
+	for (bes_size i = 0; i < count; i += 2)
+	{
+		bes_handle_free(&heap, handles[i]);
+	}
+	/* Half the heap is free, but in pieces too small for the request. */
+	const bes_handle large = bes_handle_alloc(&heap, REGION / 4);
+	result = result && count > 64 && large != BES_HANDLE_INVALID;
+	for (bes_size i = 1; result && i < count; i += 2)
+	{
+		result = handle_check(&heap, handles[i], (bes_byte)i);
+	}
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(handle_allocation_after_partial_compaction_closes_earlier_gaps)
+{
+	bes_handle_heap heap;
+	void *region;
+	bes_bool result = handle_heap_init(&heap, &region);
+	bes_handle handles[HANDLES];
+	bes_size count = 0;
+	while (count < HANDLES && (handles[count] = bes_handle_alloc(&heap, 512)))
+	{
+		count++;
+	}
+	result = result && count > 8;
+	if (result)
+	{
+		/* The budgeted pass stops after a block, past the gap of the
+		 * first block which is freed afterwards. */
+		bes_handle_free(&heap, handles[4]);
+		bes_handle_heap_compact(&heap, 1);
+		bes_handle_free(&heap, handles[0]);
+		result = bes_handle_alloc(&heap, 1000) != BES_HANDLE_INVALID;
+	}
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(handle_compact_without_budget_moves_one_block_at_a_time)
+{
+	bes_handle_heap heap;
+	void *region;
+	bes_bool result = handle_heap_init(&heap, &region);
+	bes_handle handles[8];
+	for (bes_size i = 0; i < 8; i++)
+	{
+		handles[i] = bes_handle_alloc(&heap, 1000);
+		handle_fill(&heap, handles[i], (bes_byte)(i + 1));
+	}
+	bes_handle_free(&heap, handles[0]);
+	/* Each block takes 1024 bytes including its header. */
+	bes_size calls = 1;
+	while (!bes_handle_heap_compact(&heap, 0) && calls < 100)
+	{
+		result = result && heap.moved == calls * 1024;
+		calls++;
+	}
+	result = result && calls == 7 && heap.moved == 7 * 1024 && heap.gaps == 0;
+	for (bes_size i = 1; result && i < 8; i++)
+	{
+		result = handle_check(&heap, handles[i], (bes_byte)(i + 1));
+	}
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(handle_realloc_keeps_handle_and_contents)
+{
+	bes_handle_heap heap;
+	void *region;
+	bes_bool result = handle_heap_init(&heap, &region);
+	const bes_handle a = bes_handle_alloc(&heap, 100);
+	const bes_handle b = bes_handle_alloc(&heap, 100);
+	handle_fill(&heap, a, 1);
+	handle_fill(&heap, b, 2);
+	result = result && bes_handle_realloc(&heap, a, 1000) && bes_handle_size(&heap, a) >= 1000;
+	const bes_byte *const data = bes_handle_lock(&heap, a);
+	result = result && data[0] == 1 && data[99] == 1;
+	bes_handle_unlock(&heap, a);
+	result = result && handle_check(&heap, b, 2)
+		&& bes_handle_realloc(&heap, a, 10) && bes_handle_size(&heap, a) < 100;
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST(handle_heap_runs_out_of_handles)
+{
+	bes_handle_heap heap;
+	void *region = malloc(REGION);
+	bes_bool result = region && bes_handle_heap_init(&heap, region, REGION, 2);
+	const bes_handle a = bes_handle_alloc(&heap, 16);
+	const bes_handle b = bes_handle_alloc(&heap, 16);
+	result = result && a && b && a != b && !bes_handle_alloc(&heap, 16);
+	bes_handle_free(&heap, a);
+	result = result && bes_handle_alloc(&heap, 16) == a;
+	free(region);
+	return result;
+}
+
+BES_DEFINE_TEST_LIST(handle_tests)
+{
+	BES_ADD_TEST(handle_lock_gives_aligned_memory),
+	BES_ADD_TEST(handle_compact_closes_gaps_and_keeps_contents),
+	BES_ADD_TEST(handle_compact_leaves_locked_blocks_in_place),
+	BES_ADD_TEST(handle_fragmented_heap_satisfies_large_allocation),
+	BES_ADD_TEST(handle_allocation_after_partial_compaction_closes_earlier_gaps),
+	BES_ADD_TEST(handle_compact_without_budget_moves_one_block_at_a_time),
+	BES_ADD_TEST(handle_realloc_keeps_handle_and_contents),
+	BES_ADD_TEST(handle_heap_runs_out_of_handles)
+};
+
+#include <stdio.h>
+BES_DEFINE_TEST_COMMAND(test_handle_command, "handle", handle_tests, printf)
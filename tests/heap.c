@@ -0,0 +1,342 @@
+#include <bes/foundation/test.h>
+#include <bes/foundation/heap.h>
+#include <bes/foundation/string.h>
+
+#include <pthread.h>
+
+#define THREADS 4
+#define MESSAGES 20000
+#define QUEUE 256
+
+BES_DEFINE_TEST(heap_allocations_are_distinct_and_aligned)
+{
+	bes_heap_allocator heap_allocator;
+	bes_heap_allocator_init(&heap_allocator, 0);
+	bes_allocator *allocator = &heap_allocator.allocator;
+	bes_bool result = BES_TRUE;
+	void *previous = 0;
+	for (bes_size size = 1; size <= BES_HEAP_MAX_SIZE; size++)
+	{
+		void *x = allocator->allocate(allocator, size);
+		result = result && x && x != previous && (bes_uintptr)x % BES_ALIGNMENT == 0;
+		previous = x;
+	}
+	bes_heap_allocator_release(&heap_allocator);
+	return result;
+}
+
+BES_DEFINE_TEST(heap_free_then_allocate_reuses_object)
+{
+	bes_heap_allocator heap_allocator;
+	bes_heap_allocator_init(&heap_allocator, 0);
+	bes_allocator *allocator = &heap_allocator.allocator;
+	allocator->allocate(allocator, 32);
+	void *x = allocator->allocate(allocator, 32);
+	allocator->deallocate(allocator, x);
+	void *y = allocator->allocate(allocator, 32);
+	bes_heap_allocator_release(&heap_allocator);
+	return x == y;
+}
+
+BES_DEFINE_TEST(heap_large_allocation_is_passed_through)
+{
+	bes_heap_allocator heap_allocator;
+	bes_heap_allocator_init(&heap_allocator, 0);
+	bes_allocator *allocator = &heap_allocator.allocator;
+	char *x = allocator->allocate(allocator, BES_HEAP_MAX_SIZE + 1);
+	bes_memcpy(x, "hello", 6);
+	x = allocator->reallocate(allocator, x, 4 * BES_HEAP_MAX_SIZE);
+	bes_bool result = x && bes_strcmp(x, "hello") == 0 && heap_allocator.spans == 0;
+	x = allocator->reallocate(allocator, x, 6);
+	result = result && x && bes_strcmp(x, "hello") == 0 && heap_allocator.spans == 1;
+	allocator->deallocate(allocator, x);
+	bes_heap_allocator_release(&heap_allocator);
+	return result;
+}
+
+typedef struct heap_batch heap_batch;
+
+struct heap_batch
+{
+	bes_heap_allocator *heap_allocator;
+	void **objects;
+	bes_size count;
+};
+
+static void*
+free_batch_on_thread(void *data)
+{
+	heap_batch *const batch = data;
+	bes_allocator *const allocator = &batch->heap_allocator->allocator;
+	for (bes_size i = 0; i < batch->count; i++)
+	{
+		allocator->deallocate(allocator, batch->objects[i]);
+	}
+	bes_heap_allocator_detach(batch->heap_allocator);
+	return 0;
+}
+
+BES_DEFINE_TEST(heap_objects_freed_on_other_threads_are_reused)
+{
+	static void *objects[4096];
+	bes_heap_allocator heap_allocator;
+	bes_heap_allocator_init(&heap_allocator, 0);
+	bes_allocator *allocator = &heap_allocator.allocator;
+	for (bes_size i = 0; i < 4096; i++)
+	{
+		objects[i] = allocator->allocate(allocator, 64);
+	}
+	const bes_u64 spans = heap_allocator.spans;
+
+	/* Every slab is full when freed into, so all of them are only found
+	 * again through the delayed list. */
+	heap_batch batch = { &heap_allocator, objects, 4096 };
+	pthread_t thread;
+	bes_bool result = pthread_create(&thread, 0, &free_batch_on_thread, &batch) == 0
+		&& pthread_join(thread, 0) == 0;
+	for (bes_size i = 0; i < 4096; i++)
+	{
+		result = result && allocator->allocate(allocator, 64);
+	}
+	result = result && heap_allocator.spans == spans && heap_allocator.count == 1;
+	bes_heap_allocator_release(&heap_allocator);
+	return result;
+}
+
+static void*
+allocate_on_thread(void *data)
+{
+	heap_batch *const batch = data;
+	bes_allocator *const allocator = &batch->heap_allocator->allocator;
+	for (bes_size i = 0; i < batch->count; i++)
+	{
+		batch->objects[i] = allocator->allocate(allocator, 48);
+	}
+	bes_heap_allocator_detach(batch->heap_allocator);
+	return 0;
+}
+
+static void*
+free_batch_together_on_thread(void *data)
+{
+	heap_batch *const batch = data;
+	bes_allocator *const allocator = &batch->heap_allocator->allocator;
+	allocator->deallocate_batch(allocator, batch->objects, batch->count);
+	return 0;
+}
+
+BES_DEFINE_TEST(heap_batch_freed_on_other_thread_is_reused)
+{
+	static void *objects[1024];
+	bes_heap_allocator heap_allocator;
+	bes_heap_allocator_init(&heap_allocator, 0);
+	bes_allocator *allocator = &heap_allocator.allocator;
+	bes_bool result = allocator->allocate_batch(allocator, 128, 1024, objects) == 1024;
+	for (bes_size i = 0; result && i < 1024; i++)
+	{
+		bes_memset(objects[i], (int)i, 128);
+	}
+	const bes_u64 spans = heap_allocator.spans;
+	heap_batch batch = { &heap_allocator, objects, 1024 };
+	pthread_t thread;
+	result = result && pthread_create(&thread, 0, &free_batch_together_on_thread, &batch) == 0
+		&& pthread_join(thread, 0) == 0;
+	result = result && allocator->allocate_batch(allocator, 128, 1024, objects) == 1024
+		&& heap_allocator.spans == spans;
+	bes_heap_allocator_release(&heap_allocator);
+	return result;
+}
+
+BES_DEFINE_TEST(heap_of_detached_thread_is_adopted)
+{
+	static void *first[256];
+	static void *second[256];
+	bes_heap_allocator heap_allocator;
+	bes_heap_allocator_init(&heap_allocator, 0);
+	heap_batch a = { &heap_allocator, first, 256 };
+	heap_batch b = { &heap_allocator, second, 256 };
+	pthread_t thread;
+	bes_bool result = pthread_create(&thread, 0, &allocate_on_thread, &a) == 0
+		&& pthread_join(thread, 0) == 0
+		&& pthread_create(&thread, 0, &allocate_on_thread, &b) == 0
+		&& pthread_join(thread, 0) == 0;
+	/* The second thread carried on in the slabs of the first. */
+	result = result && heap_allocator.count == 1 && heap_allocator.spans == 1
+		&& (bes_byte *)second[0] == (bes_byte *)first[255] + 48;
+	bes_heap_allocator_release(&heap_allocator);
+	return result;
+}
+
+/* Producers allocate messages and consumers free them, so nearly every
+ * free is on a thread other than the one that allocated. */
+typedef struct heap_queue heap_queue;
+
+struct heap_queue
+{
+	bes_heap_allocator *heap_allocator;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bes_u32 *messages[QUEUE];
+	bes_size head;
+	bes_size tail;
+	bes_bool corrupt;
+};
+
+static void*
+produce(void *data)
+{
+	heap_queue *const queue = data;
+	bes_allocator *const allocator = &queue->heap_allocator->allocator;
+	for (bes_u32 i = 0; i < MESSAGES; i++)
+	{
+		const bes_u32 words = 1 + i % (BES_HEAP_MAX_SIZE / sizeof(bes_u32));
+		bes_u32 *const message = allocator->allocate(allocator, words * sizeof(bes_u32));
+		message[0] = words;
+		for (bes_u32 j = 1; j < words; j++)
+		{
+			message[j] = words ^ j;
+		}
+
+		pthread_mutex_lock(&queue->mutex);
+		while (queue->tail - queue->head == QUEUE)
+		{
+			pthread_cond_wait(&queue->cond, &queue->mutex);
+		}
+		queue->messages[queue->tail++ % QUEUE] = message;
+		pthread_cond_broadcast(&queue->cond);
+		pthread_mutex_unlock(&queue->mutex);
+	}
+	bes_heap_allocator_detach(queue->heap_allocator);
+	return 0;
+}
+
+static void*
+consume(void *data)
+{
+	heap_queue *const queue = data;
+	bes_allocator *const allocator = &queue->heap_allocator->allocator;
+	for (bes_u32 i = 0; i < MESSAGES; i++)
+	{
+		pthread_mutex_lock(&queue->mutex);
+		while (queue->tail == queue->head)
+		{
+			pthread_cond_wait(&queue->cond, &queue->mutex);
+		}
+		bes_u32 *const message = queue->messages[queue->head++ % QUEUE];
+		pthread_cond_broadcast(&queue->cond);
+		pthread_mutex_unlock(&queue->mutex);
+
+		const bes_u32 words = message[0];
+		for (bes_u32 j = 1; j < words; j++)
+		{
+			if (message[j] != (words ^ j))
+			{
+				queue->corrupt = BES_TRUE;
+			}
+		}
+		allocator->deallocate(allocator, message);
+	}
+	bes_heap_allocator_detach(queue->heap_allocator);
+	return 0;
+}
+
+BES_DEFINE_TEST(heap_producers_and_consumers)
+{
+	bes_heap_allocator heap_allocator;
+	bes_heap_allocator_init(&heap_allocator, 0);
+	static heap_queue queue;
+	queue.heap_allocator = &heap_allocator;
+	pthread_mutex_init(&queue.mutex, 0);
+	pthread_cond_init(&queue.cond, 0);
+	queue.head = 0;
+	queue.tail = 0;
+	queue.corrupt = BES_FALSE;
+
+	pthread_t producers[THREADS];
+	pthread_t consumers[THREADS];
+	bes_bool result = BES_TRUE;
+	for (bes_size i = 0; i < THREADS; i++)
+	{
+		result = result && pthread_create(&producers[i], 0, &produce, &queue) == 0
+			&& pthread_create(&consumers[i], 0, &consume, &queue) == 0;
+	}
+	for (bes_size i = 0; i < THREADS; i++)
+	{
+		result = result && pthread_join(producers[i], 0) == 0
+			&& pthread_join(consumers[i], 0) == 0;
+	}
+
+	/* With at most a queue of messages live at once, reused objects keep
+	 * the memory obtained far below what every message would need. */
+	result = result && !queue.corrupt && heap_allocator.count <= 2 * THREADS
+		&& heap_allocator.spans * BES_HEAP_SPAN_PAGES * BES_HEAP_PAGE_SIZE < (bes_u64)THREADS * MESSAGES * 256;
+
+	pthread_cond_destroy(&queue.cond);
+	pthread_mutex_destroy(&queue.mutex);
+	bes_heap_allocator_release(&heap_allocator);
+	return result;
+}
+
+BES_DEFINE_TEST(heap_allocator_behind_malloc)
+{
+	bes_heap_allocator heap_allocator;
+	bes_heap_allocator_init(&heap_allocator, 0);
+	bes_allocator *previous = bes_allocator_get();
+	bes_allocator_set(&heap_allocator.allocator);
+	char *x = bes_malloc(100);
+	bes_memcpy(x, "hello", 6);
+	x = bes_realloc(x, 3000);
+	char *y = bes_malloc(24);
+	void *z = bes_malloc(16);
+	/* Objects take their own size class, without a header in front. */
+	const bes_bool result = x && y && z && bes_strcmp(x, "hello") == 0
+		&& (bes_uintptr)x % BES_ALIGNMENT == 0 && bes_malloc_usable_size(x) == 3000
+		&& bes_malloc_usable_size(y) == 32 && bes_malloc_usable_size(z) == 16;
+	bes_free(x);
+	bes_free(y);
+	bes_free(z);
+	bes_allocator_set(previous);
+	bes_heap_allocator_release(&heap_allocator);
+	return result;
+}
+
+BES_DEFINE_TEST(heap_trim_purges_empty_slabs)
+{
+	bes_heap_allocator heap_allocator;
+	bes_heap_allocator_init(&heap_allocator, 0);
+	bes_allocator *allocator = &heap_allocator.allocator;
+	static void *objects[2048];
+	bes_bool result = BES_TRUE;
+	for (bes_size i = 0; i < BES_ARRAY_SIZE(objects); i++)
+	{
+		objects[i] = allocator->allocate(allocator, 64);
+		result = result && objects[i];
+	}
+	for (bes_size i = 0; i < BES_ARRAY_SIZE(objects); i++)
+	{
+		allocator->deallocate(allocator, objects[i]);
+	}
+	result = result && allocator->trim(allocator) > 0 && allocator->trim(allocator) == 0;
+	char *x = allocator->allocate(allocator, 64);
+	result = result && x;
+	bes_memset(x, 0xAA, 64);
+	allocator->deallocate(allocator, x);
+	bes_heap_allocator_release(&heap_allocator);
+	return result;
+}
+
+BES_DEFINE_TEST_LIST(heap_tests)
+{
+	BES_ADD_TEST(heap_allocations_are_distinct_and_aligned),
+	BES_ADD_TEST(heap_free_then_allocate_reuses_object),
+	BES_ADD_TEST(heap_large_allocation_is_passed_through),
+	BES_ADD_TEST(heap_objects_freed_on_other_threads_are_reused),
+	BES_ADD_TEST(heap_batch_freed_on_other_thread_is_reused),
+	BES_ADD_TEST(heap_of_detached_thread_is_adopted),
+	BES_ADD_TEST(heap_producers_and_consumers),
+	BES_ADD_TEST(heap_allocator_behind_malloc),
+	BES_ADD_TEST(heap_trim_purges_empty_slabs)
+};
+
+#include <stdio.h>
+BES_DEFINE_TEST_COMMAND(test_heap_command, "heap", heap_tests, printf)
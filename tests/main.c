@@ -28,6 +28,16 @@ static bes_allocator allocator =
 	&allocate,
 	&reallocate,
 	&release,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
 	0
 };
 
@@ -42,6 +52,15 @@ struct test_command
 extern bes_bool test_types_command(bes_size*, bes_size*); /* types.c */
 extern bes_bool test_bswap_command(bes_size*, bes_size*); /* bswap.c */
 extern bes_bool test_memory_command(bes_size*, bes_size*); /* memory.c */
+extern bes_bool test_slab_command(bes_size*, bes_size*); /* slab.c */
+extern bes_bool test_mmap_command(bes_size*, bes_size*); /* mmap.c */
+extern bes_bool test_buddy_command(bes_size*, bes_size*); /* buddy.c */
+extern bes_bool test_tlsf_command(bes_size*, bes_size*); /* tlsf.c */
+extern bes_bool test_heap_command(bes_size*, bes_size*); /* heap.c */
+extern bes_bool test_vm_command(bes_size*, bes_size*); /* vm.c */
+extern bes_bool test_handle_command(bes_size*, bes_size*); /* handle.c */
+extern bes_bool test_pressure_command(bes_size*, bes_size*); /* pressure.c */
+extern bes_bool test_scratch_command(bes_size*, bes_size*); /* scratch.c */
 extern bes_bool test_buffer_command(bes_size*, bes_size*); /* buffer.c */
 extern bes_bool test_string_command(bes_size*, bes_size*); /* string.c */
 extern bes_bool test_stream_command(bes_size*, bes_size*); /* stream.c */
@@ -51,6 +70,15 @@ static const test_command test_commands[] =
 	{ "types", test_types_command },
 	{ "bswap", test_bswap_command },
 	{ "memory", test_memory_command },
+	{ "slab", test_slab_command },
+	{ "mmap", test_mmap_command },
+	{ "buddy", test_buddy_command },
+	{ "tlsf", test_tlsf_command },
+	{ "heap", test_heap_command },
+	{ "vm", test_vm_command },
+	{ "handle", test_handle_command },
+	{ "pressure", test_pressure_command },
+	{ "scratch", test_scratch_command },
 	{ "buffer", test_buffer_command },
 	{ "string", test_string_command },
 	{ "stream", test_stream_command }
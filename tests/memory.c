@@ -1,5 +1,12 @@
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include <bes/foundation/test.h>
 #include <bes/foundation/memory.h>
+#include <bes/foundation/string.h>
 
 BES_DEFINE_TEST(malloc_returns_non_null)
 {
@@ -27,11 +34,1077 @@ BES_DEFINE_TEST(realloc_from_larger_to_smaller_makes_smaller)
 	return result;
 }
 
+typedef struct counting_allocator counting_allocator;
+
+struct counting_allocator
+{
+	bes_allocator allocator;
+	bes_allocator *backing;
+	bes_size allocations;
+	bes_size deallocations;
+	bes_size allocated_size;
+	bes_size deallocated_size;
+	bes_size batches;
+	bes_size trims;
+};
+
+static void *counting_allocate(bes_allocator *allocator, bes_size size)
+{
+	counting_allocator *counting = allocator->aux;
+	counting->allocations++;
+	counting->allocated_size = size;
+	return counting->backing->allocate(counting->backing, size);
+}
+
+static void *counting_reallocate(bes_allocator *allocator, void *data, bes_size size)
+{
+	counting_allocator *counting = allocator->aux;
+	return counting->backing->reallocate(counting->backing, data, size);
+}
+
+static void counting_deallocate(bes_allocator *allocator, void *data)
+{
+	counting_allocator *counting = allocator->aux;
+	counting->deallocations++;
+	counting->backing->deallocate(counting->backing, data);
+}
+
+static void counting_deallocate_sized(bes_allocator *allocator, void *data, bes_size size)
+{
+	counting_allocator *counting = allocator->aux;
+	counting->deallocated_size = size;
+	counting_deallocate(allocator, data);
+}
+
+static void counting_init(counting_allocator *counting, bes_u32 flags)
+{
+	counting->allocator.allocate = &counting_allocate;
+	counting->allocator.reallocate = &counting_reallocate;
+	counting->allocator.deallocate = &counting_deallocate;
+	counting->allocator.aux = counting;
+	counting->allocator.flags = flags;
+	counting->backing = bes_allocator_get();
+	counting->allocator.deallocate_sized = 0;
+	counting->allocator.alignment = 0;
+	counting->allocator.usable_size = 0;
+	counting->allocator.allocate_aligned = 0;
+	counting->allocator.reallocate_in_place = 0;
+	counting->allocator.allocate_batch = 0;
+	counting->allocator.deallocate_batch = 0;
+	counting->allocator.allocate_zeroed = 0;
+	counting->allocator.trim = 0;
+	counting->allocations = 0;
+	counting->deallocations = 0;
+	counting->allocated_size = 0;
+	counting->deallocated_size = 0;
+	counting->batches = 0;
+	counting->trims = 0;
+}
+
+static bes_size counting_trim(bes_allocator *allocator)
+{
+	counting_allocator *counting = allocator->aux;
+	counting->trims++;
+	return 100;
+}
+
+static void counting_deallocate_batch(bes_allocator *allocator, void *const *data, bes_size count)
+{
+	counting_allocator *counting = allocator->aux;
+	counting->batches++;
+	for (bes_size i = 0; i < count; i++)
+	{
+		counting_deallocate(allocator, data[i]);
+	}
+}
+
+BES_DEFINE_TEST(usable_size_is_at_least_requested_size)
+{
+	void *x = bes_malloc(17);
+	const bes_bool result = bes_malloc_usable_size(x) >= 17;
+	bes_free(x);
+	return result;
+}
+
+BES_DEFINE_TEST(usable_size_of_null_is_zero)
+{
+	return bes_malloc_usable_size(0) == 0;
+}
+
+BES_DEFINE_TEST(malloc_aligned_is_aligned)
+{
+	bes_bool result = BES_TRUE;
+	for (bes_size alignment = 1; alignment <= 4096; alignment *= 2)
+	{
+		void *x = bes_malloc_aligned(100, alignment);
+		result = result && x && (bes_uintptr)x % alignment == 0;
+		bes_free(x);
+	}
+	return result;
+}
+
+BES_DEFINE_TEST(malloc_aligned_with_non_power_of_two_fails)
+{
+	return bes_malloc_aligned(100, 48) == 0;
+}
+
+BES_DEFINE_TEST(realloc_of_aligned_keeps_alignment_and_contents)
+{
+	char *x = bes_malloc_aligned(2, BES_CACHE_LINE_SIZE);
+	x[0] = 'h';
+	x[1] = 'i';
+	x = bes_realloc(x, 4096);
+	const bes_bool result = x
+		&& (bes_uintptr)x % BES_CACHE_LINE_SIZE == 0
+		&& x[0] == 'h'
+		&& x[1] == 'i';
+	bes_free(x);
+	return result;
+}
+
+BES_DEFINE_TEST(realloc_aligned_changes_alignment)
+{
+	void *x = bes_malloc(100);
+	x = bes_realloc_aligned(x, 200, 4096);
+	const bes_bool result = x && (bes_uintptr)x % 4096 == 0;
+	bes_free(x);
+	return result;
+}
+
+BES_DEFINE_TEST(sized_free_is_given_allocation_size)
+{
+	counting_allocator counting;
+	counting_init(&counting, 0);
+	counting.allocator.deallocate_sized = &counting_deallocate_sized;
+	bes_allocator_set(&counting.allocator);
+	bes_free(bes_malloc(100));
+	bes_allocator_set(counting.backing);
+	return counting.deallocations == 1 && counting.deallocated_size == counting.allocated_size;
+}
+
+BES_DEFINE_TEST(free_then_malloc_of_same_size_is_served_from_cache)
+{
+	counting_allocator counting;
+	counting_init(&counting, BES_ALLOCATOR_CACHE);
+	bes_allocator_set(&counting.allocator);
+	void *x = bes_malloc(100);
+	bes_free(x);
+	void *y = bes_malloc(100);
+	bes_free(y);
+	const bes_bool result = x == y && counting.allocations == 1 && counting.deallocations == 0;
+	bes_allocator_set(counting.backing);
+	return result && counting.deallocations == 1;
+}
+
+BES_DEFINE_TEST(free_reaches_owning_allocator)
+{
+	counting_allocator counting;
+	counting_init(&counting, 0);
+	bes_allocator_set(&counting.allocator);
+	void *x = bes_malloc(100);
+	bes_allocator_set(counting.backing);
+	bes_free(x);
+	return counting.allocations == 1 && counting.deallocations == 1;
+}
+
+static void *cache_on_thread(void *allocator)
+{
+	bes_allocator_set(allocator);
+	bes_free(bes_malloc(100));
+	return 0;
+}
+
+BES_DEFINE_TEST(thread_exit_flushes_cache)
+{
+	counting_allocator counting;
+	counting_init(&counting, BES_ALLOCATOR_CACHE);
+	pthread_t thread;
+	if (pthread_create(&thread, 0, &cache_on_thread, &counting.allocator) != 0)
+	{
+		return BES_FALSE;
+	}
+	pthread_join(thread, 0);
+	return counting.allocations == 1 && counting.deallocations == 1;
+}
+
+static void *free_on_thread(void *ptr)
+{
+	bes_free(ptr);
+	bes_allocator_flush();
+	return 0;
+}
+
+BES_DEFINE_TEST(free_on_other_thread_reaches_owning_allocator)
+{
+	counting_allocator counting;
+	counting_init(&counting, BES_ALLOCATOR_CACHE);
+	bes_allocator_set(&counting.allocator);
+	void *x = bes_malloc(100);
+	bes_allocator_set(counting.backing);
+	pthread_t thread;
+	if (pthread_create(&thread, 0, &free_on_thread, x) != 0)
+	{
+		bes_free(x);
+		return BES_FALSE;
+	}
+	pthread_join(thread, 0);
+	return counting.deallocations == 1;
+}
+
+static void *headerless_last;
+
+static void *headerless_allocate(bes_allocator *allocator, bes_size size)
+{
+	(void)allocator;
+	return headerless_last = malloc(size);
+}
+
+static void *headerless_reallocate(bes_allocator *allocator, void *data, bes_size size)
+{
+	(void)allocator;
+	return headerless_last = realloc(data, size);
+}
+
+static void headerless_deallocate(bes_allocator *allocator, void *data)
+{
+	(void)allocator;
+	free(data);
+}
+
+static bes_size headerless_usable_size(bes_allocator *allocator, const void *data)
+{
+	(void)allocator;
+	return malloc_usable_size((void *)data);
+}
+
+static void *headerless_allocate_aligned(bes_allocator *allocator, bes_size size, bes_size alignment)
+{
+	(void)allocator;
+	return headerless_last = aligned_alloc(alignment, (size + alignment - 1) & -alignment);
+}
+
+static bes_allocator headerless =
+{
+	&headerless_allocate,
+	&headerless_reallocate,
+	&headerless_deallocate,
+	0,
+	0,
+	0,
+	BES_ALIGNMENT,
+	&headerless_usable_size,
+	&headerless_allocate_aligned,
+	0,
+	0,
+	0,
+	0,
+	0
+};
+
+BES_DEFINE_TEST(headerless_malloc_returns_allocator_memory)
+{
+	bes_allocator *const previous = bes_allocator_get();
+	bes_allocator_set(&headerless);
+	void *x = bes_malloc(100);
+	const bes_bool result = x && x == headerless_last && bes_malloc_usable_size(x) >= 100;
+	bes_free(x);
+	bes_allocator_set(previous);
+	return result;
+}
+
+static bes_size headerless_sized;
+
+static void headerless_deallocate_sized(bes_allocator *allocator, void *data, bes_size size)
+{
+	(void)allocator;
+	headerless_sized = size;
+	free(data);
+}
+
+BES_DEFINE_TEST(headerless_free_sized_passes_size)
+{
+	bes_allocator *const previous = bes_allocator_get();
+	headerless.deallocate_sized = &headerless_deallocate_sized;
+	bes_allocator_set(&headerless);
+	headerless_sized = 0;
+	bes_free_sized(bes_malloc(100), 100);
+	const bes_bool result = headerless_sized == 100;
+	bes_allocator_set(previous);
+	headerless.deallocate_sized = 0;
+	return result;
+}
+
+BES_DEFINE_TEST(headerless_realloc_preserves_contents)
+{
+	bes_allocator *const previous = bes_allocator_get();
+	bes_allocator_set(&headerless);
+	char *x = bes_malloc(2);
+	x[0] = 'h';
+	x[1] = 'i';
+	x = bes_realloc(x, 4096);
+	const bes_bool result = x && x[0] == 'h' && x[1] == 'i';
+	bes_free(x);
+	bes_allocator_set(previous);
+	return result;
+}
+
+BES_DEFINE_TEST(headerless_malloc_aligned_beyond_guarantee_is_aligned)
+{
+	bes_allocator *const previous = bes_allocator_get();
+	bes_allocator_set(&headerless);
+	char *x = bes_malloc_aligned(100, 4096);
+	bes_bool result = x && (bes_uintptr)x % 4096 == 0;
+	if (x)
+	{
+		x[0] = '!';
+	}
+	x = bes_realloc_aligned(x, 8192, 4096);
+	result = result && x && (bes_uintptr)x % 4096 == 0 && x[0] == '!';
+	bes_free(x);
+	bes_allocator_set(previous);
+	return result;
+}
+
+BES_DEFINE_TEST(arena_allocations_are_aligned)
+{
+	bes_arena arena;
+	bes_arena_init(&arena, 0, 0);
+	void *x = bes_arena_allocate(&arena, 1);
+	void *y = bes_arena_allocate(&arena, 3);
+	const bes_bool result = x && y && x != y
+		&& (bes_uintptr)x % BES_ALIGNMENT == 0
+		&& (bes_uintptr)y % BES_ALIGNMENT == 0;
+	bes_arena_release(&arena);
+	return result;
+}
+
+BES_DEFINE_TEST(arena_oversized_allocation_succeeds)
+{
+	bes_arena arena;
+	bes_arena_init(&arena, 0, 64);
+	bes_byte *x = bes_arena_allocate(&arena, 1024);
+	const bes_bool result = x != 0;
+	if (x)
+	{
+		bes_memset(x, 0xAA, 1024);
+	}
+	bes_arena_release(&arena);
+	return result;
+}
+
+BES_DEFINE_TEST(arena_rejects_sizes_that_wrap)
+{
+	bes_arena arena;
+	bes_arena_init(&arena, 0, 64);
+	bes_bool result = bes_arena_allocate(&arena, (bes_size)-40) == 0;
+	result = result && bes_arena_allocate(&arena, 16) != 0;
+	result = result && bes_arena_allocate(&arena, (bes_size)-1 - 7) == 0;
+	bes_arena_release(&arena);
+	return result;
+}
+
+BES_DEFINE_TEST(arena_zero_size_allocations_are_distinct)
+{
+	bes_arena arena;
+	bes_arena_init(&arena, 0, 0);
+	void *x = bes_arena_allocate(&arena, 0);
+	void *y = bes_arena_allocate(&arena, 0);
+	const bes_bool result = x && y && x != y;
+	bes_arena_release(&arena);
+	return result;
+}
+
+BES_DEFINE_TEST(arena_rewind_reuses_memory)
+{
+	bes_arena arena;
+	bes_arena_init(&arena, 0, 64);
+	bes_arena_allocate(&arena, 16);
+	const bes_arena_marker marker = bes_arena_mark(&arena);
+	void *x = bes_arena_allocate(&arena, 32);
+	bes_arena_allocate(&arena, 128); /* forces another chunk */
+	bes_arena_rewind(&arena, marker);
+	void *y = bes_arena_allocate(&arena, 32);
+	bes_arena_release(&arena);
+	return x == y;
+}
+
+BES_DEFINE_TEST(arena_reset_reuses_first_chunk)
+{
+	bes_arena arena;
+	bes_arena_init(&arena, 0, 64);
+	void *x = bes_arena_allocate(&arena, 16);
+	bes_arena_allocate(&arena, 256);
+	bes_arena_reset(&arena);
+	void *y = bes_arena_allocate(&arena, 16);
+	bes_arena_release(&arena);
+	return x == y;
+}
+
+BES_DEFINE_TEST(arena_allocator_reallocate_preserves_contents)
+{
+	bes_arena arena;
+	bes_arena_init(&arena, 0, 0);
+	bes_allocator *allocator = &arena.allocator;
+	char *x = allocator->allocate(allocator, 2);
+	x[0] = 'h';
+	x[1] = 'i';
+	allocator->allocate(allocator, 16); /* x is no longer most recent */
+	x = allocator->reallocate(allocator, x, 64);
+	const bes_bool result = x && x[0] == 'h' && x[1] == 'i';
+	bes_arena_release(&arena);
+	return result;
+}
+
+BES_DEFINE_TEST(arena_allocator_free_of_most_recent_reclaims)
+{
+	bes_arena arena;
+	bes_arena_init(&arena, 0, 0);
+	bes_allocator *allocator = &arena.allocator;
+	void *x = allocator->allocate(allocator, 32);
+	allocator->deallocate(allocator, x);
+	void *y = allocator->allocate(allocator, 32);
+	bes_arena_release(&arena);
+	return x == y;
+}
+
+BES_DEFINE_TEST(realloc_in_place_grows_most_recent_arena_allocation)
+{
+	bes_allocator *const previous = bes_allocator_get();
+	bes_arena arena;
+	bes_arena_init(&arena, previous, 0);
+	bes_allocator_set(&arena.allocator);
+	char *x = bes_malloc(32);
+	x[0] = '!';
+	const bes_bool grown = bes_realloc_in_place(x, 1024);
+	const bes_bool result = grown && bes_malloc_usable_size(x) >= 1024 && x[0] == '!';
+	bes_free(x);
+	bes_allocator_set(previous);
+	bes_arena_release(&arena);
+	return result;
+}
+
+BES_DEFINE_TEST(realloc_in_place_without_support_only_shrinks)
+{
+	bes_allocator *const previous = bes_allocator_get();
+	counting_allocator counting;
+	counting_init(&counting, 0);
+	bes_allocator_set(&counting.allocator);
+	void *x = bes_malloc(64);
+	const bes_bool result = !bes_realloc_in_place(x, 4096) && bes_realloc_in_place(x, 16);
+	bes_free(x);
+	bes_allocator_set(previous);
+	return result;
+}
+
+/* An allocator that alternates the misalignment of what it hands out by
+ * half the alignment, so reallocation moves blocks to a different offset. */
+static bes_size shifting_count;
+
+static void *shifting_allocate(bes_allocator *allocator, bes_size size)
+{
+	(void)allocator;
+	bes_size *raw = malloc(size + 3 * sizeof(bes_size) + BES_ALIGNMENT);
+	if (!raw)
+	{
+		return 0;
+	}
+	raw[0] = size;
+	bes_byte *data = (bes_byte *)raw + BES_ALIGNMENT + (shifting_count++ % 2) * (BES_ALIGNMENT / 2);
+	((bes_size **)data)[-1] = raw;
+	return data;
+}
+
+static void shifting_deallocate(bes_allocator *allocator, void *data)
+{
+	(void)allocator;
+	free(((bes_size **)data)[-1]);
+}
+
+static void *shifting_reallocate(bes_allocator *allocator, void *data, bes_size size)
+{
+	void *resize = shifting_allocate(allocator, size);
+	if (resize)
+	{
+		const bes_size preserve = ((bes_size **)data)[-1][0];
+		bes_memcpy(resize, data, size < preserve ? size : preserve);
+		shifting_deallocate(allocator, data);
+	}
+	return resize;
+}
+
+static bes_allocator shifting =
+{
+	&shifting_allocate,
+	&shifting_reallocate,
+	&shifting_deallocate,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0,
+	0
+};
+
+static bes_bool realloc_on_shifting(bes_size alignment)
+{
+	bes_allocator *const previous = bes_allocator_get();
+	bes_allocator_set(&shifting);
+	bes_byte *x = bes_malloc_aligned(100, alignment);
+	for (bes_size i = 0; i < 100; i++)
+	{
+		x[i] = (bes_byte)i;
+	}
+	bes_bool result = BES_TRUE;
+	for (bes_size size = 200; size <= 3200; size *= 2)
+	{
+		x = bes_realloc(x, size);
+		result = result && x && (bes_uintptr)x % alignment == 0;
+		for (bes_size i = 0; result && i < 100; i++)
+		{
+			result = x[i] == (bes_byte)i;
+		}
+	}
+	bes_free(x);
+	bes_allocator_set(previous);
+	return result;
+}
+
+BES_DEFINE_TEST(realloc_preserves_contents_when_block_offset_changes)
+{
+	return realloc_on_shifting(BES_ALIGNMENT);
+}
+
+BES_DEFINE_TEST(realloc_of_aligned_preserves_contents_when_block_offset_changes)
+{
+	return realloc_on_shifting(BES_CACHE_LINE_SIZE);
+}
+
+BES_DEFINE_TEST(stats_count_calls_and_live_bytes)
+{
+	bes_memory_snapshot before, during, after;
+	bes_memory_stats_enable(BES_TRUE);
+	bes_memory_stats(&before);
+	void *x = bes_malloc(100);
+	x = bes_realloc(x, 200);
+	bes_memory_stats(&during);
+	const bes_size usable = bes_malloc_usable_size(x);
+	bes_free(x);
+	bes_memory_stats(&after);
+	bes_memory_stats_enable(BES_FALSE);
+	return during.live - before.live == usable
+		&& during.mallocs - before.mallocs == 1
+		&& during.reallocs - before.reallocs == 1
+		&& during.histogram[6] - before.histogram[6] == 1
+		&& during.histogram[7] - before.histogram[7] == 1
+		&& after.frees - before.frees == 1
+		&& after.live == before.live;
+}
+
+BES_DEFINE_TEST(stats_peak_includes_freed_allocation)
+{
+	bes_memory_snapshot before, after;
+	bes_memory_stats_enable(BES_TRUE);
+	bes_memory_stats(&before);
+	bes_free(bes_malloc(1024 * 1024));
+	bes_memory_stats(&after);
+	bes_memory_stats_enable(BES_FALSE);
+	return after.peak >= before.live + 1024 * 1024 && after.live == before.live;
+}
+
+static void *malloc_on_thread(void *allocator)
+{
+	bes_allocator_set(allocator);
+	return bes_malloc(64);
+}
+
+BES_DEFINE_TEST(stats_include_other_threads)
+{
+	bes_memory_snapshot before, after;
+	bes_memory_stats_enable(BES_TRUE);
+	bes_memory_stats(&before);
+	pthread_t thread;
+	void *x = 0;
+	bes_bool result = pthread_create(&thread, 0, &malloc_on_thread, bes_allocator_get()) == 0
+		&& pthread_join(thread, &x) == 0;
+	bes_memory_stats(&after);
+	result = result && x
+		&& after.mallocs - before.mallocs == 1
+		&& after.live - before.live >= 64;
+	bes_free(x);
+	bes_memory_stats_enable(BES_FALSE);
+	return result;
+}
+
+static char profile_text[1024 * 1024];
+static bes_size profile_length;
+
+static bes_bool profile_write(bes_stream *stream, const void *data, bes_size size, bes_size *write_)
+{
+	(void)stream;
+	if (profile_length + size >= sizeof profile_text)
+	{
+		return BES_FALSE;
+	}
+	memcpy(profile_text + profile_length, data, size);
+	profile_length += size;
+	profile_text[profile_length] = '\0';
+	*write_ = size;
+	return BES_TRUE;
+}
+
+static bes_bool profile_dump(bes_memory_profile_format format)
+{
+	bes_stream stream = { 0, &profile_write, 0, 0, 0 };
+	profile_length = 0;
+	return bes_memory_profile_dump(&stream, format);
+}
+
+static bes_bool profile_contains(const char *line)
+{
+	return strstr(profile_text, line) != 0;
+}
+
+BES_DEFINE_TEST(profile_counts_tagged_allocations)
+{
+	static const char tag[] = "profile_counts_tagged_allocations";
+	bes_memory_profile_start(1);
+	void *x = bes_malloc_tagged(64, tag);
+	void *y = bes_malloc_tagged(64, tag);
+	void *z = bes_malloc_tagged(64, tag);
+	bes_memory_profile_stop();
+	bes_free(y);
+	const bes_bool result = profile_dump(BES_MEMORY_PROFILE_TEXT)
+		&& profile_contains("2 128 3 192 profile_counts_tagged_allocations\n");
+	bes_free(x);
+	bes_free(z);
+	return result;
+}
+
+BES_DEFINE_TEST(profile_is_not_sampled_while_stopped)
+{
+	static const char tag[] = "profile_is_not_sampled_while_stopped";
+	bes_free(bes_malloc_tagged(64, tag));
+	return profile_dump(BES_MEMORY_PROFILE_TEXT) && !profile_contains(tag);
+}
+
+BES_DEFINE_TEST(profile_realloc_of_sampled_allocation_preserves_contents)
+{
+	static const char tag[] = "profile_realloc_of_sampled_allocation";
+	bes_memory_profile_start(1);
+	char *x = bes_malloc_tagged(64, tag);
+	bes_memory_profile_stop();
+	x[0] = 'h';
+	x[1] = 'i';
+	x = bes_realloc(x, 4096);
+	const bes_bool result = x && x[0] == 'h' && x[1] == 'i'
+		&& profile_dump(BES_MEMORY_PROFILE_TEXT)
+		&& profile_contains("0 0 1 64 profile_realloc_of_sampled_allocation\n");
+	bes_free(x);
+	return result;
+}
+
+BES_DEFINE_TEST(profile_samples_in_proportion_to_bytes)
+{
+	static const char tag[] = "profile_samples_in_proportion_to_bytes";
+	static void *blocks[1024];
+	bes_memory_profile_start(4096);
+	for (bes_size i = 0; i < BES_ARRAY_SIZE(blocks); i++)
+	{
+		blocks[i] = bes_malloc_tagged(64, tag);
+	}
+	bes_memory_profile_stop();
+	for (bes_size i = 0; i < BES_ARRAY_SIZE(blocks); i++)
+	{
+		bes_free(blocks[i]);
+	}
+
+	/* The total count is the third column of the line of the tag. */
+	unsigned long total = 0;
+	const char *site = profile_dump(BES_MEMORY_PROFILE_TEXT) ? strstr(profile_text, tag) : 0;
+	if (site)
+	{
+		while (site > profile_text && site[-1] != '\n')
+		{
+			site--;
+		}
+		sscanf(site, "%*u %*u %lu", &total);
+	}
+
+	/* 64 KiB sampled every 4 KiB is 16 samples on average. */
+	return total >= 2 && total <= 64;
+}
+
+BES_DEFINE_TEST(profile_pprof_has_header_and_mappings)
+{
+	static const char tag[] = "profile_pprof_has_header_and_mappings";
+	bes_memory_profile_start(1);
+	void *x = bes_malloc_tagged(64, tag);
+	bes_memory_profile_stop();
+	bes_bool result = profile_dump(BES_MEMORY_PROFILE_PPROF)
+		&& strncmp(profile_text, "heap profile: ", 14) == 0
+		&& profile_contains("] @ heap_v2/1\n")
+		&& profile_contains("\nMAPPED_LIBRARIES:\n");
+#if defined(BES_PLATFORM_LINUX)
+	result = result && profile_contains("[stack]");
+#endif
+	bes_free(x);
+	return result;
+}
+
+BES_DEFINE_TEST(push_routes_allocations_until_pop)
+{
+	bes_arena arena;
+	bes_arena_init(&arena, bes_allocator_get(), 0);
+	bes_bool result = bes_allocator_push(&arena.allocator);
+	const bes_byte *cursor = arena.cursor;
+	void *x = bes_malloc(100);
+	result = result && bes_allocator_get() == &arena.allocator
+		&& (bes_byte *)x > cursor && (bes_byte *)x < arena.cursor;
+	bes_free(x);
+	bes_allocator_pop();
+	cursor = arena.cursor;
+	void *y = bes_malloc(100);
+	result = result && bes_allocator_get() != &arena.allocator && arena.cursor == cursor;
+	bes_free(y);
+	bes_arena_release(&arena);
+	return result;
+}
+
+BES_DEFINE_TEST(push_routes_allocations_made_inside_foundation)
+{
+	bes_arena arena;
+	bes_arena_init(&arena, bes_allocator_get(), 0);
+	bes_allocator_push(&arena.allocator);
+	const bes_arena_marker marker = bes_arena_mark(&arena);
+	bes_wchar *wide = 0;
+	const bes_bool result = bes_utf8_to_utf16("scratch", &wide)
+		&& (bes_byte *)wide > marker.cursor && (bes_byte *)wide < arena.cursor;
+	bes_allocator_pop();
+	bes_arena_rewind(&arena, marker);
+	bes_arena_release(&arena);
+	return result;
+}
+
+BES_DEFINE_TEST(push_frees_reach_owning_allocator)
+{
+	counting_allocator outer;
+	counting_allocator inner;
+	counting_init(&outer, BES_ALLOCATOR_CACHE);
+	counting_init(&inner, BES_ALLOCATOR_CACHE);
+	bes_allocator_set(&outer.allocator);
+	void *x = bes_malloc(100);
+	bes_allocator_push(&inner.allocator);
+	void *y = bes_malloc(100);
+	/* Neither block may be cached for the other allocator to hand out. */
+	bes_free(x);
+	x = bes_realloc(bes_malloc(100), 200);
+	bes_allocator_pop();
+	bes_free(y);
+	void *z = bes_malloc(100);
+	bes_allocator_push(&inner.allocator);
+	bes_free(x);
+	bes_free(z);
+	bes_allocator_pop();
+	bes_allocator_set(outer.backing);
+	return outer.allocations == 2 && outer.deallocations == 2
+		&& inner.allocations == 2 && inner.deallocations == 2;
+}
+
+BES_DEFINE_TEST(push_nests)
+{
+	bes_allocator *const bottom = bes_allocator_get();
+	counting_allocator counting[BES_ALLOCATOR_STACK_DEPTH + 1];
+	bes_bool result = BES_TRUE;
+	for (bes_size i = 0; i < BES_ALLOCATOR_STACK_DEPTH; i++)
+	{
+		counting_init(&counting[i], 0);
+		result = result && bes_allocator_push(&counting[i].allocator);
+	}
+	counting_init(&counting[BES_ALLOCATOR_STACK_DEPTH], 0);
+	result = result && !bes_allocator_push(&counting[BES_ALLOCATOR_STACK_DEPTH].allocator);
+	for (bes_size i = BES_ALLOCATOR_STACK_DEPTH; i-- > 0;)
+	{
+		result = result && bes_allocator_get() == &counting[i].allocator;
+		bes_allocator_pop();
+	}
+	return result && bes_allocator_get() == bottom;
+}
+
+BES_DEFINE_TEST(push_over_headerless_allocator_fails)
+{
+	bes_allocator *const previous = bes_allocator_get();
+	bes_allocator_set(&headerless);
+	const bes_bool result = !bes_allocator_push(previous) && bes_allocator_get() == &headerless;
+	bes_allocator_set(previous);
+	return result;
+}
+
+BES_DEFINE_TEST(push_of_headerless_allocator_keeps_headers)
+{
+	bes_allocator *const previous = bes_allocator_get();
+	bes_bool result = bes_allocator_push(&headerless);
+	void *x = bes_malloc(100);
+	result = result && x && x != headerless_last;
+	bes_allocator_pop();
+	/* The header leads the block back to the headerless allocator. */
+	bes_free(x);
+	return result && bes_allocator_get() == previous;
+}
+
+BES_DEFINE_TEST(malloc_batch_allocates_distinct_blocks)
+{
+	void *blocks[100];
+	bes_bool result = bes_malloc_batch(100, 24, blocks);
+	for (bes_size i = 0; result && i < 100; i++)
+	{
+		result = blocks[i] && (bes_uintptr)blocks[i] % BES_ALIGNMENT == 0
+			&& bes_malloc_usable_size(blocks[i]) >= 24
+			&& (i == 0 || blocks[i] != blocks[i - 1]);
+		bes_memset(blocks[i], 0xff, 24);
+	}
+	bes_free_batch(blocks, 100);
+	return result;
+}
+
+BES_DEFINE_TEST(malloc_batch_from_arena_is_contiguous)
+{
+	bes_arena arena;
+	bes_arena_init(&arena, bes_allocator_get(), 0);
+	bes_arena_allocate(&arena, 16);
+	bes_allocator_push(&arena.allocator);
+	bes_byte *const cursor = arena.cursor;
+	void *blocks[64];
+	bes_bool result = bes_malloc_batch(64, 32, blocks);
+	const bes_size stride = (bes_size)((bes_byte *)blocks[1] - (bes_byte *)blocks[0]);
+	for (bes_size i = 1; result && i < 64; i++)
+	{
+		result = (bes_byte *)blocks[i] - (bes_byte *)blocks[i - 1] == (bes_ptrdiff)stride;
+	}
+	/* Freed together, the whole batch is given back to the arena. */
+	bes_free_batch(blocks, 64);
+	result = result && arena.cursor == cursor;
+	bes_allocator_pop();
+	bes_arena_release(&arena);
+	return result;
+}
+
+BES_DEFINE_TEST(free_batch_reaches_each_owning_allocator)
+{
+	counting_allocator first;
+	counting_allocator second;
+	counting_init(&first, 0);
+	counting_init(&second, 0);
+	first.allocator.deallocate_batch = &counting_deallocate_batch;
+	bes_allocator_set(&first.allocator);
+	void *blocks[8];
+	bes_bool result = bes_malloc_batch(4, 100, blocks);
+	bes_allocator_set(&second.allocator);
+	result = result && bes_malloc_batch(3, 100, blocks + 4);
+	blocks[7] = 0;
+	bes_allocator_set(first.backing);
+	bes_free_batch(blocks, 8);
+	return result && first.deallocations == 4 && first.batches == 1
+		&& second.deallocations == 3 && second.batches == 0;
+}
+
+BES_DEFINE_TEST(malloc_batch_is_counted_by_stats)
+{
+	bes_memory_stats_enable(BES_TRUE);
+	bes_memory_snapshot before;
+	bes_memory_stats(&before);
+	void *blocks[10];
+	bes_bool result = bes_malloc_batch(10, 64, blocks);
+	bes_free_batch(blocks, 10);
+	bes_memory_snapshot after;
+	bes_memory_stats(&after);
+	bes_memory_stats_enable(BES_FALSE);
+	return result && after.mallocs - before.mallocs == 10 && after.frees - before.frees == 10;
+}
+
+BES_DEFINE_TEST(calloc_clears_reused_memory)
+{
+	bes_byte *x = bes_malloc(64);
+	memset(x, 0xff, 64);
+	bes_free(x);
+	x = bes_calloc(8, 8);
+	bes_bool result = x != 0;
+	for (bes_size i = 0; result && i < 64; i++)
+	{
+		result = x[i] == 0;
+	}
+	bes_free(x);
+	return result;
+}
+
+BES_DEFINE_TEST(calloc_overflow_fails)
+{
+	return !bes_calloc((bes_size)-1 / 2, 4) && !bes_calloc(4, (bes_size)-1 / 2);
+}
+
+static bes_bool zeroed_reported;
+
+static void *zeroed_allocate(bes_allocator *allocator, bes_size size, bes_bool *zeroed)
+{
+	void *data = counting_allocate(allocator, size);
+	if (data)
+	{
+		memset(data, 0xaa, size);
+	}
+	*zeroed = zeroed_reported;
+	return data;
+}
+
+BES_DEFINE_TEST(calloc_skips_clearing_memory_reported_zeroed)
+{
+	counting_allocator counting;
+	counting_init(&counting, 0);
+	counting.allocator.allocate_zeroed = &zeroed_allocate;
+	bes_allocator_set(&counting.allocator);
+	zeroed_reported = BES_TRUE;
+	bes_byte *x = bes_calloc(1, 4096);
+	bes_bool result = x && x[0] == 0xaa && x[4095] == 0xaa;
+	bes_free(x);
+	zeroed_reported = BES_FALSE;
+	x = bes_calloc(1, 4096);
+	for (bes_size i = 0; result && i < 4096; i++)
+	{
+		result = x[i] == 0;
+	}
+	bes_free(x);
+	bes_allocator_set(counting.backing);
+	return result && counting.allocations == 2;
+}
+
+BES_DEFINE_TEST(realloc_zeroed_clears_growth_only)
+{
+	bes_byte *x = bes_malloc(100);
+	memset(x, 0x11, bes_malloc_usable_size(x));
+	x = bes_realloc_zeroed(x, 100, 5000);
+	bes_bool result = x != 0;
+	for (bes_size i = 0; result && i < 100; i++)
+	{
+		result = x[i] == 0x11;
+	}
+	for (bes_size i = 100; result && i < 5000; i++)
+	{
+		result = x[i] == 0;
+	}
+	bes_free(x);
+	return result;
+}
+
+BES_DEFINE_TEST(realloc_zeroed_skips_clearing_memory_reported_zeroed)
+{
+	counting_allocator counting;
+	counting_init(&counting, 0);
+	counting.allocator.allocate_zeroed = &zeroed_allocate;
+	bes_allocator_set(&counting.allocator);
+	zeroed_reported = BES_TRUE;
+	bes_byte *x = bes_malloc(100);
+	memset(x, 0x11, 100);
+	x = bes_realloc_zeroed(x, 100, 4096);
+	const bes_bool result = x && x[0] == 0x11 && x[99] == 0x11
+		&& x[100] == 0xaa && x[4095] == 0xaa;
+	bes_free(x);
+	zeroed_reported = BES_FALSE;
+	bes_allocator_set(counting.backing);
+	return result;
+}
+
+BES_DEFINE_TEST(trim_reaches_current_and_pushed_allocators_once)
+{
+	counting_allocator a;
+	counting_allocator b;
+	counting_init(&a, 0);
+	counting_init(&b, 0);
+	a.allocator.trim = &counting_trim;
+	b.allocator.trim = &counting_trim;
+	bes_bool result = bes_allocator_push(&a.allocator);
+	result = result && bes_allocator_push(&b.allocator);
+	result = result && bes_allocator_push(&a.allocator);
+	const bes_size released = bes_allocator_trim();
+	bes_allocator_pop();
+	bes_allocator_pop();
+	bes_allocator_pop();
+	return result && released == 200 && a.trims == 1 && b.trims == 1;
+}
+
+BES_DEFINE_TEST(budget_counts_allocator_calls)
+{
+	void *data = bes_malloc(16);
+	BES_TEST_BUDGET_RESET();
+	void *x = bes_malloc(32);
+	data = bes_realloc(data, 4096);
+	const bes_bool result = data && x
+		&& g_bes_test_counter.allocations == 1
+		&& g_bes_test_counter.reallocations == 1;
+	bes_free(x);
+	bes_free(data);
+	return result;
+}
+
 BES_DEFINE_TEST_LIST(memory_tests)
 {
 	BES_ADD_TEST(malloc_returns_non_null),
 	BES_ADD_TEST(realloc_from_smaller_to_larger_makes_larger),
-	BES_ADD_TEST(realloc_from_larger_to_smaller_makes_smaller)
+	BES_ADD_TEST(realloc_from_larger_to_smaller_makes_smaller),
+	BES_ADD_TEST(usable_size_is_at_least_requested_size),
+	BES_ADD_TEST(usable_size_of_null_is_zero),
+	BES_ADD_TEST(malloc_aligned_is_aligned),
+	BES_ADD_TEST(malloc_aligned_with_non_power_of_two_fails),
+	BES_ADD_TEST(realloc_of_aligned_keeps_alignment_and_contents),
+	BES_ADD_TEST(realloc_aligned_changes_alignment),
+	BES_ADD_TEST(sized_free_is_given_allocation_size),
+	BES_ADD_TEST(free_then_malloc_of_same_size_is_served_from_cache),
+	BES_ADD_TEST(free_reaches_owning_allocator),
+	BES_ADD_TEST(free_on_other_thread_reaches_owning_allocator),
+	BES_ADD_TEST(thread_exit_flushes_cache),
+	BES_ADD_TEST(headerless_malloc_returns_allocator_memory),
+	BES_ADD_TEST(headerless_free_sized_passes_size),
+	BES_ADD_TEST(headerless_realloc_preserves_contents),
+	BES_ADD_TEST(headerless_malloc_aligned_beyond_guarantee_is_aligned),
+	BES_ADD_TEST(arena_allocations_are_aligned),
+	BES_ADD_TEST(arena_oversized_allocation_succeeds),
+	BES_ADD_TEST(arena_rejects_sizes_that_wrap),
+	BES_ADD_TEST(arena_zero_size_allocations_are_distinct),
+	BES_ADD_TEST(arena_rewind_reuses_memory),
+	BES_ADD_TEST(arena_reset_reuses_first_chunk),
+	BES_ADD_TEST(arena_allocator_reallocate_preserves_contents),
+	BES_ADD_TEST(arena_allocator_free_of_most_recent_reclaims),
+	BES_ADD_TEST(realloc_in_place_grows_most_recent_arena_allocation),
+	BES_ADD_TEST(realloc_in_place_without_support_only_shrinks),
+	BES_ADD_TEST(realloc_preserves_contents_when_block_offset_changes),
+	BES_ADD_TEST(realloc_of_aligned_preserves_contents_when_block_offset_changes),
+	BES_ADD_TEST(stats_count_calls_and_live_bytes),
+	BES_ADD_TEST(stats_peak_includes_freed_allocation),
+	BES_ADD_TEST(stats_include_other_threads),
+	BES_ADD_TEST(profile_counts_tagged_allocations),
+	BES_ADD_TEST(profile_is_not_sampled_while_stopped),
+	BES_ADD_TEST(profile_realloc_of_sampled_allocation_preserves_contents),
+	BES_ADD_TEST(profile_samples_in_proportion_to_bytes),
+	BES_ADD_TEST(profile_pprof_has_header_and_mappings),
+	BES_ADD_TEST(push_routes_allocations_until_pop),
+	BES_ADD_TEST(push_routes_allocations_made_inside_foundation),
+	BES_ADD_TEST(push_frees_reach_owning_allocator),
+	BES_ADD_TEST(push_nests),
+	BES_ADD_TEST(push_over_headerless_allocator_fails),
+	BES_ADD_TEST(push_of_headerless_allocator_keeps_headers),
+	BES_ADD_TEST(malloc_batch_allocates_distinct_blocks),
+	BES_ADD_TEST(malloc_batch_from_arena_is_contiguous),
+	BES_ADD_TEST(free_batch_reaches_each_owning_allocator),
+	BES_ADD_TEST(malloc_batch_is_counted_by_stats),
+	BES_ADD_TEST(calloc_clears_reused_memory),
+	BES_ADD_TEST(calloc_overflow_fails),
+	BES_ADD_TEST(calloc_skips_clearing_memory_reported_zeroed),
+	BES_ADD_TEST(realloc_zeroed_clears_growth_only),
+	BES_ADD_TEST(realloc_zeroed_skips_clearing_memory_reported_zeroed),
+	BES_ADD_TEST(trim_reaches_current_and_pushed_allocators_once),
+	BES_ADD_TEST_BUDGET(budget_counts_allocator_calls, 1, 1)
 };
 
 #include <stdio.h>
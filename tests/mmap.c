@@ -0,0 +1,145 @@
+#include <bes/foundation/test.h>
+#include <bes/foundation/mmap.h>
+#include <bes/foundation/string.h>
+
+#define LARGE (4 * BES_MMAP_THRESHOLD)
+
+BES_DEFINE_TEST(mmap_large_allocation_is_mapped_until_freed)
+{
+	bes_mmap_allocator mmap_allocator;
+	bes_mmap_allocator_init(&mmap_allocator, 0, 0, 0);
+	bes_allocator *allocator = &mmap_allocator.allocator;
+	void *x = allocator->allocate(allocator, LARGE);
+	bes_bool result = x && mmap_allocator.mapped >= LARGE;
+	allocator->deallocate(allocator, x);
+	return result && mmap_allocator.mapped == 0;
+}
+
+BES_DEFINE_TEST(mmap_small_allocation_is_passed_through)
+{
+	bes_mmap_allocator mmap_allocator;
+	bes_mmap_allocator_init(&mmap_allocator, 0, 0, 0);
+	bes_allocator *allocator = &mmap_allocator.allocator;
+	void *x = allocator->allocate(allocator, 100);
+	const bes_bool result = x && mmap_allocator.mapped == 0 && (bes_uintptr)x % BES_ALIGNMENT == 0;
+	allocator->deallocate(allocator, x);
+	return result;
+}
+
+BES_DEFINE_TEST(mmap_growth_preserves_contents)
+{
+	bes_mmap_allocator mmap_allocator;
+	bes_mmap_allocator_init(&mmap_allocator, 0, 0, 0);
+	bes_allocator *allocator = &mmap_allocator.allocator;
+	bes_byte *x = allocator->allocate(allocator, LARGE);
+	for (bes_size i = 0; i < LARGE; i += 4096)
+	{
+		x[i] = (bes_byte)(i / 4096);
+	}
+	x = allocator->reallocate(allocator, x, 4 * LARGE);
+	bes_bool result = x && mmap_allocator.mapped >= 4 * LARGE;
+	for (bes_size i = 0; result && i < LARGE; i += 4096)
+	{
+		result = x[i] == (bes_byte)(i / 4096);
+	}
+	allocator->deallocate(allocator, x);
+	return result;
+}
+
+BES_DEFINE_TEST(mmap_small_allocation_grown_large_is_mapped)
+{
+	bes_mmap_allocator mmap_allocator;
+	bes_mmap_allocator_init(&mmap_allocator, 0, 0, 0);
+	bes_allocator *allocator = &mmap_allocator.allocator;
+	char *x = allocator->allocate(allocator, 2);
+	x[0] = 'h';
+	x[1] = 'i';
+	x = allocator->reallocate(allocator, x, LARGE);
+	bes_bool result = x && mmap_allocator.mapped >= LARGE && x[0] == 'h' && x[1] == 'i';
+	x = allocator->reallocate(allocator, x, 2);
+	result = result && x && mmap_allocator.mapped == 0 && x[0] == 'h' && x[1] == 'i';
+	allocator->deallocate(allocator, x);
+	return result;
+}
+
+BES_DEFINE_TEST(mmap_shrink_in_place_returns_pages)
+{
+	bes_mmap_allocator mmap_allocator;
+	bes_mmap_allocator_init(&mmap_allocator, 0, 0, 0);
+	bes_allocator *allocator = &mmap_allocator.allocator;
+	void *x = allocator->allocate(allocator, 4 * LARGE);
+	const bes_u64 before = mmap_allocator.mapped;
+	const bes_bool result = allocator->reallocate_in_place(allocator, x, LARGE)
+		&& mmap_allocator.mapped < before;
+	allocator->deallocate(allocator, x);
+	return result && mmap_allocator.mapped == 0;
+}
+
+BES_DEFINE_TEST(mmap_huge_pages_fall_back_to_regular_pages)
+{
+	bes_mmap_allocator mmap_allocator;
+	bes_mmap_allocator_init(&mmap_allocator, 0, 0, BES_MMAP_HUGETLB | BES_MMAP_TRANSPARENT_HUGE_PAGES);
+	bes_allocator *allocator = &mmap_allocator.allocator;
+	bes_byte *x = allocator->allocate(allocator, 2 * BES_MMAP_HUGE_PAGE_SIZE);
+	bes_bool result = x && (bes_uintptr)x % BES_ALIGNMENT == 0;
+	if (x)
+	{
+		x[0] = 1;
+		x[2 * BES_MMAP_HUGE_PAGE_SIZE - 1] = 2;
+		x = allocator->reallocate(allocator, x, 4 * BES_MMAP_HUGE_PAGE_SIZE);
+		result = x && x[0] == 1 && x[2 * BES_MMAP_HUGE_PAGE_SIZE - 1] == 2;
+	}
+	allocator->deallocate(allocator, x);
+	return result && mmap_allocator.mapped == 0;
+}
+
+BES_DEFINE_TEST(mmap_allocator_behind_malloc_grows_buffers)
+{
+	bes_allocator *const previous = bes_allocator_get();
+	bes_mmap_allocator mmap_allocator;
+	bes_mmap_allocator_init(&mmap_allocator, previous, 0, 0);
+	bes_allocator_set(&mmap_allocator.allocator);
+	bes_byte *x = bes_malloc(512);
+	bes_bool result = x != 0;
+	for (bes_size size = 1024; result && size <= 16 * LARGE; size *= 2)
+	{
+		x[size / 2 - 1] = (bes_byte)(size >> 10);
+		x = bes_realloc(x, size);
+		result = x && x[size / 2 - 1] == (bes_byte)(size >> 10);
+	}
+	bes_free(x);
+	bes_allocator_set(previous);
+	return result && mmap_allocator.mapped == 0;
+}
+
+BES_DEFINE_TEST(mmap_calloc_of_large_allocation_is_mapped_and_zero)
+{
+	bes_allocator *const previous = bes_allocator_get();
+	bes_mmap_allocator mmap_allocator;
+	bes_mmap_allocator_init(&mmap_allocator, previous, 0, 0);
+	bes_allocator_set(&mmap_allocator.allocator);
+	bes_byte *x = bes_calloc(LARGE / 8, 8);
+	bes_bool result = x && mmap_allocator.mapped >= LARGE;
+	for (bes_size i = 0; result && i < LARGE; i += 512)
+	{
+		result = x[i] == 0;
+	}
+	bes_free(x);
+	bes_allocator_set(previous);
+	return result && mmap_allocator.mapped == 0;
+}
+
+BES_DEFINE_TEST_LIST(mmap_tests)
+{
+	BES_ADD_TEST(mmap_large_allocation_is_mapped_until_freed),
+	BES_ADD_TEST(mmap_small_allocation_is_passed_through),
+	BES_ADD_TEST(mmap_growth_preserves_contents),
+	BES_ADD_TEST(mmap_small_allocation_grown_large_is_mapped),
+	BES_ADD_TEST(mmap_shrink_in_place_returns_pages),
+	BES_ADD_TEST(mmap_huge_pages_fall_back_to_regular_pages),
+	BES_ADD_TEST(mmap_allocator_behind_malloc_grows_buffers),
+	BES_ADD_TEST(mmap_calloc_of_large_allocation_is_mapped_and_zero)
+};
+
+#include <stdio.h>
+BES_DEFINE_TEST_COMMAND(test_mmap_command, "mmap", mmap_tests, printf)
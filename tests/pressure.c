@@ -0,0 +1,94 @@
+#include <bes/foundation/test.h>
+#include <bes/foundation/pressure.h>
+
+typedef struct pressure_record pressure_record;
+
+struct pressure_record
+{
+	bes_size calls;
+	bes_memory_pressure level;
+};
+
+static void pressure_record_callback(bes_memory_pressure level, void *user)
+{
+	pressure_record *record = user;
+	record->calls++;
+	record->level = level;
+}
+
+static void pressure_unsubscribe_callback(bes_memory_pressure level, void *user)
+{
+	pressure_record_callback(level, user);
+	bes_memory_pressure_unsubscribe(&pressure_unsubscribe_callback, user);
+}
+
+BES_DEFINE_TEST(pressure_notify_reaches_subscribers)
+{
+	pressure_record a = { 0, BES_MEMORY_PRESSURE_MODERATE };
+	pressure_record b = { 0, BES_MEMORY_PRESSURE_MODERATE };
+	bes_bool result = bes_memory_pressure_subscribe(&pressure_record_callback, &a);
+	result = result && bes_memory_pressure_subscribe(&pressure_record_callback, &b);
+	bes_memory_pressure_notify(BES_MEMORY_PRESSURE_CRITICAL);
+	bes_memory_pressure_unsubscribe(&pressure_record_callback, &a);
+	bes_memory_pressure_notify(BES_MEMORY_PRESSURE_MODERATE);
+	bes_memory_pressure_unsubscribe(&pressure_record_callback, &b);
+	bes_memory_pressure_notify(BES_MEMORY_PRESSURE_CRITICAL);
+	return result
+		&& a.calls == 1 && a.level == BES_MEMORY_PRESSURE_CRITICAL
+		&& b.calls == 2 && b.level == BES_MEMORY_PRESSURE_MODERATE;
+}
+
+BES_DEFINE_TEST(pressure_callback_may_unsubscribe_itself)
+{
+	pressure_record record = { 0, BES_MEMORY_PRESSURE_MODERATE };
+	const bes_bool result = bes_memory_pressure_subscribe(&pressure_unsubscribe_callback, &record);
+	bes_memory_pressure_notify(BES_MEMORY_PRESSURE_MODERATE);
+	bes_memory_pressure_notify(BES_MEMORY_PRESSURE_MODERATE);
+	return result && record.calls == 1;
+}
+
+BES_DEFINE_TEST(pressure_subscribe_fails_when_full)
+{
+	pressure_record records[BES_MEMORY_PRESSURE_CALLBACKS + 1];
+	bes_bool result = BES_TRUE;
+	for (bes_size i = 0; i < BES_MEMORY_PRESSURE_CALLBACKS; i++)
+	{
+		records[i].calls = 0;
+		result = result && bes_memory_pressure_subscribe(&pressure_record_callback, &records[i]);
+	}
+	result = result && !bes_memory_pressure_subscribe(&pressure_record_callback, &records[BES_MEMORY_PRESSURE_CALLBACKS]);
+	bes_memory_pressure_notify(BES_MEMORY_PRESSURE_MODERATE);
+	for (bes_size i = 0; i < BES_MEMORY_PRESSURE_CALLBACKS; i++)
+	{
+		result = result && records[i].calls == 1;
+		bes_memory_pressure_unsubscribe(&pressure_record_callback, &records[i]);
+	}
+	return result;
+}
+
+BES_DEFINE_TEST(pressure_watch_only_once)
+{
+	/* Pressure stall information may not be available, or writing triggers
+	 * may not be permitted, in which case watching fails cleanly. */
+	if (!bes_memory_pressure_watch(0, 150000, 1000000))
+	{
+		bes_memory_pressure_unwatch();
+		return !bes_memory_pressure_watch("/nonexistent/memory.pressure", 150000, 1000000);
+	}
+
+	const bes_bool result = !bes_memory_pressure_watch(0, 150000, 1000000);
+	bes_memory_pressure_unwatch();
+	bes_memory_pressure_unwatch();
+	return result;
+}
+
+BES_DEFINE_TEST_LIST(pressure_tests)
+{
+	BES_ADD_TEST(pressure_notify_reaches_subscribers),
+	BES_ADD_TEST(pressure_callback_may_unsubscribe_itself),
+	BES_ADD_TEST(pressure_subscribe_fails_when_full),
+	BES_ADD_TEST(pressure_watch_only_once)
+};
+
+#include <stdio.h>
+BES_DEFINE_TEST_COMMAND(test_pressure_command, "pressure", pressure_tests, printf)
@@ -0,0 +1,87 @@
+#include <bes/foundation/test.h>
+#include <bes/foundation/scratch.h>
+#include <bes/foundation/string.h>
+
+/* Joins two strings in the scope given, with a temporary of its own. */
+static char *scratch_join(const bes_scratch *out, const char *a, const char *b, bes_bool *distinct)
+{
+	const bes_scratch scratch = bes_scratch_begin(out);
+	*distinct = scratch.arena != out->arena;
+	const bes_size a_length = bes_strlen(a);
+	const bes_size b_length = bes_strlen(b);
+	char *temporary = bes_scratch_alloc(&scratch, a_length + b_length + 1);
+	bes_memcpy(temporary, a, a_length);
+	bes_memcpy(temporary + a_length, b, b_length + 1);
+	char *result = bes_scratch_alloc(out, a_length + b_length + 1);
+	bes_strcpy(result, temporary);
+	bes_memset(temporary, 0, a_length + b_length + 1);
+	bes_scratch_end(&scratch);
+	return result;
+}
+
+BES_DEFINE_TEST(scratch_end_frees_scope)
+{
+	bes_scratch scratch = bes_scratch_begin(0);
+	void *x = bes_scratch_alloc(&scratch, 100);
+	bes_scratch_end(&scratch);
+	scratch = bes_scratch_begin(0);
+	void *y = bes_scratch_alloc(&scratch, 100);
+	bes_scratch_end(&scratch);
+	bes_scratch_release();
+	return x && x == y && (bes_uintptr)x % BES_ALIGNMENT == 0;
+}
+
+BES_DEFINE_TEST(scratch_nested_scope_keeps_outer_memory)
+{
+	const bes_scratch outer = bes_scratch_begin(0);
+	char *x = bes_scratch_alloc(&outer, 16);
+	bes_strcpy(x, "outer");
+	const bes_scratch inner = bes_scratch_begin(0);
+	char *y = bes_scratch_alloc(&inner, 16);
+	bes_strcpy(y, "inner");
+	bes_scratch_end(&inner);
+	char *z = bes_scratch_alloc(&outer, 16);
+	const bes_bool result = x && y && x != y && z == y && bes_strcmp(x, "outer") == 0;
+	bes_scratch_end(&outer);
+	bes_scratch_release();
+	return result;
+}
+
+BES_DEFINE_TEST(scratch_conflict_keeps_result_alive)
+{
+	const bes_scratch scratch = bes_scratch_begin(0);
+	bes_bool distinct = BES_FALSE;
+	char *joined = scratch_join(&scratch, "hello ", "world", &distinct);
+	bes_bool nested_distinct = BES_FALSE;
+	char *again = scratch_join(&scratch, joined, "!", &nested_distinct);
+	const bes_bool result = distinct && nested_distinct
+		&& bes_strcmp(joined, "hello world") == 0
+		&& bes_strcmp(again, "hello world!") == 0;
+	bes_scratch_end(&scratch);
+	bes_scratch_release();
+	return result;
+}
+
+BES_DEFINE_TEST(scratch_reuses_memory_across_scopes)
+{
+	bes_bool result = BES_TRUE;
+	for (bes_size i = 0; i < 100; i++)
+	{
+		const bes_scratch scratch = bes_scratch_begin(0);
+		result = result && bes_scratch_alloc(&scratch, 1000);
+		bes_scratch_end(&scratch);
+	}
+	bes_scratch_release();
+	return result;
+}
+
+BES_DEFINE_TEST_LIST(scratch_tests)
+{
+	BES_ADD_TEST(scratch_end_frees_scope),
+	BES_ADD_TEST(scratch_nested_scope_keeps_outer_memory),
+	BES_ADD_TEST(scratch_conflict_keeps_result_alive),
+	BES_ADD_TEST_BUDGET(scratch_reuses_memory_across_scopes, 1, 0)
+};
+
+#include <stdio.h>
+BES_DEFINE_TEST_COMMAND(test_scratch_command, "scratch", scratch_tests, printf)
@@ -0,0 +1,219 @@
+#include <bes/foundation/test.h>
+#include <bes/foundation/slab.h>
+#include <bes/foundation/string.h>
+
+BES_DEFINE_TEST(slab_allocations_are_distinct)
+{
+	bes_slab_allocator slab;
+	bes_slab_allocator_init(&slab, 0);
+	bes_allocator *allocator = &slab.allocator;
+	void *x = allocator->allocate(allocator, 24);
+	void *y = allocator->allocate(allocator, 24);
+	const bes_bool result = x && y && x != y;
+	bes_slab_allocator_release(&slab);
+	return result;
+}
+
+BES_DEFINE_TEST(slab_allocations_are_aligned)
+{
+	bes_slab_allocator slab;
+	bes_slab_allocator_init(&slab, 0);
+	bes_allocator *allocator = &slab.allocator;
+	bes_bool result = BES_TRUE;
+	for (bes_size size = 1; size <= BES_SLAB_MAX_SIZE; size++)
+	{
+		void *x = allocator->allocate(allocator, size);
+		result = result && x && (bes_uintptr)x % BES_ALIGNMENT == 0;
+	}
+	bes_slab_allocator_release(&slab);
+	return result;
+}
+
+BES_DEFINE_TEST(slab_free_then_allocate_reuses_object)
+{
+	bes_slab_allocator slab;
+	bes_slab_allocator_init(&slab, 0);
+	bes_allocator *allocator = &slab.allocator;
+	allocator->allocate(allocator, 32);
+	void *x = allocator->allocate(allocator, 32);
+	allocator->deallocate(allocator, x);
+	void *y = allocator->allocate(allocator, 32);
+	bes_slab_allocator_release(&slab);
+	return x == y;
+}
+
+BES_DEFINE_TEST(slab_empty_slab_is_reused_by_other_class)
+{
+	bes_slab_allocator slab;
+	bes_slab_allocator_init(&slab, 0);
+	bes_allocator *allocator = &slab.allocator;
+	void *x = allocator->allocate(allocator, 16);
+	allocator->deallocate(allocator, x);
+	void *y = allocator->allocate(allocator, 128);
+	bes_slab_allocator_release(&slab);
+	return ((bes_uintptr)x & -(bes_uintptr)BES_SLAB_PAGE_SIZE) == ((bes_uintptr)y & -(bes_uintptr)BES_SLAB_PAGE_SIZE);
+}
+
+BES_DEFINE_TEST(slab_many_allocations_span_slabs)
+{
+	bes_slab_allocator slab;
+	bes_slab_allocator_init(&slab, 0);
+	bes_allocator *allocator = &slab.allocator;
+	bes_u32 *objects[1024];
+	bes_bool result = BES_TRUE;
+	for (bes_u32 i = 0; i < BES_ARRAY_SIZE(objects); i++)
+	{
+		objects[i] = allocator->allocate(allocator, sizeof(bes_u32) * 16);
+		result = result && objects[i];
+		if (objects[i])
+		{
+			bes_memset(objects[i], 0, sizeof(bes_u32) * 16);
+			*objects[i] = i;
+		}
+	}
+	for (bes_u32 i = 0; result && i < BES_ARRAY_SIZE(objects); i++)
+	{
+		result = *objects[i] == i;
+		allocator->deallocate(allocator, objects[i]);
+	}
+	bes_slab_allocator_release(&slab);
+	return result;
+}
+
+BES_DEFINE_TEST(slab_large_allocation_roundtrips)
+{
+	bes_slab_allocator slab;
+	bes_slab_allocator_init(&slab, 0);
+	bes_allocator *allocator = &slab.allocator;
+	bes_byte *x = allocator->allocate(allocator, 4096);
+	bes_memset(x, 0xAA, 4096);
+	x = allocator->reallocate(allocator, x, 8192);
+	const bes_bool result = x && x[0] == 0xAA && x[4095] == 0xAA;
+	allocator->deallocate(allocator, x);
+	bes_slab_allocator_release(&slab);
+	return result;
+}
+
+BES_DEFINE_TEST(slab_reallocate_from_small_to_large_preserves_contents)
+{
+	bes_slab_allocator slab;
+	bes_slab_allocator_init(&slab, 0);
+	bes_allocator *allocator = &slab.allocator;
+	char *x = allocator->allocate(allocator, 2);
+	x[0] = 'h';
+	x[1] = 'i';
+	x = allocator->reallocate(allocator, x, BES_SLAB_MAX_SIZE * 2);
+	bes_bool result = x && x[0] == 'h' && x[1] == 'i';
+	x = allocator->reallocate(allocator, x, 2);
+	result = result && x && x[0] == 'h' && x[1] == 'i';
+	allocator->deallocate(allocator, x);
+	bes_slab_allocator_release(&slab);
+	return result;
+}
+
+BES_DEFINE_TEST(slab_batch_from_fresh_slab_is_contiguous)
+{
+	bes_slab_allocator slab;
+	bes_slab_allocator_init(&slab, 0);
+	bes_allocator *allocator = &slab.allocator;
+	void *objects[32];
+	bes_bool result = allocator->allocate_batch(allocator, 48, 32, objects) == 32;
+	for (bes_size i = 1; result && i < 32; i++)
+	{
+		result = (bes_byte *)objects[i] == (bes_byte *)objects[i - 1] + 48;
+	}
+	/* Objects freed one at a time are handed out again in a batch. */
+	allocator->deallocate(allocator, objects[3]);
+	allocator->deallocate(allocator, objects[7]);
+	void *again[2];
+	result = result && allocator->allocate_batch(allocator, 48, 2, again) == 2
+		&& ((again[0] == objects[3] && again[1] == objects[7]) || (again[0] == objects[7] && again[1] == objects[3]));
+	bes_slab_allocator_release(&slab);
+	return result;
+}
+
+BES_DEFINE_TEST(slab_trim_releases_empty_spans)
+{
+	bes_slab_allocator slab;
+	bes_slab_allocator_init(&slab, 0);
+	bes_allocator *allocator = &slab.allocator;
+	static void *objects[4096];
+	bes_bool result = BES_TRUE;
+	for (bes_size i = 0; i < BES_ARRAY_SIZE(objects); i++)
+	{
+		objects[i] = allocator->allocate(allocator, 64);
+		result = result && objects[i];
+	}
+	result = result && allocator->trim(allocator) == 0;
+	for (bes_size i = 0; i < BES_ARRAY_SIZE(objects); i++)
+	{
+		allocator->deallocate(allocator, objects[i]);
+	}
+	result = result && allocator->trim(allocator) > 0 && !slab.spans;
+	void *x = allocator->allocate(allocator, 64);
+	result = result && x;
+	bes_slab_allocator_release(&slab);
+	return result;
+}
+
+BES_DEFINE_TEST(slab_trim_keeps_spans_in_use)
+{
+	bes_slab_allocator slab;
+	bes_slab_allocator_init(&slab, 0);
+	bes_allocator *allocator = &slab.allocator;
+	void *x = allocator->allocate(allocator, 16);
+	void *y = allocator->allocate(allocator, 256);
+	allocator->deallocate(allocator, y);
+	bes_bool result = allocator->trim(allocator) == 0 && slab.spans;
+	bes_memset(x, 0xAA, 16);
+	allocator->deallocate(allocator, x);
+	result = result && allocator->trim(allocator) > 0;
+	bes_slab_allocator_release(&slab);
+	return result;
+}
+
+BES_DEFINE_TEST(slab_malloc_takes_size_class_without_header)
+{
+	bes_allocator *const previous = bes_allocator_get();
+	bes_slab_allocator slab;
+	bes_slab_allocator_init(&slab, previous);
+	bes_bool result = bes_allocator_set(&slab.allocator);
+	void *x = bes_malloc(16);
+	bes_byte *y = bes_malloc(BES_SLAB_MAX_SIZE * 2);
+	result = result && x && y
+		&& (bes_slab_page *)((bes_uintptr)x & -(bes_uintptr)BES_SLAB_PAGE_SIZE) == slab.partial[0]
+		&& bes_malloc_usable_size(x) == 16
+		&& (bes_uintptr)y % BES_ALIGNMENT == 0
+		&& bes_malloc_usable_size(y) == BES_SLAB_MAX_SIZE * 2;
+	if (y)
+	{
+		bes_memset(y, 0xAA, BES_SLAB_MAX_SIZE * 2);
+	}
+	y = bes_realloc(y, BES_SLAB_PAGE_SIZE * 4);
+	result = result && y && (bes_uintptr)y % BES_ALIGNMENT == 0
+		&& y[0] == 0xAA && y[BES_SLAB_MAX_SIZE * 2 - 1] == 0xAA
+		&& bes_malloc_usable_size(y) == BES_SLAB_PAGE_SIZE * 4;
+	bes_free(x);
+	bes_free(y);
+	bes_allocator_set(previous);
+	bes_slab_allocator_release(&slab);
+	return result;
+}
+
+BES_DEFINE_TEST_LIST(slab_tests)
+{
+	BES_ADD_TEST(slab_allocations_are_distinct),
+	BES_ADD_TEST(slab_allocations_are_aligned),
+	BES_ADD_TEST(slab_free_then_allocate_reuses_object),
+	BES_ADD_TEST(slab_empty_slab_is_reused_by_other_class),
+	BES_ADD_TEST(slab_many_allocations_span_slabs),
+	BES_ADD_TEST(slab_large_allocation_roundtrips),
+	BES_ADD_TEST(slab_reallocate_from_small_to_large_preserves_contents),
+	BES_ADD_TEST(slab_batch_from_fresh_slab_is_contiguous),
+	BES_ADD_TEST(slab_trim_releases_empty_spans),
+	BES_ADD_TEST(slab_trim_keeps_spans_in_use),
+	BES_ADD_TEST(slab_malloc_takes_size_class_without_header)
+};
+
+#include <stdio.h>
+BES_DEFINE_TEST_COMMAND(test_slab_command, "slab", slab_tests, printf)
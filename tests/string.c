@@ -15,6 +15,51 @@ BES_DEFINE_TEST(bes_memcpy_copies_memory)
 	return a == b;
 }
 
+BES_DEFINE_TEST(bes_memcpy_copies_misaligned_memory)
+{
+	bes_byte source[128];
+	bes_byte destination[128];
+	for (bes_size i = 0; i < sizeof source; i++)
+	{
+		source[i] = (bes_byte)(i * 7 + 3);
+	}
+
+	for (bes_size s = 0; s < 4; s++)
+	{
+		for (bes_size d = 0; d < 4; d++)
+		{
+			for (bes_size n = 0; n < 100; n++)
+			{
+				bes_memset(destination, 0xaa, sizeof destination);
+				bes_memcpy(destination + d, source + s, n);
+				for (bes_size i = 0; i < sizeof destination; i++)
+				{
+					const bes_byte expected = i >= d && i < d + n ? source[s + i - d] : 0xaa;
+					if (destination[i] != expected)
+					{
+						return BES_FALSE;
+					}
+				}
+			}
+		}
+	}
+	return BES_TRUE;
+}
+
+BES_DEFINE_TEST(bes_memmove_copies_overlapping_forward)
+{
+	char a[] = "0123456789abcdef0123456789";
+	bes_memmove(a + 3, a, 20);
+	return bes_memcmp(a, "0120123456789abcdef0123789", sizeof a - 1) == 0;
+}
+
+BES_DEFINE_TEST(bes_memmove_copies_overlapping_backward)
+{
+	char a[] = "0123456789abcdef0123456789";
+	bes_memmove(a, a + 3, 20);
+	return bes_memcmp(a, "3456789abcdef0123456456789", sizeof a - 1) == 0;
+}
+
 BES_DEFINE_TEST(bes_memset_returns_destination)
 {
 	return bes_memset(0, 0, 0) == 0;
@@ -62,6 +107,38 @@ BES_DEFINE_TEST(utf16_to_utf8_back_to_utf16_is_same)
 	return result;
 }
 
+BES_DEFINE_TEST(utf8_to_utf16_outside_ascii_back_to_utf8_is_same)
+{
+	/* Two, three and four byte sequences, the last one a surrogate pair. */
+	const char *const text = "h\xc3\xa9llo \xe2\x82\xac \xf0\x9f\x98\x80";
+	bes_wchar *utf16_result = 0;
+	char *utf8_result = 0;
+	const bes_bool result =
+		bes_utf8_to_utf16(text, &utf16_result) &&
+		utf16_result[1] == 0x00e9 && utf16_result[6] == 0x20ac &&
+		utf16_result[8] == 0xd83d && utf16_result[9] == 0xde00 && utf16_result[10] == 0 &&
+		bes_utf16_to_utf8(utf16_result, &utf8_result) &&
+		bes_strcmp(utf8_result, text) == 0;
+	bes_free(utf16_result);
+	bes_free(utf8_result);
+	return result;
+}
+
+BES_DEFINE_TEST(utf8_to_utf16_scratch_back_to_utf8_is_same)
+{
+	const bes_scratch scratch = bes_scratch_begin(0);
+	bes_wchar *utf16_result = 0;
+	char *utf8_result = 0;
+	const bes_bool result =
+		bes_utf8_to_utf16_scratch(&scratch, "h\xc3\xa9llo \xf0\x9f\x98\x80", &utf16_result) &&
+		utf16_result[1] == 0x00e9 && utf16_result[6] == 0xd83d && utf16_result[7] == 0xde00 &&
+		bes_utf16_to_utf8_scratch(&scratch, utf16_result, &utf8_result) &&
+		bes_strcmp(utf8_result, "h\xc3\xa9llo \xf0\x9f\x98\x80") == 0;
+	bes_scratch_end(&scratch);
+	bes_scratch_release();
+	return result;
+}
+
 BES_DEFINE_TEST(bes_strlen_for_empty_string_is_zero)
 {
 	return bes_strlen("") == 0;
@@ -282,12 +359,17 @@ BES_DEFINE_TEST_LIST(string_tests)
 {
 	BES_ADD_TEST(bes_memcpy_returns_destination),
 	BES_ADD_TEST(bes_memcpy_copies_memory),
+	BES_ADD_TEST(bes_memcpy_copies_misaligned_memory),
+	BES_ADD_TEST(bes_memmove_copies_overlapping_forward),
+	BES_ADD_TEST(bes_memmove_copies_overlapping_backward),
 	BES_ADD_TEST(bes_memset_returns_destination),
 	BES_ADD_TEST(bes_memset_sets_memory),
 	BES_ADD_TEST(utf8_to_utf16_back_to_utf8_is_same),
 	BES_ADD_TEST(utf16_to_utf8_back_to_utf16_is_same),
-	BES_ADD_TEST(bes_strlen_for_empty_string_is_zero),
-	BES_ADD_TEST(bes_strlen_is_string_length),
+	BES_ADD_TEST(utf8_to_utf16_outside_ascii_back_to_utf8_is_same),
+	BES_ADD_TEST(utf8_to_utf16_scratch_back_to_utf8_is_same),
+	BES_ADD_TEST_BUDGET(bes_strlen_for_empty_string_is_zero, 0, 0),
+	BES_ADD_TEST_BUDGET(bes_strlen_is_string_length, 0, 0),
 	BES_ADD_TEST(bes_strcmp_0_for_empty_strings),
 	BES_ADD_TEST(bes_strcmp_0_for_same_strings),
 	BES_ADD_TEST(bes_strcmp_lt0_for_first_non_matching_lower_value_in_lhs),
@@ -300,9 +382,9 @@ BES_DEFINE_TEST_LIST(string_tests)
 	BES_ADD_TEST(bes_strcspn_with_match_is_span_before_match),
 	BES_ADD_TEST(bes_strspn_with_match_is_match_count),
 	BES_ADD_TEST(bes_strspn_without_match_is_zero),
-	BES_ADD_TEST(bes_strtok_returns_first_token_when_found),
-	BES_ADD_TEST(bes_strtok_returns_beginning_when_not_found_first_time),
-	BES_ADD_TEST(bes_strtok_returns_null_when_not_found_after_first_time),
+	BES_ADD_TEST_BUDGET(bes_strtok_returns_first_token_when_found, 0, 0),
+	BES_ADD_TEST_BUDGET(bes_strtok_returns_beginning_when_not_found_first_time, 0, 0),
+	BES_ADD_TEST_BUDGET(bes_strtok_returns_null_when_not_found_after_first_time, 0, 0),
 	BES_ADD_TEST(bes_atoi_zero_is_zero),
 	BES_ADD_TEST(bes_atoi_positive_zero_is_zero),
 	BES_ADD_TEST(bes_atoi_negative_zero_is_zero),
@@ -0,0 +1,322 @@
+#include <bes/foundation/test.h>
+#include <bes/foundation/tlsf.h>
+#include <bes/foundation/string.h>
+
+#include <stdlib.h>
+
+#define POOL (256 * 1024)
+
+/* Requests are rounded up to the list they are served from, so most but
+ * not all of an empty pool can be allocated at once. */
+#define POOL_BLOCK (POOL - POOL / BES_TLSF_SL_COUNT)
+
+static bes_u32
+random_next(bes_u32 *const state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+BES_DEFINE_TEST(tlsf_allocations_are_aligned_and_distinct)
+{
+	bes_byte *pool = aligned_alloc(4096, POOL);
+	bes_tlsf_allocator tlsf;
+	bes_tlsf_allocator_init(&tlsf);
+	bes_bool result = bes_tlsf_allocator_add_pool(&tlsf, pool, POOL);
+	bes_allocator *allocator = &tlsf.allocator;
+	void *x = allocator->allocate(allocator, 1);
+	void *y = allocator->allocate(allocator, 100);
+	void *z = allocator->allocate(allocator, 10000);
+	result = result && x && y && z && x != y && y != z && x != z;
+	result = result && (bes_uintptr)x % BES_ALIGNMENT == 0
+		&& (bes_uintptr)y % BES_ALIGNMENT == 0
+		&& (bes_uintptr)z % BES_ALIGNMENT == 0;
+	result = result && allocator->usable_size(allocator, y) >= 100
+		&& allocator->usable_size(allocator, z) >= 10000;
+	allocator->deallocate(allocator, x);
+	allocator->deallocate(allocator, y);
+	allocator->deallocate(allocator, z);
+	free(pool);
+	return result && tlsf.used == 0;
+}
+
+BES_DEFINE_TEST(tlsf_free_coalesces_back_to_one_block)
+{
+	bes_byte *pool = aligned_alloc(4096, POOL);
+	bes_tlsf_allocator tlsf;
+	bes_tlsf_allocator_init(&tlsf);
+	bes_tlsf_allocator_add_pool(&tlsf, pool, POOL);
+	bes_allocator *allocator = &tlsf.allocator;
+	void *blocks[90];
+	for (bes_size i = 0; i < 90; i++)
+	{
+		blocks[i] = allocator->allocate(allocator, 16 + i * 37);
+	}
+	/* Free the middle of runs first so blocks coalesce on both sides. */
+	for (bes_size i = 1; i < 90; i += 3)
+	{
+		allocator->deallocate(allocator, blocks[i]);
+	}
+	for (bes_size i = 0; i < 90; i += 3)
+	{
+		allocator->deallocate(allocator, blocks[i]);
+	}
+	for (bes_size i = 2; i < 90; i += 3)
+	{
+		allocator->deallocate(allocator, blocks[i]);
+	}
+	void *x = allocator->allocate(allocator, POOL_BLOCK);
+	const bes_bool result = x == pool + BES_ALIGNMENT && tlsf.used >= POOL_BLOCK;
+	free(pool);
+	return result;
+}
+
+BES_DEFINE_TEST(tlsf_allocates_from_every_pool)
+{
+	bes_byte *a = aligned_alloc(4096, POOL);
+	bes_byte *b = aligned_alloc(4096, POOL);
+	bes_tlsf_allocator tlsf;
+	bes_tlsf_allocator_init(&tlsf);
+	bes_allocator *allocator = &tlsf.allocator;
+	bes_bool result = !allocator->allocate(allocator, 1);
+	result = result && bes_tlsf_allocator_add_pool(&tlsf, a, POOL)
+		&& bes_tlsf_allocator_add_pool(&tlsf, b, POOL);
+	void *x = allocator->allocate(allocator, POOL_BLOCK);
+	void *y = allocator->allocate(allocator, POOL_BLOCK);
+	result = result && x && y && x != y && !allocator->allocate(allocator, POOL / 2);
+	allocator->deallocate(allocator, x);
+	allocator->deallocate(allocator, y);
+	result = result && !allocator->allocate(allocator, POOL);
+	free(a);
+	free(b);
+	return result;
+}
+
+BES_DEFINE_TEST(tlsf_small_pool_is_rejected)
+{
+	bes_byte pool[BES_TLSF_POOL_OVERHEAD];
+	bes_tlsf_allocator tlsf;
+	bes_tlsf_allocator_init(&tlsf);
+	return !bes_tlsf_allocator_add_pool(&tlsf, pool, sizeof pool);
+}
+
+BES_DEFINE_TEST(tlsf_aligned_allocation_gives_back_both_ends)
+{
+	bes_byte *pool = aligned_alloc(4096, POOL);
+	bes_tlsf_allocator tlsf;
+	bes_tlsf_allocator_init(&tlsf);
+	bes_tlsf_allocator_add_pool(&tlsf, pool, POOL);
+	bes_allocator *allocator = &tlsf.allocator;
+	void *x = allocator->allocate(allocator, 100);
+	void *y = allocator->allocate_aligned(allocator, 100, 4096);
+	void *z = allocator->allocate(allocator, 100);
+	bes_bool result = y && (bes_uintptr)y % 4096 == 0 && tlsf.steps <= BES_TLSF_MAX_STEPS;
+	result = result && (bes_byte *)z < (bes_byte *)y && (bes_byte *)y - pool <= 8192;
+	allocator->deallocate(allocator, x);
+	allocator->deallocate(allocator, y);
+	allocator->deallocate(allocator, z);
+	result = result && allocator->allocate(allocator, POOL_BLOCK);
+	free(pool);
+	return result;
+}
+
+BES_DEFINE_TEST(tlsf_oversized_requests_fail)
+{
+	bes_byte *pool = aligned_alloc(4096, POOL);
+	bes_tlsf_allocator tlsf;
+	bes_tlsf_allocator_init(&tlsf);
+	bes_tlsf_allocator_add_pool(&tlsf, pool, POOL);
+	bes_allocator *allocator = &tlsf.allocator;
+	const bes_size half = (bes_size)1 << (sizeof(bes_size) * 8 - 1);
+	const bes_bool result = !allocator->allocate(allocator, (bes_size)-1)
+		&& !allocator->allocate(allocator, (bes_size)-1 - 4096)
+		&& !allocator->allocate_aligned(allocator, 100, half)
+		&& !allocator->allocate_aligned(allocator, (bes_size)-1 - 4096, 4096)
+		&& allocator->allocate(allocator, POOL_BLOCK);
+	free(pool);
+	return result;
+}
+
+BES_DEFINE_TEST(tlsf_reallocate_in_place_grows_and_shrinks)
+{
+	bes_byte *pool = aligned_alloc(4096, POOL);
+	bes_tlsf_allocator tlsf;
+	bes_tlsf_allocator_init(&tlsf);
+	bes_tlsf_allocator_add_pool(&tlsf, pool, POOL);
+	bes_allocator *allocator = &tlsf.allocator;
+	void *x = allocator->allocate(allocator, 64);
+	bes_bool result = allocator->reallocate_in_place(allocator, x, 4096)
+		&& allocator->usable_size(allocator, x) == 4096 && tlsf.used == 4096;
+	void *y = allocator->allocate(allocator, 64);
+	result = result && !allocator->reallocate_in_place(allocator, x, 8192);
+	result = result && allocator->reallocate_in_place(allocator, x, 100)
+		&& allocator->usable_size(allocator, x) == 112;
+	/* The memory given back is reused before the rest of the pool. */
+	void *z = allocator->allocate(allocator, 1000);
+	result = result && (bes_byte *)z < (bes_byte *)y;
+	allocator->deallocate(allocator, x);
+	allocator->deallocate(allocator, y);
+	allocator->deallocate(allocator, z);
+	result = result && tlsf.used == 0;
+	free(pool);
+	return result;
+}
+
+BES_DEFINE_TEST(tlsf_reallocate_moves_and_preserves_contents)
+{
+	bes_byte *pool = aligned_alloc(4096, POOL);
+	bes_tlsf_allocator tlsf;
+	bes_tlsf_allocator_init(&tlsf);
+	bes_tlsf_allocator_add_pool(&tlsf, pool, POOL);
+	bes_allocator *allocator = &tlsf.allocator;
+	bes_byte *x = allocator->allocate(allocator, 64);
+	void *y = allocator->allocate(allocator, 64);
+	for (bes_size i = 0; i < 64; i++)
+	{
+		x[i] = (bes_byte)i;
+	}
+	bes_byte *z = allocator->reallocate(allocator, x, 1024);
+	bes_bool result = z && z != x && tlsf.steps <= 2 * BES_TLSF_MAX_STEPS;
+	for (bes_size i = 0; result && i < 64; i++)
+	{
+		result = z[i] == (bes_byte)i;
+	}
+	allocator->deallocate(allocator, z);
+	allocator->deallocate(allocator, y);
+	free(pool);
+	return result && tlsf.used == 0;
+}
+
+BES_DEFINE_TEST(tlsf_steps_are_bounded_under_churn)
+{
+	bes_byte *pool = aligned_alloc(4096, 16 * POOL);
+	bes_tlsf_allocator tlsf;
+	bes_tlsf_allocator_init(&tlsf);
+	bes_tlsf_allocator_add_pool(&tlsf, pool, 16 * POOL);
+	bes_allocator *allocator = &tlsf.allocator;
+	void *blocks[512] = { 0 };
+	bes_size most = 0;
+	bes_size most_moving = 0;
+	bes_u32 state = 1;
+	for (bes_size i = 0; i < 100000; i++)
+	{
+		const bes_u32 r = random_next(&state);
+		void **const block = &blocks[r % 512];
+		const bes_size size = (r >> 9) % 8 ? (r >> 12) % 512 : (r >> 12) % 65536;
+		bes_size limit = BES_TLSF_MAX_STEPS;
+		if (!*block)
+		{
+			*block = (r >> 9) % 16 == 0
+				? allocator->allocate_aligned(allocator, size, (bes_size)64 << (r % 6))
+				: allocator->allocate(allocator, size);
+		}
+		else if ((r >> 9) % 4 == 0)
+		{
+			void *const resize = allocator->reallocate(allocator, *block, size);
+			if (resize)
+			{
+				*block = resize;
+			}
+			limit = 2 * BES_TLSF_MAX_STEPS;
+			if (tlsf.steps > most_moving)
+			{
+				most_moving = tlsf.steps;
+			}
+		}
+		else
+		{
+			allocator->deallocate(allocator, *block);
+			*block = 0;
+		}
+		if (tlsf.steps > limit)
+		{
+			most = tlsf.steps;
+			break;
+		}
+		if (limit == BES_TLSF_MAX_STEPS && tlsf.steps > most)
+		{
+			most = tlsf.steps;
+		}
+	}
+	for (bes_size i = 0; i < 512; i++)
+	{
+		allocator->deallocate(allocator, blocks[i]);
+		most = tlsf.steps > most ? tlsf.steps : most;
+	}
+	/* Churn must not leave fragments behind once everything is freed. */
+	const bes_bool result = most <= BES_TLSF_MAX_STEPS
+		&& most_moving <= 2 * BES_TLSF_MAX_STEPS
+		&& tlsf.used == 0
+		&& allocator->allocate(allocator, 16 * (POOL - POOL / BES_TLSF_SL_COUNT));
+	free(pool);
+	return result;
+}
+
+BES_DEFINE_TEST(tlsf_steps_do_not_grow_with_free_blocks)
+{
+	/* Thousands of free blocks of one size, none large enough, still take
+	 * a single search to pass over. */
+	bes_byte *pool = aligned_alloc(4096, 16 * POOL);
+	bes_tlsf_allocator tlsf;
+	bes_tlsf_allocator_init(&tlsf);
+	bes_tlsf_allocator_add_pool(&tlsf, pool, 16 * POOL);
+	bes_allocator *allocator = &tlsf.allocator;
+	bes_size count = 0;
+	void *x;
+	void **blocks = malloc(sizeof *blocks * 16 * POOL / 64);
+	while ((x = allocator->allocate(allocator, 48)))
+	{
+		blocks[count++] = x;
+	}
+	bes_bool result = tlsf.steps == 1;
+	for (bes_size i = 0; i < count; i += 2)
+	{
+		allocator->deallocate(allocator, blocks[i]);
+		result = result && tlsf.steps <= BES_TLSF_MAX_STEPS;
+	}
+	result = result && !allocator->allocate(allocator, 256) && tlsf.steps == 1;
+	x = allocator->allocate(allocator, 48);
+	result = result && x && tlsf.steps <= BES_TLSF_MAX_STEPS;
+	free(blocks);
+	free(pool);
+	return result;
+}
+
+BES_DEFINE_TEST(tlsf_allocator_behind_malloc)
+{
+	bes_byte *pool = aligned_alloc(4096, POOL);
+	bes_tlsf_allocator tlsf;
+	bes_tlsf_allocator_init(&tlsf);
+	bes_tlsf_allocator_add_pool(&tlsf, pool, POOL);
+	bes_allocator *previous = bes_allocator_get();
+	bes_allocator_set(&tlsf.allocator);
+	char *x = bes_malloc(100);
+	void *y = bes_malloc_aligned(100, 4096);
+	bes_memcpy(x, "hello", 6);
+	x = bes_realloc(x, 3000);
+	bes_bool result = x && y && (bes_uintptr)y % 4096 == 0 && bes_strcmp(x, "hello") == 0;
+	bes_free(x);
+	bes_free(y);
+	bes_allocator_set(previous);
+	result = result && tlsf.used == 0;
+	free(pool);
+	return result;
+}
+
+BES_DEFINE_TEST_LIST(tlsf_tests)
+{
+	BES_ADD_TEST(tlsf_allocations_are_aligned_and_distinct),
+	BES_ADD_TEST(tlsf_free_coalesces_back_to_one_block),
+	BES_ADD_TEST(tlsf_allocates_from_every_pool),
+	BES_ADD_TEST(tlsf_small_pool_is_rejected),
+	BES_ADD_TEST(tlsf_aligned_allocation_gives_back_both_ends),
+	BES_ADD_TEST(tlsf_oversized_requests_fail),
+	BES_ADD_TEST(tlsf_reallocate_in_place_grows_and_shrinks),
+	BES_ADD_TEST(tlsf_reallocate_moves_and_preserves_contents),
+	BES_ADD_TEST(tlsf_steps_are_bounded_under_churn),
+	BES_ADD_TEST(tlsf_steps_do_not_grow_with_free_blocks),
+	BES_ADD_TEST(tlsf_allocator_behind_malloc)
+};
+
+#include <stdio.h>
+BES_DEFINE_TEST_COMMAND(test_tlsf_command, "tlsf", tlsf_tests, printf)
@@ -0,0 +1,58 @@
+#include <bes/foundation/test.h>
+#include <bes/foundation/vm.h>
+#include <bes/foundation/string.h>
+
+#define RESERVE (64 * 1024 * 1024)
+
+BES_DEFINE_TEST(vm_committed_pages_are_zero)
+{
+	bes_byte *x = bes_vm_reserve(RESERVE);
+	const bes_size page_size = bes_vm_page_size();
+	bes_bool result = x && bes_vm_commit(x, 4 * page_size);
+	for (bes_size i = 0; result && i < 4 * page_size; i++)
+	{
+		result = x[i] == 0;
+	}
+	bes_vm_release(x, RESERVE);
+	return result;
+}
+
+BES_DEFINE_TEST(vm_commit_keeps_committed_contents)
+{
+	bes_byte *x = bes_vm_reserve(RESERVE);
+	const bes_size page_size = bes_vm_page_size();
+	bes_bool result = x && bes_vm_commit(x, page_size);
+	if (result)
+	{
+		x[0] = 1;
+		x[page_size - 1] = 2;
+		result = bes_vm_commit(x, 2 * page_size) && x[0] == 1 && x[page_size - 1] == 2;
+	}
+	bes_vm_release(x, RESERVE);
+	return result;
+}
+
+BES_DEFINE_TEST(vm_decommitted_pages_are_zero_once_recommitted)
+{
+	bes_byte *x = bes_vm_reserve(RESERVE);
+	const bes_size page_size = bes_vm_page_size();
+	bes_bool result = x && bes_vm_commit(x + page_size, page_size);
+	if (result)
+	{
+		bes_memset(x + page_size, 0xff, page_size);
+		bes_vm_decommit(x + page_size, page_size);
+		result = bes_vm_commit(x + page_size, page_size) && x[page_size] == 0 && x[2 * page_size - 1] == 0;
+	}
+	bes_vm_release(x, RESERVE);
+	return result;
+}
+
+BES_DEFINE_TEST_LIST(vm_tests)
+{
+	BES_ADD_TEST(vm_committed_pages_are_zero),
+	BES_ADD_TEST(vm_commit_keeps_committed_contents),
+	BES_ADD_TEST(vm_decommitted_pages_are_zero_once_recommitted)
+};
+
+#include <stdio.h>
+BES_DEFINE_TEST_COMMAND(test_vm_command, "vm", vm_tests, printf)